@@ -26,6 +26,7 @@
 #include <Windows.h>
 #else
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 
 namespace kaldi {
@@ -47,4 +48,19 @@ void Sleep(float seconds) {
 #endif
 }
 
+long PeakMemoryKb() {
+#if defined(_MSC_VER) || defined(MINGW)
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // in bytes on Darwin.
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
 }  // end namespace kaldi
@@ -82,6 +82,10 @@ inline int MachineIsLittleEndian() {
 // number of seconds.  On Windows it's only accurate to microseconds.
 void Sleep(float seconds);
 
+// Returns the peak resident memory of this process in kilobytes, or -1 if we
+// cannot work it out (e.g. on Windows).  For use in benchmarking programs.
+long PeakMemoryKb();
+
 }
 
 #define KALDI_SWAP8(a) { \
@@ -98,14 +98,15 @@ int main(int argc, char *argv[]) {
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
     int num_success = 0, num_fail = 0;
-    VectorFst<StdArc> *decode_fst = NULL; // only used if there is a single
+    fst::Fst<StdArc> *decode_fst = NULL; // only used if there is a single
                                           // decoding graph.
     
     TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
-      decode_fst = fst::ReadFstKaldi(fst_in_str);
+      // This may be a normal or a memory-mapped FST (see fstmakemapped).
+      decode_fst = fst::ReadMappedOrVectorFst(fst_in_str);
 
       {
         for (; !loglike_reader.Done(); loglike_reader.Next()) {
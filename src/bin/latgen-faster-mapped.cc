@@ -98,7 +98,8 @@ int main(int argc, char *argv[]) {
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
-      VectorFst<StdArc> *decode_fst = fst::ReadFstKaldi(fst_in_str);
+      // This may be a normal or a memory-mapped FST (see fstmakemapped).
+      fst::Fst<StdArc> *decode_fst = fst::ReadMappedOrVectorFst(fst_in_str);
 
       {
         LatticeFasterDecoder decoder(*decode_fst, config);
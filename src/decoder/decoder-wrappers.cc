@@ -26,8 +26,9 @@ namespace kaldi {
 
 
 
-DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
-    LatticeFasterDecoder *decoder,
+template<class Decoder>
+DecodeUtteranceLatticeFasterClassTpl<Decoder>::DecodeUtteranceLatticeFasterClassTpl(
+    Decoder *decoder,
     DecodableInterface *decodable,
     const TransitionModel &trans_model,
     const fst::SymbolTable *word_syms,
@@ -58,7 +59,8 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     clat_(NULL), lat_(NULL) { }
 
 
-void DecodeUtteranceLatticeFasterClass::operator () () {
+template<class Decoder>
+void DecodeUtteranceLatticeFasterClassTpl<Decoder>::operator () () {
   // Decoding and lattice determinization happens here.
   computed_ = true; // Just means this function was called-- a check on the
   // calling code.
@@ -110,7 +112,8 @@ void DecodeUtteranceLatticeFasterClass::operator () () {
   }
 }
 
-DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
+template<class Decoder>
+DecodeUtteranceLatticeFasterClassTpl<Decoder>::~DecodeUtteranceLatticeFasterClassTpl() {
   if (!computed_)
     KALDI_ERR << "Destructor called without operator (), error in calling code.";
 
@@ -192,6 +195,10 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
   delete decodable_;
 }
 
+// Instantiate the template for the decoders that use it.
+template class DecodeUtteranceLatticeFasterClassTpl<LatticeFasterDecoder>;
+template class DecodeUtteranceLatticeFasterClassTpl<LatticeBiglmFasterDecoder>;
+
 
 // Takes care of output.  Returns true on success.
 bool DecodeUtteranceLatticeFaster(
@@ -23,6 +23,7 @@
 #include "itf/options-itf.h"
 #include "decoder/lattice-faster-decoder.h"
 #include "decoder/lattice-simple-decoder.h"
+#include "decoder/lattice-biglm-faster-decoder.h"
 
 // This header contains declarations from various convenience functions that are called
 // from binary-level programs such as gmm-decode-faster.cc, gmm-align-compiled.cc, and
@@ -114,14 +115,17 @@ bool DecodeUtteranceLatticeFaster(
 /// to build a multi-threaded command line program more easily,
 /// using code in ../thread/kaldi-task-sequence.h.  The main
 /// computation takes place in operator (), and the output happens
-/// in the destructor.
-class DecodeUtteranceLatticeFasterClass {
+/// in the destructor.  It is templated on the type of the decoder, which
+/// may be LatticeFasterDecoder or LatticeBiglmFasterDecoder (see the typedefs
+/// below).
+template<class Decoder>
+class DecodeUtteranceLatticeFasterClassTpl {
  public:
   // Initializer sets various variables.
   // NOTE: we "take ownership" of "decoder" and "decodable".  These
   // are deleted by the destructor.  On error, "num_err" is incremented.
-  DecodeUtteranceLatticeFasterClass(
-      LatticeFasterDecoder *decoder,
+  DecodeUtteranceLatticeFasterClassTpl(
+      Decoder *decoder,
       DecodableInterface *decodable,
       const TransitionModel &trans_model,
       const fst::SymbolTable *word_syms,
@@ -139,10 +143,10 @@ class DecodeUtteranceLatticeFasterClass {
       int32 *num_err,  // on failure, increments this.
       int32 *num_partial);  // If partial decode (final-state not reached), increments this.
   void operator () (); // The decoding happens here.
-  ~DecodeUtteranceLatticeFasterClass(); // Output happens here.
+  ~DecodeUtteranceLatticeFasterClassTpl(); // Output happens here.
  private:
   // The following variables correspond to inputs:
-  LatticeFasterDecoder *decoder_;
+  Decoder *decoder_;
   DecodableInterface *decodable_;
   const TransitionModel *trans_model_;
   const fst::SymbolTable *word_syms_;
@@ -168,6 +172,11 @@ class DecodeUtteranceLatticeFasterClass {
   Lattice *lat_; // Stored output, if determinize_ == false.
 };
 
+typedef DecodeUtteranceLatticeFasterClassTpl<LatticeFasterDecoder>
+    DecodeUtteranceLatticeFasterClass;
+typedef DecodeUtteranceLatticeFasterClassTpl<LatticeBiglmFasterDecoder>
+    DecodeUtteranceLatticeBiglmFasterClass;
+
 // This function DecodeUtteranceLatticeSimple is used in several decoders, and
 // we have moved it here.  Note: this is really "binary-level" code as it
 // involves table readers and writers; we've just put it here as there is no
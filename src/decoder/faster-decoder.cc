@@ -39,7 +39,8 @@ void FasterDecoder::InitDecoding() {
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   Arc dummy_arc(0, 0, Weight::One(), start_state);
-  toks_.Insert(start_state, new Token(dummy_arc, NULL));
+  toks_.Insert(start_state,
+               new (token_pool_.Allocate()) Token(dummy_arc, NULL));
   ProcessNonemitting(std::numeric_limits<float>::max());
   num_frames_decoded_ = 0;
 }
@@ -276,7 +277,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
           BaseFloat ac_cost =  - decodable->LogLikelihood(frame, arc.ilabel);
           double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
           if (new_weight < next_weight_cutoff) {  // not pruned..
-            Token *new_tok = new Token(arc, ac_cost, tok);
+            Token *new_tok = new (token_pool_.Allocate())
+                Token(arc, ac_cost, tok);
             Elem *e_found = toks_.Find(arc.nextstate);
             if (new_weight + adaptive_beam < next_weight_cutoff)
               next_weight_cutoff = new_weight + adaptive_beam;
@@ -284,10 +286,10 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
               toks_.Insert(arc.nextstate, new_tok);
             } else {
               if ( *(e_found->val) < *new_tok ) {
-                Token::TokenDelete(e_found->val);
+                TokenDelete(e_found->val);
                 e_found->val = new_tok;
               } else {
-                Token::TokenDelete(new_tok);
+                TokenDelete(new_tok);
               }
             }
           }
@@ -295,7 +297,7 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
       }
     }
     e_tail = e->tail;
-    Token::TokenDelete(e->val);
+    TokenDelete(e->val);
     toks_.Delete(e);
   }
   num_frames_decoded_++;
@@ -322,9 +324,9 @@ void FasterDecoder::ProcessNonemitting(double cutoff) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel == 0) {  // propagate nonemitting only...
-        Token *new_tok = new Token(arc, tok);
+        Token *new_tok = new (token_pool_.Allocate()) Token(arc, tok);
         if (new_tok->cost_ > cutoff) {  // prune
-          Token::TokenDelete(new_tok);
+          TokenDelete(new_tok);
         } else {
           Elem *e_found = toks_.Find(arc.nextstate);
           if (e_found == NULL) {
@@ -332,11 +334,11 @@ void FasterDecoder::ProcessNonemitting(double cutoff) {
             queue_.push_back(arc.nextstate);
           } else {
             if ( *(e_found->val) < *new_tok ) {
-              Token::TokenDelete(e_found->val);
+              TokenDelete(e_found->val);
               e_found->val = new_tok;
               queue_.push_back(arc.nextstate);
             } else {
-              Token::TokenDelete(new_tok);
+              TokenDelete(new_tok);
             }
           }
         }
@@ -347,7 +349,7 @@ void FasterDecoder::ProcessNonemitting(double cutoff) {
 
 void FasterDecoder::ClearToks(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
-    Token::TokenDelete(e->val);
+    TokenDelete(e->val);
     e_tail = e->tail;
     toks_.Delete(e);
   }
@@ -24,6 +24,7 @@
 #include "util/stl-utils.h"
 #include "itf/options-itf.h"
 #include "util/hash-list.h"
+#include "util/memory-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "lat/kaldi-lattice.h" // for CompactLatticeArc
@@ -133,20 +134,22 @@ class FasterDecoder {
     inline bool operator < (const Token &other) {
       return cost_ > other.cost_;
     }
+  };
+  typedef HashList<StateId, Token*>::Elem Elem;
 
-    inline static void TokenDelete(Token *tok) {
-      while (--tok->ref_count_ == 0) {
-        Token *prev = tok->prev_;
-        delete tok;
-        if (prev == NULL) return;
-        else tok = prev;
-      }
+  // Decrements the reference count of "tok", and if it reaches zero returns
+  // it to token_pool_ and does the same for its predecessor, and so on.
+  inline void TokenDelete(Token *tok) {
+    while (--tok->ref_count_ == 0) {
+      Token *prev = tok->prev_;
+      token_pool_.Delete(tok);
+      if (prev == NULL) return;
+      else tok = prev;
+    }
 #ifdef KALDI_PARANOID
-      KALDI_ASSERT(tok->ref_count_ > 0);
+    KALDI_ASSERT(tok->ref_count_ > 0);
 #endif
-    }
-  };
-  typedef HashList<StateId, Token*>::Elem Elem;
+  }
 
 
   /// Gets the weight cutoff.  Also counts the active tokens.
@@ -167,6 +170,9 @@ class FasterDecoder {
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.
   HashList<StateId, Token*> toks_;
+  // Tokens are allocated from this pool rather than with new/delete, for
+  // speed; see util/memory-pool.h.
+  MemoryPool<Token> token_pool_;
   const fst::Fst<fst::StdArc> &fst_;
   FasterDecoderOptions config_;
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
@@ -0,0 +1,135 @@
+// decoder/lattice-faster-batch-decoder-test.cc
+
+// Copyright 2015  Johns Hopkins University (Author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-batch-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "fstext/fstext-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "lat/lattice-test-utils.h"
+
+namespace kaldi {
+
+// Determinizes the raw lattice "lat" on the words, as lattice-determinize-pruned
+// does.
+void DeterminizeForTest(const LatticeFasterDecoderConfig &config,
+                        Lattice *lat, CompactLattice *clat) {
+  Invert(lat);  // so the words are on the input side.
+  fst::DeterminizeLatticePruned(*lat, config.lattice_beam, clat);
+}
+
+// Decodes several random utterances in lock-step with LatticeFasterBatchDecoder,
+// in pieces of random size, and checks that the results are the same as
+// decoding them one by one with LatticeFasterDecoder.
+void UnitTestLatticeFasterBatchDecoder() {
+  int32 num_pdfs = RandInt(1, 10);
+  fst::VectorFst<fst::StdArc> *graph = RandDecodingGraph(num_pdfs, 20, 10);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 4.0 + 10.0 * RandUniform();
+  config.lattice_beam = 1.0 + 5.0 * RandUniform();
+  config.prune_interval = RandInt(1, 30);
+  if (RandInt(0, 1) == 0) {
+    // The beam is adapted per stream; these settings exercise that (and the
+    // timing of the frames) without ever reducing the beam, so the output must
+    // still be the same as that of LatticeFasterDecoder.
+    config.target_active = 1000000;
+    config.max_rtf = 1.0e+10;
+    config.min_beam = 0.5 * config.beam;
+  }
+
+  int32 num_streams = RandInt(1, 5);
+  // The decodables keep a reference to the matrices, so we have to keep them.
+  std::vector<Matrix<BaseFloat> > loglikes(num_streams);
+  std::vector<DecodableMatrixScaled*> decodables(num_streams);
+  for (int32 s = 0; s < num_streams; s++) {
+    // Column zero is not used, as the input labels are one-based.
+    loglikes[s].Resize(RandInt(1, 50), num_pdfs + 1);
+    loglikes[s].SetRandn();
+    decodables[s] = new DecodableMatrixScaled(loglikes[s], 1.0);
+  }
+
+  LatticeFasterBatchDecoder batch_decoder(*graph, config, num_streams);
+  batch_decoder.InitDecoding();
+  while (true) {
+    // Leave out some of the streams for some of the calls, and decode a
+    // random number of frames.
+    std::vector<DecodableInterface*> active(num_streams, NULL);
+    bool done = true;
+    for (int32 s = 0; s < num_streams; s++) {
+      if (batch_decoder.Decoder(s).NumFramesDecoded() <
+          decodables[s]->NumFramesReady()) {
+        done = false;
+        if (RandInt(0, 3) != 0)
+          active[s] = decodables[s];
+      }
+    }
+    if (done)
+      break;
+    batch_decoder.AdvanceDecoding(active, RandInt(-1, 10));
+  }
+
+  for (int32 s = 0; s < num_streams; s++) {
+    batch_decoder.FinalizeDecoding(s);
+    const LatticeFasterDecoder &batch_stream = batch_decoder.Decoder(s);
+
+    LatticeFasterDecoder decoder(*graph, config);
+    decoder.Decode(decodables[s]);
+    KALDI_ASSERT(decoder.NumFramesDecoded() ==
+                 batch_stream.NumFramesDecoded());
+    KALDI_ASSERT(ApproxEqual(decoder.FinalRelativeCost(),
+                             batch_stream.FinalRelativeCost()));
+
+    Lattice best_path, batch_best_path;
+    bool ans = decoder.GetBestPath(&best_path),
+        batch_ans = batch_stream.GetBestPath(&batch_best_path);
+    KALDI_ASSERT(ans == batch_ans);
+    if (!ans)
+      continue;  // No tokens survived; it's possible for some graphs.
+    std::vector<int32> alignment, words, batch_alignment, batch_words;
+    LatticeWeight weight, batch_weight;
+    GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+    GetLinearSymbolSequence(batch_best_path, &batch_alignment, &batch_words,
+                            &batch_weight);
+    KALDI_ASSERT(alignment == batch_alignment && words == batch_words);
+    KALDI_ASSERT(ApproxEqual(weight.Value1() + weight.Value2(),
+                             batch_weight.Value1() + batch_weight.Value2()));
+
+    // The raw lattices have the same paths, but the states may be numbered
+    // differently, so we compare them after determinization.
+    Lattice lat, batch_lat;
+    decoder.GetRawLattice(&lat);
+    batch_stream.GetRawLattice(&batch_lat);
+    CompactLattice clat, batch_clat;
+    DeterminizeForTest(config, &lat, &clat);
+    DeterminizeForTest(config, &batch_lat, &batch_clat);
+    KALDI_ASSERT(fst::RandEquivalent(clat, batch_clat, 5, 0.01, Rand(), 100));
+  }
+
+  DeletePointers(&decodables);
+  delete graph;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 50; i++)
+    kaldi::UnitTestLatticeFasterBatchDecoder();
+  KALDI_LOG << "Tests succeeded.";
+}
@@ -0,0 +1,152 @@
+// decoder/lattice-faster-batch-decoder.cc
+
+// Copyright 2015  Johns Hopkins University (Author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "decoder/lattice-faster-batch-decoder.h"
+
+namespace kaldi {
+
+LatticeFasterBatchDecoder::LatticeFasterBatchDecoder(
+    const fst::Fst<fst::StdArc> &fst,
+    const LatticeFasterDecoderConfig &config,
+    int32 num_streams): fst_(fst), config_(config) {
+  KALDI_ASSERT(num_streams > 0);
+  config.Check();
+  decoders_.resize(num_streams);
+  for (int32 s = 0; s < num_streams; s++)
+    decoders_[s] = new StreamDecoder(fst, config);
+  frame_info_.resize(num_streams);
+}
+
+LatticeFasterBatchDecoder::~LatticeFasterBatchDecoder() {
+  DeletePointers(&decoders_);
+}
+
+void LatticeFasterBatchDecoder::InitDecoding() {
+  for (size_t s = 0; s < decoders_.size(); s++)
+    decoders_[s]->InitDecoding();
+}
+
+void LatticeFasterBatchDecoder::InitDecoding(int32 s) {
+  Decoder(s).InitDecoding();
+}
+
+void LatticeFasterBatchDecoder::AdvanceDecoding(
+    const std::vector<DecodableInterface*> &decodables,
+    int32 max_num_frames) {
+  int32 num_streams = decoders_.size();
+  KALDI_ASSERT(decodables.size() == static_cast<size_t>(num_streams));
+
+  std::vector<int32> target_frames(num_streams, 0);
+  for (int32 s = 0; s < num_streams; s++) {
+    if (decodables[s] == NULL) continue;
+    StreamDecoder *decoder = decoders_[s];
+    KALDI_ASSERT(decoder->CanAdvance() &&
+                 "You must call InitDecoding() before AdvanceDecoding");
+    int32 num_frames_ready = decodables[s]->NumFramesReady();
+    KALDI_ASSERT(num_frames_ready >= decoder->NumFramesDecoded());
+    target_frames[s] = num_frames_ready;
+    if (max_num_frames >= 0)
+      target_frames[s] = std::min(target_frames[s],
+                                  decoder->NumFramesDecoded() + max_num_frames);
+  }
+
+  std::vector<int32> streams;
+  std::vector<BaseFloat> cutoffs;
+  while (true) {
+    streams.clear();
+    for (int32 s = 0; s < num_streams; s++)
+      if (decodables[s] != NULL &&
+          decoders_[s]->NumFramesDecoded() < target_frames[s])
+        streams.push_back(s);
+    if (streams.empty())
+      break;
+    for (size_t i = 0; i < streams.size(); i++) {
+      StreamDecoder *decoder = decoders_[streams[i]];
+      if (decoder->NumFramesDecoded() % config_.prune_interval == 0)
+        decoder->PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+    }
+    ProcessEmittingBatch(decodables, streams, &cutoffs);
+    // The nonemitting arcs are a small fraction of the work and are processed
+    // in a queue-driven order that does not batch well, so we do them per
+    // stream.
+    for (size_t i = 0; i < streams.size(); i++)
+      decoders_[streams[i]]->ProcessNonemitting(cutoffs[i]);
+  }
+}
+
+void LatticeFasterBatchDecoder::ProcessEmittingBatch(
+    const std::vector<DecodableInterface*> &decodables,
+    const std::vector<int32> &streams,
+    std::vector<BaseFloat> *cutoffs) {
+  if (config_.max_rtf > 0.0)
+    frame_timer_.Reset();
+  tasks_.clear();
+  for (size_t i = 0; i < streams.size(); i++) {
+    int32 s = streams[i];
+    StreamFrameInfo &info = frame_info_[s];
+    info.decodable = decodables[s];
+    info.prev_toks = decoders_[s]->BeginEmitting(info.decodable,
+                                                 &(info.emitting));
+    for (Elem *e = info.prev_toks; e != NULL; e = e->tail) {
+      if (e->val->tot_cost <= info.emitting.cur_cutoff) {
+        EmitTask task;
+        task.state = e->key;
+        task.stream = s;
+        task.tok = e->val;
+        tasks_.push_back(task);
+      }
+    }
+  }
+  // Sorting on the state means that the arcs of each state are read only once
+  // per frame, however many streams have a token there; it also makes the
+  // accesses to the FST roughly sequential in memory.
+  std::sort(tasks_.begin(), tasks_.end());
+
+  size_t num_tasks = tasks_.size();
+  for (size_t begin = 0, end; begin < num_tasks; begin = end) {
+    StateId state = tasks_[begin].state;
+    for (end = begin + 1; end < num_tasks && tasks_[end].state == state; end++);
+    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel == 0) continue;
+      for (size_t t = begin; t < end; t++) {
+        const EmitTask &task = tasks_[t];
+        StreamFrameInfo &info = frame_info_[task.stream];
+        decoders_[task.stream]->ProcessEmittingArc(task.tok, arc,
+                                                   info.decodable,
+                                                   &(info.emitting));
+      }
+    }
+  }
+
+  double frame_time = (config_.max_rtf > 0.0 ? frame_timer_.Elapsed() : 0.0);
+  cutoffs->resize(streams.size());
+  for (size_t i = 0; i < streams.size(); i++) {
+    int32 s = streams[i];
+    decoders_[s]->DeleteElems(frame_info_[s].prev_toks);
+    frame_info_[s].prev_toks = NULL;
+    (*cutoffs)[i] = frame_info_[s].emitting.next_cutoff;
+    decoders_[s]->UpdateBeam(frame_info_[s].emitting.tok_count, frame_time);
+  }
+}
+
+} // end namespace kaldi.
@@ -0,0 +1,176 @@
+// decoder/lattice-faster-batch-decoder.h
+
+// Copyright 2015  Johns Hopkins University (Author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LATTICE_FASTER_BATCH_DECODER_H_
+#define KALDI_DECODER_LATTICE_FASTER_BATCH_DECODER_H_
+
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+/** LatticeFasterBatchDecoder decodes several utterances ("streams") at once
+    against a single, shared decoding graph.  Each stream has its own
+    LatticeFasterDecoder (which holds the tokens and lattice for that stream),
+    but the streams are advanced in lock-step, one frame at a time, and the
+    emitting-arc expansion for a frame is done jointly for all streams: the
+    active tokens of all streams are gathered, sorted on FST state, and the arcs
+    leaving each distinct state are read only once and applied to all the
+    tokens (from any stream) that sit on that state.  For large graphs with many
+    concurrent streams this makes much better use of the cache, since
+    different streams tend to be active in the same regions of the graph.
+
+    Because all streams are on the same frame (or close to it), the caller is
+    also free to compute the acoustic scores for all streams with a single
+    batched computation before calling AdvanceDecoding(), e.g. by splicing the
+    features of all streams into one matrix and wrapping the rows of the output
+    in DecodableMatrixScaled objects.
+
+    Lattices and best paths are obtained per stream from Decoder(s), exactly as
+    for a LatticeFasterDecoder.  The streams are independent, so it is fine to
+    re-initialize one stream with InitDecoding(s) while the others continue.
+
+    The tokens of a stream are expanded in a different order than in
+    LatticeFasterDecoder, and the pruning cutoff tightens as tokens are
+    expanded, so a few tokens just outside the beam may survive one frame
+    longer in one decoder than in the other; the results are otherwise the
+    same as decoding each stream with its own LatticeFasterDecoder.
+
+    If --target-active or --max-rtf is set, the beam is adapted separately for
+    each stream.  For --max-rtf, the time a stream takes per frame is the time
+    that the whole batch takes, as the streams are decoded in lock-step.
+ */
+class LatticeFasterBatchDecoder {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::Label Label;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  // Does not take ownership of the FST, which must stay in scope while this
+  // object exists.
+  LatticeFasterBatchDecoder(const fst::Fst<fst::StdArc> &fst,
+                            const LatticeFasterDecoderConfig &config,
+                            int32 num_streams);
+
+  ~LatticeFasterBatchDecoder();
+
+  int32 NumStreams() const { return decoders_.size(); }
+
+  /// Initializes decoding for all streams.
+  void InitDecoding();
+
+  /// Initializes (or re-initializes) decoding for stream "s" only.
+  void InitDecoding(int32 s);
+
+  /// Advances all streams for which decodables[s] is non-NULL, until each of
+  /// them has consumed all the frames its decodable object has ready (or until
+  /// max_num_frames more frames have been decoded, if max_num_frames >= 0).
+  /// Streams with fewer frames ready simply drop out of the batch once they
+  /// are done.  decodables.size() must equal NumStreams().
+  void AdvanceDecoding(const std::vector<DecodableInterface*> &decodables,
+                       int32 max_num_frames = -1);
+
+  /// Calls FinalizeDecoding() for stream "s"; see the documentation of
+  /// LatticeFasterDecoder::FinalizeDecoding().
+  void FinalizeDecoding(int32 s) { Decoder(s).FinalizeDecoding(); }
+
+  /// Gives access to the decoder of stream "s", e.g. to call GetRawLattice()
+  /// or NumFramesDecoded() on it.  The user should not call InitDecoding() or
+  /// AdvanceDecoding() on it directly (although nothing will break if they do).
+  LatticeFasterDecoder &Decoder(int32 s) {
+    KALDI_ASSERT(static_cast<size_t>(s) < decoders_.size());
+    return *(decoders_[s]);
+  }
+  const LatticeFasterDecoder &Decoder(int32 s) const {
+    KALDI_ASSERT(static_cast<size_t>(s) < decoders_.size());
+    return *(decoders_[s]);
+  }
+
+ private:
+  // LatticeFasterDecoder, with the functions that make up its emitting stage
+  // made accessible to this class.
+  class StreamDecoder: public LatticeFasterDecoder {
+   public:
+    StreamDecoder(const fst::Fst<fst::StdArc> &fst,
+                  const LatticeFasterDecoderConfig &config):
+        LatticeFasterDecoder(fst, config) { }
+    using LatticeFasterDecoder::Token;
+    using LatticeFasterDecoder::Elem;
+    using LatticeFasterDecoder::EmittingFrameInfo;
+    using LatticeFasterDecoder::BeginEmitting;
+    using LatticeFasterDecoder::ProcessEmittingArc;
+    using LatticeFasterDecoder::DeleteElems;
+    using LatticeFasterDecoder::ProcessNonemitting;
+    using LatticeFasterDecoder::PruneActiveTokens;
+    using LatticeFasterDecoder::UpdateBeam;
+    bool CanAdvance() const {
+      return !active_toks_.empty() && !decoding_finalized_;
+    }
+  };
+  typedef StreamDecoder::Token Token;
+  typedef StreamDecoder::Elem Elem;
+
+  // One token that survived the cutoff on the previous frame, and needs its
+  // emitting arcs expanded.
+  struct EmitTask {
+    StateId state;
+    int32 stream;
+    Token *tok;
+    // Sort on state, then stream; the stream is only there to make the order
+    // (and hence the output) independent of the sort algorithm.
+    bool operator < (const EmitTask &other) const {
+      if (state != other.state) return state < other.state;
+      return stream < other.stream;
+    }
+  };
+
+  // Per-stream state kept for the duration of one frame of
+  // ProcessEmittingBatch().
+  struct StreamFrameInfo {
+    DecodableInterface *decodable;
+    Elem *prev_toks;  // list of Elems from the previous frame, which we own
+                      // until we call DeleteElems() on it.
+    StreamDecoder::EmittingFrameInfo emitting;
+  };
+
+  // Does the emitting part of decoding for the streams listed in "streams"
+  // (which must all have their decodable non-NULL in decodables).  On exit,
+  // (*cutoffs)[i] is the cutoff to use in ProcessNonemitting() for stream
+  // streams[i].
+  void ProcessEmittingBatch(const std::vector<DecodableInterface*> &decodables,
+                            const std::vector<int32> &streams,
+                            std::vector<BaseFloat> *cutoffs);
+
+  std::vector<StreamDecoder*> decoders_;
+  const fst::Fst<fst::StdArc> &fst_;
+  LatticeFasterDecoderConfig config_;
+
+  // Temporaries used in ProcessEmittingBatch(); class members to avoid
+  // reallocating them on every frame.
+  std::vector<EmitTask> tasks_;
+  std::vector<StreamFrameInfo> frame_info_;
+  Timer frame_timer_;  // Used if config_.max_rtf > 0.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterBatchDecoder);
+};
+
+
+} // end namespace kaldi.
+
+#endif
@@ -0,0 +1,122 @@
+// decoder/lattice-faster-decoder-test.cc
+
+// Copyright 2015  Johns Hopkins University (Author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "lat/lattice-test-utils.h"
+
+namespace kaldi {
+
+// LatticeFasterDecoder, with the cutoff that it applies to the tokens of the
+// current frame made accessible to the test.
+class TestDecoder: public LatticeFasterDecoder {
+ public:
+  TestDecoder(const fst::Fst<fst::StdArc> &fst,
+              const LatticeFasterDecoderConfig &config):
+      LatticeFasterDecoder(fst, config) { }
+
+  // Returns the cutoff that the next ProcessEmitting() will apply to the
+  // tokens of the current frame, and outputs their costs.  Sets
+  // *first_bin_count to the number of tokens in the first nonempty bin of the
+  // histogram (or zero if there is no histogram).
+  BaseFloat GetCutoff(std::vector<BaseFloat> *costs, int32 *first_bin_count) {
+    costs->clear();
+    for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+      costs->push_back(e->val->tot_cost);
+    size_t tok_count;
+    BaseFloat adaptive_beam;
+    Elem *best_elem = NULL;
+    // GetCutoff() does not change the list.
+    BaseFloat cutoff = LatticeFasterDecoder::GetCutoff(
+        const_cast<Elem*>(toks_.GetList()), &tok_count, &adaptive_beam,
+        &best_elem);
+    KALDI_ASSERT(tok_count == costs->size());
+    *first_bin_count = 0;
+    for (size_t i = 0; i < histogram_.size() && *first_bin_count == 0; i++)
+      *first_bin_count = histogram_[i];
+    return cutoff;
+  }
+};
+
+// Decodes a random utterance with --num-histogram-bins and a small
+// --max-active, and checks the cutoff on each frame against the exact one.  If
+// "force_fallback" is true there is only one bin, so the histogram is no use
+// and GetCutoff() has to fall back to the exact cutoff.
+void UnitTestHistogramCutoff(bool force_fallback) {
+  int32 num_pdfs = RandInt(1, 10);
+  fst::VectorFst<fst::StdArc> *graph = RandDecodingGraph(num_pdfs, 20, 10);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 20.0;
+  config.max_active = RandInt(2, 5);
+  config.num_histogram_bins = (force_fallback ? 1 : RandInt(2, 100));
+
+  // Column zero is not used, as the input labels are one-based.
+  Matrix<BaseFloat> loglikes(RandInt(1, 50), num_pdfs + 1);
+  loglikes.SetRandn();
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+
+  TestDecoder decoder(*graph, config);
+  decoder.InitDecoding();
+  int32 num_histogram = 0, num_fallback = 0;
+  while (decoder.NumFramesDecoded() < decodable.NumFramesReady()) {
+    std::vector<BaseFloat> costs;
+    int32 first_bin_count;
+    BaseFloat cutoff = decoder.GetCutoff(&costs, &first_bin_count);
+    if (costs.empty())
+      break;  // No tokens survived; it's possible for some graphs.
+    std::sort(costs.begin(), costs.end());
+    BaseFloat beam_cutoff = costs[0] + config.beam;
+    int32 num_kept = std::upper_bound(costs.begin(), costs.end(), cutoff) -
+        costs.begin();
+    if (costs.size() > static_cast<size_t>(config.max_active)) {
+      BaseFloat exact_cutoff = costs[config.max_active];
+      if (force_fallback)
+        KALDI_ASSERT(first_bin_count == static_cast<int32>(costs.size()));
+      if (first_bin_count > config.max_active) {
+        num_fallback++;
+        KALDI_ASSERT(ApproxEqual(cutoff, std::min(exact_cutoff, beam_cutoff)));
+      } else {
+        // The cutoff is the highest cost in the bins before the one that
+        // contains the (max_active + 1)'th best token, so it keeps at most
+        // max_active tokens, even if some have the same cost.
+        num_histogram++;
+        KALDI_ASSERT(cutoff <= exact_cutoff);
+        KALDI_ASSERT(num_kept <= config.max_active);
+      }
+    } else {
+      KALDI_ASSERT(ApproxEqual(cutoff, beam_cutoff));
+    }
+    decoder.AdvanceDecoding(&decodable, 1);
+  }
+  KALDI_VLOG(1) << "Used the histogram on " << num_histogram
+                << " frames and the exact cutoff on " << num_fallback
+                << " frames where the first bin was too full.";
+  delete graph;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 50; i++) {
+    kaldi::UnitTestHistogramCutoff(false);
+    kaldi::UnitTestHistogramCutoff(true);
+  }
+  KALDI_LOG << "Tests succeeded.";
+}
@@ -57,14 +57,18 @@ void LatticeFasterDecoder::InitDecoding() {
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
+  token_pool_.ResetHighWaterMark();
+  link_pool_.ResetHighWaterMark();
   warned_ = false;
   num_toks_ = 0;
   decoding_finalized_ = false;
   final_costs_.clear();
+  cur_beam_ = config_.beam;
+  avg_frame_time_ = 0.0;
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+  Token *start_tok = new (token_pool_.Allocate()) Token(0.0, 0.0, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -224,49 +228,6 @@ void LatticeFasterDecoder::PossiblyResizeHash(size_t num_toks) {
   }
 }
 
-// FindOrAddToken either locates a token in hash of toks_,
-// or if necessary inserts a new, empty token (i.e. with no forward links)
-// for the current frame.  [note: it's inserted if necessary into hash toks_
-// and also into the singly linked list of tokens active on this frame
-// (whose head is at active_toks_[frame]).
-inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
-    StateId state, int32 frame_plus_one, BaseFloat tot_cost, bool *changed) {
-  // Returns the Token pointer.  Sets "changed" (if non-NULL) to true
-  // if the token was newly created or the cost changed.
-  KALDI_ASSERT(frame_plus_one < active_toks_.size());
-  Token *&toks = active_toks_[frame_plus_one].toks;
-  Elem *e_found = toks_.Find(state);
-  if (e_found == NULL) {  // no such token presently.
-    const BaseFloat extra_cost = 0.0;
-    // tokens on the currently final frame have zero extra_cost
-    // as any of them could end up
-    // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
-    // NULL: no forward links yet
-    toks = new_tok;
-    num_toks_++;
-    toks_.Insert(state, new_tok);
-    if (changed) *changed = true;
-    return new_tok;
-  } else {
-    Token *tok = e_found->val;  // There is an existing Token for this state.
-    if (tok->tot_cost > tot_cost) {  // replace old token
-      tok->tot_cost = tot_cost;
-      // we don't allocate a new token, the old stays linked in active_toks_
-      // we only replace the tot_cost
-      // in the current frame, there are no forward links (and no extra_cost)
-      // only in ProcessNonemitting we have to delete forward links
-      // in case we visit a state for the second time
-      // those forward links, that lead to this replaced token before:
-      // they remain and will hopefully be pruned later (PruneForwardLinks...)
-      if (changed) *changed = true;
-    } else {
-      if (changed) *changed = false;
-    }
-    return tok;
-  }
-}
-
 // prunes outgoing links for all tokens in active_toks_[frame]
 // it's called by PruneActiveTokens
 // all links, that have link_extra_cost > lattice_beam are pruned
@@ -314,7 +275,7 @@ void LatticeFasterDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -401,7 +362,7 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -460,7 +421,7 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -585,6 +546,9 @@ void LatticeFasterDecoder::FinalizeDecoding() {
   PruneTokensForFrame(0);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  KALDI_VLOG(4) << "High-water mark of memory pools was "
+                << token_pool_.HighWaterMark() << " tokens and "
+                << link_pool_.HighWaterMark() << " forward links.";
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
@@ -593,6 +557,7 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
+  BaseFloat beam = cur_beam_;
   if (config_.max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -603,13 +568,36 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
       }
     }
     if (tok_count != NULL) *tok_count = count;
-    if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
-    return best_weight + config_.beam;
+    if (adaptive_beam != NULL) *adaptive_beam = beam;
+    return best_weight + beam;
   } else {
-    tmp_array_.clear();
+    // If use_histogram, instead of storing the costs to select the
+    // max_active'th and min_active'th best, we count them in a histogram whose
+    // bins cover the beam below nonemitting_cutoff_; we can't wait until we
+    // know the best cost to do this, as that would need a second pass.
+    bool use_histogram = (config_.num_histogram_bins > 0);
+    int32 num_bins = config_.num_histogram_bins;
+    if (use_histogram) {
+      histogram_.assign(num_bins, 0);
+      histogram_max_cost_.assign(num_bins,
+                                 -std::numeric_limits<BaseFloat>::infinity());
+      histogram_begin_ = nonemitting_cutoff_ - beam;
+      histogram_bin_width_ = beam / num_bins;
+    } else {
+      tmp_array_.clear();
+    }
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = e->val->tot_cost;
-      tmp_array_.push_back(w);
+      if (use_histogram) {
+        BaseFloat x = (w - histogram_begin_) / histogram_bin_width_;
+        int32 bin = (x <= 0.0 ? 0 : (x >= num_bins ? num_bins - 1 :
+                                     static_cast<int32>(x)));
+        histogram_[bin]++;
+        if (w > histogram_max_cost_[bin])
+          histogram_max_cost_[bin] = w;
+      } else {
+        tmp_array_.push_back(w);
+      }
       if (w < best_weight) {
         best_weight = w;
         if (best_elem) *best_elem = e;
@@ -617,27 +605,41 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
     }
     if (tok_count != NULL) *tok_count = count;
 
-    BaseFloat beam_cutoff = best_weight + config_.beam,
+    BaseFloat beam_cutoff = best_weight + beam,
         min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
         max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
 
     KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
-                  << " is " << tmp_array_.size();
-    
-    if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
-      std::nth_element(tmp_array_.begin(),
-                       tmp_array_.begin() + config_.max_active,
-                       tmp_array_.end());
-      max_active_cutoff = tmp_array_[config_.max_active];
+                  << " is " << count;
+
+    if (count > static_cast<size_t>(config_.max_active)) {
+      if (use_histogram)
+        max_active_cutoff = GetHistogramCutoff(config_.max_active, false);
+      if (max_active_cutoff == -std::numeric_limits<BaseFloat>::infinity()) {
+        // The first nonempty bin has too many tokens (the costs are more
+        // spread out than usual); we have to store and sort them after all.
+        tmp_array_.clear();
+        for (Elem *e = list_head; e != NULL; e = e->tail)
+          tmp_array_.push_back(e->val->tot_cost);
+        use_histogram = false;
+      }
+      if (!use_histogram) {
+        std::nth_element(tmp_array_.begin(),
+                         tmp_array_.begin() + config_.max_active,
+                         tmp_array_.end());
+        max_active_cutoff = tmp_array_[config_.max_active];
+      }
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
       if (adaptive_beam)
         *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
       return max_active_cutoff;
     }     
-    if (tmp_array_.size() > static_cast<size_t>(config_.min_active)) {
+    if (count > static_cast<size_t>(config_.min_active)) {
       if (config_.min_active == 0) min_active_cutoff = best_weight;
-      else {
+      else if (use_histogram) {
+        min_active_cutoff = GetHistogramCutoff(config_.min_active, true);
+      } else {
         std::nth_element(tmp_array_.begin(),
                          tmp_array_.begin() + config_.min_active,
                          tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
@@ -651,13 +653,51 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
         *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
       return min_active_cutoff;
     } else {
-      *adaptive_beam = config_.beam;
+      *adaptive_beam = beam;
       return beam_cutoff;
     }
   }
 }
 
-BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
+BaseFloat LatticeFasterDecoder::GetHistogramCutoff(int32 n,
+                                                   bool upper_edge) const {
+  int32 num_bins = histogram_.size(), count = 0;
+  BaseFloat max_cost = -std::numeric_limits<BaseFloat>::infinity();
+  for (int32 i = 0; i < num_bins; i++) {
+    if (!upper_edge && count + histogram_[i] > n)
+      return max_cost;
+    count += histogram_[i];
+    max_cost = std::max(max_cost, histogram_max_cost_[i]);
+    if (upper_edge && count > n)
+      return max_cost;
+  }
+  return (upper_edge ? std::numeric_limits<BaseFloat>::infinity() :
+          -std::numeric_limits<BaseFloat>::infinity());
+}
+
+void LatticeFasterDecoder::UpdateBeam(size_t tok_count, double frame_time) {
+  if (config_.target_active <= 0 && config_.max_rtf <= 0.0)
+    return;
+  if (config_.max_rtf > 0.0)
+    avg_frame_time_ = (avg_frame_time_ == 0.0 ? frame_time :
+                       0.9 * avg_frame_time_ + 0.1 * frame_time);
+  BaseFloat log_ratio = std::numeric_limits<BaseFloat>::infinity();
+  if (config_.target_active > 0)
+    log_ratio = Log((config_.target_active + 1.0) / (tok_count + 1.0));
+  if (config_.max_rtf > 0.0 && avg_frame_time_ > 0.0) {
+    // The real-time factor, assuming 100 frames per second.
+    double rtf = avg_frame_time_ * 100.0;
+    log_ratio = std::min(log_ratio,
+                         static_cast<BaseFloat>(Log(config_.max_rtf / rtf)));
+  }
+  if (log_ratio == std::numeric_limits<BaseFloat>::infinity())
+    return;  // Only max_rtf is set, and we have not timed any frames yet.
+  cur_beam_ += config_.beam_adapt_rate * log_ratio;
+  cur_beam_ = std::max(config_.min_beam, std::min(config_.beam, cur_beam_));
+}
+
+LatticeFasterDecoder::Elem *LatticeFasterDecoder::BeginEmitting(
+    DecodableInterface *decodable, EmittingFrameInfo *info) {
   KALDI_ASSERT(active_toks_.size() > 0);
   int32 frame = active_toks_.size() - 1; // frame is the frame-index
                                          // (zero-based) used to get likelihoods
@@ -710,6 +750,21 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
 
+  info->frame = frame;
+  info->cur_cutoff = cur_cutoff;
+  info->next_cutoff = next_cutoff;
+  info->adaptive_beam = adaptive_beam;
+  info->cost_offset = cost_offset;
+  info->tok_count = tok_cnt;
+  return final_toks;
+}
+
+BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
+  EmittingFrameInfo info;
+  if (config_.max_rtf > 0.0)
+    frame_timer_.Reset();
+  Elem *final_toks = BeginEmitting(decodable, &info);
+
   // the tokens are now owned here, in final_toks, and the hash is empty.
   // 'owned' is a complex thing here; the point is we need to call DeleteElem
   // on each elem 'e' to let toks_ know we're done with them.
@@ -717,40 +772,26 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
     // loop this way because we delete "e" as we go.
     StateId state = e->key;
     Token *tok = e->val;
-    if (tok->tot_cost <= cur_cutoff) {
+    if (tok->tot_cost <= info.cur_cutoff) {
       for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
            !aiter.Done();
            aiter.Next()) {
         const Arc &arc = aiter.Value();
-        if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
-              graph_cost = arc.weight.Value(),
-              cur_cost = tok->tot_cost,
-              tot_cost = cur_cost + ac_cost + graph_cost;
-          if (tot_cost > next_cutoff) continue;
-          else if (tot_cost + adaptive_beam < next_cutoff)
-            next_cutoff = tot_cost + adaptive_beam; // prune by best current token
-          // Note: the frame indexes into active_toks_ are one-based,
-          // hence the + 1.
-          Token *next_tok = FindOrAddToken(arc.nextstate,
-                                           frame + 1, tot_cost, NULL);
-          // NULL: no change indicator needed
-
-          // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
-        }
+        if (arc.ilabel != 0)  // propagate..
+          ProcessEmittingArc(tok, arc, decodable, &info);
       } // for all arcs
     }
     e_tail = e->tail;
     toks_.Delete(e); // delete Elem
   }
-  return next_cutoff;
+  UpdateBeam(info.tok_count,
+             config_.max_rtf > 0.0 ? frame_timer_.Elapsed() : 0.0);
+  return info.next_cutoff;
 }
 
 void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
   KALDI_ASSERT(!active_toks_.empty());
+  nonemitting_cutoff_ = cutoff;
   int32 frame = static_cast<int32>(active_toks_.size()) - 2;
   // Note: "frame" is the time-index we just processed, or -1 if
   // we are processing the nonemitting transitions before the
@@ -784,7 +825,7 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    tok->DeleteForwardLinks(&link_pool_); // necessary when re-visiting
     tok->links = NULL;
     for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
          !aiter.Done();
@@ -799,8 +840,9 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLink(new_tok, 0, arc.olabel,
+                          graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -824,9 +866,9 @@ void LatticeFasterDecoder::ClearActiveTokens() { // a cleanup routine, at utt en
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      tok->DeleteForwardLinks(&link_pool_);
       Token *next_tok = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -29,6 +29,8 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/memory-pool.h"
+#include "base/timer.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -50,6 +52,19 @@ struct LatticeFasterDecoderConfig {
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
+  // If > 0, the max_active and min_active cutoffs are computed approximately
+  // from a histogram of token costs with this many bins covering the beam,
+  // instead of by sorting.
+  int32 num_histogram_bins;
+  // The next four variables control the adaptive beam, which is used if
+  // target_active > 0 or max_rtf > 0.  On each frame the beam is changed by
+  // beam_adapt_rate times the log of the ratio between target_active and the
+  // number of active tokens, or between max_rtf and the recent real-time
+  // factor if that is smaller; it stays between min_beam and beam.
+  int32 target_active;
+  BaseFloat max_rtf;
+  BaseFloat min_beam;
+  BaseFloat beam_adapt_rate;
   // Most of the options inside det_opts are not actually queried by the
   // LatticeFasterDecoder class itself, but by the code that calls it, for
   // example in the function DecodeUtteranceLatticeFaster.
@@ -63,7 +78,12 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
-                                prune_scale(0.1) { }
+                                prune_scale(0.1),
+                                num_histogram_bins(0),
+                                target_active(0),
+                                max_rtf(0.0),
+                                min_beam(6.0),
+                                beam_adapt_rate(0.5) { }
   void Register(OptionsItf *po) {
     det_opts.Register(po);
     po->Register("beam", &beam, "Decoding beam.");
@@ -80,11 +100,29 @@ struct LatticeFasterDecoderConfig {
                  "max-active constraint is applied.  Larger is more accurate.");
     po->Register("hash-ratio", &hash_ratio, "Setting used in decoder to control"
                  " hash behavior");
+    po->Register("num-histogram-bins", &num_histogram_bins, "If >0, apply "
+                 "--max-active and --min-active using a histogram of token "
+                 "costs with this many bins (faster, but approximate); "
+                 "try 100.");
+    po->Register("target-active", &target_active, "If >0, adapt the beam on "
+                 "each frame to try to get this many active tokens (see also "
+                 "--min-beam, --beam-adapt-rate).");
+    po->Register("max-rtf", &max_rtf, "If >0, adapt the beam to try to keep "
+                 "the real-time factor of the search (assuming 100 frames per "
+                 "second) below this value.");
+    po->Register("min-beam", &min_beam, "Smallest beam that --target-active "
+                 "or --max-rtf may reduce the beam to (the largest is --beam).");
+    po->Register("beam-adapt-rate", &beam_adapt_rate, "Controls how fast the "
+                 "beam is changed by --target-active or --max-rtf.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
-                 && prune_scale > 0.0 && prune_scale < 1.0);
+                 && prune_scale > 0.0 && prune_scale < 1.0
+                 && num_histogram_bins >= 0);
+    if (target_active > 0 || max_rtf > 0.0)
+      KALDI_ASSERT(min_beam > 0.0 && min_beam <= beam &&
+                   beam_adapt_rate > 0.0);
   }
 };
 
@@ -204,7 +242,10 @@ class LatticeFasterDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
- private:
+ protected:
+  // The internals are protected rather than private so that
+  // LatticeFasterBatchDecoder can use the per-frame functions below.
+
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
   struct Token;
@@ -244,11 +285,11 @@ class LatticeFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next) { }
-    inline void DeleteForwardLinks() {
+    inline void DeleteForwardLinks(MemoryPool<ForwardLink> *link_pool) {
       ForwardLink *l = links, *m;
       while (l != NULL) {
         m = l->next;
-        delete l;
+        link_pool->Delete(l);
         l = m;
       }
       links = NULL;
@@ -276,9 +317,44 @@ class LatticeFasterDecoder {
   // active_toks_[frame]).  The frame_plus_one argument is the acoustic frame
   // index plus one, which is used to index into the active_toks_ array.
   // Returns the Token pointer.  Sets "changed" (if non-NULL) to true if the
-  // token was newly created or the cost changed.
+  // token was newly created or the cost changed.  It is defined here so that
+  // it can be inlined in ProcessEmittingArc() and ProcessNonemitting().
   inline Token *FindOrAddToken(StateId state, int32 frame_plus_one,
-                               BaseFloat tot_cost, bool *changed);
+                               BaseFloat tot_cost, bool *changed) {
+    KALDI_ASSERT(frame_plus_one < active_toks_.size());
+    Token *&toks = active_toks_[frame_plus_one].toks;
+    Elem *e_found = toks_.Find(state);
+    if (e_found == NULL) {  // no such token presently.
+      const BaseFloat extra_cost = 0.0;
+      // tokens on the currently final frame have zero extra_cost
+      // as any of them could end up
+      // on the winning path.
+      Token *new_tok = new (token_pool_.Allocate())
+          Token(tot_cost, extra_cost, NULL, toks);
+      // NULL: no forward links yet
+      toks = new_tok;
+      num_toks_++;
+      toks_.Insert(state, new_tok);
+      if (changed) *changed = true;
+      return new_tok;
+    } else {
+      Token *tok = e_found->val;  // There is an existing Token for this state.
+      if (tok->tot_cost > tot_cost) {  // replace old token
+        tok->tot_cost = tot_cost;
+        // we don't allocate a new token, the old stays linked in active_toks_
+        // we only replace the tot_cost
+        // in the current frame, there are no forward links (and no extra_cost)
+        // only in ProcessNonemitting we have to delete forward links
+        // in case we visit a state for the second time
+        // those forward links, that lead to this replaced token before:
+        // they remain and will hopefully be pruned later (PruneForwardLinks...)
+        if (changed) *changed = true;
+      } else {
+        if (changed) *changed = false;
+      }
+      return tok;
+    }
+  }
 
   // prunes outgoing links for all tokens in active_toks_[frame]
   // it's called by PruneActiveTokens
@@ -338,10 +414,77 @@ class LatticeFasterDecoder {
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
 
+  /// Used by GetCutoff() if config_.num_histogram_bins > 0.  Finds the first
+  /// bin of histogram_ at which the number of tokens so far exceeds n, and
+  /// returns the highest cost in the bins before it (or up to and including
+  /// it, if "upper_edge" is true).  The bins are in order of cost, so the
+  /// tokens with cost <= this cutoff are exactly those in these bins, even if
+  /// some tokens have the same cost: with upper_edge == false, at most n
+  /// tokens survive.  Returns -infinity if those bins are empty (the caller
+  /// then computes the cutoff exactly).
+  BaseFloat GetHistogramCutoff(int32 n, bool upper_edge) const;
+
+  /// Changes cur_beam_ as described for LatticeFasterDecoderConfig::
+  /// target_active, given the number of tokens active on this frame and the
+  /// time in seconds that the frame took (only used if config_.max_rtf > 0).
+  void UpdateBeam(size_t tok_count, double frame_time);
+
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to cur_toks_.
   /// Returns the cost cutoff for subsequent ProcessNonemitting() to use.
   BaseFloat ProcessEmitting(DecodableInterface *decodable);
 
+  // ProcessEmitting() is made up of BeginEmitting(), ProcessEmittingArc() for
+  // each emitting arc of each token that survives the cutoff, and
+  // DeleteElems(); they are separate so that LatticeFasterBatchDecoder can
+  // expand the tokens of several decoders together.  The following struct
+  // holds the state of the emitting stage for one frame.
+  struct EmittingFrameInfo {
+    int32 frame;  // The zero-based frame index that we are processing.
+    BaseFloat cur_cutoff;  // Tokens of the previous frame with a higher cost
+                           // are not expanded.
+    BaseFloat next_cutoff;  // The cutoff on the new tokens; it gets tighter as
+                            // we go.  It is the return value of
+                            // ProcessEmitting().
+    BaseFloat adaptive_beam;
+    BaseFloat cost_offset;  // The offset on the acoustic costs on this frame.
+    size_t tok_count;  // The number of tokens active on the previous frame.
+  };
+
+  /// Starts the emitting stage of a frame: removes the tokens of the previous
+  /// frame from the hash, works out the cutoffs (processing the arcs of the
+  /// best token first to get a tight next_cutoff) and the cost offset, and
+  /// sets up *info.  Returns the list of the previous frame's tokens; those
+  /// with tot_cost <= info->cur_cutoff should be given to ProcessEmittingArc()
+  /// with each of their emitting arcs, and then the list must be given to
+  /// DeleteElems().
+  Elem *BeginEmitting(DecodableInterface *decodable, EmittingFrameInfo *info);
+
+  /// Propagates token "tok" of the previous frame through the emitting arc
+  /// "arc", unless the result is outside info->next_cutoff.
+  inline void ProcessEmittingArc(Token *tok, const Arc &arc,
+                                 DecodableInterface *decodable,
+                                 EmittingFrameInfo *info) {
+    BaseFloat ac_cost = info->cost_offset -
+        decodable->LogLikelihood(info->frame, arc.ilabel),
+        graph_cost = arc.weight.Value(),
+        cur_cost = tok->tot_cost,
+        tot_cost = cur_cost + ac_cost + graph_cost;
+    if (tot_cost > info->next_cutoff) return;
+    else if (tot_cost + info->adaptive_beam < info->next_cutoff)
+      info->next_cutoff = tot_cost + info->adaptive_beam;  // prune by best
+                                                           // current token
+    // Note: the frame indexes into active_toks_ are one-based,
+    // hence the + 1.
+    Token *next_tok = FindOrAddToken(arc.nextstate,
+                                     info->frame + 1, tot_cost, NULL);
+    // NULL: no change indicator needed
+
+    // Add ForwardLink from tok to next_tok (put on head of list tok->links)
+    tok->links = new (link_pool_.Allocate())
+        ForwardLink(next_tok, arc.ilabel, arc.olabel,
+                    graph_cost, ac_cost, tok->links);
+  }
+
   /// Processes nonemitting (epsilon) arcs for one frame.  Called after
   /// ProcessEmitting() on each frame.  The cost cutoff is computed by the
   /// preceding ProcessEmitting().
@@ -359,9 +502,32 @@ class LatticeFasterDecoder {
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new/delete, for speed; see util/memory-pool.h.
+  MemoryPool<Token> token_pool_;
+  MemoryPool<ForwardLink> link_pool_;
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
   // make it class member to avoid internal new/delete.
+  // The histogram of token costs used in GetCutoff() if
+  // config_.num_histogram_bins > 0; bin i covers the costs from
+  // histogram_begin_ + i * histogram_bin_width_, and the first and last bins
+  // also count all the costs below and above the range.
+  std::vector<int32> histogram_;
+  // The highest cost counted in each bin of histogram_.
+  std::vector<BaseFloat> histogram_max_cost_;
+  BaseFloat histogram_begin_;
+  BaseFloat histogram_bin_width_;
+  // The cutoff passed to the most recent ProcessNonemitting(); the tokens in
+  // toks_ have costs below it, except some that are outside the beam anyway.
+  BaseFloat nonemitting_cutoff_;
+  // The beam used on the current frame; it is config_.beam unless the beam is
+  // adapted (see LatticeFasterDecoderConfig::target_active).
+  BaseFloat cur_beam_;
+  // Smoothed average of the time taken by ProcessEmitting() per frame, in
+  // seconds, and the timer used to measure it; used if config_.max_rtf > 0.
+  double avg_frame_time_;
+  Timer frame_timer_;
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
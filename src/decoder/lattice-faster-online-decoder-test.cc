@@ -0,0 +1,110 @@
+// decoder/lattice-faster-online-decoder-test.cc
+
+// Copyright 2015  Johns Hopkins University (Author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-online-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "lat/lattice-test-utils.h"
+
+namespace kaldi {
+
+// Decodes a random utterance in pieces, calling DeterminizePrefix() after each
+// piece, and checks the output of GetLatticeIncremental() and
+// FinishLatticeIncremental() against the lattice we get by determinizing the
+// whole raw lattice.  The beams are so wide that nothing is pruned, so the
+// lattices must be equivalent after we determinize the incrementally
+// determinized one again.
+void UnitTestDeterminizePrefix() {
+  TransitionModel *trans_model = RandTransitionModel();
+  // There are few states and words, so that the lattices stay small when
+  // nothing is pruned.
+  fst::VectorFst<fst::StdArc> *graph =
+      RandDecodingGraph(trans_model->NumTransitionIds(), 8, 3);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 1000.0;
+  config.lattice_beam = 1000.0;
+  config.prune_interval = RandInt(1, 10);
+
+  LatticeIncrementalDeterminizerConfig det_config;
+  det_config.min_chunk_length = RandInt(1, 5);
+  det_config.max_chunk_length = det_config.min_chunk_length + RandInt(0, 5);
+  det_config.determinize_delay = RandInt(1, 3);
+  LatticeIncrementalDeterminizer determinizer(det_config, *trans_model,
+                                              config.lattice_beam,
+                                              config.det_opts);
+
+  Matrix<BaseFloat> loglikes(RandInt(1, 30), trans_model->NumPdfs());
+  loglikes.SetRandn();
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 1.0);
+
+  LatticeFasterOnlineDecoder decoder(*graph, config);
+  decoder.InitDecoding();
+  while (decoder.NumFramesDecoded() < decodable.NumFramesReady()) {
+    decoder.AdvanceDecoding(&decodable, RandInt(1, 5));
+    while (decoder.DeterminizePrefix(&determinizer));
+  }
+  if (RandInt(0, 1) == 0)
+    decoder.FinalizeDecoding();
+  KALDI_VLOG(1) << "Determinized " << decoder.NumFramesDeterminized()
+                << " of " << decoder.NumFramesDecoded() << " frames in "
+                << determinizer.NumChunks() << " chunks.";
+  CompactLattice clat;
+  bool ans = decoder.GetLatticeIncremental(true, determinizer, &clat);
+  if (RandInt(0, 1) == 0) {
+    // The final lattice must be the same as the partial one.
+    CompactLattice final_clat;
+    KALDI_ASSERT(decoder.FinishLatticeIncremental(true, &determinizer,
+                                                  &final_clat) == ans);
+    KALDI_ASSERT(determinizer.NumChunks() == 0);
+    KALDI_ASSERT(fst::Equal(clat, final_clat));
+  }
+
+  LatticeFasterOnlineDecoder ref_decoder(*graph, config);
+  ref_decoder.Decode(&decodable);
+  Lattice raw_lat;
+  ref_decoder.GetRawLattice(&raw_lat, true);
+  CompactLattice ref_clat;
+  KALDI_ASSERT(DeterminizeLatticePhonePrunedWrapper(
+      *trans_model, &raw_lat, config.lattice_beam, &ref_clat,
+      config.det_opts));
+
+  KALDI_ASSERT(ans == (ref_clat.NumStates() != 0));
+  if (ans) {
+    KALDI_ASSERT(ApproxEqual(BestPathCost(clat), BestPathCost(ref_clat)));
+    Lattice redet_lat;
+    ConvertLattice(clat, &redet_lat);
+    CompactLattice redet_clat;
+    KALDI_ASSERT(DeterminizeLatticePhonePrunedWrapper(
+        *trans_model, &redet_lat, config.lattice_beam, &redet_clat,
+        config.det_opts));
+    KALDI_ASSERT(fst::RandEquivalent(redet_clat, ref_clat, 5, 0.01, Rand(),
+                                     100));
+  }
+
+  delete graph;
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 50; i++)
+    kaldi::UnitTestDeterminizePrefix();
+  KALDI_LOG << "Tests succeeded.";
+}
@@ -32,7 +32,8 @@ namespace kaldi {
 LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
     const fst::Fst<fst::StdArc> &fst,
     const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(fst), delete_fst_(false), config_(config), num_toks_(0),
+    num_frames_determinized_(0) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -40,7 +41,8 @@ LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
 
 LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(const LatticeFasterDecoderConfig &config,
                                                        fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0),
+    num_frames_determinized_(0) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -57,14 +59,21 @@ void LatticeFasterOnlineDecoder::InitDecoding() {
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
+  token_pool_.ResetHighWaterMark();
+  link_pool_.ResetHighWaterMark();
   warned_ = false;
   num_toks_ = 0;
   decoding_finalized_ = false;
   final_costs_.clear();
+  num_frames_determinized_ = 0;
+  entry_index_.clear();
+  cur_beam_ = config_.beam;
+  avg_frame_time_ = 0.0;
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = new (token_pool_.Allocate())
+      Token(0.0, 0.0, NULL, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -121,6 +130,8 @@ bool LatticeFasterOnlineDecoder::TestGetBestPath(bool use_final_probs) const {
 // Outputs an FST corresponding to the single best path through the lattice.
 bool LatticeFasterOnlineDecoder::GetBestPath(Lattice *olat,
                                              bool use_final_probs) const {
+  if (num_frames_determinized_ > 0)
+    KALDI_ERR << "You cannot call GetBestPath() after DeterminizePrefix()";
   olat->DeleteStates();
   BaseFloat final_graph_cost;
   BestPathIterator iter = BestPathEnd(use_final_probs, &final_graph_cost);
@@ -156,6 +167,9 @@ bool LatticeFasterOnlineDecoder::GetRawLattice(Lattice *ofst,
   if (decoding_finalized_ && !use_final_probs)
     KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
               << "GetRawLattice() with use_final_probs == false";
+  if (num_frames_determinized_ > 0)
+    KALDI_ERR << "You cannot call GetRawLattice() after DeterminizePrefix(); "
+              << "use GetLatticeIncremental()";
 
   unordered_map<Token*, BaseFloat> final_costs_local;
 
@@ -242,6 +256,9 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
   if (decoding_finalized_ && !use_final_probs)
     KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
               << "GetRawLattice() with use_final_probs == false";
+  if (num_frames_determinized_ > 0)
+    KALDI_ERR << "You cannot call GetRawLattice() after DeterminizePrefix(); "
+              << "use GetLatticeIncremental()";
 
   unordered_map<Token*, BaseFloat> final_costs_local;
 
@@ -325,6 +342,229 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
 }
 
 
+bool LatticeFasterOnlineDecoder::GetRawLatticeChunk(
+    int32 end_frame, bool use_final_probs, Lattice *ofst,
+    unordered_map<Token*, int32> *exit_index) const {
+  typedef LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+  const Arc::Label kChunkLabelOffset =
+      LatticeIncrementalDeterminizer::kChunkLabelOffset;
+
+  int32 begin_frame = num_frames_determinized_;
+  bool last_chunk = (end_frame == NumFramesDecoded());
+  KALDI_ASSERT(end_frame > begin_frame && end_frame <= NumFramesDecoded());
+
+  unordered_map<Token*, BaseFloat> final_costs_local;
+  const unordered_map<Token*, BaseFloat> &final_costs =
+      (decoding_finalized_ ? final_costs_ : final_costs_local);
+  if (last_chunk && !decoding_finalized_ && use_final_probs)
+    ComputeFinalCosts(&final_costs_local, NULL, NULL);
+
+  ofst->DeleteStates();
+  if (exit_index != NULL)
+    exit_index->clear();
+  // For all but the first chunk, state zero is a start state with arcs to the
+  // entry states.
+  if (begin_frame > 0)
+    ofst->AddState();
+  unordered_map<Token*, StateId> tok_map;
+  std::vector<Token*> token_list;
+  for (int32 f = begin_frame; f <= end_frame; f++) {
+    if (active_toks_[f].toks == NULL) {
+      KALDI_WARN << "GetRawLatticeChunk: no tokens active on frame " << f
+                 << ": not producing lattice.\n";
+      return false;
+    }
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++)
+      if (token_list[i] != NULL)
+        tok_map[token_list[i]] = ofst->AddState();
+  }
+  ofst->SetStart(0);
+
+  if (begin_frame > 0) {
+    // The entry arcs have the forward cost of the token (relative to the best
+    // one), for pruning.
+    BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity();
+    for (Token *tok = active_toks_[begin_frame].toks; tok != NULL;
+         tok = tok->next)
+      best_cost = std::min(best_cost, tok->tot_cost);
+    for (Token *tok = active_toks_[begin_frame].toks; tok != NULL;
+         tok = tok->next) {
+      unordered_map<Token*, int32>::const_iterator iter =
+          entry_index_.find(tok);
+      if (iter == entry_index_.end())
+        continue;  // It had no exit arc in the previous chunk.
+      ofst->AddArc(0, Arc(0, kChunkLabelOffset + iter->second,
+                          Weight(tok->tot_cost - best_cost, 0.0),
+                          tok_map[tok]));
+    }
+  }
+
+  // The links from tokens on end_frame belong to the next chunk, unless this
+  // is the last one.
+  int32 last_frame_with_links = (last_chunk ? end_frame : end_frame - 1);
+  for (int32 f = begin_frame; f <= last_frame_with_links; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      StateId cur_state = tok_map[tok];
+      for (ForwardLink *l = tok->links; l != NULL; l = l->next) {
+        unordered_map<Token*, StateId>::const_iterator iter =
+            tok_map.find(l->next_tok);
+        KALDI_ASSERT(iter != tok_map.end());
+        BaseFloat cost_offset = 0.0;
+        if (l->ilabel != 0) {  // emitting..
+          KALDI_ASSERT(f >= 0 && f < cost_offsets_.size());
+          cost_offset = cost_offsets_[f];
+        }
+        ofst->AddArc(cur_state,
+                     Arc(l->ilabel, l->olabel,
+                         Weight(l->graph_cost, l->acoustic_cost - cost_offset),
+                         iter->second));
+      }
+    }
+  }
+
+  if (last_chunk) {
+    for (Token *tok = active_toks_[end_frame].toks; tok != NULL;
+         tok = tok->next) {
+      StateId cur_state = tok_map[tok];
+      if (use_final_probs && !final_costs.empty()) {
+        unordered_map<Token*, BaseFloat>::const_iterator iter =
+            final_costs.find(tok);
+        if (iter != final_costs.end())
+          ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
+      } else {
+        ofst->SetFinal(cur_state, LatticeWeight::One());
+      }
+    }
+  } else {
+    // The exit arcs have the backward cost of the token (relative to the best
+    // one), for pruning; tot_cost + extra_cost is the cost of the best path
+    // through the token, plus a constant.
+    KALDI_ASSERT(exit_index != NULL);
+    BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity(),
+        best_cost = infinity;
+    for (Token *tok = active_toks_[end_frame].toks; tok != NULL;
+         tok = tok->next)
+      if (tok->extra_cost != infinity)
+        best_cost = std::min(best_cost, tok->extra_cost - tok->tot_cost);
+    StateId final_state = ofst->AddState();
+    ofst->SetFinal(final_state, LatticeWeight::One());
+    int32 num_exits = 0;
+    for (Token *tok = active_toks_[end_frame].toks; tok != NULL;
+         tok = tok->next) {
+      if (tok->extra_cost == infinity)
+        continue;  // This token will be pruned away.
+      (*exit_index)[tok] = num_exits;
+      ofst->AddArc(tok_map[tok],
+                   Arc(0, kChunkLabelOffset + num_exits,
+                       Weight(tok->extra_cost - tok->tot_cost - best_cost, 0.0),
+                       final_state));
+      num_exits++;
+    }
+  }
+  return true;
+}
+
+bool LatticeFasterOnlineDecoder::DeterminizePrefix(
+    LatticeIncrementalDeterminizer *determinizer) {
+  KALDI_ASSERT(!active_toks_.empty() && !decoding_finalized_ &&
+               "You cannot call DeterminizePrefix() after FinalizeDecoding()");
+  const LatticeIncrementalDeterminizerConfig &config = determinizer->Config();
+  int32 begin_frame = num_frames_determinized_ + config.min_chunk_length,
+      end_frame = std::min(num_frames_determinized_ + config.max_chunk_length,
+                           NumFramesDecoded() - config.determinize_delay);
+  if (end_frame < begin_frame)
+    return false;
+
+  // Make the extra_costs of the tokens we will use as accurate as we can.
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+
+  // Cut at the frame with the fewest tokens (the latest such frame, if there is
+  // a tie).
+  int32 cut_frame = -1;
+  size_t min_num_toks = std::numeric_limits<size_t>::max();
+  for (int32 f = begin_frame; f <= end_frame; f++) {
+    size_t num_toks = 0;
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next)
+      num_toks++;
+    if (num_toks <= min_num_toks) {
+      min_num_toks = num_toks;
+      cut_frame = f;
+    }
+  }
+
+  if (num_frames_determinized_ == 0)
+    determinizer->Init();
+  Lattice raw_chunk;
+  unordered_map<Token*, int32> exit_index;
+  if (!GetRawLatticeChunk(cut_frame, false, &raw_chunk, &exit_index))
+    return false;
+  if (!determinizer->AcceptChunk(&raw_chunk))
+    KALDI_WARN << "Determinization finished earlier than the beam for "
+               << "frames " << num_frames_determinized_ << " to " << cut_frame;
+
+  // The best-path traceback stops at the cut, because the tokens before it
+  // are about to be freed.
+  for (Token *tok = active_toks_[cut_frame].toks; tok != NULL; tok = tok->next)
+    if (tok->backpointer != NULL && exit_index.count(tok->backpointer) == 0)
+      tok->backpointer = NULL;
+  for (int32 f = num_frames_determinized_; f < cut_frame; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; ) {
+      tok->DeleteForwardLinks(&link_pool_);
+      Token *next_tok = tok->next;
+      token_pool_.Delete(tok);
+      num_toks_--;
+      tok = next_tok;
+    }
+    active_toks_[f].toks = NULL;
+  }
+  KALDI_VLOG(3) << "Determinized frames " << num_frames_determinized_
+                << " to " << cut_frame << ", cutting at " << min_num_toks
+                << " tokens; " << num_toks_ << " tokens remain.";
+  num_frames_determinized_ = cut_frame;
+  entry_index_.swap(exit_index);
+  return true;
+}
+
+bool LatticeFasterOnlineDecoder::GetLatticeIncremental(
+    bool use_final_probs,
+    const LatticeIncrementalDeterminizer &determinizer,
+    CompactLattice *clat) const {
+  if (decoding_finalized_ && !use_final_probs)
+    KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
+              << "GetLatticeIncremental() with use_final_probs == false";
+  clat->DeleteStates();
+  Lattice raw_chunk;
+  if (!GetRawLatticeChunk(NumFramesDecoded(), use_final_probs, &raw_chunk,
+                          NULL))
+    return false;
+  // If we never cut the lattice of this utterance, the determinizer may still
+  // have the chunks of an earlier one.
+  bool only_chunk = (num_frames_determinized_ == 0);
+  return determinizer.GetLattice(&raw_chunk, only_chunk, clat);
+}
+
+bool LatticeFasterOnlineDecoder::FinishLatticeIncremental(
+    bool use_final_probs,
+    LatticeIncrementalDeterminizer *determinizer,
+    CompactLattice *clat) const {
+  if (decoding_finalized_ && !use_final_probs)
+    KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
+              << "FinishLatticeIncremental() with use_final_probs == false";
+  clat->DeleteStates();
+  Lattice raw_chunk;
+  if (!GetRawLatticeChunk(NumFramesDecoded(), use_final_probs, &raw_chunk,
+                          NULL)) {
+    determinizer->Init();
+    return false;
+  }
+  bool only_chunk = (num_frames_determinized_ == 0);
+  return determinizer->FinishLattice(&raw_chunk, only_chunk, clat);
+}
+
+
 void LatticeFasterOnlineDecoder::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
@@ -351,7 +591,8 @@ inline LatticeFasterOnlineDecoder::Token *LatticeFasterOnlineDecoder::FindOrAddT
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = new (token_pool_.Allocate())
+        Token(tot_cost, extra_cost, NULL, toks, backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -425,7 +666,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -512,7 +753,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -572,7 +813,7 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -590,7 +831,8 @@ void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
   // one to get the corresponding index for the decodable object.
-  for (int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+  // Tokens before num_frames_determinized_ have been freed.
+  for (int32 f = cur_frame_plus_one - 1; f >= num_frames_determinized_; f--) {
     // Reason why we need to prune forward links in this situation:
     // (1) we have never pruned them (new TokenList)
     // (2) we have not yet pruned the forward links to the next f,
@@ -598,7 +840,8 @@ void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
     if (active_toks_[f].must_prune_forward_links) {
       bool extra_costs_changed = false, links_pruned = false;
       PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
-      if (extra_costs_changed && f > 0) // any token has changed extra_cost
+      if (extra_costs_changed && f > num_frames_determinized_)
+        // any token has changed extra_cost
         active_toks_[f-1].must_prune_forward_links = true;
       if (links_pruned) // any link was pruned
         active_toks_[f].must_prune_tokens = true;
@@ -778,15 +1021,19 @@ void LatticeFasterOnlineDecoder::FinalizeDecoding() {
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
   // sets decoding_finalized_.
   PruneForwardLinksFinal();
-  for (int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = final_frame_plus_one - 1; f >= num_frames_determinized_;
+       f--) {
     bool b1, b2; // values not used.
     BaseFloat dontcare = 0.0; // delta of zero means we must always update
     PruneForwardLinks(f, &b1, &b2, dontcare);
     PruneTokensForFrame(f + 1);
   }
-  PruneTokensForFrame(0);
+  PruneTokensForFrame(num_frames_determinized_);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  KALDI_VLOG(4) << "High-water mark of memory pools was "
+                << token_pool_.HighWaterMark() << " tokens and "
+                << link_pool_.HighWaterMark() << " forward links.";
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
@@ -795,6 +1042,7 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
+  BaseFloat beam = cur_beam_;
   if (config_.max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -805,41 +1053,78 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
       }
     }
     if (tok_count != NULL) *tok_count = count;
-    if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
-    return best_weight + config_.beam;
+    if (adaptive_beam != NULL) *adaptive_beam = beam;
+    return best_weight + beam;
   } else {
-    tmp_array_.clear();
+    // If use_histogram, instead of storing the costs to select the
+    // max_active'th and min_active'th best, we count them in a histogram whose
+    // bins cover the beam below nonemitting_cutoff_; we can't wait until we
+    // know the best cost to do this, as that would need a second pass.
+    bool use_histogram = (config_.num_histogram_bins > 0);
+    int32 num_bins = config_.num_histogram_bins;
+    if (use_histogram) {
+      histogram_.assign(num_bins, 0);
+      histogram_max_cost_.assign(num_bins,
+                                 -std::numeric_limits<BaseFloat>::infinity());
+      histogram_begin_ = nonemitting_cutoff_ - beam;
+      histogram_bin_width_ = beam / num_bins;
+    } else {
+      tmp_array_.clear();
+    }
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = e->val->tot_cost;
-      tmp_array_.push_back(w);
+      if (use_histogram) {
+        BaseFloat x = (w - histogram_begin_) / histogram_bin_width_;
+        int32 bin = (x <= 0.0 ? 0 : (x >= num_bins ? num_bins - 1 :
+                                     static_cast<int32>(x)));
+        histogram_[bin]++;
+        if (w > histogram_max_cost_[bin])
+          histogram_max_cost_[bin] = w;
+      } else {
+        tmp_array_.push_back(w);
+      }
       if (w < best_weight) {
         best_weight = w;
         if (best_elem) *best_elem = e;
       }
     }
     if (tok_count != NULL) *tok_count = count;
-    
-    BaseFloat beam_cutoff = best_weight + config_.beam,
+
+    BaseFloat beam_cutoff = best_weight + beam,
         min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
         max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
 
     KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
-                  << " is " << tmp_array_.size();
-
-    if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
-      std::nth_element(tmp_array_.begin(),
-                       tmp_array_.begin() + config_.max_active,
-                       tmp_array_.end());
-      max_active_cutoff = tmp_array_[config_.max_active];
+                  << " is " << count;
+
+    if (count > static_cast<size_t>(config_.max_active)) {
+      if (use_histogram)
+        max_active_cutoff = GetHistogramCutoff(config_.max_active, false);
+      if (max_active_cutoff == -std::numeric_limits<BaseFloat>::infinity()) {
+        // The first nonempty bin has too many tokens (the costs are more
+        // spread out than usual); we have to store and sort them after all.
+        tmp_array_.clear();
+        for (Elem *e = list_head; e != NULL; e = e->tail)
+          tmp_array_.push_back(e->val->tot_cost);
+        use_histogram = false;
+      }
+      if (!use_histogram) {
+        std::nth_element(tmp_array_.begin(),
+                         tmp_array_.begin() + config_.max_active,
+                         tmp_array_.end());
+        max_active_cutoff = tmp_array_[config_.max_active];
+      }
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
       if (adaptive_beam)
         *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
       return max_active_cutoff;
-    }    
-    if (tmp_array_.size() > static_cast<size_t>(config_.min_active)) {
+    }     
+    if (count > static_cast<size_t>(config_.min_active)) {
       if (config_.min_active == 0) min_active_cutoff = best_weight;
-      else {
+      else if (use_histogram) {
+        min_active_cutoff = GetHistogramCutoff(config_.min_active, true);
+      } else {
         std::nth_element(tmp_array_.begin(),
                          tmp_array_.begin() + config_.min_active,
                          tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
@@ -847,19 +1132,54 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
                          tmp_array_.end());
         min_active_cutoff = tmp_array_[config_.min_active];
       }
-    }
-
+    }    
     if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
       if (adaptive_beam)
         *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
       return min_active_cutoff;
     } else {
-      *adaptive_beam = config_.beam;
+      *adaptive_beam = beam;
       return beam_cutoff;
     }
   }
 }
 
+BaseFloat LatticeFasterOnlineDecoder::GetHistogramCutoff(int32 n,
+                                                         bool upper_edge) const {
+  int32 num_bins = histogram_.size(), count = 0;
+  BaseFloat max_cost = -std::numeric_limits<BaseFloat>::infinity();
+  for (int32 i = 0; i < num_bins; i++) {
+    if (!upper_edge && count + histogram_[i] > n)
+      return max_cost;
+    count += histogram_[i];
+    max_cost = std::max(max_cost, histogram_max_cost_[i]);
+    if (upper_edge && count > n)
+      return max_cost;
+  }
+  return (upper_edge ? std::numeric_limits<BaseFloat>::infinity() :
+          -std::numeric_limits<BaseFloat>::infinity());
+}
+
+void LatticeFasterOnlineDecoder::UpdateBeam(size_t tok_count, double frame_time) {
+  if (config_.target_active <= 0 && config_.max_rtf <= 0.0)
+    return;
+  if (config_.max_rtf > 0.0)
+    avg_frame_time_ = (avg_frame_time_ == 0.0 ? frame_time :
+                       0.9 * avg_frame_time_ + 0.1 * frame_time);
+  BaseFloat log_ratio = std::numeric_limits<BaseFloat>::infinity();
+  if (config_.target_active > 0)
+    log_ratio = Log((config_.target_active + 1.0) / (tok_count + 1.0));
+  if (config_.max_rtf > 0.0 && avg_frame_time_ > 0.0) {
+    // The real-time factor, assuming 100 frames per second.
+    double rtf = avg_frame_time_ * 100.0;
+    log_ratio = std::min(log_ratio,
+                         static_cast<BaseFloat>(Log(config_.max_rtf / rtf)));
+  }
+  if (log_ratio == std::numeric_limits<BaseFloat>::infinity())
+    return;  // Only max_rtf is set, and we have not timed any frames yet.
+  cur_beam_ += config_.beam_adapt_rate * log_ratio;
+  cur_beam_ = std::max(config_.min_beam, std::min(config_.beam, cur_beam_));
+}
 
 BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
     DecodableInterface *decodable) {
@@ -875,6 +1195,8 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
   Elem *best_elem = NULL;
   BaseFloat adaptive_beam;
   size_t tok_cnt;
+  if (config_.max_rtf > 0.0)
+    frame_timer_.Reset();
   BaseFloat cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
   PossiblyResizeHash(tok_cnt);  // This makes sure the hash is always big enough.
 
@@ -940,19 +1262,22 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLink(next_tok, arc.ilabel, arc.olabel,
+                          graph_cost, ac_cost, tok->links);
         }
       } // for all arcs
     }
     e_tail = e->tail;
     toks_.Delete(e); // delete Elem
   }
+  UpdateBeam(tok_cnt, config_.max_rtf > 0.0 ? frame_timer_.Elapsed() : 0.0);
   return next_cutoff;
 }
 
 void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
   KALDI_ASSERT(!active_toks_.empty());
+  nonemitting_cutoff_ = cutoff;
   int32 frame = static_cast<int32>(active_toks_.size()) - 2;
   // Note: "frame" is the time-index we just processed, or -1 if
   // we are processing the nonemitting transitions before the
@@ -986,7 +1311,7 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    tok->DeleteForwardLinks(&link_pool_); // necessary when re-visiting
     tok->links = NULL;
     for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
          !aiter.Done();
@@ -1001,8 +1326,9 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = new (link_pool_.Allocate())
+              ForwardLink(new_tok, 0, arc.olabel,
+                          graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -1027,9 +1353,9 @@ void LatticeFasterOnlineDecoder::ClearActiveTokens() { // a cleanup routine, at
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      tok->DeleteForwardLinks(&link_pool_);
       Token *next_tok = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
       tok = next_tok;
     }
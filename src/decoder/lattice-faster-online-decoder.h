@@ -28,11 +28,14 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/memory-pool.h"
+#include "base/timer.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/determinize-lattice-incremental.h"
 // Use the same configuration class as LatticeFasterDecoder.
 #include "decoder/lattice-faster-decoder.h"
 
@@ -193,6 +196,49 @@ class LatticeFasterOnlineDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// This function is for decoding long recordings without keeping the raw
+  /// lattice of the whole recording in memory.  It cuts the lattice at the
+  /// frame with the fewest active tokens that is between
+  /// determinizer->Config().min_chunk_length and max_chunk_length frames after
+  /// the previous cut (and at least determinize_delay frames before the most
+  /// recently decoded frame), gives the part of the lattice before the cut to
+  /// "determinizer", and frees the tokens before the cut.  Call it from time to
+  /// time while decoding, e.g. after each call to AdvanceDecoding(); it returns
+  /// true if it cut the lattice.  Once it has done so, you cannot call
+  /// GetRawLattice(), GetRawLatticePruned() or GetBestPath() for this
+  /// utterance: get the lattice with GetLatticeIncremental() instead.
+  /// BestPathEnd() and TraceBackBestPath() can still be used, but the
+  /// traceback stops at the cut.
+  bool DeterminizePrefix(LatticeIncrementalDeterminizer *determinizer);
+
+  /// Outputs the determinized lattice for the whole utterance: it determinizes
+  /// the part of the raw lattice after the last cut made by
+  /// DeterminizePrefix() with "determinizer" (which must be the one given to
+  /// DeterminizePrefix(), if it was called for this utterance) and appends it
+  /// to the part that was determinized already.  The output is not
+  /// deterministic where the pieces were joined unless the determinizer was
+  /// configured with determinize_final (see determinize-lattice-incremental.h).
+  /// It does not change the decoder, so it can be called for partial results,
+  /// but it copies the part that was determinized already; at the end of the
+  /// utterance, use FinishLatticeIncremental() instead.  "use_final_probs" is
+  /// as for GetRawLattice().  Returns true if the output is nonempty.
+  bool GetLatticeIncremental(bool use_final_probs,
+                             const LatticeIncrementalDeterminizer &determinizer,
+                             CompactLattice *clat) const;
+
+  /// As GetLatticeIncremental(), but hands the part of the lattice that was
+  /// determinized already over from "determinizer" to "clat" without copying
+  /// it (see LatticeIncrementalDeterminizer::FinishLattice()), so you cannot
+  /// call DeterminizePrefix() or GetLatticeIncremental() again for this
+  /// utterance.
+  bool FinishLatticeIncremental(bool use_final_probs,
+                                LatticeIncrementalDeterminizer *determinizer,
+                                CompactLattice *clat) const;
+
+  /// Returns the frame (plus one) of the last cut made by DeterminizePrefix(),
+  /// or zero if it has not cut the lattice of this utterance.
+  int32 NumFramesDeterminized() const { return num_frames_determinized_; }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -240,11 +286,11 @@ class LatticeFasterOnlineDecoder {
                  Token *next, Token *backpointer):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
         backpointer(backpointer) { }
-    inline void DeleteForwardLinks() {
+    inline void DeleteForwardLinks(MemoryPool<ForwardLink> *link_pool) {
       ForwardLink *l = links, *m;
       while (l != NULL) {
         m = l->next;
-        delete l;
+        link_pool->Delete(l);
         l = m;
       }
       links = NULL;
@@ -334,7 +380,15 @@ class LatticeFasterOnlineDecoder {
   /// Gets the weight cutoff.  Also counts the active tokens.
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
-  
+
+  /// Used by GetCutoff() if config_.num_histogram_bins > 0; see
+  /// LatticeFasterDecoder::GetHistogramCutoff().
+  BaseFloat GetHistogramCutoff(int32 n, bool upper_edge) const;
+
+  /// Changes cur_beam_ as described for LatticeFasterDecoderConfig::
+  /// target_active; see LatticeFasterDecoder::UpdateBeam().
+  void UpdateBeam(size_t tok_count, double frame_time);
+
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to cur_toks_.
   /// Returns the cost cutoff for subsequent ProcessNonemitting() to use.
   BaseFloat ProcessEmitting(DecodableInterface *decodable);
@@ -356,9 +410,22 @@ class LatticeFasterOnlineDecoder {
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new/delete, for speed; see util/memory-pool.h.
+  MemoryPool<Token> token_pool_;
+  MemoryPool<ForwardLink> link_pool_;
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
   // make it class member to avoid internal new/delete.
+  // The following are as in LatticeFasterDecoder.
+  std::vector<int32> histogram_;  // used in GetCutoff.
+  std::vector<BaseFloat> histogram_max_cost_;
+  BaseFloat histogram_begin_;
+  BaseFloat histogram_bin_width_;
+  BaseFloat nonemitting_cutoff_;
+  BaseFloat cur_beam_;
+  double avg_frame_time_;
+  Timer frame_timer_;
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
@@ -406,6 +473,21 @@ class LatticeFasterOnlineDecoder {
 
   void ClearActiveTokens();
 
+  // Outputs the raw lattice for the frames from num_frames_determinized_ to
+  // end_frame (frame indexes plus one), in the format that
+  // LatticeIncrementalDeterminizer expects.  If end_frame is the last frame
+  // decoded, this is the last chunk, with final-probs as in GetRawLattice();
+  // otherwise the tokens on end_frame are given exit arcs, and their indexes
+  // are output to "exit_index".  Returns false on error.
+  bool GetRawLatticeChunk(int32 end_frame, bool use_final_probs, Lattice *ofst,
+                          unordered_map<Token*, int32> *exit_index) const;
+
+  // The frame index (plus one) of the last cut made by DeterminizePrefix().
+  // The tokens on earlier frames have been freed; the tokens on this frame
+  // are the entries of the next chunk, and entry_index_ gives their indexes.
+  int32 num_frames_determinized_;
+  unordered_map<Token*, int32> entry_index_;
+
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineDecoder);
 };
@@ -24,6 +24,7 @@
 
 
 #include "util/stl-utils.h"
+#include "util/memory-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -199,11 +200,11 @@ class LatticeSimpleDecoder {
           Token *next): tot_cost(tot_cost), extra_cost(extra_cost), links(links),
                         next(next) { }
     Token() {}
-    void DeleteForwardLinks() {
+    void DeleteForwardLinks(MemoryPool<ForwardLink> *link_pool) {
       ForwardLink *l = links, *m; 
       while (l != NULL) {
         m = l->next;
-        delete l;
+        link_pool->Delete(l);
         l = m;
       }
       links = NULL;
@@ -290,6 +291,10 @@ class LatticeSimpleDecoder {
   unordered_map<StateId, Token*> prev_toks_;
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame_plus_one
+  // Tokens and ForwardLinks are allocated from these pools rather than with
+  // new/delete, for speed; see util/memory-pool.h.
+  MemoryPool<Token> token_pool_;
+  MemoryPool<ForwardLink> link_pool_;
   const fst::Fst<fst::StdArc> &fst_;
   LatticeSimpleDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
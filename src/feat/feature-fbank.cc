@@ -123,61 +123,67 @@ void Fbank::ComputeInternal(const VectorBase<BaseFloat> &wave,
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
 
   // Buffers
-  Vector<BaseFloat> window;  // windowed waveform.
-  Vector<BaseFloat> mel_energies;
-  std::vector<BaseFloat> temp_buffer;  // used by srfft.  
-  BaseFloat log_energy;
-
-  // Compute all the freames, r is frame index..
-  for (int32 r = 0; r < rows_out; r++) {
-    // Cut the window, apply window function
-    ExtractWindow(wave, r, opts_.frame_opts, feature_window_function_, &window,
-                  (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
+  Matrix<BaseFloat> windows;  // windowed waveforms, then power spectra.
+  Vector<BaseFloat> log_energy;
+
+  // Compute the frames in blocks of up to kFeatureBlockSize.
+  for (int32 first_frame = 0; first_frame < rows_out;
+       first_frame += kFeatureBlockSize) {
+    int32 num_frames = std::min(kFeatureBlockSize, rows_out - first_frame);
+    if (windows.NumRows() != num_frames) {
+      windows.Resize(num_frames, opts_.frame_opts.PaddedWindowSize(),
+                     kUndefined);
+      log_energy.Resize(num_frames, kUndefined);
+    }
+    // Cut the windows, apply window function
+    ExtractWindows(wave, first_frame, opts_.frame_opts,
+                   feature_window_function_, &windows,
+                   (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
 
     // Compute energy after window function (not the raw one)
-    if (opts_.use_energy && !opts_.raw_energy)
-      log_energy = log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
-
-    if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-      srfft_->Compute(window.Data(), true, &temp_buffer);
-    else  // An alternative algorithm that works for non-powers-of-two.
-      RealFft(&window, true);
+    if (opts_.use_energy && !opts_.raw_energy) {
+      log_energy.AddDiagMat2(1.0, windows, kNoTrans, 0.0);
+      log_energy.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+      log_energy.ApplyLog();
+    }
 
-    // Convert the FFT into a power spectrum.
-    ComputePowerSpectrum(&window);
-    SubVector<BaseFloat> power_spectrum(window, 0, window.Dim()/2 + 1);
+    // Convert the windows into power spectra.
+    ComputePowerSpectra(srfft_, &windows);
 
-    // Sum with MelFiterbank over power spectrum
-    mel_banks.Compute(power_spectrum, &mel_energies);
+    // Output buffers
+    SubMatrix<BaseFloat> these_outputs(*output, first_frame, num_frames,
+                                       0, cols_out);
+    SubMatrix<BaseFloat> these_fbanks(these_outputs, 0, num_frames,
+                                      (opts_.use_energy? 1 : 0),
+                                      opts_.mel_opts.num_bins);
+
+    // Sum with MelFiterbank over power spectra, directly into the output.
+    mel_banks.Compute(windows, &these_fbanks);
     if (opts_.use_log_fbank) {
       // avoid log of zero (which should be prevented anyway by dithering).
-      mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::min());
-      mel_energies.ApplyLog();  // take the log.
+      these_fbanks.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+      these_fbanks.ApplyLog();  // take the log.
     }
 
-    // Output buffers
-    SubVector<BaseFloat> this_output(output->Row(r));
-    SubVector<BaseFloat> this_fbank(this_output.Range((opts_.use_energy? 1 : 0),
-                                                      opts_.mel_opts.num_bins));
-
-    // Copy to output
-    this_fbank.CopyFromVec(mel_energies);
-    // Copy energy as first value
-    if (opts_.use_energy) {
-      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_) {
-        log_energy = log_energy_floor_;
+    if (!opts_.use_energy)
+      continue;
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> this_output(these_outputs, r);
+      // Copy energy as first value
+      BaseFloat this_log_energy = log_energy(r);
+      if (opts_.energy_floor > 0.0 && this_log_energy < log_energy_floor_) {
+        this_log_energy = log_energy_floor_;
       }
-      this_output(0) = log_energy;
-    }
-
-    // HTK compat: Shift features, so energy is last value
-    if (opts_.htk_compat && opts_.use_energy) {
-      BaseFloat energy = this_output(0);
-      for (int32 i = 0; i < opts_.mel_opts.num_bins; i++) {
-        this_output(i) = this_output(i+1);
+      this_output(0) = this_log_energy;
+
+      // HTK compat: Shift features, so energy is last value
+      if (opts_.htk_compat) {
+        BaseFloat energy = this_output(0);
+        for (int32 i = 0; i < opts_.mel_opts.num_bins; i++) {
+          this_output(i) = this_output(i+1);
+        }
+        this_output(opts_.mel_opts.num_bins) = energy;
       }
-      this_output(opts_.mel_opts.num_bins) = energy;
     }
   }
 }
@@ -92,6 +92,64 @@ void UnitTestOnlineCmvn() {
   }
 }
 
+// Checks that ExtractWindows(), ComputePowerSpectra() and the matrix version
+// of MelBanks::Compute() give the same results as doing it frame by frame.
+void UnitTestExtractWindows() {
+  for (int32 i = 0; i < 20; i++) {
+    FrameExtractionOptions opts;
+    opts.dither = 0.0;
+    opts.snip_edges = (i % 2 == 0);
+    opts.round_to_power_of_two = (i % 4 < 2);
+    opts.remove_dc_offset = (Rand() % 2 == 0);
+    MelBanksOptions mel_opts;
+    mel_opts.htk_mode = (i % 3 == 0);
+    int32 wave_dim = 1000 + Rand() % 5000;
+    Vector<BaseFloat> wave(wave_dim);
+    wave.SetRandn();
+    wave.Scale(100.0);
+    int32 num_frames = NumFrames(wave_dim, opts),
+        padded_window_size = opts.PaddedWindowSize();
+    KALDI_ASSERT(num_frames > 0);
+    FeatureWindowFunction window_function(opts);
+    MelBanks mel_banks(mel_opts, opts, 1.0);
+    SplitRadixRealFft<BaseFloat> *srfft = NULL;
+    if (opts.round_to_power_of_two)
+      srfft = new SplitRadixRealFft<BaseFloat>(padded_window_size);
+
+    int32 first_frame = Rand() % num_frames,
+        this_num_frames = 1 + Rand() % (num_frames - first_frame);
+    Matrix<BaseFloat> windows(this_num_frames, padded_window_size),
+        mel_energies(this_num_frames, mel_banks.NumBins());
+    Vector<BaseFloat> log_energy(this_num_frames);
+    ExtractWindows(wave, first_frame, opts, window_function, &windows,
+                   &log_energy);
+    for (int32 r = 0; r < this_num_frames; r++) {
+      Vector<BaseFloat> window;
+      BaseFloat this_log_energy;
+      ExtractWindow(wave, first_frame + r, opts, window_function, &window,
+                    &this_log_energy);
+      AssertEqual(this_log_energy, log_energy(r));
+      KALDI_ASSERT(window.ApproxEqual(windows.Row(r), 1.0e-05));
+    }
+
+    ComputePowerSpectra(srfft, &windows);
+    mel_banks.Compute(windows, &mel_energies);
+    for (int32 r = 0; r < this_num_frames; r++) {
+      Vector<BaseFloat> window;
+      ExtractWindow(wave, first_frame + r, opts, window_function, &window);
+      if (srfft != NULL) srfft->Compute(window.Data(), true);
+      else RealFft(&window, true);
+      ComputePowerSpectrum(&window);
+      SubVector<BaseFloat> power_spectrum(window, 0, window.Dim() / 2 + 1);
+      KALDI_ASSERT(power_spectrum.ApproxEqual(
+          windows.Row(r).Range(0, window.Dim() / 2 + 1), 1.0e-04));
+      Vector<BaseFloat> this_mel_energies;
+      mel_banks.Compute(power_spectrum, &this_mel_energies);
+      KALDI_ASSERT(this_mel_energies.ApproxEqual(mel_energies.Row(r), 1.0e-04));
+    }
+    delete srfft;
+  }
+}
 
 }
 
@@ -101,6 +159,7 @@ int main() {
   using namespace kaldi;
   try {
     UnitTestOnlineCmvn();
+    UnitTestExtractWindows();
     std::cout << "Tests succeeded.\n";
     return 0;
   } catch (const std::exception &e) {
@@ -88,22 +88,19 @@ FeatureWindowFunction::FeatureWindowFunction(const FrameExtractionOptions &opts)
 // padded size.  It does mean subtraction, pre-emphasis and dithering as
 // requested.
 
-void ExtractWindow(const VectorBase<BaseFloat> &wave,
-                   int32 f,  // with 0 <= f < NumFrames(feats, opts)
-                   const FrameExtractionOptions &opts,
-                   const FeatureWindowFunction &window_function,
-                   Vector<BaseFloat> *window,
-                   BaseFloat *log_energy_pre_window) {
+// Copies the samples of frame f of "wave" to "window_part", which must have
+// dimension opts.WindowSize().  This is the first part of ExtractWindow().
+static void ExtractFrameSamples(const VectorBase<BaseFloat> &wave,
+                                int32 f,
+                                const FrameExtractionOptions &opts,
+                                VectorBase<BaseFloat> *window_part) {
   int32 frame_shift = opts.WindowShift();
   int32 frame_length = opts.WindowSize();
-  KALDI_ASSERT(window_function.window.Dim() == frame_length);
-  KALDI_ASSERT(frame_shift != 0 && frame_length != 0);
-
-  Vector<BaseFloat> wave_part(frame_length);
+  KALDI_ASSERT(window_part->Dim() == frame_length);
   if (opts.snip_edges) {
     int32 start = frame_shift*f, end = start + frame_length;
     KALDI_ASSERT(start >= 0 && end <= wave.Dim());
-    wave_part.CopyFromVec(wave.Range(start, frame_length));
+    window_part->CopyFromVec(wave.Range(start, frame_length));
   } else {
     // If opts.snip_edges = false, we allow the frames to go slightly over the
     // edges of the file; we'll extend the data by reflection.
@@ -115,7 +112,7 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
         length_limited = end_limited - begin_limited;
 
     // Copy the main part.  Usually this will be the entire window.
-    wave_part.Range(begin_limited - begin, length_limited).
+    window_part->Range(begin_limited - begin, length_limited).
         CopyFromVec(wave.Range(begin_limited, length_limited));
     
     // Deal with any end effects by reflection, if needed.  This code will
@@ -125,7 +122,7 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
       // The next statement will only have an effect in the case of files
       // shorter than a single frame, it's to avoid a crash in those cases.
       reflected_f = reflected_f % wave.Dim(); 
-      wave_part(f - begin) = wave(reflected_f);
+      (*window_part)(f - begin) = wave(reflected_f);
     }
     for (int32 f = wave.Dim(); f < end; f++) {
       int32 distance_to_end = f - wave.Dim();
@@ -133,31 +130,52 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
       // shorter than a single frame, it's to avoid a crash in those cases.
       distance_to_end = distance_to_end % wave.Dim();
       int32 reflected_f = wave.Dim() - 1 - distance_to_end;
-      wave_part(f - begin) = wave(reflected_f);
+      (*window_part)(f - begin) = wave(reflected_f);
     }
   }
-  KALDI_ASSERT(window != NULL);
-  int32 frame_length_padded = opts.PaddedWindowSize();
-
-  if (window->Dim() != frame_length_padded)
-    window->Resize(frame_length_padded);
-
-  SubVector<BaseFloat> window_part(*window, 0, frame_length);
-  window_part.CopyFromVec(wave_part);
+}
 
-  if (opts.dither != 0.0) Dither(&window_part, opts.dither);
+// Does the dithering, DC removal and preemphasis of ExtractWindow() on the
+// unpadded part of the window, and computes the energy before preemphasis if
+// log_energy_pre_window != NULL.  It does not apply the window function.
+static void ProcessFrameSamples(const FrameExtractionOptions &opts,
+                                VectorBase<BaseFloat> *window_part,
+                                BaseFloat *log_energy_pre_window) {
+  int32 frame_length = window_part->Dim();
+  if (opts.dither != 0.0) Dither(window_part, opts.dither);
 
   if (opts.remove_dc_offset)
-    window_part.Add(-window_part.Sum() / frame_length);
+    window_part->Add(-window_part->Sum() / frame_length);
 
   if (log_energy_pre_window != NULL) {
-    BaseFloat energy = std::max(VecVec(window_part, window_part),
+    BaseFloat energy = std::max(VecVec(*window_part, *window_part),
                                 std::numeric_limits<BaseFloat>::min());
     *log_energy_pre_window = log(energy);
   }
 
   if (opts.preemph_coeff != 0.0)
-    Preemphasize(&window_part, opts.preemph_coeff);
+    Preemphasize(window_part, opts.preemph_coeff);
+}
+
+void ExtractWindow(const VectorBase<BaseFloat> &wave,
+                   int32 f,  // with 0 <= f < NumFrames(feats, opts)
+                   const FrameExtractionOptions &opts,
+                   const FeatureWindowFunction &window_function,
+                   Vector<BaseFloat> *window,
+                   BaseFloat *log_energy_pre_window) {
+  int32 frame_shift = opts.WindowShift();
+  int32 frame_length = opts.WindowSize();
+  KALDI_ASSERT(window_function.window.Dim() == frame_length);
+  KALDI_ASSERT(frame_shift != 0 && frame_length != 0);
+  KALDI_ASSERT(window != NULL);
+  int32 frame_length_padded = opts.PaddedWindowSize();
+
+  if (window->Dim() != frame_length_padded)
+    window->Resize(frame_length_padded);
+
+  SubVector<BaseFloat> window_part(*window, 0, frame_length);
+  ExtractFrameSamples(wave, f, opts, &window_part);
+  ProcessFrameSamples(opts, &window_part, log_energy_pre_window);
 
   window_part.MulElements(window_function.window);
 
@@ -166,6 +184,52 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
                          frame_length_padded-frame_length).SetZero();
 }
 
+void ExtractWindows(const VectorBase<BaseFloat> &wave,
+                    int32 first_frame,
+                    const FrameExtractionOptions &opts,
+                    const FeatureWindowFunction &window_function,
+                    MatrixBase<BaseFloat> *windows,
+                    VectorBase<BaseFloat> *log_energy_pre_window) {
+  int32 frame_shift = opts.WindowShift();
+  int32 frame_length = opts.WindowSize(),
+      frame_length_padded = opts.PaddedWindowSize(),
+      num_frames = windows->NumRows();
+  KALDI_ASSERT(window_function.window.Dim() == frame_length);
+  KALDI_ASSERT(frame_shift != 0 && frame_length != 0);
+  KALDI_ASSERT(windows->NumCols() == frame_length_padded);
+  KALDI_ASSERT(log_energy_pre_window == NULL ||
+               log_energy_pre_window->Dim() == num_frames);
+
+  // The frames are processed in order, so that the dithering gives the same
+  // result as calling ExtractWindow() for each frame.
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> window_part(windows->Row(r), 0, frame_length);
+    ExtractFrameSamples(wave, first_frame + r, opts, &window_part);
+    ProcessFrameSamples(opts, &window_part,
+                        (log_energy_pre_window != NULL ?
+                         &((*log_energy_pre_window)(r)) : NULL));
+  }
+  SubMatrix<BaseFloat>(*windows, 0, num_frames, 0, frame_length).
+      MulColsVec(window_function.window);
+
+  if (frame_length != frame_length_padded)
+    SubMatrix<BaseFloat>(*windows, 0, num_frames, frame_length,
+                         frame_length_padded - frame_length).SetZero();
+}
+
+void ComputePowerSpectra(const SplitRadixRealFft<BaseFloat> *srfft,
+                         MatrixBase<BaseFloat> *windows) {
+  std::vector<BaseFloat> temp_buffer;  // used by srfft.
+  for (int32 r = 0; r < windows->NumRows(); r++) {
+    SubVector<BaseFloat> window(*windows, r);
+    if (srfft != NULL)  // Compute FFT using the split-radix algorithm.
+      srfft->Compute(window.Data(), true, &temp_buffer);
+    else  // An alternative algorithm that works for non-powers-of-two.
+      RealFft(&window, true);
+    ComputePowerSpectrum(&window);
+  }
+}
+
 void ExtractWaveformRemainder(const VectorBase<BaseFloat> &wave,
                               const FrameExtractionOptions &opts,
                               Vector<BaseFloat> *wave_remainder) {
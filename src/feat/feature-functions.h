@@ -153,6 +153,29 @@ void ExtractWindow(const VectorBase<BaseFloat> &wave,
                    Vector<BaseFloat> *window,
                    BaseFloat *log_energy_pre_window = NULL);
 
+// The number of frames that the feature-computation classes process together
+// (extracting their windows with ExtractWindows(), then doing the FFTs, the
+// mel filterbanks and the DCT for the whole block).  It is small enough that
+// the block stays in cache, and big enough for the matrix multiplications
+// to be efficient.
+const int32 kFeatureBlockSize = 128;
+
+// ExtractWindows does, for the frames first_frame ... first_frame +
+// windows->NumRows() - 1, what ExtractWindow() does for a single frame, and
+// puts the windowed frames in the rows of "windows", which must have
+// opts.PaddedWindowSize() columns.  If log_energy_pre_window != NULL it must
+// have dimension windows->NumRows(), and it gets the log-energies before
+// preemphasis and windowing.  This is faster than calling ExtractWindow()
+// for each frame, as it allocates no memory and applies the window function
+// to all the frames at once.  The Mfcc, Fbank and Plp classes call it for
+// blocks of kFeatureBlockSize frames.
+void ExtractWindows(const VectorBase<BaseFloat> &wave,
+                    int32 first_frame,
+                    const FrameExtractionOptions &opts,
+                    const FeatureWindowFunction &window_function,
+                    MatrixBase<BaseFloat> *windows,
+                    VectorBase<BaseFloat> *log_energy_pre_window = NULL);
+
 // ExtractWaveformRemainder is useful if the waveform is coming in segments.
 // It extracts the bit of the waveform at the end of this block that you
 // would have to append the next bit of waveform to, if you wanted to have
@@ -172,6 +195,14 @@ void ExtractWaveformRemainder(const VectorBase<BaseFloat> &wave,
 // remaining (n/2) - 1 elements are undefined at output.
 void ComputePowerSpectrum(VectorBase<BaseFloat> *complex_fft);
 
+// ComputePowerSpectra does the FFT of each row of "windows" (using "srfft",
+// which must have been constructed with dimension windows->NumCols(), or
+// RealFft() if srfft is NULL) and then converts it into a power spectrum with
+// ComputePowerSpectrum(), in place.  At output, the first
+// windows->NumCols()/2 + 1 columns contain the energies of the fft bins.
+void ComputePowerSpectra(const SplitRadixRealFft<BaseFloat> *srfft,
+                         MatrixBase<BaseFloat> *windows);
+
 
 
 inline void MaxNormalizeEnergy(Matrix<BaseFloat> *feats) {
@@ -129,56 +129,68 @@ void Mfcc::ComputeInternal(const VectorBase<BaseFloat> &wave,
   output->Resize(rows_out, cols_out);
   if (wave_remainder != NULL)
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
-  Vector<BaseFloat> window;  // windowed waveform.
-  Vector<BaseFloat> mel_energies;
-  std::vector<BaseFloat> temp_buffer;  // used by srfft.
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index..
-    BaseFloat log_energy;
-    ExtractWindow(wave, r, opts_.frame_opts, feature_window_function_, &window,
-                  (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
-
-    if (opts_.use_energy && !opts_.raw_energy)
-      log_energy = log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
-
-    if (srfft_ != NULL)  // Compute FFT using the split-radix algorithm.
-      srfft_->Compute(window.Data(), true, &temp_buffer);
-    else  // An alternative algorithm that works for non-powers-of-two.
-      RealFft(&window, true);
+  int32 num_bins = mel_banks.NumBins();
+  Matrix<BaseFloat> windows;  // windowed waveforms, then power spectra.
+  Matrix<BaseFloat> mel_energies;
+  Vector<BaseFloat> log_energy;
+  // The frames are processed in blocks of up to kFeatureBlockSize.
+  for (int32 first_frame = 0; first_frame < rows_out;
+       first_frame += kFeatureBlockSize) {
+    int32 num_frames = std::min(kFeatureBlockSize, rows_out - first_frame);
+    if (windows.NumRows() != num_frames) {
+      windows.Resize(num_frames, opts_.frame_opts.PaddedWindowSize(),
+                     kUndefined);
+      mel_energies.Resize(num_frames, num_bins, kUndefined);
+      log_energy.Resize(num_frames, kUndefined);
+    }
+    ExtractWindows(wave, first_frame, opts_.frame_opts,
+                   feature_window_function_, &windows,
+                   (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
+
+    if (opts_.use_energy && !opts_.raw_energy) {
+      log_energy.AddDiagMat2(1.0, windows, kNoTrans, 0.0);
+      log_energy.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+      log_energy.ApplyLog();
+    }
 
-    // Convert the FFT into a power spectrum.
-    ComputePowerSpectrum(&window);
-    SubVector<BaseFloat> power_spectrum(window, 0, window.Dim()/2 + 1);
+    // Convert the windows into power spectra.
+    ComputePowerSpectra(srfft_, &windows);
 
-    mel_banks.Compute(power_spectrum, &mel_energies);
+    mel_banks.Compute(windows, &mel_energies);
 
     // avoid log of zero (which should be prevented anyway by dithering).
     mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::min());
     mel_energies.ApplyLog();  // take the log.
 
-    SubVector<BaseFloat> this_mfcc(output->Row(r));
+    SubMatrix<BaseFloat> these_mfccs(*output, first_frame, num_frames,
+                                     0, cols_out);
 
-    // this_mfcc = dct_matrix_ * mel_energies [which now have log]
-    this_mfcc.AddMatVec(1.0, dct_matrix_, kNoTrans, mel_energies, 0.0);
+    // these_mfccs = mel_energies [which now have log] * dct_matrix_^T
+    these_mfccs.AddMatMat(1.0, mel_energies, kNoTrans, dct_matrix_, kTrans,
+                          0.0);
 
     if (opts_.cepstral_lifter != 0.0)
-      this_mfcc.MulElements(lifter_coeffs_);
-
-    if (opts_.use_energy) {
-      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
-        log_energy = log_energy_floor_;
-      this_mfcc(0) = log_energy;
-    }
-
-    if (opts_.htk_compat) {
-      BaseFloat energy = this_mfcc(0);
-      for (int32 i = 0; i < opts_.num_ceps-1; i++)
-        this_mfcc(i) = this_mfcc(i+1);
-      if (!opts_.use_energy)
-        energy *= M_SQRT2;  // scale on C0 (actually removing scale
-      // we previously added that's part of one common definition of
-      // cosine transform.)
-      this_mfcc(opts_.num_ceps-1)  = energy;
+      these_mfccs.MulColsVec(lifter_coeffs_);
+
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> this_mfcc(these_mfccs, r);
+      if (opts_.use_energy) {
+        BaseFloat this_log_energy = log_energy(r);
+        if (opts_.energy_floor > 0.0 && this_log_energy < log_energy_floor_)
+          this_log_energy = log_energy_floor_;
+        this_mfcc(0) = this_log_energy;
+      }
+
+      if (opts_.htk_compat) {
+        BaseFloat energy = this_mfcc(0);
+        for (int32 i = 0; i < opts_.num_ceps-1; i++)
+          this_mfcc(i) = this_mfcc(i+1);
+        if (!opts_.use_energy)
+          energy *= M_SQRT2;  // scale on C0 (actually removing scale
+        // we previously added that's part of one common definition of
+        // cosine transform.)
+        this_mfcc(opts_.num_ceps-1)  = energy;
+      }
     }
   }
 }
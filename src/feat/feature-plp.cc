@@ -174,93 +174,100 @@ void Plp::ComputeInternal(const VectorBase<BaseFloat> &wave,
   output->Resize(rows_out, cols_out);
   if (wave_remainder != NULL)
     ExtractWaveformRemainder(wave, opts_.frame_opts, wave_remainder);
-  Vector<BaseFloat> window;  // windowed waveform.
   int32 num_mel_bins = opts_.mel_opts.num_bins;
-  Vector<BaseFloat> mel_energies(num_mel_bins);
-  Vector<BaseFloat> mel_energies_duplicated(num_mel_bins+2);
-  Vector<BaseFloat> autocorr_coeffs(opts_.lpc_order+1);
+  Matrix<BaseFloat> windows;  // windowed waveforms, then power spectra.
+  Matrix<BaseFloat> mel_energies_duplicated;
+  Matrix<BaseFloat> autocorr_coeffs;
+  Vector<BaseFloat> log_energy;
   Vector<BaseFloat> lpc_coeffs(opts_.lpc_order);
   Vector<BaseFloat> raw_cepstrum(opts_.lpc_order);  // not including C0,
   // and size may differ from final size.
-  Vector<BaseFloat> final_cepstrum(opts_.num_ceps);
-  std::vector<BaseFloat> temp_buffer;  // used by srfft.
-  
-  KALDI_ASSERT(opts_.num_ceps <= opts_.lpc_order+1);  // our num-ceps includes C0.
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index..
-    BaseFloat log_energy;
-    ExtractWindow(wave, r, opts_.frame_opts,
-                  feature_window_function_, &window,
-                  (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
-
-    if (opts_.use_energy && !opts_.raw_energy)
-      log_energy = log(std::max(VecVec(window, window),
-                                std::numeric_limits<BaseFloat>::min()));
 
-    if (srfft_ != NULL)  // Compute FFT using split-radix algorithm.
-      srfft_->Compute(window.Data(), true, &temp_buffer);
-    else  // An alternative algorithm that works for non-powers-of-two.
-      RealFft(&window, true);
+  KALDI_ASSERT(opts_.num_ceps <= opts_.lpc_order+1);  // our num-ceps includes C0.
+  // The frames are processed in blocks of up to kFeatureBlockSize; the LPC
+  // analysis is done frame by frame.
+  for (int32 first_frame = 0; first_frame < rows_out;
+       first_frame += kFeatureBlockSize) {
+    int32 num_frames = std::min(kFeatureBlockSize, rows_out - first_frame);
+    if (windows.NumRows() != num_frames) {
+      windows.Resize(num_frames, opts_.frame_opts.PaddedWindowSize(),
+                     kUndefined);
+      mel_energies_duplicated.Resize(num_frames, num_mel_bins + 2, kUndefined);
+      autocorr_coeffs.Resize(num_frames, opts_.lpc_order + 1, kUndefined);
+      log_energy.Resize(num_frames, kUndefined);
+    }
+    ExtractWindows(wave, first_frame, opts_.frame_opts,
+                   feature_window_function_, &windows,
+                   (opts_.use_energy && opts_.raw_energy ? &log_energy : NULL));
+
+    if (opts_.use_energy && !opts_.raw_energy) {
+      log_energy.AddDiagMat2(1.0, windows, kNoTrans, 0.0);
+      log_energy.ApplyFloor(std::numeric_limits<BaseFloat>::min());
+      log_energy.ApplyLog();
+    }
 
-    // Convert the FFT into a power spectrum.
-    ComputePowerSpectrum(&window);  // elements 0 ... window.Dim()/2
+    // Convert the windows into power spectra.
+    ComputePowerSpectra(srfft_, &windows);
 
-    SubVector<BaseFloat> power_spectrum(window, 0, window.Dim()/2 + 1);
+    SubMatrix<BaseFloat> mel_energies(mel_energies_duplicated, 0, num_frames,
+                                      1, num_mel_bins);
+    mel_banks.Compute(windows, &mel_energies);
 
-    mel_banks.Compute(power_spectrum, &mel_energies);
+    mel_energies.MulColsVec(equal_loudness);
 
-    mel_energies.MulElements(equal_loudness);
-    
     mel_energies.ApplyPow(opts_.compress_factor);
-    
-    // duplicate first and last elements.
-    {
-      SubVector<BaseFloat> v(mel_energies_duplicated, 1, num_mel_bins);
-      v.CopyFromVec(mel_energies);
-    }
-    mel_energies_duplicated(0) = mel_energies(0);
-    mel_energies_duplicated(num_mel_bins+1) = mel_energies(num_mel_bins-1);
-
-    autocorr_coeffs.AddMatVec(1.0, idft_bases_, kNoTrans,
-                              mel_energies_duplicated,  0.0);
-    
-    BaseFloat energy = ComputeLpc(autocorr_coeffs, &lpc_coeffs);
-
-    energy = std::max(energy,
-                      std::numeric_limits<BaseFloat>::min());
-    
-    Lpc2Cepstrum(opts_.lpc_order, lpc_coeffs.Data(), raw_cepstrum.Data());
-    {
-      SubVector<BaseFloat> dst(final_cepstrum, 1, opts_.num_ceps-1);
-      SubVector<BaseFloat> src(raw_cepstrum, 0, opts_.num_ceps-1);
-      dst.CopyFromVec(src);
-      final_cepstrum(0) = energy;
-    }
-
-    if (opts_.cepstral_lifter != 0.0)
-      final_cepstrum.MulElements(lifter_coeffs_);
 
-    if (opts_.cepstral_scale != 1.0)
-      final_cepstrum.Scale(opts_.cepstral_scale);
-
-    if (opts_.use_energy) {
-      if (opts_.energy_floor > 0.0 && log_energy < log_energy_floor_)
-        log_energy = log_energy_floor_;
-      final_cepstrum(0) = log_energy;
+    // duplicate first and last elements.
+    for (int32 r = 0; r < num_frames; r++) {
+      mel_energies_duplicated(r, 0) = mel_energies_duplicated(r, 1);
+      mel_energies_duplicated(r, num_mel_bins + 1) =
+          mel_energies_duplicated(r, num_mel_bins);
     }
 
-    if (opts_.htk_compat) {
-      BaseFloat energy = final_cepstrum(0);
-      for (int32 i = 0; i < opts_.num_ceps-1; i++)
-        final_cepstrum(i) = final_cepstrum(i+1);
-      // if (!opts_.use_energy)
-        // energy *= M_SQRT2;  // scale on C0 (actually removing scale
-      // we previously added that's part of one common definition of
-      // cosine transform.)
-      final_cepstrum(opts_.num_ceps-1)  = energy;
+    autocorr_coeffs.AddMatMat(1.0, mel_energies_duplicated, kNoTrans,
+                              idft_bases_, kTrans, 0.0);
+
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> final_cepstrum(*output, first_frame + r);
+
+      BaseFloat energy = ComputeLpc(SubVector<BaseFloat>(autocorr_coeffs, r),
+                                    &lpc_coeffs);
+
+      energy = std::max(energy,
+                        std::numeric_limits<BaseFloat>::min());
+
+      Lpc2Cepstrum(opts_.lpc_order, lpc_coeffs.Data(), raw_cepstrum.Data());
+      {
+        SubVector<BaseFloat> dst(final_cepstrum, 1, opts_.num_ceps-1);
+        SubVector<BaseFloat> src(raw_cepstrum, 0, opts_.num_ceps-1);
+        dst.CopyFromVec(src);
+        final_cepstrum(0) = energy;
+      }
+
+      if (opts_.cepstral_lifter != 0.0)
+        final_cepstrum.MulElements(lifter_coeffs_);
+
+      if (opts_.cepstral_scale != 1.0)
+        final_cepstrum.Scale(opts_.cepstral_scale);
+
+      if (opts_.use_energy) {
+        BaseFloat this_log_energy = log_energy(r);
+        if (opts_.energy_floor > 0.0 && this_log_energy < log_energy_floor_)
+          this_log_energy = log_energy_floor_;
+        final_cepstrum(0) = this_log_energy;
+      }
+
+      if (opts_.htk_compat) {
+        BaseFloat energy = final_cepstrum(0);
+        for (int32 i = 0; i < opts_.num_ceps-1; i++)
+          final_cepstrum(i) = final_cepstrum(i+1);
+        // if (!opts_.use_energy)
+          // energy *= M_SQRT2;  // scale on C0 (actually removing scale
+        // we previously added that's part of one common definition of
+        // cosine transform.)
+        final_cepstrum(opts_.num_ceps-1)  = energy;
+      }
     }
-
-    output->Row(r).CopyFromVec(final_cepstrum);
-    // std::cout << "FIN" << final_cepstrum;
   }
 }
 
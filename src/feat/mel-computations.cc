@@ -133,6 +133,12 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
       bins_[bin].second(0) = 0.0;
     
   }
+  // The same weights as a dense matrix, for the version of Compute() that
+  // works on a matrix of power spectra.
+  bins_matrix_.Resize(num_bins, num_fft_bins);
+  for (int32 bin = 0; bin < num_bins; bin++)
+    bins_matrix_.Row(bin).Range(bins_[bin].first, bins_[bin].second.Dim()).
+        CopyFromVec(bins_[bin].second);
   if (debug_) {
     for (size_t i = 0; i < bins_.size(); i++) {
       KALDI_LOG << "bin " << i << ", offset = " << bins_[i].first
@@ -245,6 +251,34 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::Compute(const MatrixBase<BaseFloat> &power_spectra,
+                       MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_bins = bins_matrix_.NumRows(),
+      num_fft_bins = bins_matrix_.NumCols();
+  KALDI_ASSERT(power_spectra.NumCols() >= num_fft_bins &&
+               mel_energies_out->NumRows() == power_spectra.NumRows() &&
+               mel_energies_out->NumCols() == num_bins);
+  SubMatrix<BaseFloat> fft_energies(power_spectra, 0, power_spectra.NumRows(),
+                                    0, num_fft_bins);
+  mel_energies_out->AddMatMat(1.0, fft_energies, kNoTrans,
+                              bins_matrix_, kTrans, 0.0);
+  // HTK-like flooring- for testing purposes (we prefer dither)
+  if (htk_mode_)
+    mel_energies_out->ApplyFloor(1.0);
+
+  // See the comment in the other version of Compute() about this check.
+  KALDI_ASSERT(!KALDI_ISNAN(mel_energies_out->Sum()));
+
+  if (debug_) {
+    for (int32 r = 0; r < mel_energies_out->NumRows(); r++) {
+      fprintf(stderr, "MEL BANKS:\n");
+      for (int32 i = 0; i < num_bins; i++)
+        fprintf(stderr, " %f", (*mel_energies_out)(r, i));
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
@@ -76,6 +76,16 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                Vector<BaseFloat> *mel_energies_out) const;
 
+  /// This version computes the Mel energies for each row of "power_spectra",
+  /// which contains the FFT energies of a number of frames (it may have more
+  /// columns than needed, e.g. the first half of the padded window size plus
+  /// one, as output by ComputePowerSpectra()).  It is done as one matrix
+  /// multiplication, which is faster than calling the other version for each
+  /// frame.  "mel_energies_out" must have the same number of rows as
+  /// "power_spectra", and NumBins() columns.
+  void Compute(const MatrixBase<BaseFloat> &power_spectra,
+               MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
@@ -90,6 +100,10 @@ class MelBanks {
   // (the first nonzero fft-bin), (the vector of weights).
   std::vector<std::pair<int32, Vector<BaseFloat> > > bins_;
 
+  // the same weights as "bins_", as a matrix of dimension num_bins by
+  // num_fft_bins (i.e. half the padded window size); it is mostly zero.
+  Matrix<BaseFloat> bins_matrix_;
+
   bool debug_;
   bool htk_mode_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(MelBanks);
@@ -198,7 +198,152 @@ void TestOnlineMfcc() {
     GetOutput(&online_mfcc, &online_mfcc_feats);
 
     AssertEqual(mfcc_feats, online_mfcc_feats);
+
+    // GetFrames() should give the same as GetFrame().
+    int32 first_frame = rand() % mfcc_feats.NumRows(),
+        num_frames = 1 + rand() % (mfcc_feats.NumRows() - first_frame);
+    Matrix<BaseFloat> some_feats(num_frames, mfcc_feats.NumCols());
+    online_mfcc.GetFrames(first_frame, &some_feats);
+    AssertEqual(some_feats, mfcc_feats.RowRange(first_frame, num_frames));
+  }
+}
+
+void TestChunkedFeatureStore() {
+  int32 dim = 1 + rand() % 5, chunk_size = 1 + rand() % 10;
+  // if max_frames_kept > 0, we discard older frames as we go.
+  int32 max_frames_kept = (rand() % 2 == 0 ? -1 : 1 + rand() % 20);
+  ChunkedFeatureStore store(dim, chunk_size);
+  Matrix<BaseFloat> all_feats(10 + rand() % 100, dim);
+  all_feats.SetRandn();
+  for (int32 t = 0; t < all_feats.NumRows(); ) {
+    int32 num_frames = std::min(1 + rand() % 15, all_feats.NumRows() - t);
+    store.AppendFrames(all_feats.RowRange(t, num_frames));
+    t += num_frames;
+    if (max_frames_kept > 0) {
+      store.DiscardFramesBefore(store.NumFrames() - max_frames_kept);
+      KALDI_ASSERT(store.FirstFrameKept() <=
+                   std::max(0, store.NumFrames() - max_frames_kept));
+    }
+  }
+  KALDI_ASSERT(store.NumFrames() == all_feats.NumRows());
+  for (int32 t = store.FirstFrameKept(); t < store.NumFrames(); t++) {
+    Vector<BaseFloat> frame(store.Frame(t)), ref_frame(all_feats.Row(t));
+    AssertEqual(frame, ref_frame);
+  }
+  int32 first_frame = store.FirstFrameKept() +
+      rand() % (store.NumFrames() - store.FirstFrameKept()),
+      num_frames = 1 + rand() % (store.NumFrames() - first_frame);
+  Matrix<BaseFloat> some_feats(num_frames, dim);
+  store.GetFrames(first_frame, &some_feats);
+  AssertEqual(some_feats, all_feats.RowRange(first_frame, num_frames));
+}
+
+// Checks that when we read the frames in order, OnlineCmvn and
+// OnlineCacheFeature give the same output with and without max_frames_kept.
+void TestOnlineMaxFramesKept() {
+  int32 dim = 2 + rand() % 5, num_frames = 500 + rand() % 500;
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  OnlineCmvnOptions opts;
+  opts.cmn_window = 10 + rand() % 100;
+  opts.speaker_frames = std::min(opts.speaker_frames, opts.cmn_window);
+  opts.global_frames = std::min(opts.global_frames, opts.speaker_frames);
+  OnlineCmvnState cmvn_state;
+  cmvn_state.global_cmvn_stats.Resize(2, dim + 1);
+  cmvn_state.global_cmvn_stats(0, dim) = 10.0;
+  cmvn_state.global_cmvn_stats.Row(1).Range(0, dim).Set(10.0);
+
+  OnlineMatrixFeature matrix_feats(input_feats);
+  OnlineCmvn cmvn(opts, cmvn_state, &matrix_feats);
+  opts.max_frames_kept = opts.cmn_window + rand() % 50;
+  OnlineCmvn cmvn_kept(opts, cmvn_state, &matrix_feats);
+  OnlineCacheFeature cache_kept(&cmvn_kept, 1 + rand() % 10);
+
+  Vector<BaseFloat> feat(dim), feat_kept(dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    cmvn.GetFrame(t, &feat);
+    cache_kept.GetFrame(t, &feat_kept);
+    AssertEqual(feat, feat_kept);
+    // Frames that are still cached should not be recomputed.
+    cache_kept.GetFrame(t, &feat_kept);
+    AssertEqual(feat, feat_kept);
+  }
+}
+
+// Checks that with max_frames_kept, OnlineMfcc does not discard frames that
+// have not been read yet, even if the readers lag far behind the waveform and
+// behind each other.  If "use_readers" is true there are two readers created
+// by NewReader(), one of which reads all the frames as soon as they are ready;
+// otherwise there is just the direct reader.
+void TestOnlineMfccMaxFramesKept(bool use_readers) {
+  std::ifstream is("../feat/test_data/test.wav");
+  WaveData wave;
+  wave.Read(is);
+  KALDI_ASSERT(wave.Data().NumRows() == 1);
+  // Repeat the waveform so there are more frames than fit in one chunk of the
+  // ChunkedFeatureStore, and old chunks actually get discarded.
+  int32 num_repeats = 8, wave_dim = wave.Data().NumCols();
+  Vector<BaseFloat> waveform(num_repeats * wave_dim);
+  for (int32 i = 0; i < num_repeats; i++)
+    waveform.Range(i * wave_dim, wave_dim).CopyFromVec(wave.Data().Row(0));
+
+  MfccOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.samp_freq = wave.SampFreq();
+  OnlineMfcc online_mfcc(op);
+  int32 max_frames_kept = 1 + rand() % 20;
+  OnlineMfcc online_mfcc_kept(op, max_frames_kept);
+  OnlineFeatureInterface *slow_reader = &online_mfcc_kept,
+      *fast_reader = NULL;
+  if (use_readers) {
+    slow_reader = online_mfcc_kept.NewReader();
+    fast_reader = online_mfcc_kept.NewReader();
+  }
+
+  int32 num_read = 0, num_read_fast = 0, offset = 0,
+      piece_length = 100 + rand() % 5000;
+  Vector<BaseFloat> feat(online_mfcc.Dim()), feat_kept(online_mfcc.Dim());
+  while (offset < waveform.Dim()) {
+    int32 n = std::min(piece_length, waveform.Dim() - offset);
+    online_mfcc.AcceptWaveform(wave.SampFreq(), waveform.Range(offset, n));
+    online_mfcc_kept.AcceptWaveform(wave.SampFreq(), waveform.Range(offset, n));
+    offset += n;
+    if (fast_reader != NULL) {
+      for (; num_read_fast < fast_reader->NumFramesReady(); num_read_fast++) {
+        online_mfcc.GetFrame(num_read_fast, &feat);
+        fast_reader->GetFrame(num_read_fast, &feat_kept);
+        AssertEqual(feat, feat_kept);
+      }
+    }
+    // Read fewer frames than were produced, so the reader falls behind.
+    int32 num_to_read = (slow_reader->NumFramesReady() - num_read) / 2;
+    for (int32 i = 0; i < num_to_read; i++, num_read++) {
+      online_mfcc.GetFrame(num_read, &feat);
+      slow_reader->GetFrame(num_read, &feat_kept);
+      AssertEqual(feat, feat_kept);
+    }
   }
+  online_mfcc_kept.InputFinished();
+  int32 num_frames = slow_reader->NumFramesReady(),
+      num_left = num_frames - num_read;
+  Matrix<BaseFloat> feats(num_left, online_mfcc.Dim()),
+      feats_kept(num_left, online_mfcc.Dim());
+  online_mfcc.GetFrames(num_read, &feats);
+  slow_reader->GetFrames(num_read, &feats_kept);
+  AssertEqual(feats, feats_kept);
+  if (fast_reader != NULL)
+    fast_reader->GetFrame(num_frames - 1, &feat_kept);
+
+  // Now that all the readers are at the end, the first frames should have
+  // been discarded.
+  KALDI_ASSERT(num_frames > 1024);
+  bool threw = false;
+  try {
+    slow_reader->GetFrame(0, &feat_kept);
+  } catch (const std::runtime_error &e) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
 }
 
 void TestOnlinePlp() {
@@ -290,6 +435,10 @@ void TestOnlineTransform() {
   }
 
   AssertEqual(trans_feats, output_feats);
+
+  Matrix<BaseFloat> trans_feats2(trans_feats.NumRows(), trans_feats.NumCols());
+  online_trans.GetFrames(0, &trans_feats2);
+  AssertEqual(trans_feats, trans_feats2);
 }
 
 void TestOnlineAppendFeature() {
@@ -389,6 +538,10 @@ int main() {
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
     TestOnlineMfcc();
+    TestChunkedFeatureStore();
+    TestOnlineMaxFramesKept();
+    TestOnlineMfccMaxFramesKept(false);
+    TestOnlineMfccMaxFramesKept(true);
     TestOnlinePlp();
     TestOnlineTransform();
     TestOnlineAppendFeature();
@@ -19,31 +19,169 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "feat/online-feature.h"
 #include "transform/cmvn.h"
 
 namespace kaldi {
 
 
+ChunkedFeatureStore::ChunkedFeatureStore(int32 dim, int32 chunk_size):
+    dim_(dim), chunk_size_(chunk_size), num_frames_(0),
+    num_chunks_discarded_(0), spare_chunk_(NULL) {
+  KALDI_ASSERT(dim > 0 && chunk_size > 0);
+}
+
+void ChunkedFeatureStore::AppendFrames(const MatrixBase<BaseFloat> &feats) {
+  if (feats.NumRows() == 0) return;
+  KALDI_ASSERT(feats.NumCols() == dim_);
+  int32 num_rows = feats.NumRows(), row = 0;
+  while (row < num_rows) {
+    int32 chunk = num_frames_ / chunk_size_ - num_chunks_discarded_,
+        offset = num_frames_ % chunk_size_;
+    if (static_cast<size_t>(chunk) == chunks_.size()) {
+      if (spare_chunk_ != NULL) {
+        chunks_.push_back(spare_chunk_);
+        spare_chunk_ = NULL;
+      } else {
+        chunks_.push_back(new Matrix<BaseFloat>(chunk_size_, dim_,
+                                                kUndefined));
+      }
+    }
+    int32 n = std::min(chunk_size_ - offset, num_rows - row);
+    chunks_[chunk]->RowRange(offset, n).CopyFromMat(feats.RowRange(row, n));
+    row += n;
+    num_frames_ += n;
+  }
+}
+
+void ChunkedFeatureStore::CheckFrame(int32 frame) const {
+  if (frame < FirstFrameKept())
+    KALDI_ERR << "Frame " << frame << " has been discarded (only frames from "
+              << FirstFrameKept() << " are kept; see --max-frames-kept).";
+  KALDI_ASSERT(frame < num_frames_);
+}
+
+const SubVector<BaseFloat> ChunkedFeatureStore::Frame(int32 frame) const {
+  CheckFrame(frame);
+  return chunks_[frame / chunk_size_ - num_chunks_discarded_]->Row(
+      frame % chunk_size_);
+}
+
+void ChunkedFeatureStore::GetFrames(int32 first_frame,
+                                    MatrixBase<BaseFloat> *feats) const {
+  int32 num_rows = feats->NumRows(), row = 0;
+  if (num_rows == 0) return;
+  KALDI_ASSERT(feats->NumCols() == dim_);
+  CheckFrame(first_frame);
+  CheckFrame(first_frame + num_rows - 1);
+  while (row < num_rows) {
+    int32 frame = first_frame + row,
+        offset = frame % chunk_size_,
+        n = std::min(chunk_size_ - offset, num_rows - row);
+    feats->RowRange(row, n).CopyFromMat(
+        chunks_[frame / chunk_size_ - num_chunks_discarded_]->RowRange(offset,
+                                                                       n));
+    row += n;
+  }
+}
+
+void ChunkedFeatureStore::DiscardFramesBefore(int32 frame) {
+  // A chunk that is not full yet is never discarded.
+  int32 num_chunks = std::min(frame, num_frames_) / chunk_size_ -
+      num_chunks_discarded_;
+  for (int32 i = 0; i < num_chunks; i++) {
+    if (spare_chunk_ == NULL)
+      spare_chunk_ = chunks_.front();
+    else
+      delete chunks_.front();
+    chunks_.pop_front();
+    num_chunks_discarded_++;
+  }
+}
+
+ChunkedFeatureStore::~ChunkedFeatureStore() {
+  for (size_t i = 0; i < chunks_.size(); i++)
+    delete chunks_[i];
+  delete spare_chunk_;
+}
+
+
 template<class C>
 void OnlineGenericBaseFeature<C>::GetFrame(int32 frame,
                                            VectorBase<BaseFloat> *feat) {
-  KALDI_ASSERT(frame >= 0 && frame < num_frames_);
+  if (direct_reader_ == -1) {
+    direct_reader_ = num_frames_read_.size();
+    num_frames_read_.push_back(0);
+  }
+  GetFrameForReader(direct_reader_, frame, feat);
+}
+
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFrames(int32 first_frame,
+                                            MatrixBase<BaseFloat> *feats) {
+  if (direct_reader_ == -1) {
+    direct_reader_ = num_frames_read_.size();
+    num_frames_read_.push_back(0);
+  }
+  GetFramesForReader(direct_reader_, first_frame, feats);
+}
+
+template<class C>
+OnlineFeatureInterface *OnlineGenericBaseFeature<C>::NewReader() {
+  readers_.push_back(new Reader(this, num_frames_read_.size()));
+  num_frames_read_.push_back(0);
+  return readers_.back();
+}
+
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFrameForReader(
+    int32 reader, int32 frame, VectorBase<BaseFloat> *feat) {
   KALDI_ASSERT(feat->Dim() == Dim());
-  feat->CopyFromVec(features_.Row(frame));
-};
+  feat->CopyFromVec(features_.Frame(frame));
+  FrameRead(reader, frame);
+}
+
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFramesForReader(
+    int32 reader, int32 first_frame, MatrixBase<BaseFloat> *feats) {
+  features_.GetFrames(first_frame, feats);
+  if (feats->NumRows() > 0)
+    FrameRead(reader, first_frame + feats->NumRows() - 1);
+}
+
+template<class C>
+void OnlineGenericBaseFeature<C>::FrameRead(int32 reader, int32 frame) {
+  if (frame < num_frames_read_[reader])
+    return;
+  num_frames_read_[reader] = frame + 1;
+  if (max_frames_kept_ > 0) {
+    int32 slowest = *std::min_element(num_frames_read_.begin(),
+                                      num_frames_read_.end());
+    features_.DiscardFramesBefore(slowest - max_frames_kept_);
+  }
+}
 
 template<class C>
 bool OnlineGenericBaseFeature<C>::IsLastFrame(int32 frame) const {
-  return (frame == num_frames_ - 1 && input_finished_);
+  return (frame == features_.NumFrames() - 1 && input_finished_);
 }
 
 template<class C>
 OnlineGenericBaseFeature<C>::OnlineGenericBaseFeature(
-    const typename C::Options &opts)
-    :mfcc_or_plp_(opts), input_finished_(false), num_frames_(0),
+    const typename C::Options &opts, int32 max_frames_kept)
+    :mfcc_or_plp_(opts), features_(mfcc_or_plp_.Dim()),
+    max_frames_kept_(max_frames_kept), direct_reader_(-1),
+    input_finished_(false),
     sampling_frequency_(opts.frame_opts.samp_freq) { }
 
+template<class C>
+OnlineGenericBaseFeature<C>::~OnlineGenericBaseFeature() {
+  for (size_t i = 0; i < readers_.size(); i++)
+    delete readers_[i];
+}
+
 template<class C>
 void OnlineGenericBaseFeature<C>::AcceptWaveform(BaseFloat sampling_rate,
                                         const VectorBase<BaseFloat> &waveform) {
@@ -58,17 +196,18 @@ void OnlineGenericBaseFeature<C>::AcceptWaveform(BaseFloat sampling_rate,
               << sampling_frequency_ << ", got " << sampling_rate;
   }
 
-  Vector<BaseFloat> appended_wave;
+  int32 remainder_dim = waveform_remainder_.Dim(),
+      appended_dim = remainder_dim + waveform.Dim();
+  if (remainder_dim != 0 && wave_buffer_.Dim() < appended_dim)
+    wave_buffer_.Resize(appended_dim, kUndefined);
+  SubVector<BaseFloat> appended_wave(wave_buffer_, 0,
+                                     (remainder_dim != 0 ? appended_dim : 0));
 
-  const VectorBase<BaseFloat> &wave_to_use = (waveform_remainder_.Dim() != 0 ?
+  const VectorBase<BaseFloat> &wave_to_use = (remainder_dim != 0 ?
                                               appended_wave : waveform);
-  if (waveform_remainder_.Dim() != 0) {
-    appended_wave.Resize(waveform_remainder_.Dim() +
-                         waveform.Dim());
-    appended_wave.Range(0, waveform_remainder_.Dim()).CopyFromVec(
-        waveform_remainder_);
-    appended_wave.Range(waveform_remainder_.Dim(),
-                        waveform.Dim()).CopyFromVec(waveform);
+  if (remainder_dim != 0) {
+    appended_wave.Range(0, remainder_dim).CopyFromVec(waveform_remainder_);
+    appended_wave.Range(remainder_dim, waveform.Dim()).CopyFromVec(waveform);
   }
   waveform_remainder_.Resize(0);
 
@@ -81,19 +220,7 @@ void OnlineGenericBaseFeature<C>::AcceptWaveform(BaseFloat sampling_rate,
     // features.  The waveform will have been appended to waveform_remainder_.
     return;
   }
-  int32 new_num_frames = num_frames_ + feats.NumRows();
-  BaseFloat increase_ratio = 1.5;  // This is a tradeoff between memory and
-                                   // compute; it's the factor by which we
-                                   // increase the memory used each time.
-  if (new_num_frames > features_.NumRows()) {
-    int32 new_num_rows = std::max<int32>(new_num_frames,
-                                         features_.NumRows() * increase_ratio);
-    // Increase the size of the features_ matrix and copy over any existing
-    // data.
-    features_.Resize(new_num_rows, Dim(), kCopyData);
-  }
-  features_.Range(num_frames_, feats.NumRows(), 0, Dim()).CopyFromMat(feats);
-  num_frames_ = new_num_frames;
+  features_.AppendFrames(feats);
 }
 
 // instantiate the templates defined here for MFCC, PLP and filterbank classes.
@@ -134,7 +261,7 @@ void OnlineCmvnState::Read(std::istream &is, bool binary) {
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
                        const OnlineCmvnState &cmvn_state,
                        OnlineFeatureInterface *src):
-    opts_(opts), src_(src) {
+    opts_(opts), num_cached_stats_discarded_(0), src_(src) {
   SetState(cmvn_state);
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
@@ -142,7 +269,8 @@ OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
 }
 
 OnlineCmvn::OnlineCmvn(const OnlineCmvnOptions &opts,
-                       OnlineFeatureInterface *src): opts_(opts), src_(src) {
+                       OnlineFeatureInterface *src):
+    opts_(opts), num_cached_stats_discarded_(0), src_(src) {
   if (!SplitStringToIntegers(opts.skip_dims, ":", false, &skip_dims_))
     KALDI_ERR << "Bad --skip-dims option (should be colon-separated list of "
               <<  "integers)";
@@ -169,19 +297,23 @@ void OnlineCmvn::GetMostRecentCachedFrame(int32 frame,
       return;
     }
   }
-  int32 n = frame / opts_.modulus;
-  if (n >= cached_stats_modulo_.size()) {
-    if (cached_stats_modulo_.size() == 0) {
+  int32 n = frame / opts_.modulus,
+      num_cached = num_cached_stats_discarded_ + cached_stats_modulo_.size();
+  if (n >= num_cached) {
+    if (num_cached == 0) {
       *cached_frame = -1;
       stats->Resize(2, this->Dim() + 1);
       return;
     } else {
-      n = static_cast<int32>(cached_stats_modulo_.size() - 1);
+      n = num_cached - 1;
     }
   }
+  if (n < num_cached_stats_discarded_)
+    KALDI_ERR << "CMVN stats for frame " << frame << " have been discarded "
+              << "(max-frames-kept = " << opts_.max_frames_kept << ")";
   *cached_frame = n * opts_.modulus;
-  KALDI_ASSERT(cached_stats_modulo_[n] != NULL);
-  *stats = *(cached_stats_modulo_[n]);
+  KALDI_ASSERT(cached_stats_modulo_[n - num_cached_stats_discarded_] != NULL);
+  *stats = *(cached_stats_modulo_[n - num_cached_stats_discarded_]);
 }
 
 // Initialize ring buffer for caching stats.
@@ -196,17 +328,26 @@ void OnlineCmvn::InitRingBufferIfNeeded() {
 void OnlineCmvn::CacheFrame(int32 frame, const Matrix<double> &stats) {
   KALDI_ASSERT(frame >= 0);
   if (frame % opts_.modulus == 0) {  // store in cached_stats_modulo_.
-    int32 n = frame / opts_.modulus;
-    if (n >= cached_stats_modulo_.size()) {
+    int32 n = frame / opts_.modulus - num_cached_stats_discarded_;
+    if (n >= static_cast<int32>(cached_stats_modulo_.size())) {
       // The following assert is a limitation on in what order you can call
       // CacheFrame.  Fortunately the calling code always calls it in sequence,
       // which it has to because you need a previous frame to compute the
       // current one.
       KALDI_ASSERT(n == cached_stats_modulo_.size());
       cached_stats_modulo_.push_back(new Matrix<double>(stats));
+      // Discard the stats that are too old to keep.
+      while (opts_.max_frames_kept > 0 &&
+             num_cached_stats_discarded_ * opts_.modulus <
+             frame - opts_.max_frames_kept) {
+        delete cached_stats_modulo_.front();
+        cached_stats_modulo_.pop_front();
+        num_cached_stats_discarded_++;
+      }
     } else {
       KALDI_WARN << "Did not expect to reach this part of code.";
       // do what seems right, but we shouldn't get here.
+      KALDI_ASSERT(n >= 0);
       cached_stats_modulo_[n]->CopyFromMat(stats);
     }
   } else {  // store in the ring buffer.
@@ -421,6 +562,16 @@ void OnlineTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   feat->AddMatVec(1.0, linear_term_, kNoTrans, input_feat, 1.0);
 }
 
+void OnlineTransform::GetFrames(int32 first_frame,
+                                MatrixBase<BaseFloat> *feats) {
+  if (feats->NumRows() == 0) return;
+  Matrix<BaseFloat> input_feats(feats->NumRows(), linear_term_.NumCols(),
+                                kUndefined);
+  src_->GetFrames(first_frame, &input_feats);
+  feats->CopyRowsFromVec(offset_);
+  feats->AddMatMat(1.0, input_feats, kNoTrans, linear_term_, kTrans, 1.0);
+}
+
 
 int32 OnlineDeltaFeature::Dim() const {
   int32 src_dim = src_->Dim();
@@ -471,16 +622,28 @@ OnlineDeltaFeature::OnlineDeltaFeature(const DeltaFeaturesOptions &opts,
 
 void OnlineCacheFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   KALDI_ASSERT(frame >= 0);
-  if (static_cast<size_t>(frame) < cache_.size() && cache_[frame] != NULL) {
-    feat->CopyFromVec(*(cache_[frame]));
+  if (frame < num_frames_discarded_)
+    KALDI_ERR << "Frame " << frame << " has been discarded from the cache "
+              << "(max-frames-kept = " << max_frames_kept_ << ")";
+  int32 index = frame - num_frames_discarded_;
+  if (static_cast<size_t>(index) < cache_.size() && cache_[index] != NULL) {
+    feat->CopyFromVec(*(cache_[index]));
   } else {
-    if (static_cast<size_t>(frame) >= cache_.size())
-      cache_.resize(frame + 1, NULL);
+    if (static_cast<size_t>(index) >= cache_.size())
+      cache_.resize(index + 1, NULL);
     int32 dim = this->Dim();
-    cache_[frame] = new Vector<BaseFloat>(dim);
+    Vector<BaseFloat> *cached = new Vector<BaseFloat>(dim);
+    cache_[index] = cached;
     // The following call will crash if frame "frame" is not ready.
-    src_->GetFrame(frame, cache_[frame]);
-    feat->CopyFromVec(*(cache_[frame]));
+    src_->GetFrame(frame, cached);
+    feat->CopyFromVec(*cached);
+    // Discard frames that are too old, relative to the latest frame cached.
+    while (max_frames_kept_ > 0 &&
+           cache_.size() > static_cast<size_t>(max_frames_kept_)) {
+      delete cache_.front();
+      cache_.pop_front();
+      num_frames_discarded_++;
+    }
   }
 }
 
@@ -489,6 +652,7 @@ void OnlineCacheFeature::ClearCache() {
     if (cache_[i] != NULL)
       delete cache_[i];
   cache_.resize(0);
+  num_frames_discarded_ = 0;
 }
 
 
@@ -502,5 +666,15 @@ void OnlineAppendFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   src2_->GetFrame(frame, &feat2);
 };
 
+void OnlineAppendFeature::GetFrames(int32 first_frame,
+                                    MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats->NumCols() == Dim());
+
+  SubMatrix<BaseFloat> feats1(feats->ColRange(0, src1_->Dim()));
+  SubMatrix<BaseFloat> feats2(feats->ColRange(src1_->Dim(), src2_->Dim()));
+  src1_->GetFrames(first_frame, &feats1);
+  src2_->GetFrames(first_frame, &feats2);
+}
+
 
 }  // namespace kaldi
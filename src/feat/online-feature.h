@@ -42,6 +42,62 @@ namespace kaldi {
 
 
 
+/// This class stores the frames of features that OnlineGenericBaseFeature has
+/// computed, in chunks of a fixed number of frames.  Unlike a Matrix that is
+/// resized as more frames arrive, appending frames never copies the frames
+/// that are already stored, and the memory grows in small steps.  Old frames
+/// can be discarded (see DiscardFramesBefore()); the memory of a discarded
+/// chunk is reused for new frames, so a store from which old frames are
+/// regularly discarded uses constant memory.
+class ChunkedFeatureStore {
+ public:
+  explicit ChunkedFeatureStore(int32 dim, int32 chunk_size = 512);
+
+  int32 Dim() const { return dim_; }
+
+  /// Returns the number of frames appended so far, including any that have
+  /// been discarded.
+  int32 NumFrames() const { return num_frames_; }
+
+  /// Returns the first frame that has not been discarded.
+  int32 FirstFrameKept() const { return num_chunks_discarded_ * chunk_size_; }
+
+  /// Appends the rows of "feats", which must have Dim() columns.
+  void AppendFrames(const MatrixBase<BaseFloat> &feats);
+
+  /// Returns frame "frame", with 0 <= frame < NumFrames().  The SubVector is
+  /// valid until this object is destroyed.
+  const SubVector<BaseFloat> Frame(int32 frame) const;
+
+  /// Copies the frames first_frame ... first_frame + feats->NumRows() - 1
+  /// to the rows of "feats".
+  void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats) const;
+
+  /// Discards the chunks that contain only frames before "frame", so that
+  /// FirstFrameKept() may become up to "frame".  It is an error to ask for a
+  /// discarded frame afterwards.
+  void DiscardFramesBefore(int32 frame);
+
+  ~ChunkedFeatureStore();
+
+ private:
+  // Dies if frame "frame" has been discarded or not appended yet.
+  void CheckFrame(int32 frame) const;
+
+  int32 dim_;
+  int32 chunk_size_;
+  int32 num_frames_;
+  int32 num_chunks_discarded_;
+  // Each chunk has chunk_size_ rows; frame t is in row t % chunk_size_ of
+  // chunk t / chunk_size_ - num_chunks_discarded_.  Only frames up to
+  // num_frames_ - 1 are defined.
+  std::deque<Matrix<BaseFloat>* > chunks_;
+  // A discarded chunk, kept for reuse; may be NULL.
+  Matrix<BaseFloat> *spare_chunk_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ChunkedFeatureStore);
+};
+
+
 template<class C>
 class OnlineGenericBaseFeature: public OnlineBaseFeature {
  public:
@@ -55,13 +111,28 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   // last few frames of delta or LDA features to exactly match a non-online
   // decode of some data.
   virtual bool IsLastFrame(int32 frame) const;
-  virtual int32 NumFramesReady() const { return num_frames_; }
+  virtual int32 NumFramesReady() const { return features_.NumFrames(); }
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats);
 
   //
   // Next, functions that are not in the interface.
   //
-  explicit OnlineGenericBaseFeature(const typename C::Options &opts);
+  /// If max_frames_kept > 0, old frames are discarded so that the memory used
+  /// stays bounded: only the frames from about max_frames_kept frames before
+  /// the most recent frame read by the slowest reader are kept (see
+  /// NewReader()).  It is an error to ask for a discarded frame.
+  explicit OnlineGenericBaseFeature(const typename C::Options &opts,
+                                    int32 max_frames_kept = -1);
+
+  /// Returns an object that reads these features and that counts as a
+  /// separate reader for max_frames_kept, so that frames it may still need
+  /// are not discarded because another reader has gone further ahead.  A
+  /// reader holds on to all the frames until its first read.  Calling
+  /// GetFrame() or GetFrames() on this object directly counts as one more
+  /// reader, from the first such call.  The returned object is owned by this
+  /// object.
+  OnlineFeatureInterface *NewReader();
 
   // This would be called from the application, when you get
   // more wave data.  Note: the sampling_rate is only provided so
@@ -76,22 +147,64 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   // of delta or LDA features.
   virtual void InputFinished() { input_finished_= true; }
 
+  virtual ~OnlineGenericBaseFeature();
 
  private:
+  // The objects returned by NewReader(); they read the features on behalf of
+  // reader "index".
+  class Reader: public OnlineFeatureInterface {
+   public:
+    Reader(OnlineGenericBaseFeature<C> *base, int32 index):
+        base_(base), index_(index) { }
+    virtual int32 Dim() const { return base_->Dim(); }
+    virtual bool IsLastFrame(int32 frame) const {
+      return base_->IsLastFrame(frame);
+    }
+    virtual int32 NumFramesReady() const { return base_->NumFramesReady(); }
+    virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+      base_->GetFrameForReader(index_, frame, feat);
+    }
+    virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats) {
+      base_->GetFramesForReader(index_, first_frame, feats);
+    }
+   private:
+    OnlineGenericBaseFeature<C> *base_;
+    int32 index_;
+  };
+
+  void GetFrameForReader(int32 reader, int32 frame,
+                         VectorBase<BaseFloat> *feat);
+  void GetFramesForReader(int32 reader, int32 first_frame,
+                          MatrixBase<BaseFloat> *feats);
+
+  // Called when reader "reader" has read frame "frame"; discards old frames if
+  // max_frames_kept_ > 0.
+  void FrameRead(int32 reader, int32 frame);
+
   C mfcc_or_plp_;  // class that does the MFCC or PLP computation
 
   // features_ is the Mfcc or Plp or Fbank features that we have already computed.
-  Matrix<BaseFloat> features_;
+  ChunkedFeatureStore features_;
+
+  // If > 0, we discard frames that are more than about this many frames older
+  // than the most recent frame read by every reader.
+  int32 max_frames_kept_;
+
+  // For each reader, one plus the highest frame index it has asked for.  A
+  // frame is only discarded once it is more than max_frames_kept_ frames
+  // before all of these.
+  std::vector<int32> num_frames_read_;
+
+  // The readers created by NewReader(), owned here.
+  std::vector<Reader*> readers_;
+
+  // The index in num_frames_read_ of the reader that stands for direct calls
+  // to GetFrame() and GetFrames(), or -1 if there have been none yet.
+  int32 direct_reader_;
 
   // True if the user has called "InputFinished()"
   bool input_finished_;
 
-  // num_frames_ is the number of frames of MFCC features we have
-  // already computed.  It may be less than the size of features_,
-  // because when we resize that matrix we leave some extra room,
-  // so that we don't spend too much time resizing.
-  int32 num_frames_;
-
   // The sampling frequency, extracted from the config.  Should
   // be identical to the waveform supplied.
   BaseFloat sampling_frequency_;
@@ -100,6 +213,13 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
   // after extracting all the whole frames we can (whatever length of feature
   // will be required for the next phase of computation).
   Vector<BaseFloat> waveform_remainder_;
+
+  // wave_buffer_ is where we put waveform_remainder_ followed by the new
+  // waveform; it is kept to avoid allocating it for each call.  Only the
+  // first part of it may be used.
+  Vector<BaseFloat> wave_buffer_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OnlineGenericBaseFeature);
 };
 
 typedef OnlineGenericBaseFeature<Mfcc> OnlineMfcc;
@@ -125,6 +245,10 @@ class OnlineMatrixFeature: public OnlineFeatureInterface {
     feat->CopyFromVec(mat_.Row(frame));
   }
 
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats) {
+    feats->CopyFromMat(mat_.RowRange(first_frame, feats->NumRows()));
+  }
+
   virtual bool IsLastFrame(int32 frame) const {
     return (frame + 1 == mat_.NumRows());
   }
@@ -154,6 +278,11 @@ struct OnlineCmvnOptions {
                   // time-efficient but less memory-efficient.  Must be >= 1.
   int32 ring_buffer_size;  // not configurable from command line; size of ring
                            // buffer used for caching CMVN stats.
+  int32 max_frames_kept;  // not configurable from command line; if > 0, the
+                          // cached stats for frames more than this many
+                          // frames before the latest frame are discarded.
+                          // Note: the source features must keep at least
+                          // the last cmn_window frames.
   std::string skip_dims; // Colon-separated list of dimensions to skip normalization
                          // of, e.g. 13:14:15.
   
@@ -165,6 +294,7 @@ struct OnlineCmvnOptions {
       normalize_variance(false),
       modulus(20),
       ring_buffer_size(20),
+      max_frames_kept(-1),
       skip_dims("") { }
   
   void Check() {
@@ -366,8 +496,11 @@ class OnlineCmvn: public OnlineFeatureInterface {
   // The variable below reflects the raw (count, x, x^2) statistics of the
   // input, computed every opts_.modulus frames.  raw_stats_[n / opts_.modulus]
   // contains the (count, x, x^2) statistics for the frames from
-  // std::max(0, n - opts_.cmn_window) through n.
-  std::vector<Matrix<double>*> cached_stats_modulo_;
+  // std::max(0, n - opts_.cmn_window) through n.  If opts_.max_frames_kept > 0,
+  // old elements are removed from the front, and the element for n is at
+  // n / opts_.modulus - num_cached_stats_discarded_.
+  std::deque<Matrix<double>*> cached_stats_modulo_;
+  int32 num_cached_stats_discarded_;
   // the variable below is a ring-buffer of cached stats.  the int32 is the
   // frame index.
   std::vector<std::pair<int32, Matrix<double> > > cached_stats_ring_;
@@ -435,6 +568,9 @@ class OnlineTransform: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  /// This does the transform for all the frames as one matrix multiplication.
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -482,6 +618,9 @@ class OnlineDeltaFeature: public OnlineFeatureInterface {
 
 /// This feature type can be used to cache its input, to avoid
 /// repetition of computation in a multi-pass decoding context.
+/// If max_frames_kept > 0, it only keeps the frames that are at most that
+/// many frames before the latest frame requested; it is an error to ask for
+/// an older frame.
 class OnlineCacheFeature: public OnlineFeatureInterface {
  public:
   virtual int32 Dim() const { return src_->Dim(); }
@@ -501,11 +640,17 @@ class OnlineCacheFeature: public OnlineFeatureInterface {
   void ClearCache();  // this should be called if you change the underlying
                       // features in some way.
 
-  explicit OnlineCacheFeature(OnlineFeatureInterface *src): src_(src) { }
+  explicit OnlineCacheFeature(OnlineFeatureInterface *src,
+                              int32 max_frames_kept = -1):
+      src_(src), max_frames_kept_(max_frames_kept), num_frames_discarded_(0) { }
  private:
 
   OnlineFeatureInterface *src_;  // Not owned here
-  std::vector<Vector<BaseFloat>* > cache_;
+  int32 max_frames_kept_;
+  // The number of frames removed from the front of cache_; cache_[i] is for
+  // frame i + num_frames_discarded_, and may be NULL.
+  int32 num_frames_discarded_;
+  std::deque<Vector<BaseFloat>* > cache_;
 };
 
 
@@ -527,6 +672,8 @@ class OnlineAppendFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineAppendFeature() {  }
 
   OnlineAppendFeature(OnlineFeatureInterface *src1,
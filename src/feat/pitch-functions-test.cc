@@ -508,7 +508,50 @@ void UnitTestProcess() {
   }
 }
 
+// Checks that NccfCorrelationComputer gives the same inner products (up to
+// rounding error) whether it computes them directly or with the FFT, and that
+// the automatic choice gives one of them.
+static void UnitTestNccfCorrelationComputer() {
+  KALDI_LOG << "=== UnitTestNccfCorrelationComputer() ===";
+  for (int32 i = 0; i < 20; i++) {
+    int32 window_size = RandInt(1, 400), first_lag = RandInt(0, 50),
+        last_lag = first_lag + RandInt(0, 400),
+        num_lags = last_lag + 1 - first_lag, num_frames = RandInt(1, 5);
+    NccfCorrelationComputer direct(first_lag, last_lag, window_size,
+                                   NccfCorrelationComputer::kDirect),
+        fft(first_lag, last_lag, window_size, NccfCorrelationComputer::kFft),
+        automatic(first_lag, last_lag, window_size);
+    Matrix<BaseFloat> waves(num_frames, window_size + last_lag);
+    waves.SetRandn();
+    waves.Add(RandGauss());  // the mean is subtracted.
+    if (RandInt(0, 3) == 0)
+      waves.Row(0).SetZero();  // check the special case of silence.
+    Matrix<BaseFloat> direct_inner_prods(num_frames, num_lags),
+        direct_norm_prods(num_frames, num_lags),
+        fft_inner_prods(num_frames, num_lags),
+        fft_norm_prods(num_frames, num_lags),
+        inner_prods(num_frames, num_lags), norm_prods(num_frames, num_lags);
+    direct.Compute(waves, &direct_inner_prods, &direct_norm_prods);
+    fft.Compute(waves, &fft_inner_prods, &fft_norm_prods);
+    automatic.Compute(waves, &inner_prods, &norm_prods);
+
+    KALDI_ASSERT(direct_norm_prods.ApproxEqual(fft_norm_prods, 1.0e-06) &&
+                 direct_norm_prods.ApproxEqual(norm_prods, 1.0e-06));
+    for (int32 t = 0; t < num_frames; t++) {
+      for (int32 l = 0; l < num_lags; l++) {
+        // The rounding error is relative to the norms of the windows.
+        BaseFloat norm = std::sqrt(direct_norm_prods(t, l));
+        KALDI_ASSERT(std::abs(fft_inner_prods(t, l) -
+                              direct_inner_prods(t, l)) <= 1.0e-04 * norm);
+        KALDI_ASSERT(inner_prods(t, l) == direct_inner_prods(t, l) ||
+                     inner_prods(t, l) == fft_inner_prods(t, l));
+      }
+    }
+  }
+}
+
 static void UnitTestFeatNoKeele() {
+  UnitTestNccfCorrelationComputer();
   UnitTestSimple();
   UnitTestPieces();
   UnitTestDelay();
@@ -85,37 +85,109 @@ BaseFloat NccfToPov(BaseFloat n) {
   return p;
 }
 
-/**
-   This function computes some dot products that are required
-   while computing the NCCF.
-   For each integer lag from start to end-1, this function
-   outputs to (*inner_prod)(lag - start), the dot-product
-   of a window starting at 0 with a window starting at
-   lag.  All windows are of length nccf_window_size.  It
-   outputs to (*norm_prod)(lag - start), e1 * e2, where
-   e1 is the dot-product of the un-shifted window with itself,
-   and d2 is the dot-product of the window shifted by "lag"
-   with itself.
- */
-void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
-                        int32 first_lag, int32 last_lag,
-                        int32 nccf_window_size,
-                        VectorBase<BaseFloat> *inner_prod,
-                        VectorBase<BaseFloat> *norm_prod) {
-  Vector<BaseFloat> zero_mean_wave(wave);
+NccfCorrelationComputer::NccfCorrelationComputer(int32 first_lag,
+                                                 int32 last_lag,
+                                                 int32 nccf_window_size,
+                                                 Method method):
+    first_lag_(first_lag), last_lag_(last_lag), window_size_(nccf_window_size),
+    fft_(NULL), zero_mean_wave_(nccf_window_size + last_lag),
+    energy_sum_(nccf_window_size + last_lag + 1) {
+  KALDI_ASSERT(first_lag >= 0 && last_lag >= first_lag &&
+               nccf_window_size > 0);
+  // The FFT has to be long enough that the cross-correlation does not wrap
+  // around.  We use it if it looks like it will be faster than the direct
+  // computation; the constant factor was tuned roughly by timing the two.  The
+  // direct computation uses BLAS and is faster for the lag ranges and window
+  // sizes normally used for pitch at 4kHz (e.g. 75 lags and 100 samples).
+  int32 fft_size = RoundUpToNearestPowerOfTwo(nccf_window_size + last_lag),
+      num_lags = last_lag + 1 - first_lag;
+  double direct_cost = static_cast<double>(num_lags) * nccf_window_size,
+      fft_cost = 50.0 * fft_size * Log(static_cast<double>(fft_size));
+  if (method == kFft || (method == kAutomatic && fft_cost < direct_cost)) {
+    fft_ = new SplitRadixRealFft<double>(fft_size);
+    window_fft_.Resize(fft_size);
+    wave_fft_.Resize(fft_size);
+  }
+}
+
+void NccfCorrelationComputer::ComputeInnerProdsFft(
+    VectorBase<BaseFloat> *inner_prod) {
+  int32 fft_size = window_fft_.Dim(), full_size = zero_mean_wave_.Dim();
+  double *a = window_fft_.Data(), *b = wave_fft_.Data();
+  const BaseFloat *x = zero_mean_wave_.Data();
+  for (int32 i = 0; i < window_size_; i++) a[i] = x[i];
+  for (int32 i = window_size_; i < fft_size; i++) a[i] = 0.0;
+  for (int32 i = 0; i < full_size; i++) b[i] = x[i];
+  for (int32 i = full_size; i < fft_size; i++) b[i] = 0.0;
+  fft_->Compute(a, true, &temp_buffer_);
+  fft_->Compute(b, true, &temp_buffer_);
+  // Multiply b by the complex conjugate of a; see the comment in srfft.h for
+  // the packing of the real FFT (the first two elements are real).
+  b[0] *= a[0];
+  b[1] *= a[1];
+  for (int32 k = 2; k < fft_size; k += 2) {
+    double ar = a[k], ai = a[k+1], br = b[k], bi = b[k+1];
+    b[k] = ar * br + ai * bi;
+    b[k+1] = ar * bi - ai * br;
+  }
+  fft_->Compute(b, false, &temp_buffer_);
+  double scale = 1.0 / fft_size;
+  for (int32 lag = first_lag_; lag <= last_lag_; lag++)
+    (*inner_prod)(lag - first_lag_) = b[lag] * scale;
+}
+
+void NccfCorrelationComputer::Compute(const VectorBase<BaseFloat> &wave,
+                                      VectorBase<BaseFloat> *inner_prod,
+                                      VectorBase<BaseFloat> *norm_prod) {
+  KALDI_ASSERT(wave.Dim() == zero_mean_wave_.Dim() &&
+               inner_prod->Dim() == last_lag_ + 1 - first_lag_ &&
+               norm_prod->Dim() == inner_prod->Dim());
+  zero_mean_wave_.CopyFromVec(wave);
   // TODO: possibly fix this, the mean normalization is done in a strange way.
-  SubVector<BaseFloat> wave_part(wave, 0, nccf_window_size);
+  SubVector<BaseFloat> wave_part(wave, 0, window_size_);
   // subtract mean-frame from wave
-  zero_mean_wave.Add(-wave_part.Sum() / nccf_window_size);
-  BaseFloat e1, e2, sum;
-  SubVector<BaseFloat> sub_vec1(zero_mean_wave, 0, nccf_window_size);
-  e1 = VecVec(sub_vec1, sub_vec1);
-  for (int32 lag = first_lag; lag <= last_lag; lag++) {
-    SubVector<BaseFloat> sub_vec2(zero_mean_wave, lag, nccf_window_size);
-    e2 = VecVec(sub_vec2, sub_vec2);
-    sum = VecVec(sub_vec1, sub_vec2);
-    (*inner_prod)(lag - first_lag) = sum;
-    (*norm_prod)(lag - first_lag) = e1 * e2;
+  zero_mean_wave_.Add(-wave_part.Sum() / window_size_);
+
+  // The sum of squares only ever increases, so the differences below are
+  // never negative, and are exactly zero for windows of zeros.
+  const BaseFloat *x = zero_mean_wave_.Data();
+  double *energy_sum = energy_sum_.Data();
+  energy_sum[0] = 0.0;
+  for (int32 i = 0; i < zero_mean_wave_.Dim(); i++)
+    energy_sum[i + 1] = energy_sum[i] + static_cast<double>(x[i]) * x[i];
+  BaseFloat e1 = energy_sum[window_size_];
+
+  if (fft_ != NULL) {
+    ComputeInnerProdsFft(inner_prod);
+  } else {
+    SubVector<BaseFloat> sub_vec1(zero_mean_wave_, 0, window_size_);
+    for (int32 lag = first_lag_; lag <= last_lag_; lag++) {
+      SubVector<BaseFloat> sub_vec2(zero_mean_wave_, lag, window_size_);
+      (*inner_prod)(lag - first_lag_) = VecVec(sub_vec1, sub_vec2);
+    }
+  }
+  for (int32 lag = first_lag_; lag <= last_lag_; lag++) {
+    BaseFloat e2 = energy_sum[lag + window_size_] - energy_sum[lag],
+        norm = e1 * e2;
+    (*norm_prod)(lag - first_lag_) = norm;
+    if (fft_ != NULL) {
+      // The FFT is not exact, so make sure the inner product obeys the
+      // Cauchy-Schwarz inequality, as ComputeNccf() expects.
+      BaseFloat &prod = (*inner_prod)(lag - first_lag_);
+      if (norm == 0.0) prod = 0.0;
+      else if (prod * prod > norm) prod = (prod > 0 ? 1.0 : -1.0) * sqrt(norm);
+    }
+  }
+}
+
+void NccfCorrelationComputer::Compute(const MatrixBase<BaseFloat> &waves,
+                                      MatrixBase<BaseFloat> *inner_prods,
+                                      MatrixBase<BaseFloat> *norm_prods) {
+  KALDI_ASSERT(inner_prods->NumRows() == waves.NumRows() &&
+               norm_prods->NumRows() == waves.NumRows());
+  for (int32 r = 0; r < waves.NumRows(); r++) {
+    SubVector<BaseFloat> inner_prod(*inner_prods, r), norm_prod(*norm_prods, r);
+    Compute(waves.Row(r), &inner_prod, &norm_prod);
   }
 }
 
@@ -124,7 +196,7 @@ void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
    two vectors) and a denominator term which equals sqrt(e1*e2 + nccf_ballast)
    where e1 and e2 are both dot-products of bits of the wave with themselves,
    and e1*e2 is supplied as "norm_prod".  These quantities are computed by
-   "ComputeCorrelation".
+   class NccfCorrelationComputer.
 */
 void ComputeNccf(const VectorBase<BaseFloat> &inner_prod,
                  const VectorBase<BaseFloat> &norm_prod,
@@ -655,6 +727,9 @@ class OnlinePitchFeatureImpl {
   // This object is used to resample the signal.
   LinearResample *signal_resampler_;
 
+  // This object computes the dot-products needed for the NCCF.
+  NccfCorrelationComputer *nccf_computer_;
+
   // frame_info_ is indexed by [frame-index + 1].  frame_info_[0] is an object
   // that corresponds to frame -1, which is not a real frame.
   std::vector<PitchFrameInfo*> frame_info_;
@@ -721,6 +796,10 @@ OnlinePitchFeatureImpl::OnlinePitchFeatureImpl(
 
   frames_latency_ = 0;  // will be set in AcceptWaveform()
 
+  nccf_computer_ = new NccfCorrelationComputer(nccf_first_lag_,
+                                               nccf_last_lag_,
+                                               opts.NccfWindowSize());
+
   // Choose the lags at which we resample the NCCF.
   SelectLags(opts, &lags_);
 
@@ -1002,6 +1081,7 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
 OnlinePitchFeatureImpl::~OnlinePitchFeatureImpl() {
   delete nccf_resampler_;
   delete signal_resampler_;
+  delete nccf_computer_;
   for (size_t i = 0; i < frame_info_.size(); i++)
     delete frame_info_[i];
   for (size_t i = 0; i < nccf_info_.size(); i++)
@@ -1051,11 +1131,12 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
       basic_frame_length = opts_.NccfWindowSize(),
       full_frame_length = basic_frame_length + nccf_last_lag_;
 
-  Vector<BaseFloat> window(full_frame_length),
-      inner_prod(num_measured_lags),
-      norm_prod(num_measured_lags);
+  Matrix<BaseFloat> windows(num_new_frames, full_frame_length, kUndefined),
+      inner_prod(num_new_frames, num_measured_lags, kUndefined),
+      norm_prod(num_new_frames, num_measured_lags, kUndefined);
   Matrix<BaseFloat> nccf_pitch(num_new_frames, num_measured_lags),
       nccf_pov(num_new_frames, num_measured_lags);
+  Vector<double> mean_square(num_new_frames, kUndefined);
 
   Vector<BaseFloat> cur_forward_cost(num_resampled_lags);
 
@@ -1063,10 +1144,12 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
   // Because the resampling of the NCCF is more efficient when grouped together,
   // we first compute the NCCF for all frames, then resample as a matrix, then
   // do the Viterbi [that happens inside the constructor of PitchFrameInfo].
+  // The dot-products for the NCCF are also computed for all frames together.
 
   for (int32 frame = start_frame; frame < end_frame; frame++) {
     // start_sample is index into the whole wave, not just this part.
     int64 start_sample = static_cast<int64>(frame) * frame_shift;
+    SubVector<BaseFloat> window(windows, frame - start_frame);
     ExtractFrame(downsampled_wave, start_sample, &window);
     if (opts_.nccf_ballast_online) {
       // use only up to end of current frame to compute root-mean-square value.
@@ -1088,23 +1171,30 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
       cur_sum += new_part.Sum();
       prev_frame_end_sample = end_sample;
     }
-    double mean_square = cur_sumsq / cur_num_samp -
+    mean_square(frame - start_frame) = cur_sumsq / cur_num_samp -
         pow(cur_sum / cur_num_samp, 2.0);
+  }
+
+  nccf_computer_->Compute(windows, &inner_prod, &norm_prod);
+  windows.Resize(0, 0);  // no longer needed.
 
-    ComputeCorrelation(window, nccf_first_lag_, nccf_last_lag_,
-                       basic_frame_length, &inner_prod, &norm_prod);
+  for (int32 frame = start_frame; frame < end_frame; frame++) {
+    int32 frame_idx = frame - start_frame;
+    SubVector<BaseFloat> this_inner_prod(inner_prod, frame_idx),
+        this_norm_prod(norm_prod, frame_idx);
     double nccf_ballast_pov = 0.0,
-        nccf_ballast_pitch = pow(mean_square * basic_frame_length, 2) *
-             opts_.nccf_ballast,
-        avg_norm_prod = norm_prod.Sum() / norm_prod.Dim();
-    SubVector<BaseFloat> nccf_pitch_row(nccf_pitch, frame - start_frame);
-    ComputeNccf(inner_prod, norm_prod, nccf_ballast_pitch,
+        nccf_ballast_pitch = pow(mean_square(frame_idx) * basic_frame_length,
+                                 2) * opts_.nccf_ballast,
+        avg_norm_prod = this_norm_prod.Sum() / this_norm_prod.Dim();
+    SubVector<BaseFloat> nccf_pitch_row(nccf_pitch, frame_idx);
+    ComputeNccf(this_inner_prod, this_norm_prod, nccf_ballast_pitch,
                 &nccf_pitch_row);
-    SubVector<BaseFloat> nccf_pov_row(nccf_pov, frame - start_frame);
-    ComputeNccf(inner_prod, norm_prod, nccf_ballast_pov,
+    SubVector<BaseFloat> nccf_pov_row(nccf_pov, frame_idx);
+    ComputeNccf(this_inner_prod, this_norm_prod, nccf_ballast_pov,
                 &nccf_pov_row);
     if (frame < opts_.recompute_frame)
-      nccf_info_.push_back(new NccfInfo(avg_norm_prod, mean_square));
+      nccf_info_.push_back(new NccfInfo(avg_norm_prod,
+                                        mean_square(frame_idx)));
   }
 
   Matrix<BaseFloat> nccf_pitch_resampled(num_new_frames, num_resampled_lags);
@@ -285,6 +285,70 @@ struct ProcessPitchOptions {
 };
 
 
+/**
+   This class computes some dot products that are required while computing the
+   NCCF, for a sequence of frames; it keeps its buffers (and the FFT object, if
+   any) between frames.  For each frame it is given a window "wave" of
+   nccf_window_size + last_lag samples, from which it subtracts the mean of the
+   first nccf_window_size samples.  For each integer lag from first_lag to
+   last_lag, it outputs to (*inner_prod)(lag - first_lag) the dot-product of a
+   window starting at 0 with a window starting at lag.  All windows are of
+   length nccf_window_size.  It outputs to (*norm_prod)(lag - first_lag),
+   e1 * e2, where e1 is the dot-product of the un-shifted window with itself,
+   and e2 is the dot-product of the window shifted by "lag" with itself.
+
+   The energies e2 are differences of a running sum of squares, so they take
+   time proportional to the number of samples, not to the window size times the
+   number of lags.  If there are enough lags that it's faster, the inner
+   products are computed as a cross-correlation using the FFT.  This is only
+   the case for long windows and lag ranges, e.g. at a high --resample-frequency
+   or a low --min-f0.
+ */
+class NccfCorrelationComputer {
+ public:
+  /// How we compute the inner products: kAutomatic chooses whichever of
+  /// kDirect and kFft should be faster; the others are for testing.
+  enum Method { kAutomatic, kDirect, kFft };
+
+  NccfCorrelationComputer(int32 first_lag, int32 last_lag,
+                          int32 nccf_window_size,
+                          Method method = kAutomatic);
+
+  ~NccfCorrelationComputer() { delete fft_; }
+
+  void Compute(const VectorBase<BaseFloat> &wave,
+               VectorBase<BaseFloat> *inner_prod,
+               VectorBase<BaseFloat> *norm_prod);
+
+  /// This is as Compute() above, for a batch of frames; each row of "waves"
+  /// is one window, and the output is to the same row of "inner_prods" and
+  /// "norm_prods".
+  void Compute(const MatrixBase<BaseFloat> &waves,
+               MatrixBase<BaseFloat> *inner_prods,
+               MatrixBase<BaseFloat> *norm_prods);
+
+ private:
+  // Outputs to inner_prod the dot-products of the first window_size_ samples
+  // of zero_mean_wave_ with the windows starting at each lag, using the FFT.
+  void ComputeInnerProdsFft(VectorBase<BaseFloat> *inner_prod);
+
+  int32 first_lag_;
+  int32 last_lag_;
+  int32 window_size_;
+  // The FFT object; NULL if we compute the inner products directly.
+  SplitRadixRealFft<double> *fft_;
+  Vector<BaseFloat> zero_mean_wave_;
+  // energy_sum_(i) is the sum of squares of the first i samples of
+  // zero_mean_wave_.
+  Vector<double> energy_sum_;
+  // Buffers for the FFTs of the window and of the whole wave.
+  Vector<double> window_fft_;
+  Vector<double> wave_fft_;
+  std::vector<double> temp_buffer_;  // used by fft_.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NccfCorrelationComputer);
+};
+
 // We don't want to expose the pitch-extraction internals here as it's
 // quite complex, so we use a private implementation.
 class OnlinePitchFeatureImpl;
@@ -27,6 +27,25 @@
 
 namespace kaldi {
 
+// Returns the inner product of a and b, which have dimension n.  The filters
+// here are short (a few tens of taps), so this is faster than calling VecVec(),
+// which goes to BLAS.  The four separate sums let the compiler use SIMD
+// instructions and avoid waiting on each addition.
+static inline BaseFloat DotProduct(const BaseFloat *a, const BaseFloat *b,
+                                   int32 n) {
+  BaseFloat sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+  int32 i = 0;
+  for (; i + 4 <= n; i += 4) {
+    sum0 += a[i] * b[i];
+    sum1 += a[i + 1] * b[i + 1];
+    sum2 += a[i + 2] * b[i + 2];
+    sum3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < n; i++)
+    sum0 += a[i] * b[i];
+  return (sum0 + sum1) + (sum2 + sum3);
+}
+
 
 LinearResample::LinearResample(int32 samp_rate_in_hz,
                                int32 samp_rate_out_hz,
@@ -159,26 +178,35 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
   output->Resize(tot_output_samp - output_sample_offset_);
 
   // samp_out is the index into the total output signal, not just the part
-  // of it we are producing here.
-  for (int64 samp_out = output_sample_offset_;
-       samp_out < tot_output_samp;
+  // of it we are producing here.  We work out the filter phase
+  // (samp_out_wrapped) and first input sample for the first output sample,
+  // and then advance them incrementally, rather than dividing for each sample.
+  int64 first_samp_out = output_sample_offset_;
+  int64 unit_first_samp_in;
+  int32 samp_out_wrapped;
+  GetIndexes(first_samp_out, &unit_first_samp_in, &samp_out_wrapped);
+  // unit_first_samp_in is now the input sample corresponding to the start of
+  // the unit we are in, i.e. first_samp_in minus first_index_[phase].
+  unit_first_samp_in -= first_index_[samp_out_wrapped];
+  const BaseFloat *input_data = input.Data();
+  BaseFloat *output_data = output->Data();
+  for (int64 samp_out = first_samp_out; samp_out < tot_output_samp;
        samp_out++) {
-    int64 first_samp_in;
-    int32 samp_out_wrapped;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
     const Vector<BaseFloat> &weights = weights_[samp_out_wrapped];
+    int32 num_weights = weights.Dim();
     // first_input_index is the first index into "input" that we have a weight
     // for.
-    int32 first_input_index = static_cast<int32>(first_samp_in -
-                                                 input_sample_offset_);
+    int32 first_input_index = static_cast<int32>(
+        unit_first_samp_in + first_index_[samp_out_wrapped] -
+        input_sample_offset_);
     BaseFloat this_output;
     if (first_input_index >= 0 &&
-        first_input_index + weights.Dim() <= input_dim) {
-      SubVector<BaseFloat> input_part(input, first_input_index, weights.Dim());
-      this_output = VecVec(input_part, weights);
+        first_input_index + num_weights <= input_dim) {
+      this_output = DotProduct(input_data + first_input_index,
+                               weights.Data(), num_weights);
     } else {  // Handle edge cases.
       this_output = 0.0;
-      for (int32 i = 0; i < weights.Dim(); i++) {
+      for (int32 i = 0; i < num_weights; i++) {
         BaseFloat weight = weights(i);
         int32 input_index = first_input_index + i;
         if (input_index < 0 && input_remainder_.Dim() + input_index >= 0) {
@@ -194,8 +222,11 @@ void LinearResample::Resample(const VectorBase<BaseFloat> &input,
         }
       }
     }
-    int32 output_index = static_cast<int32>(samp_out - output_sample_offset_);
-    (*output)(output_index) = this_output;
+    output_data[samp_out - first_samp_out] = this_output;
+    if (++samp_out_wrapped == output_samples_in_unit_) {
+      samp_out_wrapped = 0;
+      unit_first_samp_in += input_samples_in_unit_;
+    }
   }
 
   if (flush) {
@@ -302,10 +333,10 @@ void ArbitraryResample::Resample(const VectorBase<BaseFloat> &input,
                output->Dim() == weights_.size());
   
   int32 output_dim = output->Dim();
-  for (int32 i = 0; i < output_dim; i++) {
-    SubVector<BaseFloat> input_part(input, first_index_[i], weights_[i].Dim());
-    (*output)(i) = VecVec(input_part, weights_[i]);
-  }
+  const BaseFloat *input_data = input.Data();
+  for (int32 i = 0; i < output_dim; i++)
+    (*output)(i) = DotProduct(input_data + first_index_[i],
+                              weights_[i].Data(), weights_[i].Dim());
 }
 
 void ArbitraryResample::SetIndexes(const Vector<BaseFloat> &sample_points) {
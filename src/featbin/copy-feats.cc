@@ -21,6 +21,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
+#include "util/matrix-view-reader.h"
 
 
 int main(int argc, char *argv[]) {
@@ -91,7 +92,8 @@ int main(int argc, char *argv[]) {
             kaldi_writer.Write(sphinx_reader.Key(),
                                CompressedMatrix(sphinx_reader.Value()));
         } else {
-          SequentialBaseFloatMatrixReader kaldi_reader(rspecifier);
+          // We compress straight from the input archive, without copying.
+          SequentialBaseFloatMatrixViewReader kaldi_reader(rspecifier);
           for (; !kaldi_reader.Done(); kaldi_reader.Next(), num_done++)
             kaldi_writer.Write(kaldi_reader.Key(),
                                CompressedMatrix(kaldi_reader.Value()));
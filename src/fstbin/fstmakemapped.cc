@@ -0,0 +1,76 @@
+// fstbin/fstmakemapped.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/kaldi-io.h"
+#include "util/parse-options.h"
+#include "fst/fstlib.h"
+#include "fstext/fstext-utils.h"
+#include "fstext/mapped-fst.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+    using kaldi::int32;
+
+    const char *usage =
+        "Converts an FST (typically a decoding graph, HCLG.fst) to the\n"
+        "memory-mappable format that is read by the decoding programs\n"
+        "without deserialization, so that it loads almost instantly and is\n"
+        "shared between processes on the same machine.  The output should\n"
+        "be a regular file (not a pipe) for it to be memory-mapped.  With\n"
+        "--reverse=true, converts from that format back to a normal FST.\n"
+        "\n"
+        "Usage:  fstmakemapped [options] [in.fst [out.fst] ]\n"
+        "e.g.: fstmakemapped exp/tri3/graph/HCLG.fst exp/tri3/graph/HCLG.mfst\n";
+
+    bool reverse = false;
+    ParseOptions po(usage);
+    po.Register("reverse", &reverse, "If true, convert a memory-mappable FST "
+                "back to the normal (VectorFst) format.");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() > 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fst_in_filename = po.GetOptArg(1),
+        fst_out_filename = po.GetOptArg(2);
+
+    if (!reverse) {
+      VectorFst<StdArc> *fst = ReadFstKaldi(fst_in_filename);
+      WriteMappedFst(*fst, fst_out_filename);
+      KALDI_LOG << "Wrote memory-mappable FST with " << fst->NumStates()
+                << " states to " << PrintableWxfilename(fst_out_filename);
+      delete fst;
+    } else {
+      MappedFst *mapped = MappedFst::Read(fst_in_filename);
+      VectorFst<StdArc> fst(*mapped);
+      delete mapped;
+      WriteFstKaldi(fst, fst_out_filename);
+    }
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
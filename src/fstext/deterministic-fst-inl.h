@@ -253,6 +253,138 @@ bool CacheDeterministicOnDemandFst<Arc>::GetArc(StateId s, Label ilabel,
   }  
 }
 
+template<class Arc>
+ThreadSafeCacheDeterministicOnDemandFst<Arc>::
+ThreadSafeCacheDeterministicOnDemandFst(DeterministicOnDemandFst<Arc> *fst,
+                                        StateId num_cached_arcs,
+                                        int32 num_mutexes):
+    fst_(fst), num_states_seen_(0), num_cached_arcs_(num_cached_arcs),
+    cached_arcs_(num_cached_arcs), cache_mutexes_(num_mutexes) {
+  KALDI_ASSERT(num_cached_arcs > 0 && num_mutexes > 0);
+  for (StateId i = 0; i < num_cached_arcs; i++)
+    cached_arcs_[i].first = kNoStateId; // Invalidate all elements of the cache.
+  for (int32 i = 0; i < num_mutexes; i++)
+    cache_mutexes_[i] = new kaldi::Mutex();
+}
+
+template<class Arc>
+ThreadSafeCacheDeterministicOnDemandFst<Arc>::
+~ThreadSafeCacheDeterministicOnDemandFst() {
+  for (size_t i = 0; i < cache_mutexes_.size(); i++)
+    delete cache_mutexes_[i];
+}
+
+template<class Arc>
+inline size_t ThreadSafeCacheDeterministicOnDemandFst<Arc>::GetIndex(
+    StateId src_state, Label ilabel) {
+  // The same as in CacheDeterministicOnDemandFst.
+  const StateId p1 = 26597, p2 = 50329;
+  return static_cast<size_t>(src_state * p1 + ilabel * p2) %
+      static_cast<size_t>(num_cached_arcs_);
+}
+
+template<class Arc>
+typename Arc::StateId ThreadSafeCacheDeterministicOnDemandFst<Arc>::Start() {
+  fst_mutex_.Lock();
+  StateId ans = fst_->Start();
+  if (ans >= num_states_seen_)
+    num_states_seen_ = ans + 1;
+  fst_mutex_.Unlock();
+  return ans;
+}
+
+template<class Arc>
+typename Arc::Weight ThreadSafeCacheDeterministicOnDemandFst<Arc>::Final(
+    StateId s) {
+  fst_mutex_.Lock();
+  Weight ans = fst_->Final(s);
+  fst_mutex_.Unlock();
+  return ans;
+}
+
+template<class Arc>
+typename Arc::StateId
+ThreadSafeCacheDeterministicOnDemandFst<Arc>::NumStatesSeen() {
+  fst_mutex_.Lock();
+  StateId ans = num_states_seen_;
+  fst_mutex_.Unlock();
+  return ans;
+}
+
+template<class Arc>
+bool ThreadSafeCacheDeterministicOnDemandFst<Arc>::LookupCached(
+    StateId s, Label ilabel, Arc *oarc) {
+  size_t index = GetIndex(s, ilabel);
+  kaldi::Mutex *mutex = cache_mutexes_[index % cache_mutexes_.size()];
+  mutex->Lock();
+  const std::pair<StateId, Arc> &elem = cached_arcs_[index];
+  bool ans = (elem.first == s && elem.second.ilabel == ilabel);
+  if (ans)
+    *oarc = elem.second;
+  mutex->Unlock();
+  return ans;
+}
+
+template<class Arc>
+void ThreadSafeCacheDeterministicOnDemandFst<Arc>::Cache(StateId s,
+                                                         const Arc &arc) {
+  size_t index = GetIndex(s, arc.ilabel);
+  kaldi::Mutex *mutex = cache_mutexes_[index % cache_mutexes_.size()];
+  mutex->Lock();
+  cached_arcs_[index].first = s;
+  cached_arcs_[index].second = arc;
+  mutex->Unlock();
+}
+
+template<class Arc>
+bool ThreadSafeCacheDeterministicOnDemandFst<Arc>::GetArc(StateId s,
+                                                          Label ilabel,
+                                                          Arc *oarc) {
+  // As in CacheDeterministicOnDemandFst, we don't cache anything in case a
+  // requested arc does not exist.
+  KALDI_ASSERT(s >= 0 && ilabel != 0);
+  if (LookupCached(s, ilabel, oarc))
+    return true;
+  fst_mutex_.Lock();
+  bool ans = fst_->GetArc(s, ilabel, oarc);
+  if (ans)
+    SawArc(*oarc);
+  fst_mutex_.Unlock();
+  if (ans)
+    Cache(s, *oarc);
+  return ans;
+}
+
+template<class Arc>
+void ThreadSafeCacheDeterministicOnDemandFst<Arc>::GetArcs(
+    const std::vector<std::pair<StateId, Label> > &queries,
+    std::vector<Arc> *oarcs) {
+  oarcs->resize(queries.size());
+  // The queries that were not in the cache, and their indexes in "queries".
+  std::vector<std::pair<StateId, Label> > uncached_queries;
+  std::vector<size_t> uncached_indexes;
+  for (size_t i = 0; i < queries.size(); i++) {
+    KALDI_ASSERT(queries[i].first >= 0 && queries[i].second != 0);
+    if (!LookupCached(queries[i].first, queries[i].second, &((*oarcs)[i]))) {
+      uncached_queries.push_back(queries[i]);
+      uncached_indexes.push_back(i);
+    }
+  }
+  if (uncached_queries.empty())
+    return;
+  std::vector<Arc> uncached_arcs;
+  fst_mutex_.Lock();
+  fst_->GetArcs(uncached_queries, &uncached_arcs);
+  for (size_t j = 0; j < uncached_arcs.size(); j++)
+    SawArc(uncached_arcs[j]);
+  fst_mutex_.Unlock();
+  for (size_t j = 0; j < uncached_arcs.size(); j++) {
+    (*oarcs)[uncached_indexes[j]] = uncached_arcs[j];
+    if (uncached_arcs[j].nextstate != kNoStateId)
+      Cache(uncached_queries[j].first, uncached_arcs[j]);
+  }
+}
+
 template<class Arc>
 LmExampleDeterministicOnDemandFst<Arc>::LmExampleDeterministicOnDemandFst(
     void *lm, Label bos_symbol, Label eos_symbol):
@@ -177,6 +177,53 @@ void TestBackoffAndCache() {
   delete rfst;
 }
 
+void TestThreadSafeCache() {
+  cout << "Test thread-safe cache with single generated backoff FST" << endl;
+  StdVectorFst *nfst = CreateBackoffFst();
+  StdVectorFst *rfst = CreateResultFst();
+
+  ArcSort(nfst, StdILabelCompare());
+  BackoffDeterministicOnDemandFst<StdArc> dfst1a(*nfst);
+  // Use a small cache so that some arcs evict others.
+  ThreadSafeCacheDeterministicOnDemandFst<StdArc> dfst1(&dfst1a, 3, 2);
+  KALDI_ASSERT(dfst1.Start() == rfst->Start());
+
+  // Look up all the arcs twice with GetArcs() (the second time, some of them
+  // will come from the cache), with one non-existent arc in the middle.
+  std::vector<std::pair<StateId, StdArc::Label> > queries;
+  std::vector<StdArc> rarcs;
+  for (StateIterator<StdVectorFst> riter(*rfst); !riter.Done(); riter.Next()) {
+    StateId rsrc = riter.Value();
+    assert(ApproxEqual(rfst->Final(rsrc), dfst1.Final(rsrc)));
+    for (ArcIterator<StdVectorFst> aiter(*rfst, rsrc); !aiter.Done();
+         aiter.Next()) {
+      queries.push_back(std::make_pair(rsrc, aiter.Value().ilabel));
+      rarcs.push_back(aiter.Value());
+    }
+  }
+  size_t num_arcs = rarcs.size();
+  std::vector<std::pair<StateId, StdArc::Label> > arc_queries(queries);
+  queries.push_back(std::make_pair(rfst->Start(), 1000));
+  queries.insert(queries.end(), arc_queries.begin(), arc_queries.end());
+  std::vector<StdArc> darcs;
+  dfst1.GetArcs(queries, &darcs);
+  KALDI_ASSERT(darcs.size() == 2 * num_arcs + 1 &&
+               darcs[num_arcs].nextstate == kNoStateId);
+  for (size_t i = 0; i < darcs.size(); i++) {
+    if (i == num_arcs) continue;
+    const StdArc &rarc = rarcs[i % (num_arcs + 1)], &darc = darcs[i];
+    assert(ApproxEqual(rarc.weight, darc.weight, 0.001));
+    assert(rarc.ilabel == darc.ilabel && rarc.olabel == darc.olabel);
+    assert(rarc.nextstate == darc.nextstate);
+    StdArc arc;
+    KALDI_ASSERT(dfst1.GetArc(queries[i].first, queries[i].second, &arc) &&
+                 arc.nextstate == darc.nextstate);
+  }
+  KALDI_ASSERT(dfst1.NumStatesSeen() <= rfst->NumStates());
+  delete nfst;
+  delete rfst;
+}
+
 void TestCompose() {
   cout << "Test with single generated backoff FST" << endl;
   StdVectorFst *nfst = CreateBackoffFst();
@@ -224,6 +271,7 @@ void TestCompose() {
 int main() {
   using namespace fst;
   TestBackoffAndCache();
+  TestThreadSafeCache();
   TestCompose();
 }
   
@@ -56,6 +56,7 @@
 #include <fst/fst-decl.h>
 
 #include "util/stl-utils.h"
+#include "thread/kaldi-mutex.h"
 
 namespace fst {
 
@@ -86,6 +87,21 @@ class DeterministicOnDemandFst {
   /// Note: ilabel must not be epsilon.
   virtual bool GetArc(StateId s, Label ilabel, Arc *oarc) = 0;
 
+  /// Batched form of GetArc(): for each (state, ilabel) pair in "queries",
+  /// sets the corresponding element of "oarcs" to the arc that GetArc() would
+  /// output, or sets its nextstate to kNoStateId if GetArc() would return
+  /// false.  The default implementation just calls GetArc(); classes whose
+  /// lookups are dominated by memory latency can override it to overlap the
+  /// lookups (e.g. by prefetching).
+  virtual void GetArcs(const std::vector<std::pair<StateId, Label> > &queries,
+                       std::vector<Arc> *oarcs) {
+    oarcs->resize(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+      if (!GetArc(queries[i].first, queries[i].second, &((*oarcs)[i])))
+        (*oarcs)[i].nextstate = kNoStateId;
+    }
+  }
+
   virtual ~DeterministicOnDemandFst() { }
 };
 
@@ -211,6 +227,79 @@ class CacheDeterministicOnDemandFst: public DeterministicOnDemandFst<Arc> {
   std::vector<std::pair<StateId, Arc> > cached_arcs_;
 };
 
+/**
+   This is a version of CacheDeterministicOnDemandFst that can be shared by
+   several threads, e.g. when rescoring different lattices with the same
+   language model in parallel.  All the threads use the same underlying FST, so
+   its state-ids mean the same thing in all of them, and an arc that one thread
+   has looked up is in the cache for the others.  The cache has a fixed size, as
+   in CacheDeterministicOnDemandFst; it is protected by a number of mutexes,
+   each for a subset of its elements, so threads rarely have to wait for each
+   other.  The underlying FST is only accessed with a single mutex held, so it
+   does not itself need to be thread-safe; GetArcs() looks up all the arcs that
+   were not in the cache with one call to the underlying FST.
+   Note: that mutex means that cache misses are handled by one thread at a
+   time, so the threads only scale well if most lookups hit the cache.  We
+   can't split it up, because the on-demand FSTs create states (and so modify
+   their state maps) in GetArc(); make num_cached_arcs large instead.
+ */
+template<class Arc>
+class ThreadSafeCacheDeterministicOnDemandFst:
+      public DeterministicOnDemandFst<Arc> {
+ public:
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  typedef typename Arc::Label Label;
+
+  /// We don't take ownership of this pointer.  The argument is "really" const.
+  ThreadSafeCacheDeterministicOnDemandFst(DeterministicOnDemandFst<Arc> *fst,
+                                          StateId num_cached_arcs = 1000000,
+                                          int32 num_mutexes = 1024);
+
+  virtual StateId Start();
+
+  /// We don't bother caching the final-probs, just the arcs.
+  virtual Weight Final(StateId s);
+
+  virtual bool GetArc(StateId s, Label ilabel, Arc *oarc);
+
+  virtual void GetArcs(const std::vector<std::pair<StateId, Label> > &queries,
+                       std::vector<Arc> *oarcs);
+
+  /// Returns one plus the largest state-id that the underlying FST has given
+  /// us so far.  For FSTs that number their states consecutively as they
+  /// create them (as all the on-demand FSTs in Kaldi do), this is the number of
+  /// states it has created, which tells you how much memory it is using.
+  StateId NumStatesSeen();
+
+  virtual ~ThreadSafeCacheDeterministicOnDemandFst();
+
+ private:
+  // Get index for cached arc.
+  inline size_t GetIndex(StateId src_state, Label ilabel);
+
+  // Looks up the arc in the cache; returns false if it is not there.
+  bool LookupCached(StateId s, Label ilabel, Arc *oarc);
+
+  // Puts the arc in the cache.
+  void Cache(StateId s, const Arc &arc);
+
+  // Updates num_states_seen_ for this arc; fst_mutex_ must be held.
+  void SawArc(const Arc &arc) {
+    if (arc.nextstate != kNoStateId && arc.nextstate >= num_states_seen_)
+      num_states_seen_ = arc.nextstate + 1;
+  }
+
+  DeterministicOnDemandFst<Arc> *fst_;
+  kaldi::Mutex fst_mutex_;  // protects fst_ and num_states_seen_; see above.
+  StateId num_states_seen_;
+  StateId num_cached_arcs_;
+  std::vector<std::pair<StateId, Arc> > cached_arcs_;
+  // cache_mutexes_[i % cache_mutexes_.size()] protects cached_arcs_[i].
+  std::vector<kaldi::Mutex*> cache_mutexes_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadSafeCacheDeterministicOnDemandFst);
+};
+
 
 /// This class is for didactic purposes, it does not really do anything.
 /// It shows how you would wrap a language model.  Note: you should probably
@@ -30,6 +30,8 @@ namespace fst {
 // This class maps back and forth from/to integer id's to sequences of strings.
 // used in determinization algorithm.  It is constructed in such a way that
 // finding the string-id of the successor of (string, next-label) has constant time.
+// The Entries are allocated in blocks and kept in an open-addressing hash table,
+// so there is no memory allocation per string.
 
 // Note: class IntType, typically int32, is the type of the element in the
 // string (typically a template argument of the CompactLatticeWeightTpl).
@@ -54,20 +56,21 @@ template<class IntType> class LatticeStringRepository {
   // Returns string of "parent" with i appended.  Pointer
   // owned by repository
   const Entry *Successor(const Entry *parent, IntType i) {
-    new_entry_->parent = parent;
-    new_entry_->i = i;
-    
-    std::pair<typename SetType::iterator, bool> pr = set_.insert(new_entry_);
-    if (pr.second) { // Was successfully inserted (was not there).  We need to
-                     // replace the element we inserted, which resides on the
-                     // stack, with one from the heap.
-      const Entry *ans = new_entry_;
-      new_entry_ = new Entry();
-      return ans;
-    } else { // Was not inserted because an equivalent Entry already
-             // existed.
-      return *pr.first;
+    if (2 * (num_entries_ + 1) > table_.size())
+      ResizeTable(table_.empty() ? kMinTableSize : 2 * table_.size());
+    size_t mask = table_.size() - 1, index = Hash(parent, i) & mask;
+    while (table_[index] != NULL) {
+      Entry *entry = table_[index];
+      if (entry->parent == parent && entry->i == i)
+        return entry;
+      index = (index + 1) & mask;
     }
+    Entry *entry = NewEntry();
+    entry->parent = parent;
+    entry->i = i;
+    table_[index] = entry;
+    num_entries_++;
+    return entry;
   }
 
   const Entry *Concatenate (const Entry *a, const Entry *b) {
@@ -164,19 +167,16 @@ template<class IntType> class LatticeStringRepository {
     return e;
   }
   
-  LatticeStringRepository() { new_entry_ = new Entry; }
-  
+  LatticeStringRepository(): num_entries_(0), block_used_(kBlockSize) { }
+
   void Destroy() {
-    for (typename SetType::iterator iter = set_.begin();
-         iter != set_.end();
-         ++iter)
-      delete *iter;
-    SetType tmp;
-    tmp.swap(set_);
-    if (new_entry_) {
-      delete new_entry_;
-      new_entry_ = NULL;
-    }
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+    { std::vector<Entry*> tmp; tmp.swap(blocks_); }
+    { std::vector<Entry*> tmp; tmp.swap(free_list_); }
+    { std::vector<Entry*> tmp; tmp.swap(table_); }
+    num_entries_ = 0;
+    block_used_ = kBlockSize;
   }
 
   // Rebuild will rebuild this object, guaranteeing only
@@ -184,62 +184,116 @@ template<class IntType> class LatticeStringRepository {
   // to (this list does not have to be unique).  The point of
   // this is to save memory.
   void Rebuild(const std::vector<const Entry*> &to_keep) {
-    SetType tmp_set;
+    std::vector<Entry*> old_table;
+    old_table.swap(table_);
+    num_entries_ = 0;
     for (typename std::vector<const Entry*>::const_iterator
              iter = to_keep.begin();
          iter != to_keep.end(); ++iter)
-      RebuildHelper(*iter, &tmp_set);
-    // Now delete all elems not in tmp_set.
-    for (typename SetType::iterator iter = set_.begin();
-         iter != set_.end(); ++iter) {
-      if (tmp_set.count(*iter) == 0)
-        delete (*iter); // delete the Entry; not needed.
+      RebuildHelper(*iter);
+    // Now put all entries that were not kept on the free list.
+    for (size_t i = 0; i < old_table.size(); i++) {
+      Entry *entry = old_table[i];
+      if (entry != NULL && Find(entry->parent, entry->i) != entry)
+        free_list_.push_back(entry);
     }
-    set_.swap(tmp_set);
   }
-  
+
   ~LatticeStringRepository() { Destroy(); }
   int32 MemSize() const {
-    return set_.size() * sizeof(Entry) * 2; // this is a lower bound
-    // on the size this structure might take.
+    return num_entries_ * sizeof(Entry) + table_.size() * sizeof(Entry*);
   }
- private:  
-  class EntryKey { // Hash function object.
-   public:
-    inline size_t operator()(const Entry *entry) const {
-      size_t prime = 49109;
-      return static_cast<size_t>(entry->i)
-          + prime * reinterpret_cast<size_t>(entry->parent);
+ private:
+  // Entries are allocated in blocks of this size.
+  static const size_t kBlockSize = 1024;
+  static const size_t kMinTableSize = 64;
+
+  // Entries are allocated consecutively, so dividing the address of the parent
+  // by sizeof(Entry) gives something like a sequence number.
+  static inline size_t Hash(const Entry *parent, IntType i) {
+    size_t hash = reinterpret_cast<size_t>(parent) / sizeof(Entry) * 49109 +
+        static_cast<size_t>(i) * 7853;
+    return hash ^ (hash >> 15);
+  }
+
+  // Returns the Entry for (parent, i), or NULL if there is none.
+  Entry *Find(const Entry *parent, IntType i) const {
+    if (table_.empty()) return NULL;
+    size_t mask = table_.size() - 1, index = Hash(parent, i) & mask;
+    while (table_[index] != NULL) {
+      Entry *entry = table_[index];
+      if (entry->parent == parent && entry->i == i)
+        return entry;
+      index = (index + 1) & mask;
     }
-  };
-  class EntryEqual {
-   public:
-    inline bool operator()(const Entry *e1, const Entry *e2) const {
-      return (*e1 == *e2);
+    return NULL;
+  }
+
+  // Adds "entry", which must not already be in the table, to the table.
+  void Insert(Entry *entry) {
+    if (2 * (num_entries_ + 1) > table_.size())
+      ResizeTable(table_.empty() ? kMinTableSize : 2 * table_.size());
+    size_t mask = table_.size() - 1,
+        index = Hash(entry->parent, entry->i) & mask;
+    while (table_[index] != NULL)
+      index = (index + 1) & mask;
+    table_[index] = entry;
+    num_entries_++;
+  }
+
+  // new_size must be a power of two.
+  void ResizeTable(size_t new_size) {
+    std::vector<Entry*> old_table(new_size, static_cast<Entry*>(NULL));
+    old_table.swap(table_);
+    size_t mask = new_size - 1;
+    for (size_t i = 0; i < old_table.size(); i++) {
+      Entry *entry = old_table[i];
+      if (entry == NULL) continue;
+      size_t index = Hash(entry->parent, entry->i) & mask;
+      while (table_[index] != NULL)
+        index = (index + 1) & mask;
+      table_[index] = entry;
     }
-  };
-  typedef unordered_set<const Entry*, EntryKey, EntryEqual> SetType;
-
-  void RebuildHelper(const Entry *to_add, SetType *tmp_set) {
-    while(true) {
-      if (to_add == NULL) return;
-      typename SetType::iterator iter = tmp_set->find(to_add);
-      if (iter == tmp_set->end()) { // not in tmp_set.
-        tmp_set->insert(to_add);
-        to_add = to_add->parent; // and loop.
-      } else {
-        return;
-      }
+  }
+
+  Entry *NewEntry() {
+    if (!free_list_.empty()) {
+      Entry *ans = free_list_.back();
+      free_list_.pop_back();
+      return ans;
+    }
+    if (block_used_ == kBlockSize) {
+      blocks_.push_back(new Entry[kBlockSize]);
+      block_used_ = 0;
     }
+    return blocks_.back() + block_used_++;
   }
-  
-  DISALLOW_COPY_AND_ASSIGN(LatticeStringRepository);
-  Entry *new_entry_; // We always have a pre-allocated Entry ready to use,
-                     // to avoid unnecessary news and deletes.
-  SetType set_;
 
+  void RebuildHelper(const Entry *to_add) {
+    while (to_add != NULL && Find(to_add->parent, to_add->i) == NULL) {
+      Insert(const_cast<Entry*>(to_add));
+      to_add = to_add->parent;
+    }
+  }
+
+  DISALLOW_COPY_AND_ASSIGN(LatticeStringRepository);
+  // Open-addressing hash table (with linear probing) of all the Entries in
+  // use; the size is a power of two, and at most half of it is used.
+  std::vector<Entry*> table_;
+  size_t num_entries_;
+  // The Entries are allocated from blocks_, of which only the first
+  // block_used_ elements of the last one have been handed out; Entries freed
+  // by Rebuild() go on free_list_.
+  std::vector<Entry*> blocks_;
+  size_t block_used_;
+  std::vector<Entry*> free_list_;
 };
 
+template<class IntType>
+const size_t LatticeStringRepository<IntType>::kBlockSize;
+template<class IntType>
+const size_t LatticeStringRepository<IntType>::kMinTableSize;
+
 
 
 
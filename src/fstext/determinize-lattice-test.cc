@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <map>
 #include "fstext/determinize-lattice.h"
 #include "fstext/lattice-utils.h"
 #include "fstext/fst-test-utils.h"
@@ -67,6 +68,63 @@ void TestLatticeStringRepository() {
   }
 }
 
+// test the repository with many strings, so that its hash table grows several
+// times (with many collisions along the way) and the entries come from several
+// blocks; then keep some of the strings with Rebuild(), which puts the others
+// on the free list, and test that the kept ones are still found and that new
+// strings can be added.
+void TestLatticeStringRepositoryGrowth() {
+  typedef int32 IntType;
+
+  LatticeStringRepository<IntType> sr;
+  typedef LatticeStringRepository<IntType>::Entry Entry;
+  typedef std::map<vector<IntType>, const Entry*> MapType;
+  MapType strings;
+
+  for(int i = 0; i < 5000; i++) {
+    vector<IntType> str(kaldi::Rand() % 6), str2;
+    const Entry *e = NULL;
+    for(size_t j = 0; j < str.size(); j++) {
+      str[j] = kaldi::Rand() % 8;
+      e = sr.Successor(e, str[j]);
+    }
+    sr.ConvertToVector(e, &str2);
+    assert(str == str2);
+    MapType::iterator iter = strings.find(str);
+    if (iter != strings.end())
+      assert(iter->second == e);
+    else
+      strings[str] = e;
+  }
+
+  vector<const Entry*> to_keep;
+  MapType kept;
+  for (MapType::iterator iter = strings.begin(); iter != strings.end(); ++iter) {
+    if (kaldi::Rand() % 2 == 0) {
+      to_keep.push_back(iter->second);
+      kept.insert(*iter);
+    }
+  }
+  sr.Rebuild(to_keep);
+
+  for (MapType::iterator iter = kept.begin(); iter != kept.end(); ++iter) {
+    const vector<IntType> &str = iter->first;
+    const Entry *e = NULL;
+    for(size_t j = 0; j < str.size(); j++)
+      e = sr.Successor(e, str[j]);
+    assert(e == iter->second);  // it was still there.
+  }
+  for (MapType::iterator iter = strings.begin(); iter != strings.end(); ++iter) {
+    const vector<IntType> &str = iter->first;
+    vector<IntType> str2;
+    const Entry *e = NULL;
+    for(size_t j = 0; j < str.size(); j++)
+      e = sr.Successor(e, str[j]);
+    sr.ConvertToVector(e, &str2);
+    assert(str == str2);
+  }
+}
+
 
 // test that determinization proceeds correctly on general
 // FSTs (not guaranteed determinzable, but we use the
@@ -190,6 +248,7 @@ template<class Arc> void TestDeterminizeLattice2() {
 int main() {
   using namespace fst;
   TestLatticeStringRepository();
+  TestLatticeStringRepositoryGrowth();
   TestDeterminizeLattice<StdArc>();
   TestDeterminizeLattice2<StdArc>();
   std::cout << "Tests succeeded\n";
@@ -0,0 +1,147 @@
+// fstext/mapped-fst-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "fstext/mapped-fst.h"
+#include "fstext/rand-fst.h"
+#include "fstext/fstext-utils.h"
+
+
+namespace fst {
+
+// Checks that the two FSTs are identical, state by state and arc by arc.
+void AssertIdentical(const ExpandedFst<StdArc> &fst1,
+                     const ExpandedFst<StdArc> &fst2) {
+  typedef StdArc::StateId StateId;
+  KALDI_ASSERT(fst1.NumStates() == fst2.NumStates());
+  KALDI_ASSERT(fst1.Start() == fst2.Start());
+  for (StateId s = 0; s < fst1.NumStates(); s++) {
+    KALDI_ASSERT(fst1.Final(s) == fst2.Final(s));
+    KALDI_ASSERT(fst1.NumArcs(s) == fst2.NumArcs(s));
+    KALDI_ASSERT(fst1.NumInputEpsilons(s) == fst2.NumInputEpsilons(s));
+    KALDI_ASSERT(fst1.NumOutputEpsilons(s) == fst2.NumOutputEpsilons(s));
+    ArcIterator<ExpandedFst<StdArc> > aiter1(fst1, s), aiter2(fst2, s);
+    for (; !aiter1.Done(); aiter1.Next(), aiter2.Next()) {
+      KALDI_ASSERT(!aiter2.Done());
+      const StdArc &arc1 = aiter1.Value(), &arc2 = aiter2.Value();
+      KALDI_ASSERT(arc1.ilabel == arc2.ilabel && arc1.olabel == arc2.olabel &&
+                   arc1.weight == arc2.weight &&
+                   arc1.nextstate == arc2.nextstate);
+    }
+    KALDI_ASSERT(aiter2.Done());
+  }
+}
+
+void TestMappedFst() {
+  RandFstOptions opts;
+  VectorFst<StdArc> *fst = RandFst<StdArc>(opts);
+
+  WriteMappedFst(*fst, "tmpf.mapped");
+  KALDI_ASSERT(MappedFst::IsMappedFstFile("tmpf.mapped"));
+  {
+    // This will be memory-mapped.
+    MappedFst *mapped = MappedFst::Read("tmpf.mapped");
+    AssertIdentical(*fst, *mapped);
+    KALDI_ASSERT(mapped->Properties(kExpanded, false) == kExpanded);
+    KALDI_ASSERT(RandEquivalent(*fst, *mapped, 5, 0.01, kaldi::Rand(), 10));
+    MappedFst *copy = mapped->Copy();
+    delete mapped;  // the copy should still be usable.
+    AssertIdentical(*fst, *copy);
+    // Check that the generic iterators work too.
+    VectorFst<StdArc> vec_copy(*copy);
+    AssertIdentical(*fst, vec_copy);
+    delete copy;
+  }
+  {
+    // This will be read into memory, not mapped.
+    MappedFst *read = MappedFst::Read("cat tmpf.mapped |");
+    AssertIdentical(*fst, *read);
+    delete read;
+  }
+  {
+    Fst<StdArc> *graph = ReadMappedOrVectorFst("tmpf.mapped");
+    KALDI_ASSERT(graph->Type() == "kaldi_mapped");
+    delete graph;
+    // The format should be recognized when reading from a pipe too.
+    graph = ReadMappedOrVectorFst("cat tmpf.mapped |");
+    KALDI_ASSERT(graph->Type() == "kaldi_mapped");
+    AssertIdentical(*fst, *static_cast<MappedFst*>(graph));
+    delete graph;
+  }
+  {
+    // An FST in the normal format should be read as a VectorFst.
+    WriteFstKaldi(*fst, "tmpf.fst");
+    KALDI_ASSERT(!MappedFst::IsMappedFstFile("tmpf.fst"));
+    Fst<StdArc> *graph = ReadMappedOrVectorFst("tmpf.fst");
+    KALDI_ASSERT(graph->Type() == "vector");
+    delete graph;
+    graph = ReadMappedOrVectorFst("cat tmpf.fst |");
+    KALDI_ASSERT(graph->Type() == "vector");
+    AssertIdentical(*fst, *static_cast<VectorFst<StdArc>*>(graph));
+    delete graph;
+  }
+  if (fst->NumStates() > 0) {
+    // Make the arcs of the last state point past the end of the arc array; it
+    // should be an error to read the file.
+    std::string data;
+    {
+      std::ifstream is("tmpf.mapped", std::ios::in | std::ios::binary);
+      std::ostringstream os;
+      os << is.rdbuf();
+      data = os.str();
+    }
+    MappedFstHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    MappedFstState state;
+    size_t pos = header.states_offset +
+        (header.num_states - 1) * sizeof(MappedFstState);
+    memcpy(&state, data.data() + pos, sizeof(state));
+    state.num_arcs += 1;
+    memcpy(&(data[pos]), &state, sizeof(state));
+    {
+      std::ofstream os("tmpf.mapped", std::ios::out | std::ios::binary);
+      os.write(data.data(), data.size());
+    }
+    for (int32 i = 0; i < 2; i++) {
+      bool threw = false;
+      try {
+        delete MappedFst::Read(i == 0 ? "tmpf.mapped" : "cat tmpf.mapped |");
+      } catch (const std::runtime_error &e) {
+        threw = true;
+      }
+      KALDI_ASSERT(threw);
+    }
+  }
+  unlink("tmpf.mapped");
+  unlink("tmpf.fst");
+  delete fst;
+}
+
+} // end namespace fst
+
+int main() {
+  using namespace fst;
+  for (int i = 0; i < 10; i++) {
+    TestMappedFst();
+  }
+  std::cout << "Test OK\n";
+}
@@ -0,0 +1,323 @@
+// fstext/mapped-fst.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fstext/mapped-fst.h"
+#include "fstext/fstext-utils.h"
+#include "util/kaldi-io.h"
+
+namespace fst {
+
+static const char kMappedFstMagic[8] = { 'K', 'A', 'L', 'D', 'I', 'M', 'F',
+                                         'S' };
+static const int32 kMappedFstVersion = 1;
+
+// Rounds "offset" up to a multiple of kMappedFstAlignment.
+static inline int64 AlignOffset(int64 offset) {
+  return ((offset + kMappedFstAlignment - 1) / kMappedFstAlignment) *
+      kMappedFstAlignment;
+}
+
+// Checks the header against the size of the data; throws on error.
+static void CheckMappedFstHeader(const MappedFstHeader &header, size_t size,
+                                 const std::string &rxfilename) {
+  if (std::memcmp(header.magic, kMappedFstMagic, sizeof(kMappedFstMagic)) != 0)
+    KALDI_ERR << "File " << kaldi::PrintableRxfilename(rxfilename)
+              << " is not in MappedFst format.";
+  if (header.version != kMappedFstVersion)
+    KALDI_ERR << "MappedFst file " << kaldi::PrintableRxfilename(rxfilename)
+              << " has version " << header.version << ", expected "
+              << kMappedFstVersion << " (or it was written on a machine "
+              << "with different byte order).";
+  if (header.num_states < 0 || header.num_arcs < 0 ||
+      header.start >= header.num_states ||
+      header.states_offset < static_cast<int64>(sizeof(MappedFstHeader)) ||
+      header.arcs_offset < header.states_offset +
+      header.num_states * static_cast<int64>(sizeof(MappedFstState)) ||
+      header.total_size < header.arcs_offset +
+      header.num_arcs * static_cast<int64>(sizeof(StdArc)) ||
+      header.total_size != static_cast<int64>(size))
+    KALDI_ERR << "MappedFst file " << kaldi::PrintableRxfilename(rxfilename)
+              << " is corrupted or truncated.";
+}
+
+// Checks that the arcs of each state are inside the arc array, so that a
+// corrupted file cannot make the arc iterators read outside the data; throws
+// on error.  This touches the state array (but not the arcs), which is small
+// compared with the arcs for typical decoding graphs.
+static void CheckMappedFstStates(const MappedFstHeader &header,
+                                 const MappedFstState *states,
+                                 const std::string &rxfilename) {
+  uint64 num_arcs = header.num_arcs;
+  for (int64 s = 0; s < header.num_states; s++) {
+    if (states[s].first_arc > num_arcs ||
+        states[s].num_arcs > num_arcs - states[s].first_arc)
+      KALDI_ERR << "MappedFst file " << kaldi::PrintableRxfilename(rxfilename)
+                << " is corrupted: the arcs of state " << s
+                << " are outside the arc array.";
+  }
+}
+
+MappedFst::MappedFst(Region *region): region_(region) {
+  header_ = reinterpret_cast<const MappedFstHeader*>(region->data);
+  states_ = reinterpret_cast<const MappedFstState*>(region->data +
+                                                    header_->states_offset);
+  arcs_ = reinterpret_cast<const Arc*>(region->data + header_->arcs_offset);
+}
+
+MappedFst::~MappedFst() {
+  if (--region_->ref_count == 0) {
+#ifndef _MSC_VER
+    if (region_->is_mapped) {
+      if (munmap(region_->data, region_->size) != 0)
+        KALDI_WARN << "munmap failed: " << strerror(errno);
+    } else {
+      delete [] reinterpret_cast<int64*>(region_->data);
+    }
+#else
+    delete [] reinterpret_cast<int64*>(region_->data);
+#endif
+    delete region_;
+  }
+}
+
+MappedFst *MappedFst::Copy(bool safe) const {
+  region_->ref_count++;
+  return new MappedFst(region_);
+}
+
+uint64 MappedFst::Properties(uint64 mask, bool test) const {
+  if (test) {
+    uint64 known, props = TestProperties(*this, mask, &known);
+    return props & mask;
+  } else {
+    return header_->properties & mask;
+  }
+}
+
+const std::string &MappedFst::Type() const {
+  static const std::string type = "kaldi_mapped";
+  return type;
+}
+
+bool MappedFst::IsMappedFstFile(const std::string &rxfilename) {
+  if (kaldi::ClassifyRxfilename(rxfilename) != kaldi::kFileInput)
+    return false;
+  std::ifstream is(rxfilename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kMappedFstMagic)];
+  if (!is.read(magic, sizeof(magic)))
+    return false;
+  return (std::memcmp(magic, kMappedFstMagic, sizeof(magic)) == 0);
+}
+
+MappedFst *MappedFst::Read(const std::string &rxfilename) {
+  // Sanity check on the layout of StdArc, which we write directly.
+  KALDI_ASSERT(sizeof(Arc) == 16 && sizeof(MappedFstState) == 24);
+#ifndef _MSC_VER
+  if (kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput) {
+    int fd = open(rxfilename.c_str(), O_RDONLY);
+    if (fd == -1)
+      KALDI_ERR << "Could not open MappedFst file " << rxfilename << ": "
+                << strerror(errno);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      KALDI_ERR << "Could not stat " << rxfilename << ": " << strerror(errno);
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(MappedFstHeader)) {
+      close(fd);
+      KALDI_ERR << "File " << rxfilename << " is too small to be a MappedFst.";
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping stays valid after closing the file.
+    if (addr == MAP_FAILED)
+      KALDI_ERR << "Could not memory-map " << rxfilename << ": "
+                << strerror(errno);
+    try {
+      const MappedFstHeader &header = *static_cast<MappedFstHeader*>(addr);
+      CheckMappedFstHeader(header, st.st_size, rxfilename);
+      CheckMappedFstStates(header, reinterpret_cast<const MappedFstState*>(
+          static_cast<char*>(addr) + header.states_offset), rxfilename);
+    } catch (...) {
+      munmap(addr, st.st_size);
+      throw;
+    }
+    Region *region = new Region();
+    region->data = static_cast<char*>(addr);
+    region->size = st.st_size;
+    region->is_mapped = true;
+    region->ref_count = 1;
+    return new MappedFst(region);
+  }
+#endif
+  // Not an ordinary file (or no mmap on this platform): read into memory.
+  kaldi::Input ki(rxfilename);
+  return Read(ki.Stream(), rxfilename);
+}
+
+MappedFst *MappedFst::Read(std::istream &is, const std::string &rxfilename) {
+  KALDI_ASSERT(sizeof(Arc) == 16 && sizeof(MappedFstState) == 24);
+  // We allocate as int64 to get suitable alignment.
+  MappedFstHeader header;
+  if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    KALDI_ERR << "Error reading MappedFst header from "
+              << kaldi::PrintableRxfilename(rxfilename);
+  if (header.total_size < static_cast<int64>(sizeof(header)))
+    KALDI_ERR << "MappedFst file " << kaldi::PrintableRxfilename(rxfilename)
+              << " is corrupted.";
+  size_t size = header.total_size;
+  CheckMappedFstHeader(header, size, rxfilename);
+  int64 *buffer = new int64[(size + sizeof(int64) - 1) / sizeof(int64)];
+  char *data = reinterpret_cast<char*>(buffer);
+  std::memcpy(data, &header, sizeof(header));
+  if (!is.read(data + sizeof(header), size - sizeof(header))) {
+    delete [] buffer;
+    KALDI_ERR << "Error reading MappedFst from "
+              << kaldi::PrintableRxfilename(rxfilename) << " (truncated?)";
+  }
+  try {
+    CheckMappedFstStates(header, reinterpret_cast<const MappedFstState*>(
+        data + header.states_offset), rxfilename);
+  } catch (...) {
+    delete [] buffer;
+    throw;
+  }
+  Region *region = new Region();
+  region->data = data;
+  region->size = size;
+  region->is_mapped = false;
+  region->ref_count = 1;
+  return new MappedFst(region);
+}
+
+
+// Writes zeros to "os" until its position (which we track in *offset) is
+// "target".
+static void PadTo(int64 target, int64 *offset, std::ostream &os) {
+  KALDI_ASSERT(target >= *offset);
+  std::vector<char> zeros(target - *offset, 0);
+  if (!zeros.empty())
+    os.write(&(zeros[0]), zeros.size());
+  *offset = target;
+}
+
+void WriteMappedFst(const ExpandedFst<StdArc> &fst,
+                    const std::string &wxfilename) {
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+  KALDI_ASSERT(sizeof(Arc) == 16 && sizeof(MappedFstState) == 24);
+
+  int64 num_states = fst.NumStates(), num_arcs = 0;
+  for (StateId s = 0; s < num_states; s++)
+    num_arcs += fst.NumArcs(s);
+
+  MappedFstHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMappedFstMagic, sizeof(kMappedFstMagic));
+  header.version = kMappedFstVersion;
+  header.alignment = kMappedFstAlignment;
+  header.num_states = num_states;
+  header.num_arcs = num_arcs;
+  header.start = fst.Start();
+  // Like ConstFst, we copy the properties we know and add kExpanded; we do
+  // not test them, which would take a pass over the whole FST.
+  header.properties = (fst.Properties(kCopyProperties, false) & ~kMutable) |
+      kExpanded;
+  header.states_offset = AlignOffset(sizeof(header));
+  header.arcs_offset = AlignOffset(header.states_offset +
+                                   num_states * sizeof(MappedFstState));
+  header.total_size = AlignOffset(header.arcs_offset + num_arcs * sizeof(Arc));
+
+  bool binary = true, write_header = false;
+  kaldi::Output ko(wxfilename, binary, write_header);
+  std::ostream &os = ko.Stream();
+  int64 offset = 0;
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  offset += sizeof(header);
+
+  PadTo(header.states_offset, &offset, os);
+  uint64 first_arc = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    MappedFstState state;
+    std::memset(&state, 0, sizeof(state));
+    state.first_arc = first_arc;
+    state.final_cost = fst.Final(s).Value();
+    state.num_arcs = fst.NumArcs(s);
+    state.num_input_epsilons = fst.NumInputEpsilons(s);
+    state.num_output_epsilons = fst.NumOutputEpsilons(s);
+    os.write(reinterpret_cast<const char*>(&state), sizeof(state));
+    first_arc += state.num_arcs;
+  }
+  offset += num_states * sizeof(MappedFstState);
+
+  PadTo(header.arcs_offset, &offset, os);
+  for (StateId s = 0; s < num_states; s++) {
+    for (ArcIterator<ExpandedFst<Arc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      os.write(reinterpret_cast<const char*>(&arc), sizeof(arc));
+    }
+  }
+  offset += num_arcs * sizeof(Arc);
+  PadTo(header.total_size, &offset, os);
+  if (!os.good() || !ko.Close())
+    KALDI_ERR << "Error writing MappedFst to "
+              << kaldi::PrintableWxfilename(wxfilename);
+}
+
+Fst<StdArc> *ReadMappedOrVectorFst(const std::string &rxfilename_in) {
+  std::string rxfilename = (rxfilename_in == "" ? "-" : rxfilename_in);
+  if (kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput) {
+    if (MappedFst::IsMappedFstFile(rxfilename))
+      return MappedFst::Read(rxfilename);
+    else
+      return ReadFstKaldi(rxfilename);
+  }
+  // A pipe or standard input can only be read once, so we look at the first
+  // byte to decide the format.  The OpenFst magic number is 0x7eb2fdd6, so an
+  // FST in the OpenFst format starts with 0xd6 (or 0x7e on big-endian
+  // machines), never with the 'K' of the MappedFst magic string; the rest of
+  // the magic string is checked by MappedFst::Read().
+  kaldi::Input ki(rxfilename);
+  std::istream &is = ki.Stream();
+  if (is.peek() == kMappedFstMagic[0])
+    return MappedFst::Read(is, rxfilename);
+  FstHeader hdr;
+  if (!hdr.Read(is, rxfilename))
+    KALDI_ERR << "Reading FST: error reading FST header from "
+              << kaldi::PrintableRxfilename(rxfilename);
+  FstReadOptions ropts("<unspecified>", &hdr);
+  VectorFst<StdArc> *fst = VectorFst<StdArc>::Read(is, ropts);
+  if (!fst)
+    KALDI_ERR << "Could not read fst from "
+              << kaldi::PrintableRxfilename(rxfilename);
+  return fst;
+}
+
+} // end namespace fst
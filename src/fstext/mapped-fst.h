@@ -0,0 +1,181 @@
+// fstext/mapped-fst.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_MAPPED_FST_H_
+#define KALDI_FSTEXT_MAPPED_FST_H_
+
+#include <string>
+#include <fst/fstlib.h>
+#include "base/kaldi-common.h"
+
+/* This header defines MappedFst, a read-only FST on StdArc whose on-disk format
+   is the same as its in-memory format, so that it can be memory-mapped and
+   used directly, with no deserialization.  It is intended for large decoding
+   graphs (HCLG.fst): loading a multi-gigabyte VectorFst takes a long time and
+   each process gets its own private copy, while a MappedFst is "loaded" in
+   milliseconds and all processes on a machine that use the same graph share
+   one copy of it in the page cache.
+
+   The file format is native-endian and consists of three sections, each
+   starting at a multiple of kMappedFstAlignment bytes:
+     - a header (MappedFstHeader),
+     - an array of MappedFstState, one per state, in order of state-id,
+     - an array of StdArc, containing the arcs of all states: the arcs of state
+       s are at positions states[s].first_arc ... states[s].first_arc +
+       states[s].num_arcs - 1 (i.e. a "compressed sparse row" layout).
+   StdArc consists of four 32-bit fields (ilabel, olabel, weight, nextstate), so
+   the arcs can be handed directly to ArcIterator with no conversion; this
+   means the ArcIterator<Fst<StdArc> > used in the decoders takes the fast path
+   of iterating over a plain array.
+
+   Use fstmakemapped (in fstbin/) to convert an FST to this format, and
+   ReadMappedOrVectorFst() to read a decoding graph in either format.
+*/
+
+namespace fst {
+
+/// Sections in a MappedFst file start at multiples of this many bytes.
+static const int32 kMappedFstAlignment = 4096;
+
+struct MappedFstHeader {
+  char magic[8];  // "KALDIMFS"
+  int32 version;  // currently 1.
+  int32 alignment;  // the value of kMappedFstAlignment used when writing.
+  int64 num_states;
+  int64 num_arcs;
+  int64 start;  // start state, or kNoStateId.
+  uint64 properties;
+  int64 states_offset;  // byte offset of the MappedFstState array.
+  int64 arcs_offset;  // byte offset of the StdArc array.
+  int64 total_size;  // total size of the file in bytes.
+};
+
+struct MappedFstState {
+  uint64 first_arc;  // index of the first arc of this state in the arc array.
+  float final_cost;  // final cost (infinity if not final).
+  uint32 num_arcs;
+  uint32 num_input_epsilons;
+  uint32 num_output_epsilons;
+};
+
+
+class MappedFst: public ExpandedFst<StdArc> {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  /// Reads a MappedFst.  If rxfilename is an ordinary file, it is
+  /// memory-mapped (read-only and shared); otherwise (e.g. for a pipe or
+  /// standard input) it is read into memory.  Throws on error.
+  static MappedFst *Read(const std::string &rxfilename);
+
+  /// Reads a MappedFst from a stream into memory; "rxfilename" is only used
+  /// in error messages.  Throws on error.
+  static MappedFst *Read(std::istream &is, const std::string &rxfilename);
+
+  /// Returns true if rxfilename is an ordinary file that starts with the
+  /// MappedFst magic string.  Does not throw.  For pipes and standard input,
+  /// which cannot be read twice, see ReadMappedOrVectorFst().
+  static bool IsMappedFstFile(const std::string &rxfilename);
+
+  virtual StateId Start() const { return header_->start; }
+
+  virtual Weight Final(StateId s) const {
+    return Weight(states_[s].final_cost);
+  }
+
+  virtual StateId NumStates() const { return header_->num_states; }
+
+  virtual size_t NumArcs(StateId s) const { return states_[s].num_arcs; }
+
+  virtual size_t NumInputEpsilons(StateId s) const {
+    return states_[s].num_input_epsilons;
+  }
+
+  virtual size_t NumOutputEpsilons(StateId s) const {
+    return states_[s].num_output_epsilons;
+  }
+
+  virtual uint64 Properties(uint64 mask, bool test) const;
+
+  virtual const std::string &Type() const;
+
+  /// Copies share the underlying memory (which is read-only).  Note: the
+  /// reference count on the memory is not protected by a lock, so do not copy
+  /// and delete copies of the same MappedFst from different threads at the
+  /// same time.  Using the same object from several threads is fine.
+  virtual MappedFst *Copy(bool safe = false) const;
+
+  virtual const SymbolTable *InputSymbols() const { return NULL; }
+
+  virtual const SymbolTable *OutputSymbols() const { return NULL; }
+
+  virtual void InitStateIterator(StateIteratorData<Arc> *data) const {
+    data->base = NULL;
+    data->nstates = header_->num_states;
+  }
+
+  virtual void InitArcIterator(StateId s, ArcIteratorData<Arc> *data) const {
+    const MappedFstState &state = states_[s];
+    data->base = NULL;
+    data->arcs = arcs_ + state.first_arc;
+    data->narcs = state.num_arcs;
+    data->ref_count = NULL;
+  }
+
+  virtual ~MappedFst();
+
+ private:
+  // The memory that holds the FST; it is shared between copies.
+  struct Region {
+    char *data;
+    size_t size;
+    bool is_mapped;  // true if mmap'ed, false if allocated with new [].
+    int32 ref_count;
+  };
+
+  explicit MappedFst(Region *region);
+
+  Region *region_;
+  const MappedFstHeader *header_;
+  const MappedFstState *states_;
+  const Arc *arcs_;
+
+  MappedFst &operator = (const MappedFst &);  // disallow assignment.
+};
+
+
+/// Writes "fst" in MappedFst format to "wxfilename" (a filename, pipe or "-"
+/// for standard output; note that only files can be memory-mapped when read).
+/// Symbol tables are not written.  Throws on error.
+void WriteMappedFst(const ExpandedFst<StdArc> &fst,
+                    const std::string &wxfilename);
+
+/// Reads a decoding graph which may either be in MappedFst format (in which
+/// case it will be memory-mapped if rxfilename is an ordinary file) or in the
+/// normal OpenFst format (in which case it is read into a VectorFst, like
+/// ReadFstKaldi()).  Both formats are recognized when reading from a pipe or
+/// standard input too.  The caller owns the returned pointer.  Throws on
+/// error.
+Fst<StdArc> *ReadMappedOrVectorFst(const std::string &rxfilename);
+
+} // end namespace fst
+
+#endif  // KALDI_FSTEXT_MAPPED_FST_H_
@@ -0,0 +1,70 @@
+// gmm/decodable-am-diag-gmm-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/decodable-am-diag-gmm.h"
+#include "gmm/model-test-common.h"
+
+namespace kaldi {
+
+// Checks that the decodable gives the same answers with and without frame
+// batching and the packed model, when queried in the scattered order a
+// decoder would use.
+void UnitTestDecodableAmDiagGmmBatch() {
+  int32 dim = 1 + Rand() % 20, num_pdfs = 1 + Rand() % 10,
+      num_frames = 1 + Rand() % 30;
+  AmDiagGmm am_gmm;
+  for (int32 i = 0; i < num_pdfs; i++) {
+    DiagGmm gmm;
+    unittest::InitRandDiagGmm(dim, 1 + Rand() % 8, &gmm);
+    am_gmm.AddPdf(gmm);
+  }
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+
+  BaseFloat log_sum_exp_prune = (Rand() % 2 == 0 ? -1.0 : 5.0);
+  PackedAmDiagGmm packed_am(am_gmm);
+  DecodableAmDiagGmmUnmapped decodable(am_gmm, feats, log_sum_exp_prune),
+      batch_decodable(am_gmm, feats, log_sum_exp_prune),
+      packed_decodable(am_gmm, feats, log_sum_exp_prune),
+      packed_batch_decodable(am_gmm, feats, log_sum_exp_prune);
+  int32 frame_batch_size = 1 + Rand() % 8;
+  batch_decodable.SetFrameBatchSize(frame_batch_size);
+  packed_decodable.SetPackedModel(&packed_am);
+  packed_batch_decodable.SetPackedModel(&packed_am);
+  packed_batch_decodable.SetFrameBatchSize(frame_batch_size);
+
+  for (int32 t = 0; t < num_frames; t++) {
+    for (int32 n = 0; n < 2 * num_pdfs; n++) {
+      int32 index = 1 + Rand() % num_pdfs;  // indices are one-based.
+      BaseFloat loglike = decodable.LogLikelihood(t, index);
+      AssertEqual(loglike, batch_decodable.LogLikelihood(t, index), 1.0e-04);
+      AssertEqual(loglike, packed_decodable.LogLikelihood(t, index), 1.0e-04);
+      AssertEqual(loglike, packed_batch_decodable.LogLikelihood(t, index),
+                  1.0e-04);
+    }
+  }
+}
+
+}  // end namespace kaldi
+
+int main() {
+  for (int i = 0; i < 20; i++)
+    kaldi::UnitTestDecodableAmDiagGmmBatch();
+  std::cout << "Test OK.\n";
+}
@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <vector>
 using std::vector;
 
@@ -25,6 +26,20 @@ using std::vector;
 
 namespace kaldi {
 
+const DiagGmm &DecodableAmDiagGmmUnmapped::GetPdfChecked(int32 state) const {
+  const DiagGmm &pdf = acoustic_model_.GetPdf(state);
+  // check if everything is in order
+  if (pdf.Dim() != feature_matrix_.NumCols()) {
+    KALDI_ERR << "Dim mismatch: data dim = "  << feature_matrix_.NumCols()
+        << " vs. model dim = " << pdf.Dim();
+  }
+  if (!pdf.valid_gconsts()) {
+    KALDI_ERR << "State "  << (state)  << ": Must call ComputeGconsts() "
+        "before computing likelihood.";
+  }
+  return pdf;
+}
+
 BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
     int32 frame, int32 state) {
   KALDI_ASSERT(static_cast<size_t>(frame) <
@@ -32,36 +47,48 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   KALDI_ASSERT(static_cast<size_t>(state) < static_cast<size_t>(NumIndices()) &&
                "Likely graph/model mismatch, e.g. using wrong HCLG.fst");
 
-  if (log_like_cache_[state].hit_time == frame) {
-    return log_like_cache_[state].log_like;  // return cached value, if found
+  if (frame_batch_size_ > 1) {
+    int32 start_frame = batch_start_frame_[state];
+    if (start_frame < 0 || frame < start_frame ||
+        frame >= start_frame + frame_batch_size_) {
+      ComputeFrameBatch(frame, state);
+      start_frame = frame;
+    }
+    return batch_log_likes_(state, frame - start_frame);
   }
 
-  if (frame != previous_frame_) {  // cache the squared stats.
-    data_squared_.CopyFromVec(feature_matrix_.Row(frame));
-    data_squared_.ApplyPow(2.0);
-    previous_frame_ = frame;
+  if (log_like_cache_[state].hit_time == frame) {
+    return log_like_cache_[state].log_like;  // return cached value, if found
   }
 
-  const DiagGmm &pdf = acoustic_model_.GetPdf(state);
+  const DiagGmm &pdf = GetPdfChecked(state);
   const VectorBase<BaseFloat> &data = feature_matrix_.Row(frame);
 
-  // check if everything is in order
-  if (pdf.Dim() != data.Dim()) {
-    KALDI_ERR << "Dim mismatch: data dim = "  << data.Dim()
-        << " vs. model dim = " << pdf.Dim();
-  }
-  if (!pdf.valid_gconsts()) {
-    KALDI_ERR << "State "  << (state)  << ": Must call ComputeGconsts() "
-        "before computing likelihood.";
+  BaseFloat log_sum;
+#if (KALDI_DOUBLEPRECISION == 0)
+  // In single precision, if we were given the packed model, we use the kernels
+  // in packed-diag-gmm.h, which evaluate all the Gaussians without going
+  // through BLAS.
+  if (packed_am_ != NULL) {
+    log_sum = packed_am_->GetPdf(state).LogLikelihood(data,
+                                                      log_sum_exp_prune_);
+  } else
+#endif
+  {
+    if (frame != previous_frame_) {  // cache the squared stats.
+      data_squared_.CopyFromVec(feature_matrix_.Row(frame));
+      data_squared_.ApplyPow(2.0);
+      previous_frame_ = frame;
+    }
+
+    Vector<BaseFloat> loglikes(pdf.gconsts());  // need to recreate for each pdf
+    // loglikes +=  means * inv(vars) * data.
+    loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
+    // loglikes += -0.5 * inv(vars) * data_sq.
+    loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
+
+    log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
   }
-
-  Vector<BaseFloat> loglikes(pdf.gconsts());  // need to recreate for each pdf
-  // loglikes +=  means * inv(vars) * data.
-  loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
-  // loglikes += -0.5 * inv(vars) * data_sq.
-  loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
-
-  BaseFloat log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
   if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
     KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
 
@@ -71,6 +98,72 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   return log_sum;
 }
 
+void DecodableAmDiagGmmUnmapped::ComputeFrameBatch(int32 start_frame,
+                                                   int32 state) {
+  int32 num_frames = std::min(frame_batch_size_,
+                              NumFramesReady() - start_frame);
+  const DiagGmm &pdf = GetPdfChecked(state);
+  BaseFloat *log_likes = batch_log_likes_.RowData(state);
+#if (KALDI_DOUBLEPRECISION == 0)
+  // The kernel processes several frames per pass over the parameters of the
+  // pdf.
+  if (packed_am_ != NULL) {
+    packed_am_->GetPdf(state).LogLikelihoods(
+        feature_matrix_.RowData(start_frame), num_frames,
+        feature_matrix_.Stride(), log_sum_exp_prune_, log_likes);
+  } else
+#endif
+  {
+    if (feats_squared_.NumRows() == 0) {
+      feats_squared_ = feature_matrix_;
+      feats_squared_.ApplyPow(2.0);
+    }
+    int32 dim = feature_matrix_.NumCols();
+    SubMatrix<BaseFloat> feats(feature_matrix_, start_frame, num_frames, 0,
+                               dim),
+        feats_squared(feats_squared_, start_frame, num_frames, 0, dim);
+    Matrix<BaseFloat> loglikes(num_frames, pdf.NumGauss(), kUndefined);
+    loglikes.CopyRowsFromVec(pdf.gconsts());
+    // loglikes += data * (means * inv(vars))^T.
+    loglikes.AddMatMat(1.0, feats, kNoTrans, pdf.means_invvars(), kTrans, 1.0);
+    // loglikes += -0.5 * data_sq * inv(vars)^T.
+    loglikes.AddMatMat(-0.5, feats_squared, kNoTrans, pdf.inv_vars(), kTrans,
+                       1.0);
+    for (int32 t = 0; t < num_frames; t++)
+      log_likes[t] = loglikes.Row(t).LogSumExp(log_sum_exp_prune_);
+  }
+  for (int32 t = 0; t < num_frames; t++)
+    if (KALDI_ISNAN(log_likes[t]) || KALDI_ISINF(log_likes[t]))
+      KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+  batch_start_frame_[state] = start_frame;
+}
+
+void DecodableAmDiagGmmUnmapped::SetFrameBatchSize(int32 num_frames) {
+  KALDI_ASSERT(num_frames >= 1);
+  frame_batch_size_ = num_frames;
+  if (num_frames > 1) {
+    batch_start_frame_.clear();
+    batch_start_frame_.resize(acoustic_model_.NumPdfs(), -1);
+    batch_log_likes_.Resize(acoustic_model_.NumPdfs(), num_frames,
+                            kUndefined);
+  } else {
+    batch_start_frame_.clear();
+    batch_log_likes_.Resize(0, 0);
+  }
+}
+
+void DecodableAmDiagGmmUnmapped::SetPackedModel(
+    const PackedAmDiagGmm *packed_am) {
+  if (packed_am != NULL &&
+      (packed_am->NumPdfs() != acoustic_model_.NumPdfs() ||
+       packed_am->Dim() != acoustic_model_.Dim()))
+    KALDI_ERR << "Packed model does not match the acoustic model: "
+              << packed_am->NumPdfs() << " vs. " << acoustic_model_.NumPdfs()
+              << " pdfs, dim " << packed_am->Dim() << " vs. "
+              << acoustic_model_.Dim();
+  packed_am_ = packed_am;
+}
+
 void DecodableAmDiagGmmUnmapped::ResetLogLikeCache() {
   if (static_cast<int32>(log_like_cache_.size()) != acoustic_model_.NumPdfs()) {
     log_like_cache_.resize(acoustic_model_.NumPdfs());
@@ -78,6 +171,7 @@ void DecodableAmDiagGmmUnmapped::ResetLogLikeCache() {
   vector<LikelihoodCacheRecord>::iterator it = log_like_cache_.begin(),
       end = log_like_cache_.end();
   for (; it != end; ++it) { it->hit_time = -1; }
+  std::fill(batch_start_frame_.begin(), batch_start_frame_.end(), -1);
 }
 
 
@@ -26,6 +26,7 @@
 
 #include "base/kaldi-common.h"
 #include "gmm/am-diag-gmm.h"
+#include "gmm/packed-diag-gmm.h"
 #include "hmm/transition-model.h"
 #include "itf/decodable-itf.h"
 #include "transform/regression-tree.h"
@@ -53,10 +54,28 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
                              BaseFloat log_sum_exp_prune = -1.0):
     acoustic_model_(am), feature_matrix_(feats),
     previous_frame_(-1), log_sum_exp_prune_(log_sum_exp_prune), 
-    data_squared_(feats.NumCols()) {
+    data_squared_(feats.NumCols()), packed_am_(NULL), frame_batch_size_(1) {
     ResetLogLikeCache();
   }
 
+  /// If num_frames > 1, enables frame-batched computation of likelihoods: the
+  /// first time the decoder asks for a pdf on a frame t that is not cached,
+  /// we compute that pdf for frames t ... t + num_frames - 1 in one batch
+  /// (which is much faster per frame than doing them one by one) and answer
+  /// later requests for those frames from the cache.  This pays off because
+  /// most pdfs that are active on a frame are also active on the next few
+  /// frames.  Something like 4 to 8 is reasonable; 1 (the default) means the
+  /// normal frame-by-frame computation.  Does not apply to derived classes
+  /// that override LogLikelihoodZeroBased().
+  void SetFrameBatchSize(int32 num_frames);
+
+  /// Makes the likelihoods be computed with the SIMD kernels of
+  /// packed-diag-gmm.h, using "packed_am", which must have been created from
+  /// the same acoustic model and must outlive this object.  The same
+  /// PackedAmDiagGmm should be used for all utterances (and threads), so the
+  /// model is only packed once.  Only has an effect if BaseFloat is float.
+  void SetPackedModel(const PackedAmDiagGmm *packed_am);
+
   // Note, frames are numbered from zero.  But state_index is numbered
   // from one (this routine is called by FSTs).
   virtual BaseFloat LogLikelihood(int32 frame, int32 state_index) {
@@ -76,6 +95,9 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
   void ResetLogLikeCache();
   virtual BaseFloat LogLikelihoodZeroBased(int32 frame, int32 state_index);
 
+  /// Returns the pdf, checking that it is usable with our features.
+  const DiagGmm &GetPdfChecked(int32 state) const;
+
   const AmDiagGmm &acoustic_model_;
   const Matrix<BaseFloat> &feature_matrix_;
   int32 previous_frame_;
@@ -90,6 +112,25 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
  private:
   Vector<BaseFloat> data_squared_;  ///< Cache for fast likelihood calculation
 
+  /// Packed copies of the pdfs for the SIMD likelihood kernels, or NULL; not
+  /// owned here (see SetPackedModel()).
+  const PackedAmDiagGmm *packed_am_;
+
+  /// Computes the log-likelihoods of pdf "state" on frames start_frame ...
+  /// start_frame + frame_batch_size_ - 1 (or up to the last frame) and puts
+  /// them in row "state" of batch_log_likes_.
+  void ComputeFrameBatch(int32 start_frame, int32 state);
+
+  int32 frame_batch_size_;
+  /// For each pdf, the first frame of the batch of frames that row "pdf" of
+  /// batch_log_likes_ contains, or -1 if none.
+  std::vector<int32> batch_start_frame_;
+  /// Log-likelihoods of each pdf on the frames of its current batch, indexed
+  /// by (pdf, frame - batch_start_frame_[pdf]).
+  Matrix<BaseFloat> batch_log_likes_;
+  /// The squares of the features (only used if packed_am_ is not used).
+  Matrix<BaseFloat> feats_squared_;
+
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmUnmapped);
 };
@@ -0,0 +1,75 @@
+// gmm/packed-diag-gmm-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/packed-diag-gmm.h"
+#include "gmm/model-test-common.h"
+
+namespace kaldi {
+
+void UnitTestPackedDiagGmm() {
+  // Use dimensions that are not multiples of the SIMD width, to test the
+  // padding.
+  int32 dim = 1 + Rand() % 45, num_gauss = 1 + Rand() % 40,
+      num_frames = 1 + Rand() % 10;
+  DiagGmm gmm;
+  unittest::InitRandDiagGmm(dim, num_gauss, &gmm);
+
+  Matrix<float> feats(num_frames, dim);
+  feats.SetRandn();
+  for (int32 k = 0; k < 2; k++) {
+    BaseFloat prune = (k == 0 ? -1.0 : 5.0);
+    Vector<BaseFloat> ref_loglikes(num_frames);
+    for (int32 t = 0; t < num_frames; t++) {
+      Vector<BaseFloat> frame(feats.Row(t)), loglikes;
+      gmm.LogLikelihoods(frame, &loglikes);
+      ref_loglikes(t) = loglikes.LogSumExp(prune);
+    }
+    for (int32 type = 0; type <= static_cast<int32>(kGmmKernelAvx512);
+         type++) {
+      GmmKernelType kernel_type = static_cast<GmmKernelType>(type);
+      if (!GmmKernelTypeSupported(kernel_type)) {
+        KALDI_LOG << "Kernel type " << type << " is not supported here.";
+        continue;
+      }
+      PackedDiagGmm packed(gmm, kernel_type);
+      KALDI_ASSERT(packed.NumGauss() == num_gauss && packed.Dim() == dim);
+      std::vector<float> loglikes(num_frames);
+      packed.LogLikelihoods(feats.Data(), num_frames, feats.Stride(), prune,
+                            &(loglikes[0]));
+      // With pruning, roundoff can change which Gaussians are included, which
+      // changes the answer by up to log(1 + exp(-prune)).
+      BaseFloat tol = (prune > 0.0 ? 0.01 : 1.0e-04);
+      for (int32 t = 0; t < num_frames; t++) {
+        AssertEqual(loglikes[t], ref_loglikes(t), tol);
+        AssertEqual(packed.LogLikelihood(feats.Row(t), prune),
+                    ref_loglikes(t), tol);
+      }
+    }
+  }
+}
+
+}  // end namespace kaldi
+
+int main() {
+  kaldi::GmmKernelType best = kaldi::BestGmmKernelType();
+  KALDI_LOG << "Best kernel type is " << static_cast<int>(best);
+  for (int i = 0; i < 50; i++)
+    kaldi::UnitTestPackedDiagGmm();
+  std::cout << "Test OK.\n";
+}
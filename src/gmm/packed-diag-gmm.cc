@@ -0,0 +1,460 @@
+// gmm/packed-diag-gmm.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "gmm/packed-diag-gmm.h"
+
+// We compile the x86 kernels using the "target" function attribute, so that
+// the rest of Kaldi can continue to be compiled for baseline SSE2 and the
+// choice of kernel is made at run time.  This needs GCC >= 4.9 or clang.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 ||                              \
+                           (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define KALDI_GMM_AVX2_KERNEL 1
+#define KALDI_GMM_AVX512_KERNEL 1
+#include <immintrin.h>
+#endif
+
+namespace kaldi {
+
+bool GmmKernelTypeSupported(GmmKernelType type) {
+  switch (type) {
+    case kGmmKernelGeneric:
+      return true;
+#ifdef KALDI_GMM_AVX2_KERNEL
+    case kGmmKernelAvx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+#ifdef KALDI_GMM_AVX512_KERNEL
+    case kGmmKernelAvx512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+GmmKernelType BestGmmKernelType() {
+  static GmmKernelType best = (GmmKernelTypeSupported(kGmmKernelAvx512) ?
+                               kGmmKernelAvx512 :
+                               (GmmKernelTypeSupported(kGmmKernelAvx2) ?
+                                kGmmKernelAvx2 : kGmmKernelGeneric));
+  return best;
+}
+
+// Returns the value below which elements are ignored in the log-sum-exp; this
+// matches VectorBase<float>::LogSumExp().
+static inline float LogSumExpCutoff(float max_elem, float prune) {
+  float cutoff = max_elem + kMinLogDiffFloat;
+  if (prune > 0.0 && max_elem - prune > cutoff)
+    cutoff = max_elem - prune;
+  return cutoff;
+}
+
+// In all the functions below that compute the per-Gaussian log-likelihoods,
+// "frames" contains "num_frames" frames, each zero-padded to padded_dim, and
+// the log-likelihood of Gaussian i on frame t is written to
+// out[t * num_gauss + i].
+
+static void GaussLoglikesGeneric(const float *params, const float *gconsts,
+                                 int32 num_gauss, int32 num_blocks,
+                                 int32 block_width, const float *frames,
+                                 int32 padded_dim, int32 num_frames,
+                                 float *out) {
+  int32 stride = 2 * block_width;
+  for (int32 i = 0; i < num_gauss; i++) {
+    const float *gauss_params = params + i * num_blocks * stride;
+    for (int32 t = 0; t < num_frames; t++) {
+      const float *frame = frames + t * padded_dim;
+      float sum = 0.0;
+      for (int32 b = 0; b < num_blocks; b++) {
+        const float *m = gauss_params + b * stride, *h = m + block_width,
+            *x = frame + b * block_width;
+        for (int32 d = 0; d < block_width; d++)
+          sum += x[d] * (m[d] + h[d] * x[d]);
+      }
+      out[t * num_gauss + i] = gconsts[i] + sum;
+    }
+  }
+}
+
+static float LogSumExpGeneric(const float *v, int32 n, float prune) {
+  float max_elem = *std::max_element(v, v + n),
+      cutoff = LogSumExpCutoff(max_elem, prune);
+  double sum_relto_max_elem = 0.0;
+  for (int32 i = 0; i < n; i++)
+    if (v[i] >= cutoff)
+      sum_relto_max_elem += Exp(v[i] - max_elem);
+  return max_elem + Log(sum_relto_max_elem);
+}
+
+
+#ifdef KALDI_GMM_AVX2_KERNEL
+
+#define KALDI_TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+// Computes exp(x) elementwise, with a relative error of about 2e-7 for the
+// range we use it in (x <= 0).  This is the algorithm of Cephes' expf():
+// write x = n log(2) + r with |r| <= log(2)/2, and use a polynomial for
+// exp(r).
+KALDI_TARGET_AVX2 static inline __m256 ExpAvx2(__m256 x) {
+  x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+  x = _mm256_max_ps(x, _mm256_set1_ps(-88.3762626647949f));
+  __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(
+      x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x),
+                      _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+  __m256i pow2n = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+}
+
+KALDI_TARGET_AVX2 static inline float HorizontalSumAvx2(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                        _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+KALDI_TARGET_AVX2 static inline float HorizontalMaxAvx2(__m256 v) {
+  __m128 s = _mm_max_ps(_mm256_castps256_ps128(v),
+                        _mm256_extractf128_ps(v, 1));
+  s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_max_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+// Block width is 8.  NF is the number of frames; it is a template argument so
+// that the accumulators can live in registers.
+template<int32 NF>
+KALDI_TARGET_AVX2 static void GaussLoglikesAvx2(const float *params,
+                                                const float *gconsts,
+                                                int32 num_gauss,
+                                                int32 num_blocks,
+                                                const float *frames,
+                                                int32 padded_dim,
+                                                float *out) {
+  for (int32 i = 0; i < num_gauss; i++) {
+    const float *p = params + i * num_blocks * 16;
+    __m256 acc[NF];
+    for (int32 t = 0; t < NF; t++)
+      acc[t] = _mm256_setzero_ps();
+    for (int32 b = 0; b < num_blocks; b++, p += 16) {
+      __m256 m = _mm256_loadu_ps(p), h = _mm256_loadu_ps(p + 8);
+      for (int32 t = 0; t < NF; t++) {
+        __m256 x = _mm256_loadu_ps(frames + t * padded_dim + b * 8);
+        acc[t] = _mm256_fmadd_ps(_mm256_fmadd_ps(h, x, m), x, acc[t]);
+      }
+    }
+    for (int32 t = 0; t < NF; t++)
+      out[t * num_gauss + i] = gconsts[i] + HorizontalSumAvx2(acc[t]);
+  }
+}
+
+KALDI_TARGET_AVX2 static float LogSumExpAvx2(const float *v, int32 n,
+                                             float prune) {
+  int32 i = 0;
+  float max_elem = -std::numeric_limits<float>::infinity();
+  if (n >= 8) {
+    __m256 vmax = _mm256_loadu_ps(v);
+    for (i = 8; i + 8 <= n; i += 8)
+      vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(v + i));
+    max_elem = HorizontalMaxAvx2(vmax);
+  }
+  for (; i < n; i++)
+    max_elem = std::max(max_elem, v[i]);
+  float cutoff = LogSumExpCutoff(max_elem, prune);
+
+  __m256 vmax = _mm256_set1_ps(max_elem), vcutoff = _mm256_set1_ps(cutoff),
+      vsum = _mm256_setzero_ps();
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(v + i),
+        e = ExpAvx2(_mm256_sub_ps(x, vmax)),
+        mask = _mm256_cmp_ps(x, vcutoff, _CMP_GE_OQ);
+    vsum = _mm256_add_ps(vsum, _mm256_and_ps(e, mask));
+  }
+  double sum_relto_max_elem = HorizontalSumAvx2(vsum);
+  for (; i < n; i++)
+    if (v[i] >= cutoff)
+      sum_relto_max_elem += Exp(v[i] - max_elem);
+  return max_elem + Log(sum_relto_max_elem);
+}
+
+#endif  // KALDI_GMM_AVX2_KERNEL
+
+
+#ifdef KALDI_GMM_AVX512_KERNEL
+
+#if !defined(__clang__)
+// Some versions of GCC give spurious warnings about _mm512_undefined_ps()
+// etc., used inside the AVX-512 intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define KALDI_TARGET_AVX512 __attribute__((target("avx512f")))
+
+// See ExpAvx2().
+KALDI_TARGET_AVX512 static inline __m512 ExpAvx512(__m512 x) {
+  x = _mm512_min_ps(x, _mm512_set1_ps(88.3762626647949f));
+  x = _mm512_max_ps(x, _mm512_set1_ps(-88.3762626647949f));
+  __m512 n = _mm512_roundscale_ps(
+      _mm512_fmadd_ps(x, _mm512_set1_ps(1.44269504088896341f),
+                      _mm512_set1_ps(0.5f)),
+      _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  x = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+  x = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), x);
+  __m512 y = _mm512_set1_ps(1.9875691500e-4f);
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.3981999507e-3f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(8.3334519073e-3f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(4.1665795894e-2f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.6666665459e-1f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(5.0000001201e-1f));
+  y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x),
+                      _mm512_add_ps(x, _mm512_set1_ps(1.0f)));
+  __m512i pow2n = _mm512_slli_epi32(
+      _mm512_add_epi32(_mm512_cvttps_epi32(n), _mm512_set1_epi32(127)), 23);
+  return _mm512_mul_ps(y, _mm512_castsi512_ps(pow2n));
+}
+
+// We don't use _mm512_reduce_add_ps() and _mm512_reduce_max_ps(), which are
+// missing in older compilers.
+KALDI_TARGET_AVX512 static inline float HorizontalSumAvx512(__m512 v) {
+  v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, 0x4E));
+  v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, 0xB1));
+  __m128 s = _mm512_castps512_ps128(v);
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+KALDI_TARGET_AVX512 static inline float HorizontalMaxAvx512(__m512 v) {
+  v = _mm512_max_ps(v, _mm512_shuffle_f32x4(v, v, 0x4E));
+  v = _mm512_max_ps(v, _mm512_shuffle_f32x4(v, v, 0xB1));
+  __m128 s = _mm512_castps512_ps128(v);
+  s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_max_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+// Block width is 16.
+template<int32 NF>
+KALDI_TARGET_AVX512 static void GaussLoglikesAvx512(const float *params,
+                                                    const float *gconsts,
+                                                    int32 num_gauss,
+                                                    int32 num_blocks,
+                                                    const float *frames,
+                                                    int32 padded_dim,
+                                                    float *out) {
+  for (int32 i = 0; i < num_gauss; i++) {
+    const float *p = params + i * num_blocks * 32;
+    __m512 acc[NF];
+    for (int32 t = 0; t < NF; t++)
+      acc[t] = _mm512_setzero_ps();
+    for (int32 b = 0; b < num_blocks; b++, p += 32) {
+      __m512 m = _mm512_loadu_ps(p), h = _mm512_loadu_ps(p + 16);
+      for (int32 t = 0; t < NF; t++) {
+        __m512 x = _mm512_loadu_ps(frames + t * padded_dim + b * 16);
+        acc[t] = _mm512_fmadd_ps(_mm512_fmadd_ps(h, x, m), x, acc[t]);
+      }
+    }
+    for (int32 t = 0; t < NF; t++)
+      out[t * num_gauss + i] = gconsts[i] + HorizontalSumAvx512(acc[t]);
+  }
+}
+
+KALDI_TARGET_AVX512 static float LogSumExpAvx512(const float *v, int32 n,
+                                                 float prune) {
+  int32 i = 0;
+  float max_elem = -std::numeric_limits<float>::infinity();
+  if (n >= 16) {
+    __m512 vmax = _mm512_loadu_ps(v);
+    for (i = 16; i + 16 <= n; i += 16)
+      vmax = _mm512_max_ps(vmax, _mm512_loadu_ps(v + i));
+    max_elem = HorizontalMaxAvx512(vmax);
+  }
+  for (; i < n; i++)
+    max_elem = std::max(max_elem, v[i]);
+  float cutoff = LogSumExpCutoff(max_elem, prune);
+
+  __m512 vmax = _mm512_set1_ps(max_elem), vcutoff = _mm512_set1_ps(cutoff),
+      vsum = _mm512_setzero_ps();
+  for (i = 0; i + 16 <= n; i += 16) {
+    __m512 x = _mm512_loadu_ps(v + i),
+        e = ExpAvx512(_mm512_sub_ps(x, vmax));
+    __mmask16 mask = _mm512_cmp_ps_mask(x, vcutoff, _CMP_GE_OQ);
+    vsum = _mm512_mask_add_ps(vsum, mask, vsum, e);
+  }
+  double sum_relto_max_elem = HorizontalSumAvx512(vsum);
+  for (; i < n; i++)
+    if (v[i] >= cutoff)
+      sum_relto_max_elem += Exp(v[i] - max_elem);
+  return max_elem + Log(sum_relto_max_elem);
+}
+
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif  // KALDI_GMM_AVX512_KERNEL
+
+
+void PackedDiagGmm::CopyFromDiagGmm(const DiagGmm &gmm, GmmKernelType type) {
+  if (!GmmKernelTypeSupported(type))
+    KALDI_ERR << "GMM kernel type " << static_cast<int32>(type)
+              << " is not supported on this machine.";
+  kernel_type_ = type;
+  num_gauss_ = gmm.NumGauss();
+  dim_ = gmm.Dim();
+  block_width_ = (type == kGmmKernelAvx512 ? 16 : 8);
+  num_blocks_ = (dim_ + block_width_ - 1) / block_width_;
+
+  const Vector<BaseFloat> &gconsts = gmm.gconsts();  // asserts they're valid.
+  const Matrix<BaseFloat> &means_invvars = gmm.means_invvars(),
+      &inv_vars = gmm.inv_vars();
+  gconsts_.resize(num_gauss_);
+  params_.clear();
+  params_.resize(static_cast<size_t>(num_gauss_) * num_blocks_ * 2 *
+                 block_width_, 0.0);
+  for (int32 i = 0; i < num_gauss_; i++) {
+    gconsts_[i] = gconsts(i);
+    float *p = &(params_[0]) + static_cast<size_t>(i) * num_blocks_ * 2 *
+        block_width_;
+    for (int32 d = 0; d < dim_; d++) {
+      int32 b = d / block_width_, j = d % block_width_;
+      p[2 * b * block_width_ + j] = means_invvars(i, d);
+      p[(2 * b + 1) * block_width_ + j] = -0.5 * inv_vars(i, d);
+    }
+  }
+}
+
+void PackedDiagGmm::LogLikelihoods(const float *data, int32 num_frames,
+                                   int32 stride, float log_sum_exp_prune,
+                                   float *loglikes) const {
+  KALDI_ASSERT(num_gauss_ > 0 && num_frames >= 0);
+  int32 padded_dim = num_blocks_ * block_width_;
+  // We need space for kMaxFrames zero-padded frames and the per-Gaussian
+  // log-likelihoods on those frames.  This is called in the innermost loop of
+  // decoding, so avoid the heap for typical sizes.
+  size_t buffer_size = kMaxFrames * (padded_dim + num_gauss_);
+  float stack_buffer[4096];
+  std::vector<float> heap_buffer;
+  float *buffer = stack_buffer;
+  if (buffer_size > sizeof(stack_buffer) / sizeof(float)) {
+    heap_buffer.resize(buffer_size);
+    buffer = &(heap_buffer[0]);
+  }
+  float *frames = buffer, *gauss_loglikes = buffer + kMaxFrames * padded_dim;
+  if (padded_dim != dim_)  // zero the padding, which we never write to.
+    std::memset(frames, 0, sizeof(float) * kMaxFrames * padded_dim);
+
+  const float *params = &(params_[0]), *gconsts = &(gconsts_[0]);
+  for (int32 t0 = 0; t0 < num_frames; t0 += kMaxFrames) {
+    int32 n = std::min(kMaxFrames, num_frames - t0);
+    for (int32 t = 0; t < n; t++)
+      std::memcpy(frames + t * padded_dim, data + (t0 + t) * stride,
+                  sizeof(float) * dim_);
+    switch (kernel_type_) {
+#ifdef KALDI_GMM_AVX512_KERNEL
+      case kGmmKernelAvx512:
+        switch (n) {
+          case 1: GaussLoglikesAvx512<1>(params, gconsts, num_gauss_,
+                                         num_blocks_, frames, padded_dim,
+                                         gauss_loglikes); break;
+          case 2: GaussLoglikesAvx512<2>(params, gconsts, num_gauss_,
+                                         num_blocks_, frames, padded_dim,
+                                         gauss_loglikes); break;
+          case 3: GaussLoglikesAvx512<3>(params, gconsts, num_gauss_,
+                                         num_blocks_, frames, padded_dim,
+                                         gauss_loglikes); break;
+          default: GaussLoglikesAvx512<4>(params, gconsts, num_gauss_,
+                                          num_blocks_, frames, padded_dim,
+                                          gauss_loglikes);
+        }
+        for (int32 t = 0; t < n; t++)
+          loglikes[t0 + t] = LogSumExpAvx512(gauss_loglikes + t * num_gauss_,
+                                             num_gauss_, log_sum_exp_prune);
+        break;
+#endif
+#ifdef KALDI_GMM_AVX2_KERNEL
+      case kGmmKernelAvx2:
+        switch (n) {
+          case 1: GaussLoglikesAvx2<1>(params, gconsts, num_gauss_,
+                                       num_blocks_, frames, padded_dim,
+                                       gauss_loglikes); break;
+          case 2: GaussLoglikesAvx2<2>(params, gconsts, num_gauss_,
+                                       num_blocks_, frames, padded_dim,
+                                       gauss_loglikes); break;
+          case 3: GaussLoglikesAvx2<3>(params, gconsts, num_gauss_,
+                                       num_blocks_, frames, padded_dim,
+                                       gauss_loglikes); break;
+          default: GaussLoglikesAvx2<4>(params, gconsts, num_gauss_,
+                                        num_blocks_, frames, padded_dim,
+                                        gauss_loglikes);
+        }
+        for (int32 t = 0; t < n; t++)
+          loglikes[t0 + t] = LogSumExpAvx2(gauss_loglikes + t * num_gauss_,
+                                           num_gauss_, log_sum_exp_prune);
+        break;
+#endif
+      default:
+        GaussLoglikesGeneric(params, gconsts, num_gauss_, num_blocks_,
+                             block_width_, frames, padded_dim, n,
+                             gauss_loglikes);
+        for (int32 t = 0; t < n; t++)
+          loglikes[t0 + t] = LogSumExpGeneric(gauss_loglikes + t * num_gauss_,
+                                              num_gauss_, log_sum_exp_prune);
+    }
+  }
+}
+
+float PackedDiagGmm::LogLikelihood(const VectorBase<float> &data,
+                                   float log_sum_exp_prune) const {
+  KALDI_ASSERT(data.Dim() == dim_);
+  float ans;
+  LogLikelihoods(data.Data(), 1, dim_, log_sum_exp_prune, &ans);
+  return ans;
+}
+
+PackedAmDiagGmm::PackedAmDiagGmm(const AmDiagGmm &am, GmmKernelType type):
+    dim_(am.Dim()), pdfs_(am.NumPdfs()) {
+  for (int32 i = 0; i < am.NumPdfs(); i++) {
+    if (!am.GetPdf(i).valid_gconsts())
+      KALDI_ERR << "Pdf " << i << ": must call ComputeGconsts() before "
+                << "packing the model.";
+    pdfs_[i].CopyFromDiagGmm(am.GetPdf(i), type);
+  }
+}
+
+}  // End namespace kaldi
@@ -0,0 +1,151 @@
+// gmm/packed-diag-gmm.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GMM_PACKED_DIAG_GMM_H_
+#define KALDI_GMM_PACKED_DIAG_GMM_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "gmm/am-diag-gmm.h"
+#include "gmm/diag-gmm.h"
+
+namespace kaldi {
+
+/// The kernels that PackedDiagGmm can use to compute likelihoods.  The AVX2
+/// and AVX-512 kernels are only compiled on x86 with GCC-compatible compilers
+/// (they do not need -mavx2 etc. on the command line); whether they are used
+/// is decided at run time from the CPU we are running on.
+enum GmmKernelType {
+  kGmmKernelGeneric = 0,  // portable C++ (auto-vectorized, if at all)
+  kGmmKernelAvx2 = 1,     // AVX2 + FMA, 8 floats at a time.
+  kGmmKernelAvx512 = 2    // AVX-512F, 16 floats at a time.
+};
+
+/// Returns true if this kernel type was compiled in and the CPU supports it.
+bool GmmKernelTypeSupported(GmmKernelType type);
+
+/// Returns the fastest kernel type that is supported on this machine.
+GmmKernelType BestGmmKernelType();
+
+
+/**
+   PackedDiagGmm is a read-only copy of the parameters of a DiagGmm, stored in
+   the layout that our hand-written likelihood kernels want, for fast
+   evaluation of the total log-likelihood (log-sum-exp over the Gaussians) of
+   the GMM on one or more frames.  It is intended for use in decoding, where
+   this is the innermost loop.
+
+   The parameters of each Gaussian are stored contiguously, in blocks of W
+   dimensions where W is the SIMD width (8 or 16 floats): each block has W
+   values of means_invvars followed by the same W dimensions of -0.5 *
+   inv_vars, so the kernel reads a single stream of memory per Gaussian.  The
+   dimension is zero-padded to a multiple of W.  The log-likelihood of Gaussian
+   i on frame x is then gconst(i) + sum_d x_d (m_id + h_id x_d), which is two
+   fused multiply-adds per dimension.  Up to kMaxFrames frames are processed
+   per pass over the parameters, so each block of parameters that is loaded is
+   used several times.  The log-sum-exp over Gaussians is also vectorized.
+
+   Computation is in single precision regardless of BaseFloat.  The results
+   differ from those of DiagGmm::LogLikelihoods() followed by
+   VectorBase::LogSumExp() only by roundoff.
+*/
+class PackedDiagGmm {
+ public:
+  /// The maximum number of frames that are processed in one pass over the
+  /// parameters.  LogLikelihoods() accepts any number of frames.
+  static const int32 kMaxFrames = 4;
+
+  PackedDiagGmm(): kernel_type_(kGmmKernelGeneric), num_gauss_(0), dim_(0),
+                   num_blocks_(0), block_width_(0) { }
+
+  /// Initializes from "gmm", whose gconsts must be valid; uses the kernel
+  /// type "type", which must be supported (see GmmKernelTypeSupported()).
+  explicit PackedDiagGmm(const DiagGmm &gmm,
+                         GmmKernelType type = BestGmmKernelType()) {
+    CopyFromDiagGmm(gmm, type);
+  }
+
+  void CopyFromDiagGmm(const DiagGmm &gmm,
+                       GmmKernelType type = BestGmmKernelType());
+
+  /// Returns true if this has not been initialized (or was initialized from
+  /// an empty GMM).
+  bool IsEmpty() const { return num_gauss_ == 0; }
+
+  int32 NumGauss() const { return num_gauss_; }
+  int32 Dim() const { return dim_; }
+  GmmKernelType KernelType() const { return kernel_type_; }
+
+  /// Computes the total log-likelihood of each of "num_frames" frames, where
+  /// frame t is at data + t * stride (and has Dim() elements), and puts it in
+  /// loglikes[t].  "log_sum_exp_prune" has the same meaning as the "prune"
+  /// argument of VectorBase::LogSumExp(): if > 0, Gaussians whose
+  /// log-likelihood is more than this far below the best one are ignored.
+  void LogLikelihoods(const float *data, int32 num_frames, int32 stride,
+                      float log_sum_exp_prune, float *loglikes) const;
+
+  /// Convenience wrapper for a single frame.
+  float LogLikelihood(const VectorBase<float> &data,
+                      float log_sum_exp_prune) const;
+
+ private:
+  GmmKernelType kernel_type_;
+  int32 num_gauss_;
+  int32 dim_;
+  int32 num_blocks_;  // dim_ divided by block_width_, rounded up.
+  int32 block_width_;  // 8 or 16, depending on kernel_type_.
+  std::vector<float> gconsts_;  // dimension num_gauss_.
+  // Interleaved parameters; the block b of Gaussian i starts at
+  // (i * num_blocks_ + b) * 2 * block_width_.
+  std::vector<float> params_;
+};
+
+
+/**
+   PackedAmDiagGmm holds packed copies of all the pdfs of an AmDiagGmm.  Create
+   it once, after reading the model (and after any changes to it), and give it
+   to the decodable objects with DecodableAmDiagGmmUnmapped::SetPackedModel(),
+   so that the pdfs are packed once per model rather than once per utterance.
+   It is not changed after construction, so one object can be shared by all
+   the decoding threads.  It does not follow later changes to the model.
+*/
+class PackedAmDiagGmm {
+ public:
+  /// Packs all the pdfs of "am", whose gconsts must be valid.
+  explicit PackedAmDiagGmm(const AmDiagGmm &am,
+                           GmmKernelType type = BestGmmKernelType());
+
+  int32 NumPdfs() const { return pdfs_.size(); }
+  int32 Dim() const { return dim_; }
+
+  const PackedDiagGmm &GetPdf(int32 pdf_index) const {
+    KALDI_ASSERT(static_cast<size_t>(pdf_index) < pdfs_.size());
+    return pdfs_[pdf_index];
+  }
+
+ private:
+  int32 dim_;
+  std::vector<PackedDiagGmm> pdfs_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PackedAmDiagGmm);
+};
+
+}  // End namespace kaldi
+
+#endif  // KALDI_GMM_PACKED_DIAG_GMM_H_
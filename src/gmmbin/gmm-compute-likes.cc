@@ -20,6 +20,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/matrix-view-reader.h"
 #include "gmm/am-diag-gmm.h"
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
@@ -62,12 +63,12 @@ int main(int argc, char *argv[]) {
     }
 
     BaseFloatMatrixWriter loglikes_writer(loglikes_wspecifier);
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    SequentialBaseFloatMatrixViewReader feature_reader(feature_rspecifier);
 
     int32 num_done = 0;
     for (; !feature_reader.Done(); feature_reader.Next()) {
       std::string key = feature_reader.Key();
-      const Matrix<BaseFloat> &features (feature_reader.Value());
+      const SubMatrix<BaseFloat> features(feature_reader.Value());
       Matrix<BaseFloat> loglikes(features.NumRows(), am_gmm.NumPdfs());
       for (int32 i = 0; i < features.NumRows(); i++) {
         for (int32 j = 0; j < am_gmm.NumPdfs(); j++) {
@@ -109,6 +109,7 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_gmm.Read(ki.Stream(), binary);
     }
+    PackedAmDiagGmm packed_am(am_gmm);
 
     Int32VectorWriter words_writer(words_wspecifier);
 
@@ -150,6 +151,7 @@ int main(int argc, char *argv[]) {
 
       DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                              acoustic_scale);
+      gmm_decodable.SetPackedModel(&packed_am);
       decoder.Decode(&gmm_decodable);
 
       fst::VectorFst<LatticeArc> decoded;  // linear FST.
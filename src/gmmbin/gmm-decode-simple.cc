@@ -85,6 +85,7 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_gmm.Read(ki.Stream(), binary);
     }
+    PackedAmDiagGmm packed_am(am_gmm);
 
     VectorFst<StdArc> *decode_fst = ReadFstKaldi(fst_in_filename);
 
@@ -119,6 +120,7 @@ int main(int argc, char *argv[]) {
 
       DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                              acoustic_scale);
+      gmm_decodable.SetPackedModel(&packed_am);
       decoder.Decode(&gmm_decodable);
 
       VectorFst<LatticeArc> decoded;  // linear FST.
@@ -0,0 +1,300 @@
+// gmmbin/gmm-latgen-biglm-faster-parallel.cc
+
+// Copyright 2009-2011  Microsoft Corporation
+//           2013-2015  Johns Hopkins University (author: Daniel Povey)
+//                2014  Guoguo Chen
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "gmm/am-diag-gmm.h"
+#include "tree/context-dep.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "gmm/decodable-am-diag-gmm.h"
+#include "base/timer.h"
+#include "thread/kaldi-task-sequence.h"
+
+
+namespace kaldi {
+
+/// This class, for use with TaskSequencer, decodes one utterance with
+/// DecodeUtteranceLatticeBiglmFasterClass.  The decoder has its own small cache
+/// of LM-difference arcs in front of the LM-difference FST that all the
+/// threads share, so it can look up most arcs without locking anything; this
+/// class owns that cache, and the decoding graph if there is one per
+/// utterance, which must outlive the decoder.
+class BiglmDecodeTask {
+ public:
+  // We take ownership of "cache_fst" and "task", and of "decode_fst" if
+  // delete_decode_fst == true.
+  BiglmDecodeTask(const fst::Fst<fst::StdArc> *decode_fst,
+                  bool delete_decode_fst,
+                  fst::DeterministicOnDemandFst<fst::StdArc> *cache_fst,
+                  DecodeUtteranceLatticeBiglmFasterClass *task):
+      decode_fst_(decode_fst), delete_decode_fst_(delete_decode_fst),
+      cache_fst_(cache_fst), task_(task) { }
+
+  void operator () () { (*task_)(); }
+
+  ~BiglmDecodeTask() {
+    delete task_;  // This writes the output and deletes the decoder.
+    delete cache_fst_;
+    if (delete_decode_fst_)
+      delete decode_fst_;
+  }
+
+ private:
+  const fst::Fst<fst::StdArc> *decode_fst_;
+  bool delete_decode_fst_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *cache_fst_;
+  DecodeUtteranceLatticeBiglmFasterClass *task_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::VectorFst;
+    using fst::StdArc;
+    using fst::ReadFstKaldi;
+
+    const char *usage =
+        "Generate lattices using GMM-based model, using multiple decoding threads.\n"
+        "User supplies LM used to generate decoding graph, and desired LM;\n"
+        "this decoder applies the difference during decoding.  Interface and\n"
+        "behavior are otherwise the same as gmm-latgen-biglm-faster.  All the\n"
+        "threads share one cache of LM-difference arcs (see --num-cached-arcs);\n"
+        "each decoder also has a smaller one of its own (see --decoder-cache-size).\n"
+        "Usage: gmm-latgen-biglm-faster-parallel [options] model-in "
+        "(fst-in|fsts-rspecifier) oldlm-fst-in newlm-fst-in features-rspecifier"
+        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    BaseFloat acoustic_scale = 0.1;
+    int32 num_cached_arcs = 1000000;
+    int32 decoder_cache_size = 100000;
+    int32 max_lm_states = 1000000;
+    LatticeBiglmFasterDecoderConfig config;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    std::string word_syms_filename;
+    config.Register(&po);
+    sequencer_config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("num-cached-arcs", &num_cached_arcs, "Number of LM-difference "
+                "arcs in the cache shared by all threads.");
+    po.Register("decoder-cache-size", &decoder_cache_size, "Number of "
+                "LM-difference arcs in the cache of each decoder; this is the "
+                "memory per decoder, in units of about 20 bytes.");
+    po.Register("max-lm-states", &max_lm_states, "Maximum number of "
+                "LM-difference states to create before discarding them and "
+                "starting again (limits memory usage).  Each state takes "
+                "about 60 bytes.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 6 || po.NumArgs() > 8) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (num_cached_arcs <= 0 || decoder_cache_size <= 0 || max_lm_states <= 0)
+      KALDI_ERR << "Invalid --num-cached-arcs, --decoder-cache-size or "
+                << "--max-lm-states option.";
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        old_lm_fst_rxfilename = po.GetArg(3),
+        new_lm_fst_rxfilename = po.GetArg(4),
+        feature_rspecifier = po.GetArg(5),
+        lattice_wspecifier = po.GetArg(6),
+        words_wspecifier = po.GetOptArg(7),
+        alignment_wspecifier = po.GetOptArg(8);
+
+    TransitionModel trans_model;
+    AmDiagGmm am_gmm;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_gmm.Read(ki.Stream(), binary);
+    }
+    PackedAmDiagGmm packed_am(am_gmm);
+
+    VectorFst<StdArc> *old_lm_fst = ReadFstKaldi(old_lm_fst_rxfilename);
+    ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
+
+    VectorFst<StdArc> *new_lm_fst = ReadFstKaldi(new_lm_fst_rxfilename);
+
+    fst::BackoffDeterministicOnDemandFst<StdArc> old_lm_dfst(*old_lm_fst);
+    fst::BackoffDeterministicOnDemandFst<StdArc> new_lm_dfst(*new_lm_fst);
+    // The composed FST creates its states as they are needed, so we re-create
+    // it (and the cache) when it gets too large; see --max-lm-states.
+    typedef fst::ThreadSafeCacheDeterministicOnDemandFst<StdArc> SharedCacheFst;
+    fst::ComposeDeterministicOnDemandFst<StdArc> *compose_dfst = NULL;
+    SharedCacheFst *shared_cache_dfst = NULL;
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int32 num_success = 0, num_fail = 0;
+    VectorFst<StdArc> *decode_fst = NULL;  // only used if there is a single
+                                           // decoding graph.
+    bool single_fst = (ClassifyRspecifier(fst_in_str, NULL, NULL) ==
+                       kNoRspecifier);
+    SequentialBaseFloatMatrixReader sequential_feature_reader;
+    RandomAccessBaseFloatMatrixReader random_feature_reader;
+    SequentialTableReader<fst::VectorFstHolder> fst_reader;
+    if (single_fst) {
+      decode_fst = fst::ReadFstKaldi(fst_in_str);
+      if (!sequential_feature_reader.Open(feature_rspecifier))
+        KALDI_ERR << "Could not open features " << feature_rspecifier;
+    } else {
+      if (!fst_reader.Open(fst_in_str) ||
+          !random_feature_reader.Open(feature_rspecifier))
+        KALDI_ERR << "Could not open " << fst_in_str << " or "
+                  << feature_rspecifier;
+    }
+
+    {
+      TaskSequencer<BiglmDecodeTask> sequencer(
+          sequencer_config);
+      while (single_fst ? !sequential_feature_reader.Done() :
+             !fst_reader.Done()) {
+        std::string utt;
+        Matrix<BaseFloat> *features = NULL;
+        const fst::Fst<StdArc> *utt_fst = decode_fst;
+        if (single_fst) {
+          utt = sequential_feature_reader.Key();
+          features = new Matrix<BaseFloat>(sequential_feature_reader.Value());
+          sequential_feature_reader.Next();
+        } else {
+          utt = fst_reader.Key();
+          if (!random_feature_reader.HasKey(utt)) {
+            KALDI_WARN << "Not decoding utterance " << utt
+                       << " because no features available.";
+            num_fail++;
+            fst_reader.Next();
+            continue;
+          }
+          features = new Matrix<BaseFloat>(random_feature_reader.Value(utt));
+          utt_fst = new VectorFst<StdArc>(fst_reader.Value());
+          fst_reader.Next();
+        }
+        if (features->NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          delete features;
+          if (!single_fst)
+            delete utt_fst;
+          continue;
+        }
+
+        if (shared_cache_dfst != NULL &&
+            shared_cache_dfst->NumStatesSeen() > max_lm_states) {
+          // Nothing may be using the FSTs while we delete them.
+          sequencer.Wait();
+          KALDI_VLOG(1) << "Re-creating LM-difference FST after it reached "
+                        << shared_cache_dfst->NumStatesSeen() << " states.";
+          delete shared_cache_dfst;
+          delete compose_dfst;
+          shared_cache_dfst = NULL;
+          compose_dfst = NULL;
+        }
+        if (shared_cache_dfst == NULL) {
+          compose_dfst = new fst::ComposeDeterministicOnDemandFst<StdArc>(
+              &old_lm_dfst, &new_lm_dfst);
+          shared_cache_dfst = new SharedCacheFst(compose_dfst, num_cached_arcs);
+        }
+
+        // The decodable object takes ownership of the features.
+        DecodableAmDiagGmmScaled *gmm_decodable =
+            new DecodableAmDiagGmmScaled(am_gmm, trans_model, acoustic_scale,
+                                         -1.0, features);
+        gmm_decodable->SetPackedModel(&packed_am);
+        fst::CacheDeterministicOnDemandFst<StdArc> *cache_dfst =
+            new fst::CacheDeterministicOnDemandFst<StdArc>(shared_cache_dfst,
+                                                           decoder_cache_size);
+        LatticeBiglmFasterDecoder *decoder =
+            new LatticeBiglmFasterDecoder(*utt_fst, config, cache_dfst);
+        // The task takes ownership of the decoder and gmm_decodable, and
+        // BiglmDecodeTask of cache_dfst and of utt_fst if we have one FST per
+        // utterance.
+        DecodeUtteranceLatticeBiglmFasterClass *task =
+            new DecodeUtteranceLatticeBiglmFasterClass(
+                decoder, gmm_decodable, trans_model, word_syms, utt,
+                acoustic_scale, determinize, allow_partial, &alignment_writer,
+                &words_writer, &compact_lattice_writer, &lattice_writer,
+                &tot_like, &frame_count, &num_success, &num_fail, NULL);
+        sequencer.Run(new BiglmDecodeTask(utt_fst, !single_fst, cache_dfst,
+                                          task));  // takes ownership.
+      }
+      sequencer.Wait();
+    }
+    delete shared_cache_dfst;
+    delete compose_dfst;
+    delete decode_fst;
+    delete old_lm_fst;
+    delete new_lm_fst;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Decoded with " << sequencer_config.num_threads << " threads.";
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor per thread assuming 100 frames/sec is "
+              << (sequencer_config.num_threads * elapsed * 100.0 / frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+    if (word_syms) delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
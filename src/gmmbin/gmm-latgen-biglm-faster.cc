@@ -193,6 +193,7 @@ int main(int argc, char *argv[]) {
       trans_model.Read(ki.Stream(), binary);
       am_gmm.Read(ki.Stream(), binary);
     }
+    PackedAmDiagGmm packed_am(am_gmm);
 
     VectorFst<StdArc> *old_lm_fst = ReadFstKaldi(old_lm_fst_rxfilename);
     ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
@@ -248,6 +249,7 @@ int main(int argc, char *argv[]) {
       
           DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                                  acoustic_scale);
+          gmm_decodable.SetPackedModel(&packed_am);
 
 
           double like;
@@ -284,6 +286,7 @@ int main(int argc, char *argv[]) {
                                           &cache_dfst);
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
                                                acoustic_scale);
+        gmm_decodable.SetPackedModel(&packed_am);
         double like;
         if (DecodeUtterance(decoder, gmm_decodable, trans_model, word_syms, utt,
                             acoustic_scale, determinize, allow_partial,
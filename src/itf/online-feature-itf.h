@@ -74,6 +74,19 @@ class OnlineFeatureInterface {
   /// the class.
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) = 0;
 
+  /// This is like GetFrame(), but for the frames first_frame ...
+  /// first_frame + feats->NumRows() - 1, which are put in the rows of "feats";
+  /// all of them must be ready.  The default implementation calls GetFrame()
+  /// for each frame; classes that store their features, or can compute many
+  /// frames at once more efficiently, override it.  Use this rather than
+  /// GetFrame() when you need a block of frames.
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats) {
+    for (MatrixIndexT i = 0; i < feats->NumRows(); i++) {
+      SubVector<BaseFloat> feat(*feats, i);
+      GetFrame(first_frame + i, &feat);
+    }
+  }
+
   /// Virtual destructor.  Note: constructors that take another member of
   /// type OnlineFeatureInterface are not expected to take ownership of
   /// that pointer; the caller needs to keep track of that manually.
@@ -19,6 +19,7 @@
 
 #include "ivector/ivector-extractor.h"
 #include "thread/kaldi-task-sequence.h"
+#include "thread/kaldi-thread-pool.h"
 
 namespace kaldi {
 
@@ -167,13 +168,11 @@ IvectorExtractor::IvectorExtractor(
 
 class IvectorExtractorComputeDerivedVarsClass {
  public:
-  IvectorExtractorComputeDerivedVarsClass(IvectorExtractor *extractor,
-                                          int32 i):
-      extractor_(extractor), i_(i) { }
-  void operator () () { extractor_->ComputeDerivedVars(i_); }
+  explicit IvectorExtractorComputeDerivedVarsClass(IvectorExtractor *extractor):
+      extractor_(extractor) { }
+  void operator () (int32 i) const { extractor_->ComputeDerivedVars(i); }
  private:
   IvectorExtractor *extractor_;
-  int32 i_;
 };
 
 void IvectorExtractor::ComputeDerivedVars() {
@@ -189,15 +188,10 @@ void IvectorExtractor::ComputeDerivedVars() {
 
   // Note, we could have used RunMultiThreaded for this and similar tasks we
   // have here, but we found that we don't get as complete CPU utilization as we
-  // could because some tasks finish before others.
-  {
-    TaskSequencerConfig sequencer_opts;
-    sequencer_opts.num_threads = g_num_threads;
-    TaskSequencer<IvectorExtractorComputeDerivedVarsClass> sequencer(
-        sequencer_opts);
-    for (int32 i = 0; i < NumGauss(); i++)
-      sequencer.Run(new IvectorExtractorComputeDerivedVarsClass(this, i));
-  }
+  // could because some tasks finish before others.  ParallelFor hands out the
+  // Gaussians one at a time.
+  ParallelFor(0, NumGauss(), g_num_threads,
+              IvectorExtractorComputeDerivedVarsClass(this));
   KALDI_LOG << "Done.";
 }
 
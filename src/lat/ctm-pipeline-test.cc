@@ -0,0 +1,164 @@
+// lat/ctm-pipeline-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/ctm-pipeline.h"
+#include "lat/lattice-functions.h"
+#include "lat/lattice-test-utils.h"
+#include "lat/sausages.h"
+
+namespace kaldi {
+
+// Appends to "tids" the transition-ids of a random path through the HMM of
+// "phone", with the self-loops before the forward transition of each state
+// (i.e. not reordered).
+void AppendRandPhoneAlignment(const TransitionModel &trans_model,
+                              int32 phone, std::vector<int32> *tids) {
+  const HmmTopology::TopologyEntry &entry =
+      trans_model.GetTopo().TopologyForPhone(phone);
+  int32 hmm_state = 0, final_state = static_cast<int32>(entry.size()) - 1;
+  while (hmm_state != final_state) {
+    int32 trans_state = 1;
+    while (trans_model.TransitionStateToPhone(trans_state) != phone ||
+           trans_model.TransitionStateToHmmState(trans_state) != hmm_state)
+      trans_state++;
+    int32 trans_index = RandInt(0, entry[hmm_state].transitions.size() - 1);
+    tids->push_back(trans_model.PairToTransitionId(trans_state, trans_index));
+    hmm_state = entry[hmm_state].transitions[trans_index].first;
+  }
+}
+
+// Creates a random acyclic lattice in which each arc has one word, and the
+// transition-ids of one phone, so it can be word-aligned if all the phones are
+// "singleton" phones.  Sometimes the lattice is empty.
+void RandAlignableLattice(const TransitionModel &trans_model,
+                          CompactLattice *clat) {
+  clat->DeleteStates();
+  if (RandInt(0, 9) == 0)
+    return;
+  const std::vector<int32> &phones = trans_model.GetPhones();
+  int32 num_states = RandInt(2, 8);
+  for (int32 s = 0; s < num_states; s++)
+    clat->AddState();
+  clat->SetStart(0);
+  for (int32 s = 0; s + 1 < num_states; s++) {
+    int32 num_arcs = RandInt(1, 3);
+    for (int32 a = 0; a < num_arcs; a++) {
+      int32 word = RandInt(1, 5),
+          phone = phones[RandInt(0, phones.size() - 1)],
+          nextstate = RandInt(s + 1, std::min(s + 2, num_states - 1));
+      std::vector<int32> tids;
+      AppendRandPhoneAlignment(trans_model, phone, &tids);
+      CompactLatticeWeight weight(
+          LatticeWeight(RandUniform(), 5.0 * RandUniform()), tids);
+      clat->AddArc(s, CompactLatticeArc(word, word, weight, nextstate));
+    }
+  }
+  clat->SetFinal(num_states - 1, CompactLatticeWeight::One());
+}
+
+// Does serially what LatticeToCtmPipeline does, and checks that the pipeline,
+// with one or several threads, produces exactly the same CTM and counts.
+void TestLatticeToCtmPipeline(const TransitionModel &trans_model,
+                              const WordBoundaryInfo &info) {
+  int32 num_lattices = RandInt(0, 30);
+  std::vector<CompactLattice> lats(num_lattices);
+  for (int32 i = 0; i < num_lattices; i++)
+    RandAlignableLattice(trans_model, &(lats[i]));
+
+  LatticeToCtmPipelineOptions opts;
+  opts.acoustic_scale = 0.1 + RandUniform();
+  opts.lm_scale = 0.5 + RandUniform();
+  opts.decode_mbr = (RandInt(0, 3) != 0);
+
+  std::ostringstream ref_ctm;
+  int32 ref_num_done = 0, ref_num_err = 0;
+  int64 ref_num_words = 0;
+  double ref_tot_bayes_risk = 0.0;
+  for (int32 i = 0; i < num_lattices; i++) {
+    std::ostringstream key;
+    key << "utt" << i;
+    CompactLattice aligned_clat;
+    bool ok = WordAlignLattice(lats[i], trans_model, info, 0, &aligned_clat);
+    if (aligned_clat.Start() == fst::kNoStateId) {
+      ref_num_err++;
+      continue;
+    }
+    if (!ok)
+      ref_num_err++;
+    TopSortCompactLatticeIfNeeded(&aligned_clat);
+    fst::ScaleLattice(fst::LatticeScale(opts.lm_scale, opts.acoustic_scale),
+                      &aligned_clat);
+    MinimumBayesRisk mbr(aligned_clat, opts.decode_mbr);
+    const std::vector<int32> &words = mbr.GetOneBest();
+    const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+        mbr.GetOneBestTimes();
+    const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
+    for (size_t j = 0; j < words.size(); j++)
+      ref_ctm << key.str() << " 1 " << (opts.frame_shift * times[j].first)
+              << ' ' << (opts.frame_shift * (times[j].second - times[j].first))
+              << ' ' << words[j] << ' ' << conf[j] << '\n';
+    ref_num_done++;
+    ref_num_words += words.size();
+    ref_tot_bayes_risk += mbr.GetBayesRisk();
+  }
+
+  for (int32 n = 0; n < 2; n++) {
+    opts.sequencer_opts.num_threads = (n == 0 ? 1 : RandInt(2, 8));
+    opts.sequencer_opts.num_threads_total =
+        opts.sequencer_opts.num_threads + RandInt(0, 3);
+    std::ostringstream ctm;
+    LatticeToCtmPipeline pipeline(opts, &trans_model, &info, &ctm);
+    for (int32 i = 0; i < num_lattices; i++) {
+      std::ostringstream key;
+      key << "utt" << i;
+      CompactLattice clat(lats[i]);
+      pipeline.AcceptLattice(key.str(), &clat);
+      KALDI_ASSERT(clat.NumStates() == 0);
+    }
+    pipeline.Finish();
+    KALDI_ASSERT(ctm.str() == ref_ctm.str());
+    KALDI_ASSERT(pipeline.NumDone() == ref_num_done &&
+                 pipeline.NumErrors() == ref_num_err &&
+                 pipeline.NumWords() == ref_num_words);
+    KALDI_ASSERT(ApproxEqual(pipeline.TotBayesRisk(), ref_tot_bayes_risk));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++) {
+    TransitionModel *trans_model = RandTransitionModel();
+    // All the phones are single-phone words.
+    std::ostringstream boundary_os;
+    const std::vector<int32> &phones = trans_model->GetPhones();
+    for (size_t j = 0; j < phones.size(); j++)
+      boundary_os << phones[j] << " singleton\n";
+    std::istringstream boundary_is(boundary_os.str());
+    WordBoundaryInfoNewOpts info_opts;
+    info_opts.reorder = false;
+    WordBoundaryInfo info(info_opts);
+    info.Init(boundary_is);
+    for (int32 j = 0; j < 10; j++)
+      TestLatticeToCtmPipeline(*trans_model, info);
+    delete trans_model;
+  }
+  KALDI_LOG << "Success.";
+}
@@ -0,0 +1,143 @@
+// lat/ctm-pipeline.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <numeric>
+#include "lat/ctm-pipeline.h"
+#include "lat/lattice-functions.h"
+#include "lat/sausages.h"
+
+namespace kaldi {
+
+// The operator () does the word alignment and MBR decoding, and the destructor
+// writes the CTM lines and accumulates the statistics.  Only the results of MBR
+// are kept between the two, not the lattices.
+class LatticeToCtmPipeline::Task {
+ public:
+  Task(LatticeToCtmPipeline *pipeline, const std::string &key,
+       CompactLattice *clat): pipeline_(pipeline), key_(key),
+                              align_error_(false), empty_(false),
+                              bayes_risk_(0.0) {
+    // VectorFst shares its implementation on copying, and DeleteStates() gives
+    // *clat a new one, so this does not copy the lattice.
+    clat_ = *clat;
+    clat->DeleteStates();
+  }
+
+  void operator () () {
+    const LatticeToCtmPipelineOptions &opts = pipeline_->opts_;
+    if (pipeline_->tmodel_ != NULL) {
+      CompactLattice aligned_clat;
+      int32 max_states;
+      if (opts.max_expand > 0)
+        max_states = 1000 + opts.max_expand * clat_.NumStates();
+      else
+        max_states = 0;
+      align_error_ = !WordAlignLattice(clat_, *(pipeline_->tmodel_),
+                                       *(pipeline_->info_), max_states,
+                                       &aligned_clat);
+      clat_ = aligned_clat;
+    }
+    if (clat_.Start() == fst::kNoStateId) {
+      empty_ = true;
+      return;
+    }
+    TopSortCompactLatticeIfNeeded(&clat_);
+    fst::ScaleLattice(fst::LatticeScale(opts.lm_scale, opts.acoustic_scale),
+                      &clat_);
+
+    MinimumBayesRisk mbr(clat_, opts.decode_mbr);
+    clat_.DeleteStates();  // Free the memory now.
+    words_ = mbr.GetOneBest();
+    times_ = mbr.GetOneBestTimes();
+    conf_ = mbr.GetOneBestConfidences();
+    bayes_risk_ = mbr.GetBayesRisk();
+    KALDI_ASSERT(conf_.size() == words_.size() &&
+                 words_.size() == times_.size());
+  }
+
+  ~Task() {
+    if (empty_) {
+      pipeline_->num_err_++;
+      if (align_error_)
+        KALDI_WARN << "Empty aligned lattice for " << key_
+                   << ", producing no output.";
+      else
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      return;
+    }
+    if (align_error_) {
+      pipeline_->num_err_++;
+      KALDI_WARN << "Lattice for " << key_ << " did not align correctly; "
+                 << "outputting CTM for the partial lattice.";
+    }
+    BaseFloat frame_shift = pipeline_->opts_.frame_shift;
+    std::ostream &os = *(pipeline_->ctm_stream_);
+    for (size_t i = 0; i < words_.size(); i++) {
+      KALDI_ASSERT(words_[i] != 0); // Should not have epsilons.
+      os << key_ << " 1 " << (frame_shift * times_[i].first) << ' '
+         << (frame_shift * (times_[i].second - times_[i].first)) << ' '
+         << words_[i] << ' ' << conf_[i] << '\n';
+    }
+    KALDI_VLOG(1) << "For utterance " << key_ << ", Bayes Risk "
+                  << bayes_risk_ << ", avg. confidence per-word "
+                  << std::accumulate(conf_.begin(), conf_.end(), 0.0) /
+                     words_.size();
+    pipeline_->num_done_++;
+    pipeline_->num_words_ += words_.size();
+    pipeline_->tot_bayes_risk_ += bayes_risk_;
+  }
+
+ private:
+  LatticeToCtmPipeline *pipeline_;
+  std::string key_;
+  CompactLattice clat_;
+  bool align_error_;  // true if WordAlignLattice() failed.
+  bool empty_;  // true if the (aligned) lattice was empty.
+  std::vector<int32> words_;
+  std::vector<std::pair<BaseFloat, BaseFloat> > times_;
+  std::vector<BaseFloat> conf_;
+  BaseFloat bayes_risk_;
+};
+
+
+LatticeToCtmPipeline::LatticeToCtmPipeline(
+    const LatticeToCtmPipelineOptions &opts,
+    const TransitionModel *tmodel,
+    const WordBoundaryInfo *info,
+    std::ostream *ctm_stream):
+    opts_(opts), tmodel_(tmodel), info_(info), ctm_stream_(ctm_stream),
+    num_done_(0), num_err_(0), num_words_(0), tot_bayes_risk_(0.0),
+    sequencer_(opts.sequencer_opts) {
+  KALDI_ASSERT((tmodel == NULL) == (info == NULL) && ctm_stream != NULL);
+}
+
+void LatticeToCtmPipeline::AcceptLattice(const std::string &key,
+                                         CompactLattice *clat) {
+  sequencer_.Run(new Task(this, key, clat));
+}
+
+void LatticeToCtmPipeline::Finish() {
+  sequencer_.Wait();
+}
+
+LatticeToCtmPipeline::~LatticeToCtmPipeline() {
+  Finish();
+}
+
+}  // namespace kaldi
@@ -0,0 +1,129 @@
+// lat/ctm-pipeline.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_CTM_PIPELINE_H_
+#define KALDI_LAT_CTM_PIPELINE_H_
+
+#include <string>
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "itf/options-itf.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/word-align-lattice.h"
+#include "thread/kaldi-task-sequence.h"
+
+namespace kaldi {
+
+/*
+   This header provides a class that does, for a sequence of lattices, what
+   the pipeline
+     lattice-align-words | lattice-to-ctm-conf
+   does (as in steps/get_ctm.sh), but in one process and using several
+   threads: word alignment of the lattice (WordAlignLattice()), MBR decoding
+   (class MinimumBayesRisk) and output of the CTM lines with confidences.
+   The CTM output is in the same order as the lattices were given to it.
+   Memory use is bounded by the number of lattices in progress, which is
+   controlled by --num-threads-total (see TaskSequencerConfig).
+*/
+
+struct LatticeToCtmPipelineOptions {
+  BaseFloat acoustic_scale;
+  BaseFloat lm_scale;
+  bool decode_mbr;
+  BaseFloat frame_shift;
+  BaseFloat max_expand;
+  TaskSequencerConfig sequencer_opts;
+
+  LatticeToCtmPipelineOptions(): acoustic_scale(1.0), lm_scale(1.0),
+                                 decode_mbr(true), frame_shift(0.01),
+                                 max_expand(0.0) { }
+
+  void Register(OptionsItf *po) {
+    po->Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
+                 "acoustic likelihoods");
+    po->Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                 "probabilities");
+    po->Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
+                 "decoding (else, Maximum a Posteriori)");
+    po->Register("frame-shift", &frame_shift, "Time in seconds between "
+                 "frames.");
+    po->Register("max-expand", &max_expand, "If >0, the maximum amount by "
+                 "which word alignment may expand a lattice before we give up "
+                 "on it.  E.g. 10.");
+    sequencer_opts.Register(po);
+  }
+};
+
+
+class LatticeToCtmPipeline {
+ public:
+  /// If "tmodel" and "info" are NULL, the lattices are assumed to be
+  /// word-aligned already and no word alignment is done.  The CTM lines are
+  /// written to "ctm_stream" (with word-ids, not words), which should be set
+  /// up for floating-point output as the caller wants it; they are relative to
+  /// the keys of the lattices.  The objects pointed to must exist until after
+  /// Finish() is called.
+  LatticeToCtmPipeline(const LatticeToCtmPipelineOptions &opts,
+                       const TransitionModel *tmodel,
+                       const WordBoundaryInfo *info,
+                       std::ostream *ctm_stream);
+
+  /// Takes the lattice "clat" (it will be empty afterwards) and starts
+  /// processing it.  This may wait until a thread is free, and until the
+  /// output for enough earlier lattices has been written.
+  void AcceptLattice(const std::string &key, CompactLattice *clat);
+
+  /// Waits until all the lattices have been processed and their output
+  /// written.  AcceptLattice() may be called again afterwards.
+  void Finish();
+
+  /// Number of lattices for which we produced output (including any that
+  /// were only partially aligned).
+  int32 NumDone() const { return num_done_; }
+  /// Number of lattices that did not align correctly or were empty.
+  int32 NumErrors() const { return num_err_; }
+  int64 NumWords() const { return num_words_; }
+  double TotBayesRisk() const { return tot_bayes_risk_; }
+
+  /// The destructor calls Finish().
+  ~LatticeToCtmPipeline();
+
+ private:
+  class Task;  // This does the work for one lattice; see ctm-pipeline.cc.
+
+  LatticeToCtmPipelineOptions opts_;
+  const TransitionModel *tmodel_;
+  const WordBoundaryInfo *info_;
+  std::ostream *ctm_stream_;
+
+  // The following are only changed by the destructors of the tasks, which
+  // TaskSequencer calls one at a time.
+  int32 num_done_;
+  int32 num_err_;
+  int64 num_words_;
+  double tot_bayes_risk_;
+
+  TaskSequencer<Task> sequencer_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeToCtmPipeline);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_CTM_PIPELINE_H_
@@ -0,0 +1,248 @@
+// lat/determinize-lattice-incremental-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/determinize-lattice-incremental.h"
+#include "lat/lattice-test-utils.h"
+
+namespace kaldi {
+
+typedef LatticeArc::StateId StateId;
+
+// Creates a random raw lattice like the ones the decoders output, but without
+// epsilon input labels: the states of frame t are tokens[t], and the arcs go
+// from the states of each frame to those of the next.  The states are numbered
+// in order of frame, so the lattice is topologically sorted.
+void RandRawLattice(const TransitionModel &trans_model,
+                    Lattice *lat,
+                    std::vector<std::vector<StateId> > *tokens) {
+  int32 num_frames = RandInt(1, 20);
+  lat->DeleteStates();
+  tokens->clear();
+  tokens->resize(num_frames + 1);
+  (*tokens)[0].push_back(lat->AddState());
+  lat->SetStart(0);
+  for (int32 t = 1; t <= num_frames; t++) {
+    int32 num_toks = RandInt(1, 4);
+    for (int32 i = 0; i < num_toks; i++)
+      (*tokens)[t].push_back(lat->AddState());
+  }
+  for (int32 t = 0; t < num_frames; t++) {
+    for (size_t i = 0; i < (*tokens)[t].size(); i++) {
+      int32 num_arcs = RandInt(1, 3);
+      for (int32 a = 0; a < num_arcs; a++) {
+        const std::vector<StateId> &next_toks = (*tokens)[t + 1];
+        int32 ilabel = RandInt(1, trans_model.NumTransitionIds()),
+            olabel = (RandInt(0, 3) == 0 ? RandInt(1, 3) : 0);
+        StateId nextstate = next_toks[RandInt(0, next_toks.size() - 1)];
+        lat->AddArc((*tokens)[t][i],
+                    LatticeArc(ilabel, olabel,
+                               LatticeWeight(RandUniform(), 2.0 * RandUniform()),
+                               nextstate));
+      }
+    }
+  }
+  for (size_t i = 0; i < (*tokens)[num_frames].size(); i++)
+    if (i == 0 || RandInt(0, 1) == 0)
+      lat->SetFinal((*tokens)[num_frames][i], LatticeWeight(RandUniform(), 0));
+}
+
+// Outputs the cost of the best path from the start to each state of the
+// topologically sorted lattice "lat" and from each state to the end.
+void ViterbiCosts(const Lattice &lat, std::vector<double> *forward_cost,
+                  std::vector<double> *backward_cost) {
+  double inf = std::numeric_limits<double>::infinity();
+  forward_cost->assign(lat.NumStates(), inf);
+  backward_cost->assign(lat.NumStates(), inf);
+  (*forward_cost)[lat.Start()] = 0.0;
+  for (StateId s = 0; s < lat.NumStates(); s++) {
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      (*forward_cost)[arc.nextstate] =
+          std::min((*forward_cost)[arc.nextstate],
+                   (*forward_cost)[s] + ConvertToCost(arc.weight));
+    }
+  }
+  for (StateId s = lat.NumStates() - 1; s >= 0; s--) {
+    double cost = ConvertToCost(lat.Final(s));
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      cost = std::min(cost, ConvertToCost(arc.weight) +
+                      (*backward_cost)[arc.nextstate]);
+    }
+    (*backward_cost)[s] = cost;
+  }
+}
+
+// Outputs to "chunk" the part of "lat" from frame "begin" to frame "end", in
+// the format that LatticeIncrementalDeterminizer expects, as
+// LatticeFasterOnlineDecoder::DeterminizePrefix() does: there are entry arcs
+// (if begin > 0) to the tokens on frame "begin" and exit arcs (if end is not
+// the last frame) from the tokens on frame "end", with the forward and
+// backward costs of the tokens, relative to the best one, as their costs.  The
+// entry and exit arcs with the same label are for the same token.
+void GetChunk(const Lattice &lat,
+              const std::vector<std::vector<StateId> > &tokens,
+              const std::vector<double> &forward_cost,
+              const std::vector<double> &backward_cost,
+              int32 begin, int32 end, Lattice *chunk) {
+  const LatticeArc::Label kChunkLabelOffset =
+      LatticeIncrementalDeterminizer::kChunkLabelOffset;
+  double inf = std::numeric_limits<double>::infinity();
+  bool last_chunk = (end + 1 == static_cast<int32>(tokens.size()));
+  chunk->DeleteStates();
+  if (begin > 0)
+    chunk->AddState();
+  std::vector<StateId> state_map(lat.NumStates(), fst::kNoStateId);
+  for (int32 t = begin; t <= end; t++)
+    for (size_t i = 0; i < tokens[t].size(); i++)
+      state_map[tokens[t][i]] = chunk->AddState();
+  chunk->SetStart(0);
+
+  if (begin > 0) {
+    double best_cost = inf;
+    for (size_t i = 0; i < tokens[begin].size(); i++)
+      best_cost = std::min(best_cost, forward_cost[tokens[begin][i]]);
+    for (size_t i = 0; i < tokens[begin].size(); i++) {
+      StateId s = tokens[begin][i];
+      if (forward_cost[s] != inf && backward_cost[s] != inf)
+        chunk->AddArc(0, LatticeArc(0, kChunkLabelOffset + i,
+                                    LatticeWeight(forward_cost[s] - best_cost,
+                                                  0.0),
+                                    state_map[s]));
+    }
+  }
+  for (int32 t = begin; t < end; t++) {
+    for (size_t i = 0; i < tokens[t].size(); i++) {
+      StateId s = tokens[t][i];
+      for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done();
+           aiter.Next()) {
+        LatticeArc arc(aiter.Value());
+        arc.nextstate = state_map[arc.nextstate];
+        chunk->AddArc(state_map[s], arc);
+      }
+    }
+  }
+  if (last_chunk) {
+    for (size_t i = 0; i < tokens[end].size(); i++)
+      chunk->SetFinal(state_map[tokens[end][i]], lat.Final(tokens[end][i]));
+  } else {
+    double best_cost = inf;
+    for (size_t i = 0; i < tokens[end].size(); i++)
+      best_cost = std::min(best_cost, backward_cost[tokens[end][i]]);
+    StateId final_state = chunk->AddState();
+    chunk->SetFinal(final_state, LatticeWeight::One());
+    for (size_t i = 0; i < tokens[end].size(); i++) {
+      StateId s = tokens[end][i];
+      if (forward_cost[s] != inf && backward_cost[s] != inf)
+        chunk->AddArc(state_map[s],
+                      LatticeArc(0, kChunkLabelOffset + i,
+                                 LatticeWeight(backward_cost[s] - best_cost,
+                                               0.0),
+                                 final_state));
+    }
+  }
+}
+
+// Determinizes random lattices in random chunks and checks that the result is
+// the same as determinizing the whole lattice.  The costs of the entry and exit
+// arcs are exact here, so the best path is never pruned; if "lattice_beam" is
+// large enough that nothing is pruned, the lattices must be equivalent after
+// we determinize the one that was determinized incrementally again.
+void TestLatticeIncrementalDeterminizer(const TransitionModel &trans_model,
+                                        BaseFloat lattice_beam) {
+  Lattice lat;
+  std::vector<std::vector<StateId> > tokens;
+  RandRawLattice(trans_model, &lat, &tokens);
+  std::vector<double> forward_cost, backward_cost;
+  ViterbiCosts(lat, &forward_cost, &backward_cost);
+  if (backward_cost[lat.Start()] == std::numeric_limits<double>::infinity())
+    return;  // No successful paths.
+
+  fst::DeterminizeLatticePhonePrunedOptions det_opts;
+  CompactLattice ref_clat;
+  {
+    Lattice lat_copy(lat);
+    KALDI_ASSERT(DeterminizeLatticePhonePrunedWrapper(
+        trans_model, &lat_copy, lattice_beam, &ref_clat, det_opts));
+  }
+
+  LatticeIncrementalDeterminizerConfig config;
+  config.determinize_final = (Rand() % 2 == 0);
+  LatticeIncrementalDeterminizer determinizer(config, trans_model,
+                                              lattice_beam, det_opts);
+  // We use the determinizer for two "utterances", to check that Init() and
+  // "only_chunk" make it forget the first one; for the first we get a partial
+  // result with GetLattice(), and for the second the final one with
+  // FinishLattice().
+  for (int32 n = 0; n < 2; n++) {
+    determinizer.Init();
+    int32 num_frames = tokens.size() - 1, begin = 0;
+    Lattice chunk;
+    while (true) {
+      int32 end = RandInt(begin + 1, num_frames + 3);
+      if (end >= num_frames)
+        break;
+      GetChunk(lat, tokens, forward_cost, backward_cost, begin, end, &chunk);
+      KALDI_ASSERT(determinizer.AcceptChunk(&chunk));
+      begin = end;
+    }
+    GetChunk(lat, tokens, forward_cost, backward_cost, begin, num_frames,
+             &chunk);
+    int32 num_chunks = determinizer.NumChunks() + 1;
+    CompactLattice clat;
+    if (n == 0) {
+      KALDI_ASSERT(determinizer.GetLattice(&chunk, (begin == 0), &clat));
+    } else {
+      KALDI_ASSERT(determinizer.FinishLattice(&chunk, (begin == 0), &clat));
+      KALDI_ASSERT(determinizer.NumChunks() == 0);
+    }
+    KALDI_VLOG(1) << "Determinized lattice in " << num_chunks
+                  << " chunks: it has " << clat.NumStates()
+                  << " states, versus " << ref_clat.NumStates();
+
+    KALDI_ASSERT(ApproxEqual(BestPathCost(clat), BestPathCost(ref_clat)));
+    if (config.determinize_final)
+      KALDI_ASSERT(clat.Properties(fst::kIDeterministic, true) != 0);
+    if (lattice_beam > 1000.0) {
+      Lattice redet_lat;
+      ConvertLattice(clat, &redet_lat);
+      CompactLattice redet_clat;
+      KALDI_ASSERT(DeterminizeLatticePhonePrunedWrapper(
+          trans_model, &redet_lat, lattice_beam, &redet_clat, det_opts));
+      KALDI_ASSERT(fst::RandEquivalent(redet_clat, ref_clat, 5, 0.01, Rand(),
+                                       100));
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    TransitionModel *trans_model = RandTransitionModel();
+    for (int32 j = 0; j < 10; j++) {
+      TestLatticeIncrementalDeterminizer(*trans_model, 1.0e+10);
+      TestLatticeIncrementalDeterminizer(*trans_model,
+                                         0.5 + 5.0 * RandUniform());
+    }
+    delete trans_model;
+  }
+  KALDI_LOG << "Success.";
+}
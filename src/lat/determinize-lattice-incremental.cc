@@ -0,0 +1,244 @@
+// lat/determinize-lattice-incremental.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/determinize-lattice-incremental.h"
+#include "fstext/remove-eps-local.h"
+
+namespace kaldi {
+
+const LatticeIncrementalDeterminizer::Label
+LatticeIncrementalDeterminizer::kChunkLabelOffset;
+
+LatticeIncrementalDeterminizer::LatticeIncrementalDeterminizer(
+    const LatticeIncrementalDeterminizerConfig &config,
+    const TransitionModel &trans_model,
+    BaseFloat lattice_beam,
+    const fst::DeterminizeLatticePhonePrunedOptions &det_opts):
+    config_(config), trans_model_(trans_model), lattice_beam_(lattice_beam),
+    det_opts_(det_opts), num_chunks_(0) {
+  config.Check();
+}
+
+void LatticeIncrementalDeterminizer::Init() {
+  num_chunks_ = 0;
+  clat_.DeleteStates();
+  exit_states_.clear();
+  exit_costs_.clear();
+}
+
+bool LatticeIncrementalDeterminizer::DeterminizeChunk(
+    Lattice *raw_chunk, CompactLattice *chunk,
+    std::vector<BaseFloat> *entry_costs,
+    std::vector<BaseFloat> *exit_costs) const {
+  entry_costs->clear();
+  exit_costs->clear();
+  StateId start = raw_chunk->Start();
+  for (StateId s = 0; s < raw_chunk->NumStates(); s++) {
+    for (fst::ArcIterator<Lattice> aiter(*raw_chunk, s); !aiter.Done();
+         aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      if (arc.olabel < kChunkLabelOffset)
+        continue;
+      // Arcs from the start state are entry arcs; the others are exit arcs.
+      std::vector<BaseFloat> *costs = (s == start ? entry_costs : exit_costs);
+      size_t index = arc.olabel - kChunkLabelOffset;
+      if (index >= costs->size())
+        costs->resize(index + 1, 0.0);
+      (*costs)[index] = arc.weight.Value1();
+    }
+  }
+  bool ans = fst::DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, raw_chunk, lattice_beam_, chunk, det_opts_);
+  raw_chunk->DeleteStates();
+  return ans;
+}
+
+// static
+void LatticeIncrementalDeterminizer::AppendChunk(
+    const CompactLattice &chunk,
+    const std::vector<BaseFloat> &entry_costs,
+    const std::vector<StateId> &exit_states,
+    const std::vector<BaseFloat> &exit_costs,
+    CompactLattice *clat,
+    std::vector<StateId> *chunk_exit_states) {
+  typedef CompactLatticeArc::Weight Weight;
+  chunk_exit_states->clear();
+  if (chunk.Start() == fst::kNoStateId) {
+    // Nothing survived determinization; the lattice is empty from now on.
+    clat->DeleteStates();
+    return;
+  }
+  bool first_chunk = (clat->Start() == fst::kNoStateId);
+
+  // Copy the states and arcs of "chunk" to "clat".
+  StateId offset = clat->NumStates();
+  for (StateId s = 0; s < chunk.NumStates(); s++)
+    clat->AddState();
+  for (StateId s = 0; s < chunk.NumStates(); s++) {
+    clat->SetFinal(s + offset, chunk.Final(s));
+    bool is_exit_state = false;
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, s); !aiter.Done();
+         aiter.Next()) {
+      CompactLatticeArc arc(aiter.Value());
+      if (arc.ilabel >= kChunkLabelOffset && (first_chunk ||
+                                              s != chunk.Start()))
+        is_exit_state = true;
+      arc.nextstate += offset;
+      clat->AddArc(s + offset, arc);
+    }
+    if (is_exit_state)
+      chunk_exit_states->push_back(s + offset);
+  }
+  if (first_chunk) {
+    clat->SetStart(chunk.Start() + offset);
+    return;
+  }
+
+  // The entry arcs of "chunk", indexed by label minus kChunkLabelOffset.
+  std::vector<CompactLatticeArc> entry_arcs;
+  KALDI_ASSERT(chunk.Final(chunk.Start()) == Weight::Zero());
+  for (fst::ArcIterator<CompactLattice> aiter(chunk, chunk.Start());
+       !aiter.Done(); aiter.Next()) {
+    const CompactLatticeArc &arc = aiter.Value();
+    KALDI_ASSERT(arc.ilabel >= kChunkLabelOffset);
+    size_t index = arc.ilabel - kChunkLabelOffset;
+    if (index >= entry_arcs.size())
+      entry_arcs.resize(index + 1, CompactLatticeArc(0, 0, Weight::Zero(),
+                                                     fst::kNoStateId));
+    entry_arcs[index] = arc;
+  }
+
+  // Replace each exit arc p -> q of the previous chunk, where q is final and
+  // has no arcs, by an epsilon arc from p to the destination of the entry arc
+  // with the same label, whose weight is the product of the weights of the
+  // exit arc, the final-weight of q and the entry arc, without the costs that
+  // were added for pruning.
+  std::vector<StateId> exit_final_states;
+  for (size_t i = 0; i < exit_states.size(); i++) {
+    StateId p = exit_states[i];
+    for (fst::MutableArcIterator<CompactLattice> aiter(clat, p);
+         !aiter.Done(); aiter.Next()) {
+      CompactLatticeArc arc(aiter.Value());
+      if (arc.ilabel < kChunkLabelOffset)
+        continue;
+      size_t index = arc.ilabel - kChunkLabelOffset;
+      StateId q = arc.nextstate;
+      KALDI_ASSERT(clat->NumArcs(q) == 0 && index < exit_costs.size());
+      exit_final_states.push_back(q);
+      if (index >= entry_arcs.size() ||
+          entry_arcs[index].nextstate == fst::kNoStateId) {
+        // The token was pruned away in this chunk; the arc now leads to a
+        // dead state (we make q non-final below).
+        continue;
+      }
+      const CompactLatticeArc &entry_arc = entry_arcs[index];
+      Weight weight = fst::Times(fst::Times(arc.weight, clat->Final(q)),
+                                 entry_arc.weight);
+      BaseFloat pruning_cost = exit_costs[index] + entry_costs[index];
+      arc.weight = Weight(LatticeWeight(weight.Weight().Value1() - pruning_cost,
+                                        weight.Weight().Value2()),
+                          weight.String());
+      arc.ilabel = 0;
+      arc.olabel = 0;
+      arc.nextstate = entry_arc.nextstate + offset;
+      aiter.SetValue(arc);
+    }
+  }
+  for (size_t i = 0; i < exit_final_states.size(); i++)
+    clat->SetFinal(exit_final_states[i], Weight::Zero());
+}
+
+bool LatticeIncrementalDeterminizer::AcceptChunk(Lattice *raw_chunk) {
+  CompactLattice chunk;
+  std::vector<BaseFloat> entry_costs, exit_costs;
+  bool ans = DeterminizeChunk(raw_chunk, &chunk, &entry_costs, &exit_costs);
+  if (num_chunks_ > 0 && clat_.Start() == fst::kNoStateId) {
+    // An earlier chunk was empty, so the whole lattice will be.
+    num_chunks_++;
+    return ans;
+  }
+  std::vector<StateId> chunk_exit_states;
+  AppendChunk(chunk, entry_costs, exit_states_, exit_costs_, &clat_,
+              &chunk_exit_states);
+  exit_states_.swap(chunk_exit_states);
+  exit_costs_.swap(exit_costs);
+  num_chunks_++;
+  KALDI_VLOG(2) << "Determinized lattice chunk " << num_chunks_ << " has "
+                << chunk.NumStates() << " states; lattice so far has "
+                << clat_.NumStates() << " states.";
+  return ans;
+}
+
+bool LatticeIncrementalDeterminizer::FinishLattice(Lattice *last_chunk,
+                                                   bool only_chunk,
+                                                   CompactLattice *clat) {
+  if (!only_chunk) {
+    // Assigning an Fst shares its data; deleting the states of clat_ then
+    // leaves "clat" as the only owner, so it is not copied when it is changed.
+    *clat = clat_;
+    clat_.DeleteStates();
+  }
+  bool ans = JoinLastChunk(last_chunk, only_chunk, clat);
+  Init();
+  return ans;
+}
+
+bool LatticeIncrementalDeterminizer::GetLattice(Lattice *last_chunk,
+                                                bool only_chunk,
+                                                CompactLattice *clat) const {
+  if (!only_chunk)
+    *clat = clat_;  // This is copied when JoinLastChunk() changes it.
+  return JoinLastChunk(last_chunk, only_chunk, clat);
+}
+
+bool LatticeIncrementalDeterminizer::JoinLastChunk(Lattice *last_chunk,
+                                                   bool only_chunk,
+                                                   CompactLattice *clat) const {
+  CompactLattice chunk;
+  std::vector<BaseFloat> entry_costs, exit_costs;
+  bool ans = DeterminizeChunk(last_chunk, &chunk, &entry_costs, &exit_costs);
+  KALDI_ASSERT(exit_costs.empty() && "Last chunk must not have exit arcs.");
+  if (only_chunk) {
+    KALDI_ASSERT(entry_costs.empty() && "Only chunk must not have entry arcs.");
+    *clat = chunk;
+    chunk.DeleteStates();
+  } else {
+    KALDI_ASSERT(num_chunks_ > 0 && "No chunks were accepted.");
+    if (clat->Start() != fst::kNoStateId) {
+      std::vector<StateId> chunk_exit_states;
+      AppendChunk(chunk, entry_costs, exit_states_, exit_costs_, clat,
+                  &chunk_exit_states);
+    }
+  }
+  fst::Connect(clat);
+  // Removes most of the epsilon arcs where the chunks were joined.
+  fst::RemoveEpsLocal(clat);
+  if (config_.determinize_final && !only_chunk && clat->NumStates() != 0) {
+    Lattice lat;
+    ConvertLattice(*clat, &lat);
+    clat->DeleteStates();
+    if (!fst::DeterminizeLatticePhonePrunedWrapper(trans_model_, &lat,
+                                                   lattice_beam_, clat,
+                                                   det_opts_))
+      ans = false;
+  }
+  return ans && clat->NumStates() != 0;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,203 @@
+// lat/determinize-lattice-incremental.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_DETERMINIZE_LATTICE_INCREMENTAL_H_
+#define KALDI_LAT_DETERMINIZE_LATTICE_INCREMENTAL_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "itf/options-itf.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/*
+   This header implements determinization of a lattice in pieces, for use in
+   decoders (see LatticeFasterOnlineDecoder::DeterminizePrefix()) on long
+   recordings, where getting the whole raw lattice at the end and determinizing
+   it would take a lot of memory and a long time after the end of the audio.
+
+   The decoder cuts the raw lattice at frames where not many tokens are active,
+   and gives each piece ("chunk") to the determinizer as soon as the frames in
+   it are finished, after which it can free the tokens.  The chunks are joined
+   by special labels: for all but the last chunk, each of the tokens on the
+   frame where the chunk ends is an "exit" i, represented by an arc with
+   olabel kChunkLabelOffset + i into a final state, and the next chunk starts
+   with a start state that has an arc with that olabel to the state for the same
+   token (its "entry").  Each chunk is determinized separately
+   (DeterminizeLatticePhonePruned()), and afterwards the arcs with these labels
+   are replaced by epsilon arcs from the determinized previous chunk into the
+   determinized next chunk.
+
+   By default the result is not deterministic: where two chunks meet, a word
+   sequence has one path for each of the tokens at the cut that it can go
+   through (and RemoveEpsLocal() only removes some of the epsilon arcs).  It
+   has the same word sequences as the lattice we would get by determinizing the
+   whole raw lattice, with the same best costs and alignments (apart from
+   differences in pruning), so it is equivalent to that lattice after it is
+   determinized again.  With --determinize-final=true we do that at the end
+   (taking time proportional to the size of the determinized lattice, which is
+   much less than determinizing the raw lattice); otherwise do it later if you
+   need a deterministic lattice, e.g. with lattice-determinize-pruned.
+
+   The costs of the entry and exit arcs are only used for pruning: they should
+   be the forward cost of the entry token and the (estimated) backward cost of
+   the exit token, relative to the best token, so that paths are pruned in the
+   chunk as they would be in the whole lattice.  They are removed when the
+   chunks are joined.
+*/
+
+struct LatticeIncrementalDeterminizerConfig {
+  int32 min_chunk_length;
+  int32 max_chunk_length;
+  int32 determinize_delay;
+  bool determinize_final;
+
+  LatticeIncrementalDeterminizerConfig(): min_chunk_length(100),
+                                          max_chunk_length(400),
+                                          determinize_delay(25),
+                                          determinize_final(false) { }
+
+  void Register(OptionsItf *po) {
+    po->Register("determinize-min-chunk", &min_chunk_length, "Minimum number "
+                 "of frames in each piece of lattice that is determinized "
+                 "incrementally.");
+    po->Register("determinize-max-chunk", &max_chunk_length, "Maximum number "
+                 "of frames in each piece of lattice that is determinized "
+                 "incrementally (the piece ends at the frame with fewest "
+                 "active tokens in this range).");
+    po->Register("determinize-delay", &determinize_delay, "Number of frames "
+                 "before the most recently decoded frame that we wait before "
+                 "determinizing the lattice; tokens on recent frames may "
+                 "still be pruned away.");
+    po->Register("determinize-final", &determinize_final, "If true, "
+                 "determinize the joined lattice again when it is output, so "
+                 "that it is also deterministic where the pieces were joined.");
+  }
+  void Check() const {
+    KALDI_ASSERT(min_chunk_length > 0 && max_chunk_length >= min_chunk_length
+                 && determinize_delay > 0);
+  }
+};
+
+
+class LatticeIncrementalDeterminizer {
+ public:
+  typedef CompactLatticeArc::StateId StateId;
+  typedef CompactLatticeArc::Label Label;
+
+  /// The olabels of the arcs that join chunks are kChunkLabelOffset plus the
+  /// index of the token; word-ids must be less than this.
+  static const Label kChunkLabelOffset = 1 << 28;
+
+  /// "lattice_beam" and "det_opts" are as for
+  /// DeterminizeLatticePhonePrunedWrapper().
+  LatticeIncrementalDeterminizer(
+      const LatticeIncrementalDeterminizerConfig &config,
+      const TransitionModel &trans_model,
+      BaseFloat lattice_beam,
+      const fst::DeterminizeLatticePhonePrunedOptions &det_opts);
+
+  const LatticeIncrementalDeterminizerConfig &Config() const {
+    return config_;
+  }
+
+  /// Forgets any chunks accepted so far; call this at the start of each
+  /// utterance.
+  void Init();
+
+  /// Determinizes the raw lattice "raw_chunk" (which is destroyed) and appends
+  /// it to the lattice determinized so far.  "raw_chunk" has transition-ids
+  /// on the input and words on the output side, as from the decoder's
+  /// GetRawLattice(), plus the entry and exit arcs described at the top of
+  /// this file; the first chunk has no entry arcs.  Returns false if
+  /// determinization terminated early (see DeterminizeLatticePruned()).
+  bool AcceptChunk(Lattice *raw_chunk);
+
+  /// Determinizes "last_chunk" (which has no exit arcs, and is destroyed) and
+  /// outputs the whole determinized lattice, including the chunks accepted so
+  /// far.  If "only_chunk" is true, "last_chunk" is the whole raw lattice (it
+  /// was never cut, so it has no entry arcs either) and any chunks accepted
+  /// since Init() are ignored, as they would belong to an earlier utterance.
+  /// The output is only deterministic where the chunks were joined if
+  /// Config().determinize_final is true (see the top of this file).  Returns
+  /// false if determinization terminated early or if the output is empty.
+  /// This hands the lattice determinized so far over to "clat" without
+  /// copying it, so afterwards this object is as after Init().
+  bool FinishLattice(Lattice *last_chunk, bool only_chunk,
+                     CompactLattice *clat);
+
+  /// As FinishLattice(), but does not change the state of this object, so it
+  /// can be called for partial results.  This has to copy the lattice
+  /// determinized so far, so do not call it more often than you need to.
+  bool GetLattice(Lattice *last_chunk, bool only_chunk,
+                  CompactLattice *clat) const;
+
+  /// Returns the number of chunks accepted since Init().
+  int32 NumChunks() const { return num_chunks_; }
+
+ private:
+  // Determinizes "raw_chunk" into "chunk", and outputs the costs of its
+  // entry arcs, indexed by label minus kChunkLabelOffset, and likewise for its
+  // exit arcs.
+  bool DeterminizeChunk(Lattice *raw_chunk, CompactLattice *chunk,
+                        std::vector<BaseFloat> *entry_costs,
+                        std::vector<BaseFloat> *exit_costs) const;
+
+  // Does the work of FinishLattice() and GetLattice(): unless "only_chunk",
+  // "clat" must contain the chunks accepted so far, and we determinize
+  // "last_chunk" and append it.
+  bool JoinLastChunk(Lattice *last_chunk, bool only_chunk,
+                     CompactLattice *clat) const;
+
+  // Appends the determinized chunk "chunk" to "clat", joining the exit arcs
+  // that leave the states "exit_states" of "clat" (whose costs are
+  // "exit_costs") to the entry arcs of "chunk".  Outputs to "chunk_exit_states"
+  // the states of "clat" that have the exit arcs of "chunk".
+  static void AppendChunk(const CompactLattice &chunk,
+                          const std::vector<BaseFloat> &entry_costs,
+                          const std::vector<StateId> &exit_states,
+                          const std::vector<BaseFloat> &exit_costs,
+                          CompactLattice *clat,
+                          std::vector<StateId> *chunk_exit_states);
+
+  LatticeIncrementalDeterminizerConfig config_;
+  const TransitionModel &trans_model_;
+  BaseFloat lattice_beam_;
+  fst::DeterminizeLatticePhonePrunedOptions det_opts_;
+
+  int32 num_chunks_;
+  // The lattice determinized so far.  It is not connected (Connect() would
+  // take time proportional to its size each time we accept a chunk); the
+  // final states of the last chunk are only reached by its exit arcs.
+  CompactLattice clat_;
+  // The states of clat_ with exit arcs (arcs with labels >= kChunkLabelOffset).
+  std::vector<StateId> exit_states_;
+  // The costs of the exit arcs of the last chunk, indexed by label minus
+  // kChunkLabelOffset.
+  std::vector<BaseFloat> exit_costs_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeIncrementalDeterminizer);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_DETERMINIZE_LATTICE_INCREMENTAL_H_
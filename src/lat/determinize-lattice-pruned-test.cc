@@ -160,6 +160,88 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
   }
 }
 
+// test that determinizing an epsilon-free lattice that is already deterministic
+// gives one output state per input state, even for the states that can be
+// reached by more than one path.
+template<class Arc> void TestDeterminizeLatticePrunedDeterministic() {
+  typedef kaldi::int32 Int;
+  typedef typename Arc::Weight Weight;
+  typedef ArcTpl<CompactLatticeWeightTpl<Weight, Int> > CompactArc;
+  for(int i = 0; i < 100; i++) {
+    VectorFst<Arc> fst;
+    int num_states = kaldi::RandInt(2, 20);
+    for (int s = 0; s < num_states; s++)
+      fst.AddState();
+    fst.SetStart(0);
+    fst.SetFinal(num_states - 1, Weight::One());
+    for (int s = 0; s + 1 < num_states; s++) {
+      int num_arcs = kaldi::RandInt(1, 3);
+      for (int a = 0; a < num_arcs; a++) {
+        // The first arc makes sure that all the states are accessible.
+        int nextstate = (a == 0 ? s + 1 : kaldi::RandInt(s + 1, num_states - 1));
+        fst.AddArc(s, Arc(a + 1, kaldi::RandInt(1, 5),
+                          Weight(kaldi::RandUniform(), kaldi::RandUniform()),
+                          nextstate));
+      }
+    }
+    VectorFst<CompactArc> det_fst;
+    bool ans = DeterminizeLatticePruned<Weight, Int>(fst, 1.0e+10, &det_fst);
+    KALDI_ASSERT(ans && det_fst.NumStates() == num_states);
+  }
+}
+
+// test determinization on a lattice where many of the determinized states
+// have subsets with the same hash value.  The lattice has two chains of states,
+// x_0 ... x_n and y_0 ... y_n, with epsilon output labels; from x_t and y_t
+// there are arcs with labels 1 and 2 to x_{t+1} and y_{t+1}, which cost the
+// same except that label 1 costs one more on the y chain.  After t labels, the
+// subset is {x_t, y_t}, with the weight of y_t relative to x_t equal to the
+// number of 1's so far; so there are t + 1 subsets for frame t, which differ
+// only in weight and hence have the same hash value, and many strings of
+// labels lead to each of them.  (The start state has epsilon arcs to x_0 and
+// y_0.)  This makes the subset tables deal with
+// collisions and grow several times.
+template<class Arc> void TestDeterminizeLatticePrunedCollisions() {
+  typedef kaldi::int32 Int;
+  typedef typename Arc::Weight Weight;
+  typedef ArcTpl<CompactLatticeWeightTpl<Weight, Int> > CompactArc;
+  for(int i = 0; i < 10; i++) {
+    int n = kaldi::RandInt(1, 30);
+    VectorFst<Arc> fst;
+    int start = fst.AddState();
+    fst.SetStart(start);
+    vector<int> x(n + 1), y(n + 1);
+    for (int t = 0; t <= n; t++) {
+      x[t] = fst.AddState();
+      y[t] = fst.AddState();
+    }
+    fst.AddArc(start, Arc(0, 0, Weight::One(), x[0]));
+    fst.AddArc(start, Arc(0, 0, Weight(0.5, 0.0), y[0]));
+    for (int t = 0; t < n; t++) {
+      for (int label = 1; label <= 2; label++) {
+        float cost = kaldi::RandInt(0, 3);
+        fst.AddArc(x[t], Arc(label, 0, Weight(cost, 0.0), x[t + 1]));
+        fst.AddArc(y[t], Arc(label, 0, Weight(cost + (label == 1 ? 1.0 : 0.0),
+                                              0.0), y[t + 1]));
+      }
+    }
+    fst.SetFinal(x[n], Weight::One());
+    fst.SetFinal(y[n], Weight::One());
+
+    VectorFst<CompactArc> det_fst;
+    bool ans = DeterminizeLatticePruned<Weight, Int>(fst, 1000.0, &det_fst);
+    KALDI_ASSERT(ans);
+    // t + 1 states for frame t (the start state is the one for frame 0).
+    KALDI_ASSERT(det_fst.NumStates() == (n + 1) * (n + 2) / 2);
+    KALDI_ASSERT(det_fst.Properties(kIDeterministic, true) & kIDeterministic);
+    VectorFst<CompactArc> compact_fst;
+    ConvertLattice<Weight, Int>(fst, &compact_fst, false);
+    KALDI_ASSERT(RandEquivalent(det_fst, compact_fst, 5/*paths*/,
+                                0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                100/*path length, max*/));
+  }
+}
+
 
 } // end namespace fst
 
@@ -167,5 +249,7 @@ int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticePrunedDeterministic<kaldi::LatticeArc>();
+  TestDeterminizeLatticePrunedCollisions<kaldi::LatticeArc>();
   std::cout << "Tests succeeded\n";
 }
@@ -199,8 +199,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                             double beam,
                             DeterminizeLatticePrunedOptions opts):
       num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
-      equal_(opts_.delta), determinized_(false),
-      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
+      determinized_(false), minimal_hash_(opts_.delta),
+      initial_hash_(opts_.delta) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
     // work correctly otherwise.
   }
@@ -219,17 +219,18 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       delete ifst_;
       ifst_ = NULL;
     }
-    { MinimalSubsetHash tmp; tmp.swap(minimal_hash_); }
+    minimal_hash_.Clear();
     
     for (size_t i = 0; i < output_states_.size(); i++) {
       vector<Element> empty_subset;
       empty_subset.swap(output_states_[i]->minimal_subset);
     }
     
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter)
-      delete iter->first;
-    { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
+    const vector<typename InitialSubsetHash::Slot> &slots =
+        initial_hash_.Slots();
+    for (size_t i = 0; i < slots.size(); i++)
+      delete slots[i].subset;
+    initial_hash_.Clear();
     for (size_t i = 0; i < output_states_.size(); i++) {
       vector<Element> tmp;
       tmp.swap(output_states_[i]->minimal_subset);
@@ -279,13 +280,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     }
 
     // the following loop covers strings present in initial_hash_.
-    for (typename InitialSubsetHash::const_iterator
-             iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter) {
-      const vector<Element> &vec = *(iter->first);
-      Element elem = iter->second;
-      AddStrings(vec, &needed_strings);
-      needed_strings.push_back(elem.string);
+    const vector<typename InitialSubsetHash::Slot> &slots =
+        initial_hash_.Slots();
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (slots[i].subset == NULL) continue;
+      AddStrings(*(slots[i].subset), &needed_strings);
+      needed_strings.push_back(slots[i].value.string);
     }
     std::sort(needed_strings.begin(), needed_strings.end());
     needed_strings.erase(std::unique(needed_strings.begin(),
@@ -424,7 +424,6 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   };
 
   // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
   // The Elements are in sorted order on state id, and without repeated states.
   // Because the order of Elements is fixed, we can use a hashing function that is
   // order-dependent.  However the weights are not included in the hashing function--
@@ -435,19 +434,20 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   //   We don't quantize the weights, in order to avoid inexactness in simple cases.
   // Instead we apply the delta when comparing subsets for equality, and allow a small
   // difference.
-
-  class SubsetKey {
-   public:
-    size_t operator ()(const vector<Element> * subset) const {  // hashes only the state and string.
-      size_t hash = 0, factor = 1;
-      for (typename vector<Element>::const_iterator iter= subset->begin(); iter != subset->end(); ++iter) {
-        hash *= factor;
-        hash += iter->state + reinterpret_cast<size_t>(iter->string);
-        factor *= 23531;  // these numbers are primes.
-      }
-      return hash;
-    }
-  };
+  //   The hash of a subset is computed incrementally, one Element at a time, by
+  // starting from zero and calling HashElement() for each Element; this is done
+  // in NormalizeSubset(), in the loop that writes the normalized Elements.
+  static inline size_t HashElement(size_t hash, const Element &elem) {
+    return hash * 23531 + static_cast<size_t>(elem.state) * 7853 +
+        reinterpret_cast<size_t>(elem.string);  // these numbers are primes.
+  }
+  static size_t SubsetHashValue(const vector<Element> &subset) {
+    size_t hash = 0;
+    for (typename vector<Element>::const_iterator iter = subset.begin();
+         iter != subset.end(); ++iter)
+      hash = HashElement(hash, *iter);
+    return hash;
+  }
 
   // This is the equality operator on subsets.  It checks for exact match on state-id
   // and string, and approximate match on weights.
@@ -488,18 +488,105 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     }
   };
 
+  // An open-addressing hash table (with linear probing) from subsets to
+  // values of type T.  It stores the hash value of each subset next to the
+  // pointer, so hash values are never recomputed, and subsets whose hash values
+  // differ are never compared.  It does not own the subsets.
+  template<class T> class SubsetTable {
+   public:
+    struct Slot {
+      size_t hash;
+      const vector<Element> *subset;  // NULL if this slot is empty.
+      T value;
+      Slot(): hash(0), subset(NULL), value() { }
+    };
+
+    explicit SubsetTable(float delta): equal_(delta), num_used_(0),
+                                       slots_(kMinSize) { }
+
+    // Returns the value for "subset", whose hash value is "hash", or NULL if
+    // it is not in the table.
+    const T *Find(const vector<Element> &subset, size_t hash) const {
+      size_t mask = slots_.size() - 1, index = Index(hash) & mask;
+      while (slots_[index].subset != NULL) {
+        const Slot &slot = slots_[index];
+        if (slot.hash == hash && equal_(slot.subset, &subset))
+          return &(slot.value);
+        index = (index + 1) & mask;
+      }
+      return NULL;
+    }
+
+    // Adds "subset", which must not already be in the table.
+    void Insert(const vector<Element> *subset, size_t hash, const T &value) {
+      if (2 * (num_used_ + 1) > slots_.size())
+        Resize(2 * slots_.size());
+      size_t mask = slots_.size() - 1, index = Index(hash) & mask;
+      while (slots_[index].subset != NULL)
+        index = (index + 1) & mask;
+      slots_[index].hash = hash;
+      slots_[index].subset = subset;
+      slots_[index].value = value;
+      num_used_++;
+    }
+
+    // Makes sure the table can hold "num_subsets" subsets without growing.
+    void Reserve(size_t num_subsets) {
+      size_t size = slots_.size();
+      while (size < 2 * num_subsets) size *= 2;
+      if (size != slots_.size())
+        Resize(size);
+    }
+
+    // Removes all subsets and frees the memory.
+    void Clear() {
+      vector<Slot> tmp;
+      tmp.swap(slots_);
+      slots_.resize(kMinSize);
+      num_used_ = 0;
+    }
+
+    // For iterating over the table; ignore the slots whose subset is NULL.
+    const vector<Slot> &Slots() const { return slots_; }
+
+   private:
+    static const size_t kMinSize = 8;  // must be a power of two.
+
+    // Scrambles the bits of "hash", so that all of them affect the low-order
+    // bits that we use.
+    static inline size_t Index(size_t hash) {
+      return hash ^ (hash >> 16);
+    }
+
+    // new_size must be a power of two.
+    void Resize(size_t new_size) {
+      vector<Slot> old_slots(new_size);
+      old_slots.swap(slots_);
+      size_t mask = new_size - 1;
+      for (size_t i = 0; i < old_slots.size(); i++) {
+        if (old_slots[i].subset == NULL) continue;
+        size_t index = Index(old_slots[i].hash) & mask;
+        while (slots_[index].subset != NULL)
+          index = (index + 1) & mask;
+        slots_[index] = old_slots[i];
+      }
+    }
+
+    SubsetEqual equal_;
+    size_t num_used_;
+    vector<Slot> slots_;
+  };
+
   // Define the hash type we use to map subsets (in minimal
   // representation) to OutputStateId.
-  typedef unordered_map<const vector<Element>*, OutputStateId,
-                        SubsetKey, SubsetEqual> MinimalSubsetHash;
+  typedef SubsetTable<OutputStateId> MinimalSubsetHash;
 
   // Define the hash type we use to map subsets (in initial
   // representation) to OutputStateId, together with an
   // extra weight. [note: we interpret the Element.state in here
   // as an OutputStateId even though it's declared as InputStateId;
   // these types are the same anyway].
-  typedef unordered_map<const vector<Element>*, Element,
-                        SubsetKey, SubsetEqual> InitialSubsetHash;
+  typedef SubsetTable<Element> InitialSubsetHash;
   
 
   // converts the representation of the subset from canonical (all states) to
@@ -519,17 +606,18 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     subset->resize(cur_out - subset->begin());
   }
   
-  // Takes a minimal, normalized subset, and converts it to an OutputStateId.
+  // Takes a minimal, normalized subset whose hash value (see
+  // SubsetHashValue()) is "hash", and converts it to an OutputStateId.
   // Involves a hash lookup, and possibly adding a new OutputStateId.
   // If it creates a new OutputStateId, it creates a new record for it, works
   // out its final-weight, and puts stuff on the queue relating to its
   // transitions.
   OutputStateId MinimalToStateId(const vector<Element> &subset,
+                                 size_t hash,
                                  const double forward_cost) {
-    typename MinimalSubsetHash::const_iterator iter
-        = minimal_hash_.find(&subset);
-    if (iter != minimal_hash_.end()) { // Found a matching subset.
-      OutputStateId state_id = iter->second;
+    const OutputStateId *found = minimal_hash_.Find(subset, hash);
+    if (found != NULL) { // Found a matching subset.
+      OutputStateId state_id = *found;
       const OutputState &state = *(output_states_[state_id]);
       // Below is just a check that the algorithm is working...
       if (forward_cost < state.forward_cost - 0.1) {
@@ -538,10 +626,11 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                    << forward_cost << ", "
                    << state.forward_cost;
       }
+      return state_id;
     }
     OutputStateId state_id = static_cast<OutputStateId>(output_states_.size());
     OutputState *new_state = new OutputState(subset, forward_cost);
-    minimal_hash_[&(new_state->minimal_subset)] = state_id;
+    minimal_hash_.Insert(&(new_state->minimal_subset), hash, state_id);
     output_states_.push_back(new_state);
     num_elems_ += subset.size();
     // Note: in the previous algorithm, we pushed the new state-id onto the queue
@@ -554,15 +643,15 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   
   // Given a normalized initial subset of elements (i.e. before epsilon closure),
-  // compute the corresponding output-state.
+  // whose hash value is "hash", compute the corresponding output-state.
   OutputStateId InitialToStateId(const vector<Element> &subset_in,
+                                 size_t hash,
                                  double forward_cost,
                                  Weight *remaining_weight,
                                  StringId *common_prefix) {
-    typename InitialSubsetHash::const_iterator iter
-        = initial_hash_.find(&subset_in);
-    if (iter != initial_hash_.end()) { // Found a matching subset.
-      const Element &elem = iter->second;
+    const Element *found = initial_hash_.Find(subset_in, hash);
+    if (found != NULL) { // Found a matching subset.
+      const Element &elem = *found;
       *remaining_weight = elem.weight;
       *common_prefix = elem.string;
       if (elem.weight == Weight::Zero())
@@ -580,12 +669,14 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
     Element elem; // will be used to store remaining weight and string, and
                  // OutputStateId, in initial_hash_;    
-    NormalizeSubset(&subset, &elem.weight, &elem.string); // normalize subset; put
+    size_t minimal_hash;
+    NormalizeSubset(&subset, &elem.weight, &elem.string,
+                    &minimal_hash); // normalize subset; put
     // common string and weight in "elem".  The subset is now a minimal,
     // normalized subset.
 
     forward_cost += ConvertToCost(elem.weight);
-    OutputStateId ans = MinimalToStateId(subset, forward_cost);
+    OutputStateId ans = MinimalToStateId(subset, minimal_hash, forward_cost);
     *remaining_weight = elem.weight;
     *common_prefix = elem.string;
     if (elem.weight == Weight::Zero())
@@ -596,7 +687,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // we process the same initial subset.
     vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
     elem.state = ans;
-    initial_hash_[initial_subset_ptr] = elem;
+    initial_hash_.Insert(initial_subset_ptr, hash, elem);
     num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
     return ans;
   }
@@ -790,9 +881,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // NormalizeSubset normalizes the subset "elems" by
   // removing any common string prefix (putting it in common_str),
   // and dividing by the total weight (putting it in tot_weight).
+  // It also outputs the hash value of the normalized subset to "hash".
   void NormalizeSubset(vector<Element> *elems,
                        Weight *tot_weight,
-                       StringId *common_str) {
+                       StringId *common_str,
+                       size_t *hash) {
+    *hash = 0;
     if(elems->empty()) { // just set common_str, tot_weight
       // to defaults and return...
       KALDI_WARN << "empty subset";
@@ -815,6 +909,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       (*elems)[i].weight = Divide((*elems)[i].weight, weight, DIVIDE_LEFT);
       (*elems)[i].string =
           repository_.RemovePrefix((*elems)[i].string, prefix_len);
+      *hash = HashElement(*hash, (*elems)[i]);
     }
     *common_str = repository_.ConvertFromVector(common_prefix);
     *tot_weight = weight;
@@ -865,7 +960,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     double forward_cost = output_states_[ostate_id]->forward_cost;
     StringId common_str;
     Weight tot_weight;
-    NormalizeSubset(subset, &tot_weight, &common_str);
+    size_t hash;
+    NormalizeSubset(subset, &tot_weight, &common_str, &hash);
     forward_cost += ConvertToCost(tot_weight);
      
     OutputStateId nextstate;
@@ -873,6 +969,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       Weight next_tot_weight;
       StringId next_common_str;
       nextstate = InitialToStateId(*subset,
+                                   hash,
                                    forward_cost,
                                    &next_tot_weight,
                                    &next_common_str);
@@ -1061,16 +1158,14 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // require this, that escapes me at the moment.
     KALDI_ASSERT(ifst_->Properties(kTopSorted, true) != 0);
     ComputeBackwardWeight();
-#if !(__GNUC__ == 4 && __GNUC_MINOR__ == 0)
     if(ifst_->Properties(kExpanded, false) != 0) { // if we know the number of
       // states in ifst_, it might be a bit more efficient
       // to pre-size the hashes so we're not constantly rebuilding them.
       StateId num_states =
           down_cast<const ExpandedFst<Arc>*, const Fst<Arc> >(ifst_)->NumStates();
-      minimal_hash_.rehash(num_states/2 + 3);
-      initial_hash_.rehash(num_states/2 + 3);
+      minimal_hash_.Reserve(num_states/2 + 3);
+      initial_hash_.Reserve(num_states/2 + 3);
     }
-#endif
     InputStateId start_id = ifst_->Start();
     if (start_id != kNoStateId) {
       /* Create determinized-state corresponding to the start state....
@@ -1099,7 +1194,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       output_states_.push_back(initial_state);
       num_elems_ += subset.size();
       OutputStateId initial_state_id = 0;
-      minimal_hash_[&(initial_state->minimal_subset)] = initial_state_id;
+      minimal_hash_.Insert(&(initial_state->minimal_subset),
+                           SubsetHashValue(initial_state->minimal_subset),
+                           initial_state_id);
       ProcessFinal(initial_state_id);
       ProcessTransitions(initial_state_id); // this will add tasks to
       // the queue, which we'll start processing in Determinize().
@@ -1141,14 +1238,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // guaranteed to be "tropical-like" so the sum does represent a min-cost.
   
   DeterminizeLatticePrunedOptions opts_;
-  SubsetKey hasher_;  // object that computes keys-- has no data members.
-  SubsetEqual equal_;  // object that compares subsets-- only data member is delta_.
   bool determinized_; // set to true when user called Determinize(); used to make
   // sure this object is used correctly.
   MinimalSubsetHash minimal_hash_;  // hash from Subset to OutputStateId.  Subset is "minimal
                                     // representation" (only include final and states and states with
-                                    // nonzero ilabel on arc out of them.  Owns the pointers
-                                    // in its keys.
+                                    // nonzero ilabel on arc out of them.  The
+                                    // subsets are owned by output_states_.
   InitialSubsetHash initial_hash_;   // hash from Subset to Element, which
                                      // represents the OutputStateId together
                                      // with an extra weight and string.  Subset
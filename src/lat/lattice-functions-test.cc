@@ -0,0 +1,175 @@
+// lat/lattice-functions-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "fstext/rand-fst.h"
+#include "fstext/deterministic-fst.h"
+
+namespace kaldi {
+using namespace fst;
+
+CompactLattice *RandCompactLattice() {
+  RandFstOptions opts;
+  opts.acyclic = true;
+  Lattice *fst = fst::RandPairFst<LatticeArc>(opts);
+  CompactLattice *cfst = new CompactLattice;
+  ConvertLattice(*fst, cfst);
+  delete fst;
+  return cfst;
+}
+
+// Returns a random backoff language model on the words 1 ... num_words, in
+// which every word is allowed in every state (state zero has arcs for all the
+// words, and the other states back off to it).  The costs are non-negative.
+VectorFst<StdArc> *RandBackoffLm(int32 num_words) {
+  VectorFst<StdArc> *lm = new VectorFst<StdArc>();
+  int32 num_states = RandInt(1, 5);
+  for (int32 s = 0; s < num_states; s++)
+    lm->AddState();
+  lm->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    lm->SetFinal(s, TropicalWeight(RandUniform()));
+    for (int32 w = 1; w <= num_words; w++)
+      if (s == 0 || RandInt(0, 1) == 0)
+        lm->AddArc(s, StdArc(w, w, TropicalWeight(2.0 * RandUniform()),
+                             RandInt(0, num_states - 1)));
+    if (s != 0)
+      lm->AddArc(s, StdArc(0, 0, TropicalWeight(RandUniform()), 0));
+  }
+  return lm;
+}
+
+int32 MaxOutputLabel(const CompactLattice &clat) {
+  int32 ans = 0;
+  for (StateIterator<CompactLattice> siter(clat); !siter.Done(); siter.Next())
+    for (ArcIterator<CompactLattice> aiter(clat, siter.Value()); !aiter.Done();
+         aiter.Next())
+      ans = std::max(ans, aiter.Value().olabel);
+  return ans;
+}
+
+int32 TotalNumArcs(const CompactLattice &clat) {
+  int32 ans = 0;
+  for (StateIterator<CompactLattice> siter(clat); !siter.Done(); siter.Next())
+    ans += clat.NumArcs(siter.Value());
+  return ans;
+}
+
+// Outputs, for each state of the topologically sorted lattice "clat", the
+// cost of the best path from the start state to it and from it to the end;
+// returns the cost of the best path.
+double ViterbiCosts(const CompactLattice &clat,
+                    std::vector<double> *forward_cost,
+                    std::vector<double> *backward_cost) {
+  typedef CompactLatticeArc::StateId StateId;
+  StateId num_states = clat.NumStates();
+  double inf = std::numeric_limits<double>::infinity();
+  forward_cost->assign(num_states, inf);
+  backward_cost->assign(num_states, inf);
+  if (num_states == 0)
+    return inf;
+  (*forward_cost)[clat.Start()] = 0.0;
+  for (StateId s = 0; s < num_states; s++) {
+    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      KALDI_ASSERT(arc.nextstate > s);
+      (*forward_cost)[arc.nextstate] = std::min(
+          (*forward_cost)[arc.nextstate],
+          (*forward_cost)[s] + ConvertToCost(arc.weight));
+    }
+  }
+  for (StateId s = num_states - 1; s >= 0; s--) {
+    double cost = ConvertToCost(clat.Final(s));
+    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      cost = std::min(cost, ConvertToCost(arc.weight) +
+                      (*backward_cost)[arc.nextstate]);
+    }
+    (*backward_cost)[s] = cost;
+  }
+  return (*backward_cost)[clat.Start()];
+}
+
+void TestComposeCompactLatticeDeterministicPruned() {
+  CompactLattice *clat = RandCompactLattice();
+  VectorFst<StdArc> *lm = RandBackoffLm(std::max(1, MaxOutputLabel(*clat)));
+  BackoffDeterministicOnDemandFst<StdArc> det_lm(*lm);
+
+  CompactLattice composed_clat;
+  ComposeCompactLatticeDeterministic(*clat, &det_lm, &composed_clat);
+  TopSort(&composed_clat);
+  std::vector<double> forward_cost, backward_cost;
+  double best_cost = ViterbiCosts(composed_clat, &forward_cost, &backward_cost);
+
+  // With a very large beam nothing is pruned, so the output must be the same
+  // as that of ComposeCompactLatticeDeterministic() (apart from the numbering
+  // of the states).
+  CompactLattice unpruned_clat;
+  ComposeCompactLatticeDeterministicPruned(*clat, 1.0e+10, &det_lm,
+                                           &unpruned_clat);
+  KALDI_ASSERT(unpruned_clat.NumStates() == composed_clat.NumStates() &&
+               TotalNumArcs(unpruned_clat) == TotalNumArcs(composed_clat));
+  if (composed_clat.NumStates() != 0)
+    KALDI_ASSERT(RandEquivalent(composed_clat, unpruned_clat, 5, 0.01, Rand(),
+                                100));
+
+  // With a small beam, the best path must be kept, and every arc and final-prob
+  // of the output must be on a path within the beam of the best path.
+  BaseFloat beam = 5.0 * RandUniform() + 0.01, delta = 0.01;
+  CompactLattice pruned_clat;
+  ComposeCompactLatticeDeterministicPruned(*clat, beam, &det_lm, &pruned_clat);
+  if (composed_clat.NumStates() == 0) {
+    KALDI_ASSERT(pruned_clat.NumStates() == 0);
+  } else {
+    KALDI_ASSERT(pruned_clat.Properties(kTopSorted, true) != 0);
+    std::vector<double> pruned_forward_cost, pruned_backward_cost;
+    double pruned_best_cost = ViterbiCosts(pruned_clat, &pruned_forward_cost,
+                                           &pruned_backward_cost);
+    // The weights of the random lattices may have ties, so we only check the
+    // cost of the best path.
+    KALDI_ASSERT(ApproxEqual(static_cast<BaseFloat>(pruned_best_cost),
+                             static_cast<BaseFloat>(best_cost)));
+    for (int32 s = 0; s < pruned_clat.NumStates(); s++) {
+      double final_cost = ConvertToCost(pruned_clat.Final(s));
+      if (final_cost != std::numeric_limits<double>::infinity())
+        KALDI_ASSERT(pruned_forward_cost[s] + final_cost <=
+                     best_cost + beam + delta);
+      for (ArcIterator<CompactLattice> aiter(pruned_clat, s); !aiter.Done();
+           aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        KALDI_ASSERT(pruned_forward_cost[s] + ConvertToCost(arc.weight) +
+                     pruned_backward_cost[arc.nextstate] <=
+                     best_cost + beam + delta);
+      }
+    }
+  }
+  delete lm;
+  delete clat;
+}
+
+}  // end namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 100; i++)
+    kaldi::TestComposeCompactLatticeDeterministicPruned();
+  KALDI_LOG << "Success.";
+}
@@ -23,6 +23,10 @@
 // limitations under the License.
 
 
+#include <functional>
+#include <limits>
+#include <queue>
+
 #include "lat/lattice-functions.h"
 #include "hmm/transition-model.h"
 #include "util/stl-utils.h"
@@ -1422,6 +1426,11 @@ void ComposeCompactLatticeDeterministic(
       state_map.insert(std::make_pair(start_pair, start_state));
   KALDI_ASSERT(result.second == true);
 
+  // Buffers for looking up the arcs of <det_fst> for all arcs of a state of
+  // <clat> at once.
+  std::vector<std::pair<StateId, fst::StdArc::Label> > det_queries;
+  std::vector<fst::StdArc> det_arcs;
+
   // Starts composition here.
   while (!state_queue.empty()) {
     // Gets the first state in the queue.
@@ -1442,6 +1451,17 @@ void ComposeCompactLatticeDeterministic(
       composed_clat->SetFinal(state_map[s], final_weight);
     }
 
+    // Looks up the matching arcs in <det_fst> for all the non-epsilon arcs at
+    // s1 in one batch, which is faster for some types of <det_fst>.
+    det_queries.clear();
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s1);
+         !aiter.Done(); aiter.Next()) {
+      if (aiter.Value().olabel != 0)
+        det_queries.push_back(std::make_pair(s2, aiter.Value().olabel));
+    }
+    det_fst->GetArcs(det_queries, &det_arcs);
+    size_t det_arc_index = 0;
+
     // Loops over pair of edges at s1 and s2.
     for (fst::ArcIterator<CompactLattice> aiter(clat, s1);
          !aiter.Done(); aiter.Next()) {
@@ -1456,8 +1476,9 @@ void ComposeCompactLatticeDeterministic(
         matched = true;
         next_state2 = s2;
       } else {
-        // Otherwise try to find the matched arc in <det_fst>.
-        matched = det_fst->GetArc(s2, arc1.olabel, &arc2);
+        // Otherwise take the matched arc in <det_fst>, if any.
+        arc2 = det_arcs[det_arc_index++];
+        matched = (arc2.nextstate != fst::kNoStateId);
         if (matched) {
           next_state2 = arc2.nextstate;
         }
@@ -1506,4 +1527,198 @@ void ComposeCompactLatticeDeterministic(
   fst::Connect(composed_clat);
 }
 
+
+// This class implements ComposeCompactLatticeDeterministicPruned().  It does
+// the same as ComposeCompactLatticeDeterministic(), except that it expands the
+// composed states in best-first order, i.e. in order of their forward cost
+// plus the backward cost of their state in <clat>, which is used as an
+// estimate of the cost of getting from there to the end, and that it stops
+// when this is more than <beam> worse than the best complete path found so
+// far; then it prunes the result with PruneLattice().
+class PrunedCompactLatticeComposer {
+ public:
+  typedef fst::StdArc::StateId StateId;
+  typedef fst::StdArc::Label Label;
+  typedef CompactLatticeArc::Weight Weight;
+  typedef std::pair<StateId, StateId> StatePair;
+
+  // <clat> must be topologically sorted.
+  PrunedCompactLatticeComposer(
+      const CompactLattice &clat, BaseFloat beam,
+      fst::DeterministicOnDemandFst<fst::StdArc> *det_fst,
+      CompactLattice *composed_clat):
+      clat_(clat), beam_(beam), det_fst_(det_fst),
+      composed_clat_(composed_clat) { }
+
+  void Compose() {
+    composed_clat_->DeleteStates();
+    if (clat_.Start() == fst::kNoStateId)
+      return;
+    ComputeBackwardCosts();
+    composed_clat_->SetStart(
+        FindOrAddState(StatePair(clat_.Start(), det_fst_->Start()), 0.0));
+
+    double best_final_cost = std::numeric_limits<double>::infinity();
+    while (!queue_.empty()) {
+      QueueElem elem = queue_.top();
+      // All the remaining states are outside the beam.
+      if (elem.first > best_final_cost + beam_)
+        break;
+      queue_.pop();
+      StateId s = elem.second;
+      if (expanded_[s])
+        continue;  // A stale entry for a state whose cost was improved.
+      expanded_[s] = true;
+      double final_cost = ExpandState(s);
+      if (forward_cost_[s] + final_cost < best_final_cost)
+        best_final_cost = forward_cost_[s] + final_cost;
+    }
+    // The states that we did not expand are not coaccessible; this removes
+    // them.
+    fst::Connect(composed_clat_);
+    // An arc between two expanded states may still be on no path within the
+    // beam, so we prune the result as well.
+    if (composed_clat_->NumStates() != 0)
+      PruneLattice(beam_, composed_clat_);
+  }
+
+ private:
+  void ComputeBackwardCosts() {
+    StateId num_states = clat_.NumStates();
+    backward_cost_.resize(num_states);
+    for (StateId s = num_states - 1; s >= 0; s--) {
+      double cost = ConvertToCost(clat_.Final(s));
+      for (fst::ArcIterator<CompactLattice> aiter(clat_, s);
+           !aiter.Done(); aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        KALDI_ASSERT(arc.nextstate > s);
+        cost = std::min(cost, ConvertToCost(arc.weight) +
+                        backward_cost_[arc.nextstate]);
+      }
+      backward_cost_[s] = cost;
+    }
+  }
+
+  // Returns the state of <composed_clat_> for <pair>, creating it if needed,
+  // and updates its forward cost with <forward_cost>.
+  StateId FindOrAddState(const StatePair &pair, double forward_cost) {
+    MapType::iterator iter = state_map_.find(pair);
+    StateId s;
+    if (iter == state_map_.end()) {
+      s = composed_clat_->AddState();
+      state_map_[pair] = s;
+      state_pairs_.push_back(pair);
+      forward_cost_.push_back(forward_cost);
+      expanded_.push_back(false);
+    } else {
+      s = iter->second;
+      if (forward_cost >= forward_cost_[s])
+        return s;
+      // If the state has already been expanded (which can only happen if
+      // <det_fst> has negative costs, since otherwise the backward costs of
+      // <clat> are a lower bound on the remaining cost), the new cost is not
+      // propagated to its successors, so the pruning is only approximate.
+      forward_cost_[s] = forward_cost;
+      if (expanded_[s])
+        return s;
+    }
+    queue_.push(QueueElem(forward_cost + backward_cost_[pair.first], s));
+    return s;
+  }
+
+  // Adds the final-prob and the arcs of state s of <composed_clat_>, and
+  // returns its final cost.
+  double ExpandState(StateId s) {
+    StateId s1 = state_pairs_[s].first, s2 = state_pairs_[s].second;
+    double forward_cost = forward_cost_[s];
+
+    const Weight &final1 = clat_.Final(s1);
+    Weight final_weight(LatticeWeight(final1.Weight().Value1() +
+                                      det_fst_->Final(s2).Value(),
+                                      final1.Weight().Value2()),
+                        final1.String());
+    if (final_weight != Weight::Zero())
+      composed_clat_->SetFinal(s, final_weight);
+
+    det_queries_.clear();
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, s1);
+         !aiter.Done(); aiter.Next()) {
+      if (aiter.Value().olabel != 0)
+        det_queries_.push_back(std::make_pair(s2, aiter.Value().olabel));
+    }
+    det_fst_->GetArcs(det_queries_, &det_arcs_);
+    size_t det_arc_index = 0;
+
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, s1);
+         !aiter.Done(); aiter.Next()) {
+      const CompactLatticeArc &arc1 = aiter.Value();
+      CompactLatticeArc arc(arc1);
+      StateId next_state2 = s2;
+      if (arc1.olabel != 0) {
+        const fst::StdArc &arc2 = det_arcs_[det_arc_index++];
+        if (arc2.nextstate == fst::kNoStateId)
+          continue;
+        next_state2 = arc2.nextstate;
+        arc.weight = Weight(LatticeWeight(arc1.weight.Weight().Value1() +
+                                          arc2.weight.Value(),
+                                          arc1.weight.Weight().Value2()),
+                            arc1.weight.String());
+      } else {
+        arc.ilabel = 0;  // As in ComposeCompactLatticeDeterministic().
+      }
+      arc.nextstate = FindOrAddState(
+          StatePair(arc1.nextstate, next_state2),
+          forward_cost + ConvertToCost(arc.weight));
+      composed_clat_->AddArc(s, arc);
+    }
+    return ConvertToCost(final_weight);
+  }
+
+  typedef unordered_map<StatePair, StateId, PairHasher<StateId> > MapType;
+  // (forward cost + backward cost in clat_, state of composed_clat_).
+  typedef std::pair<double, StateId> QueueElem;
+
+  const CompactLattice &clat_;
+  BaseFloat beam_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *det_fst_;
+  CompactLattice *composed_clat_;
+
+  std::vector<double> backward_cost_;  // indexed by state of clat_.
+
+  MapType state_map_;
+  // The following are indexed by state of composed_clat_.
+  std::vector<StatePair> state_pairs_;
+  std::vector<double> forward_cost_;
+  std::vector<bool> expanded_;
+
+  std::priority_queue<QueueElem, std::vector<QueueElem>,
+                      std::greater<QueueElem> > queue_;
+
+  // Buffers for GetArcs().
+  std::vector<std::pair<StateId, Label> > det_queries_;
+  std::vector<fst::StdArc> det_arcs_;
+};
+
+void ComposeCompactLatticeDeterministicPruned(
+    const CompactLattice &clat,
+    BaseFloat beam,
+    fst::DeterministicOnDemandFst<fst::StdArc> *det_fst,
+    CompactLattice *composed_clat) {
+  KALDI_ASSERT(composed_clat != NULL && beam > 0.0);
+  if (clat.Properties(fst::kTopSorted, true) != 0) {
+    PrunedCompactLatticeComposer composer(clat, beam, det_fst, composed_clat);
+    composer.Compose();
+    return;
+  }
+  CompactLattice sorted_clat(clat);
+  if (!fst::TopSort(&sorted_clat)) {
+    KALDI_WARN << "Cycles detected in lattice; composing without pruning.";
+    ComposeCompactLatticeDeterministic(clat, det_fst, composed_clat);
+    return;
+  }
+  PrunedCompactLatticeComposer composer(sorted_clat, beam, det_fst,
+                                        composed_clat);
+  composer.Compose();
+}
+
 }  // namespace kaldi
@@ -295,6 +295,24 @@ void ComposeCompactLatticeDeterministic(
     fst::DeterministicOnDemandFst<fst::StdArc>* det_fst,
     CompactLattice* composed_clat);
 
+/// This is a pruned version of ComposeCompactLatticeDeterministic(), for large
+/// lattices where the full composition would take too much time and memory.
+/// It expands the composed states in best-first order, using the backward cost
+/// of the corresponding state in <clat> (the best cost from there to the end,
+/// before composition) as an estimate of the remaining cost, and stops when
+/// that estimate is more than <beam> worse than the best complete path found so
+/// far; states that were not expanded are removed, and the result is pruned
+/// with PruneLattice(), so every arc in the output is on a path within <beam>
+/// of the best path.  If the costs of <det_fst> are non-negative, as for a
+/// language model, the estimate is never too large, so the best path and all
+/// the paths within <beam> of it are kept.  The output is topologically
+/// sorted.  Cyclic lattices are composed without pruning, with a warning.
+void ComposeCompactLatticeDeterministicPruned(
+    const CompactLattice &clat,
+    BaseFloat beam,
+    fst::DeterministicOnDemandFst<fst::StdArc> *det_fst,
+    CompactLattice *composed_clat);
+
 }  // namespace kaldi
 
 #endif  // KALDI_LAT_LATTICE_FUNCTIONS_H_
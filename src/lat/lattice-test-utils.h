@@ -0,0 +1,98 @@
+// lat/lattice-test-utils.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_LATTICE_TEST_UTILS_H_
+#define KALDI_LAT_LATTICE_TEST_UTILS_H_
+
+// Random models, graphs and lattices for the tests in lat/ and decoder/.
+
+#include <vector>
+
+#include "base/kaldi-math.h"
+#include "fstext/fstext-utils.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "tree/context-dep.h"
+
+namespace kaldi {
+
+/// Returns a new transition model with phone 1 and a random subset of phones 2
+/// to 9, with the default topology and a random monophone tree.
+inline TransitionModel *RandTransitionModel() {
+  std::vector<int32> phones;
+  phones.push_back(1);
+  for (int32 i = 2; i < 10; i++)
+    if (RandInt(0, 1) == 0)
+      phones.push_back(i);
+  std::vector<int32> num_pdf_classes;
+  ContextDependency *ctx_dep =
+      GenRandContextDependencyLarge(phones, 1, 0, true, &num_pdf_classes);
+  TransitionModel *trans_model =
+      new TransitionModel(*ctx_dep, GetDefaultTopology(phones));
+  delete ctx_dep;
+  return trans_model;
+}
+
+/// Returns a new random decoding graph with up to "max_states" states, whose
+/// input labels are in [1, num_ilabels] (e.g. pdf-ids plus one, or
+/// transition-ids) and output labels in [1, num_words].  Epsilon arcs only go
+/// to higher-numbered states, so there are no epsilon cycles, and each state
+/// has at least one emitting arc.  Use few states and words if the lattices
+/// must stay small when nothing is pruned.
+inline fst::VectorFst<fst::StdArc> *RandDecodingGraph(int32 num_ilabels,
+                                                      int32 max_states,
+                                                      int32 num_words) {
+  typedef fst::StdArc Arc;
+  fst::VectorFst<Arc> *graph = new fst::VectorFst<Arc>();
+  int32 num_states = RandInt(2, max_states);
+  for (int32 s = 0; s < num_states; s++)
+    graph->AddState();
+  graph->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = RandInt(1, 3);
+    for (int32 a = 0; a < num_arcs; a++) {
+      bool epsilon = (a > 0 && s + 1 < num_states && RandInt(0, 3) == 0);
+      int32 ilabel = (epsilon ? 0 : RandInt(1, num_ilabels)),
+          olabel = (RandInt(0, 2) == 0 ? RandInt(1, num_words) : 0),
+          nextstate = (epsilon ? RandInt(s + 1, num_states - 1) :
+                       RandInt(0, num_states - 1));
+      graph->AddArc(s, Arc(ilabel, olabel, Arc::Weight(2.0 * RandUniform()),
+                           nextstate));
+    }
+    if (RandInt(0, 2) == 0)
+      graph->SetFinal(s, Arc::Weight(RandUniform()));
+  }
+  graph->SetFinal(num_states - 1, Arc::Weight::One());
+  return graph;
+}
+
+/// Returns the cost (graph plus acoustic) of the best path through "clat".
+inline double BestPathCost(const CompactLattice &clat) {
+  CompactLattice best_path;
+  CompactLatticeShortestPath(clat, &best_path);
+  std::vector<int32> words, alignment;
+  CompactLatticeWeight weight;
+  fst::GetLinearSymbolSequence(best_path, &words, &alignment, &weight);
+  return ConvertToCost(weight);
+}
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_LATTICE_TEST_UTILS_H_
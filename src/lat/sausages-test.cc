@@ -0,0 +1,554 @@
+// lat/sausages-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include "lat/sausages.h"
+#include "lat/lattice-functions.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+// This is the implementation of MinimumBayesRisk from before it was changed to
+// keep its buffers in flat, reusable arrays; it allocated its Matrix and
+// Vector temporaries and std::map stats for each iteration.  We keep it here to
+// check that the current implementation gives the same output.
+class OldMinimumBayesRisk {
+ public:
+  OldMinimumBayesRisk(const CompactLattice &clat, bool do_mbr = true);
+  
+  const std::vector<int32> &GetOneBest() const { // gets one-best (with no epsilons)
+    return R_;
+  }
+
+  const std::vector<std::pair<BaseFloat, BaseFloat> > GetSausageTimes() const {
+    return times_; // returns average (start,end) times for each bin (each entry
+    // of GetSausageStats()).  Note: if you want the times for the one best,
+    // you can work out the one best yourself from the sausage stats and get the times
+    // at the same time.
+  }
+
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &GetOneBestTimes() const {
+    return one_best_times_; // returns average (start,end) times for each bin corresponding
+    // to an entry in the one-best output.  This is just the appropriate
+    // subsequence of the times in SausageTimes().
+  }
+
+  /// Outputs the confidences for the one-best transcript.
+  const std::vector<BaseFloat> &GetOneBestConfidences() const {
+    return one_best_confidences_;
+  }
+
+  /// Returns the expected WER over this sentence (assuming
+  /// model correctness.
+  BaseFloat GetBayesRisk() const { return L_; }
+  
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &GetSausageStats() const {
+    return gamma_;
+  }  
+
+ private:
+  /// Minimum-Bayes-Risk Decode. Top-level algorithm.  Figure 6 of the paper.
+  void MbrDecode(); 
+
+  /// The basic edit-distance function l(a,b), as in the paper.
+  inline double l(int32 a, int32 b) { return (a == b ? 0.0 : 1.0); }
+  
+  /// returns r_q, in one-based indexing, as in the paper.
+  inline int32 r(int32 q) { return R_[q-1]; }
+  
+  
+  /// Figure 4 of the paper; called from AccStats (Fig. 5)
+  double EditDistance(int32 N, int32 Q,
+                      Vector<double> &alpha,
+                      Matrix<double> &alpha_dash,
+                      Vector<double> &alpha_dash_arc);
+
+  /// Figure 5 of the paper.  Outputs to gamma_ and L_.
+  void AccStats(); 
+
+  /// Removes epsilons (symbol 0) from a vector
+  static void RemoveEps(std::vector<int32> *vec); 
+
+  // Ensures that between each word in "vec" and at the beginning and end, is
+  // epsilon (0).  (But if no words in vec, just one epsilon)
+  static void NormalizeEps(std::vector<int32> *vec);   
+
+  static inline BaseFloat delta() { return 1.0e-05; } // A constant
+  // used in the algorithm.
+
+  /// Function used to increment map.
+  static inline void AddToMap(int32 i, double d, std::map<int32, double> *gamma) {
+    if (d == 0) return;
+    std::pair<const int32, double> pr(i, d);
+    std::pair<std::map<int32, double>::iterator, bool> ret = gamma->insert(pr);
+    if (!ret.second) // not inserted, so add to contents.
+      ret.first->second += d;
+  }
+    
+  struct Arc {
+    int32 word;
+    int32 start_node;
+    int32 end_node;
+    BaseFloat loglike;
+  };
+
+  /// Boolean configuration parameter: if true, we actually update the hypothesis
+  /// to do MBR decoding (if false, our output is the MAP decoded output, but we
+  /// output the stats too).
+  bool do_mbr_;
+  
+  /// Arcs in the topologically sorted acceptor form of the word-level lattice,
+  /// with one final-state.  Contains (word-symbol, log-likelihood on arc ==
+  /// negated cost).  Indexed from zero.
+  std::vector<Arc> arcs_;
+
+  /// For each node in the lattice, a list of arcs entering that node. Indexed
+  /// from 1 (first node == 1).
+  std::vector<std::vector<int32> > pre_;
+
+  std::vector<int32> state_times_; // time of each state in the word lattice,
+  // indexed from 1 (same index as into pre_)
+  
+  std::vector<int32> R_; // current 1-best word sequence, normalized to have
+  // epsilons between each word and at the beginning and end.  R in paper...
+  // caution: indexed from zero, not from 1 as in paper.
+
+  double L_; // current averaged edit-distance between lattice and R_.
+  // \hat{L} in paper.
+  
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > gamma_;
+  // The stats we accumulate; these are pairs of (posterior, word-id), and note
+  // that word-id may be epsilon.  Caution: indexed from zero, not from 1 as in
+  // paper.  We sort in reverse order on the second member (posterior), so more
+  // likely word is first.
+
+  std::vector<std::pair<BaseFloat, BaseFloat> > times_;
+  // The average start and end times for each confusion-network bin.  This
+  // is like an average over words, of the tau_b and tau_e quantities in
+  // Appendix C of the paper.  Indexed from zero, like gamma_ and R_.
+
+  std::vector<std::pair<BaseFloat, BaseFloat> > one_best_times_;
+  // one_best_times_ is a subsequence of times_, corresponding to
+  // (start,end) times of words in the one best output.  Actually these
+  // times are averages over the bin that each word came from.
+
+  std::vector<BaseFloat> one_best_confidences_;
+  // vector of confidences for the 1-best output (which could be
+  // the MAP output if do_mbr_ == false, or the MBR output otherwise).
+  // Indexed by the same index as one_best_times_.
+  
+  struct GammaCompare{
+    // should be like operator <.  But we want reverse order
+    // on the 2nd element (posterior), so it'll be like operator
+    // > that looks first at the posterior.
+    bool operator () (const std::pair<int32, BaseFloat> &a,
+                      const std::pair<int32, BaseFloat> &b) const {
+      if (a.second > b.second) return true;
+      else if (a.second < b.second) return false;
+      else return a.first > b.first;
+    }
+  };
+};
+
+
+void OldMinimumBayesRisk::MbrDecode() {
+  
+  for (size_t counter = 0; ; counter++) {
+    NormalizeEps(&R_);
+    AccStats(); // writes to gamma_
+    double delta_Q = 0.0; // change in objective function.
+
+    one_best_times_.clear();
+    one_best_confidences_.clear();
+    
+    // Caution: q in the line below is (q-1) in the algorithm
+    // in the paper; both R_ and gamma_ are indexed by q-1.
+    for (size_t q = 0; q < R_.size(); q++) {
+      if (do_mbr_) { // This loop updates R_ [indexed same as gamma_]. 
+        // gamma_[i] is sorted in reverse order so most likely one is first.
+        const vector<pair<int32, BaseFloat> > &this_gamma = gamma_[q];
+        double old_gamma = 0, new_gamma = this_gamma[0].second;
+        int32 rq = R_[q], rhat = this_gamma[0].first; // rq: old word, rhat: new.
+        for (size_t j = 0; j < this_gamma.size(); j++)
+          if (this_gamma[j].first == rq) old_gamma = this_gamma[j].second;
+        delta_Q += (old_gamma - new_gamma); // will be 0 or negative; a bound on
+        // change in error.
+        if (rq != rhat)
+          KALDI_VLOG(2) << "Changing word " << rq << " to " << rhat;
+        R_[q] = rhat;
+      }
+      if (R_[q] != 0) {
+        one_best_times_.push_back(times_[q]);
+        BaseFloat confidence = 0.0;
+        for (int32 j = 0; j < gamma_[q].size(); j++)
+          if (gamma_[q][j].first == R_[q]) confidence = gamma_[q][j].second;
+        one_best_confidences_.push_back(confidence);
+      }
+    }
+    KALDI_VLOG(2) << "Iter = " << counter << ", delta-Q = " << delta_Q;
+    if (delta_Q == 0) break;
+    if (counter > 100) {
+      KALDI_WARN << "Iterating too many times in MbrDecode; stopping.";
+      break;
+    }
+  }
+  RemoveEps(&R_);
+}
+
+// static
+void OldMinimumBayesRisk::RemoveEps(std::vector<int32> *vec) {
+  vec->erase(std::remove(vec->begin(), vec->end(), 0), vec->end());
+}
+
+// static
+void OldMinimumBayesRisk::NormalizeEps(std::vector<int32> *vec) {
+  RemoveEps(vec);
+  vec->resize(1 + vec->size() * 2);
+  int32 s = vec->size();
+  for (int32 i = s/2 - 1; i >= 0; i--) {
+    (*vec)[i*2 + 1] = (*vec)[i];
+    (*vec)[i*2 + 2] = 0;
+  }
+  (*vec)[0] = 0;
+}
+
+double OldMinimumBayesRisk::EditDistance(int32 N, int32 Q,
+                                      Vector<double> &alpha,
+                                      Matrix<double> &alpha_dash,
+                                      Vector<double> &alpha_dash_arc) {
+  alpha(1) = 0.0; // = log(1).  Line 5.
+  alpha_dash(1, 0) = 0.0; // Line 5.
+  for (int32 q = 1; q <= Q; q++) 
+    alpha_dash(1, q) = alpha_dash(1, q-1) + l(0, r(q)); // Line 7.
+  for (int32 n = 2; n <= N; n++) {
+    double alpha_n = kLogZeroDouble;
+    for (size_t i = 0; i < pre_[n].size(); i++) {
+      const Arc &arc = arcs_[pre_[n][i]];
+      alpha_n = LogAdd(alpha_n, alpha(arc.start_node) + arc.loglike);
+    }
+    alpha(n) = alpha_n; // Line 10.
+    // Line 11 omitted: matrix was initialized to zero.
+    for (size_t i = 0; i < pre_[n].size(); i++) {
+      const Arc &arc = arcs_[pre_[n][i]];
+      int32 s_a = arc.start_node, w_a = arc.word;
+      BaseFloat p_a = arc.loglike;
+      for (int32 q = 0; q <= Q; q++) {
+        if (q == 0) {
+          alpha_dash_arc(q) = // line 15.
+              alpha_dash(s_a, q) + l(w_a, 0) + delta();
+        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
+          int32 r_q = r(q);
+          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
+              a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
+              a3 = alpha_dash_arc(q-1) + l(0, r_q);
+          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
+        }
+        // line 19:
+        alpha_dash(n, q) += exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
+      }
+    }
+  }
+  return alpha_dash(N, Q); // line 23.
+}
+
+// Figure 5 in the paper.
+void OldMinimumBayesRisk::AccStats() {
+  using std::map;
+  
+  int32 N = static_cast<int32>(pre_.size()) - 1,
+      Q = static_cast<int32>(R_.size());
+
+  Vector<double> alpha(N+1); // index (1...N)
+  Matrix<double> alpha_dash(N+1, Q+1); // index (1...N, 0...Q)
+  Vector<double> alpha_dash_arc(Q+1); // index 0...Q
+  Matrix<double> beta_dash(N+1, Q+1); // index (1...N, 0...Q)
+  Vector<double> beta_dash_arc(Q+1); // index 0...Q
+  vector<char> b_arc(Q+1); // integer in {1,2,3}; index 1...Q
+  vector<map<int32, double> > gamma(Q+1); // temp. form of gamma.
+  // index 1...Q [word] -> occ.
+
+  // The tau arrays below are the sums over words of the tau_b
+  // and tau_e timing quantities mentioned in Appendix C of
+  // the paper... we are using these to get averaged times for
+  // the sausage bins, not specifically for the 1-best output.
+  Vector<double> tau_b(Q+1), tau_e(Q+1);
+
+  double Ltmp = EditDistance(N, Q, alpha, alpha_dash, alpha_dash_arc); 
+  if (L_ != 0 && Ltmp > L_) { // L_ != 0 is to rule out 1st iter.
+    KALDI_WARN << "Edit distance increased: " << Ltmp << " > "
+               << L_;
+  }
+  L_ = Ltmp;
+  KALDI_VLOG(2) << "L = " << L_;
+  // omit line 10: zero when initialized.
+  beta_dash(N, Q) = 1.0; // Line 11.
+  for (int32 n = N; n >= 2; n--) {
+    for (size_t i = 0; i < pre_[n].size(); i++) {
+      const Arc &arc = arcs_[pre_[n][i]];
+      int32 s_a = arc.start_node, w_a = arc.word;
+      BaseFloat p_a = arc.loglike;
+      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0) + delta(); // line 14.
+      for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
+        int32 r_q = r(q);
+        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
+            a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
+            a3 = alpha_dash_arc(q-1) + l(0, r_q);
+        if (a1 <= a2) {
+          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
+          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+        } else {
+          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
+          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+        }
+      }
+      beta_dash_arc.SetZero(); // line 19.
+      for (int32 q = Q; q >= 1; q--) {
+        // line 21:
+        beta_dash_arc(q) += exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
+        switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
+          case 1:
+            beta_dash(s_a, q-1) += beta_dash_arc(q);
+            // next: gamma(q, w(a)) += beta_dash_arc(q)
+            AddToMap(w_a, beta_dash_arc(q), &(gamma[q]));
+            // next: accumulating times, see decl for tau_b,tau_e
+            tau_b(q) += state_times_[s_a] * beta_dash_arc(q);
+            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            break;
+          case 2:
+            beta_dash(s_a, q) += beta_dash_arc(q);
+            break;
+          case 3:
+            beta_dash_arc(q-1) += beta_dash_arc(q);
+            // next: gamma(q, epsilon) += beta_dash_arc(q)
+            AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+            // next: accumulating times, see decl for tau_b,tau_e
+            // WARNING: there was an error in Appendix C.  If we followed
+            // the instructions there the next line would say state_times_[sa], but
+            // it would be wrong.  I will try to publish an erratum.
+            tau_b(q) += state_times_[n] * beta_dash_arc(q);
+            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            break;
+          default:
+            KALDI_ERR << "Invalid b_arc value"; // error in code.
+        }
+      }
+      beta_dash_arc(0) += exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
+      beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
+    }
+  }
+  beta_dash_arc.SetZero(); // line 29.
+  for (int32 q = Q; q >= 1; q--) {
+    beta_dash_arc(q) += beta_dash(1, q);
+    beta_dash_arc(q-1) += beta_dash_arc(q);
+    AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+    // the statements below are actually redundant because
+    // state_times_[1] is zero.
+    tau_b(q) += state_times_[1] * beta_dash_arc(q);
+    tau_e(q) += state_times_[1] * beta_dash_arc(q);
+  }
+  for (int32 q = 1; q <= Q; q++) { // a check (line 35)
+    double sum = 0.0;
+    for (map<int32, double>::iterator iter = gamma[q].begin();
+         iter != gamma[q].end(); ++iter) sum += iter->second;
+    if (fabs(sum - 1.0) > 0.1)
+      KALDI_WARN << "sum of gamma[" << q << ",s] is " << sum;
+  }
+  // The next part is where we take gamma, and convert
+  // to the class member gamma_, which is using a different
+  // data structure and indexed from zero, not one.
+  gamma_.clear();
+  gamma_.resize(Q);
+  for (int32 q = 1; q <= Q; q++) {
+    for (map<int32, double>::iterator iter = gamma[q].begin();
+         iter != gamma[q].end(); ++iter)
+      gamma_[q-1].push_back(std::make_pair(iter->first, static_cast<BaseFloat>(iter->second)));
+    // sort gamma_[q-1] from largest to smallest posterior.
+    GammaCompare comp;
+    std::sort(gamma_[q-1].begin(), gamma_[q-1].end(), comp);
+  }
+  // We do the same conversion for the state times tau_b and tau_e:
+  // they get turned into the times_ data member, which has zero-based
+  // indexing.
+  times_.clear();
+  times_.resize(Q);
+  for (int32 q = 1; q <= Q; q++) {
+    times_[q-1].first = tau_b(q);
+    times_[q-1].second = tau_e(q);
+    if (times_[q-1].first > times_[q-1].second) // this is quite bad.
+      KALDI_WARN << "Times out of order";
+    if (q > 1 && times_[q-2].second > times_[q-1].first) {
+      // We previously had a warning here, but now we'll just set both
+      // those values to their average.  It's quite possible for this
+      // condition to happen, but it seems like it would have a bad effect
+      // on the downstream processing, so we fix it.
+      double avg = 0.5 * (times_[q-2].second + times_[q-1].first);
+      times_[q-2].second = times_[q-1].first = avg;
+    }
+  }  
+}
+
+OldMinimumBayesRisk::OldMinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
+    do_mbr_(do_mbr) {
+  CompactLattice clat(clat_in); // copy.
+
+  CreateSuperFinal(&clat); // Add super-final state to clat... this is
+  // one of the requirements of the MBR algorithm, as mentioned in the
+  // paper (i.e. just one final state).
+  
+  // Topologically sort the lattice, if not already sorted.
+  kaldi::uint64 props = clat.Properties(fst::kFstProperties, false);
+  if (!(props & fst::kTopSorted)) {
+    if (fst::TopSort(&clat) == false)
+      KALDI_ERR << "Cycles detected in lattice.";
+  }
+  CompactLatticeStateTimes(clat, &state_times_); // work out times of
+  // the states in clat
+  state_times_.push_back(0); // we'll convert to 1-based numbering.
+  for (size_t i = state_times_.size()-1; i > 0; i--)
+    state_times_[i] = state_times_[i-1];
+  
+  // Now we convert the information in "clat" into a special internal
+  // format (pre_, post_ and arcs_) which allows us to access the
+  // arcs preceding any given state.
+  // Note: in our internal format the states will be numbered from 1,
+  // which involves adding 1 to the OpenFst states.
+  int32 N = clat.NumStates();
+  pre_.resize(N+1);
+
+  // Careful: "Arc" is a class-member struct, not an OpenFst type of arc as one
+  // would normally assume.
+  for (int32 n = 1; n <= N; n++) {
+    for (fst::ArcIterator<CompactLattice> aiter(clat, n-1);
+         !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &carc = aiter.Value();
+      Arc arc; // in our local format.
+      arc.word = carc.ilabel; // == carc.olabel
+      arc.start_node = n;
+      arc.end_node = carc.nextstate + 1; // convert to 1-based.
+      arc.loglike = - (carc.weight.Weight().Value1() +
+                       carc.weight.Weight().Value2());
+      // loglike: sum graph/LM and acoustic cost, and negate to
+      // convert to loglikes.  We assume acoustic scaling is already done.
+
+      pre_[arc.end_node].push_back(arcs_.size()); // record index of this arc.
+      arcs_.push_back(arc);
+    }
+  }
+
+  // We don't need to look at clat.Start() or clat.Final(state):
+  // we know clat.Start() == 0 since it's topologically sorted,
+  // and clat.Final(state) is Zero() except for One() at the last-
+  // numbered state, thanks to CreateSuperFinal and the topological
+  // sorting.
+
+  { // Now set R_ to one best in the FST.
+    RemoveAlignmentsFromCompactLattice(&clat); // will be more efficient
+    // in best-path if we do this.
+    Lattice lat;
+    ConvertLattice(clat, &lat); // convert from CompactLattice to Lattice.
+    fst::VectorFst<fst::StdArc> fst;
+    ConvertLattice(lat, &fst); // convert from lattice to normal FST.
+    fst::VectorFst<fst::StdArc> fst_shortest_path;
+    fst::ShortestPath(fst, &fst_shortest_path); // take shortest path of FST.
+    std::vector<int32> alignment, words;
+    fst::TropicalWeight weight;
+    GetLinearSymbolSequence(fst_shortest_path, &alignment, &words, &weight);
+    KALDI_ASSERT(alignment.empty()); // we removed the alignment.
+    R_ = words;
+    L_ = 0.0; // Set current edit-distance to 0 [just so we know
+    // when we're on the 1st iter.]
+  }
+  
+  MbrDecode();
+  
+}
+
+
+
+CompactLattice *RandCompactLattice() {
+  fst::RandFstOptions opts;
+  opts.acyclic = true;
+  Lattice *fst = fst::RandPairFst<LatticeArc>(opts);
+  CompactLattice *cfst = new CompactLattice;
+  ConvertLattice(*fst, cfst);
+  delete fst;
+  return cfst;
+}
+
+void AssertEqual(const std::vector<std::pair<BaseFloat, BaseFloat> > &a,
+                 const std::vector<std::pair<BaseFloat, BaseFloat> > &b) {
+  KALDI_ASSERT(a.size() == b.size());
+  for (size_t i = 0; i < a.size(); i++)
+    KALDI_ASSERT(ApproxEqual(a[i].first, b[i].first) &&
+                 ApproxEqual(a[i].second, b[i].second));
+}
+
+// Checks that "mbr" (the current implementation) has the same output as
+// "old_mbr".
+void AssertEqual(const OldMinimumBayesRisk &old_mbr,
+                 const MinimumBayesRisk &mbr) {
+  KALDI_ASSERT(old_mbr.GetOneBest() == mbr.GetOneBest());
+  KALDI_ASSERT(ApproxEqual(old_mbr.GetBayesRisk(), mbr.GetBayesRisk()));
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > >
+      &old_gamma = old_mbr.GetSausageStats(), &gamma = mbr.GetSausageStats();
+  KALDI_ASSERT(old_gamma.size() == gamma.size());
+  for (size_t q = 0; q < gamma.size(); q++) {
+    KALDI_ASSERT(old_gamma[q].size() == gamma[q].size());
+    for (size_t j = 0; j < gamma[q].size(); j++)
+      KALDI_ASSERT(old_gamma[q][j].first == gamma[q][j].first &&
+                   ApproxEqual(old_gamma[q][j].second, gamma[q][j].second));
+  }
+  AssertEqual(old_mbr.GetSausageTimes(), mbr.GetSausageTimes());
+  AssertEqual(old_mbr.GetOneBestTimes(), mbr.GetOneBestTimes());
+  const std::vector<BaseFloat> &old_conf = old_mbr.GetOneBestConfidences(),
+      &conf = mbr.GetOneBestConfidences();
+  KALDI_ASSERT(old_conf.size() == conf.size());
+  for (size_t i = 0; i < conf.size(); i++)
+    KALDI_ASSERT(ApproxEqual(old_conf[i], conf[i]));
+}
+
+// Compares the old and current implementations on a random lattice, both with
+// a new MinimumBayesRisk object and with one that has been used for other
+// lattices already (reused_mbr[do_mbr ? 1 : 0]).
+void TestMinimumBayesRisk(MinimumBayesRisk **reused_mbr) {
+  CompactLattice *clat = RandCompactLattice();
+  fst::Connect(clat);
+  if (clat->Start() != fst::kNoStateId) {
+    bool do_mbr = (RandInt(0, 3) != 0);
+    OldMinimumBayesRisk old_mbr(*clat, do_mbr);
+    MinimumBayesRisk mbr(*clat, do_mbr);
+    AssertEqual(old_mbr, mbr);
+    MinimumBayesRisk *this_reused_mbr = reused_mbr[do_mbr ? 1 : 0];
+    this_reused_mbr->Compute(*clat);
+    AssertEqual(old_mbr, *this_reused_mbr);
+  }
+  delete clat;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  MinimumBayesRisk map_mbr(false), mbr(true);
+  MinimumBayesRisk *reused_mbr[2] = { &map_mbr, &mbr };
+  for (int32 i = 0; i < 200; i++)
+    TestMinimumBayesRisk(reused_mbr);
+  KALDI_LOG << "Success.";
+}
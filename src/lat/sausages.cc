@@ -89,156 +89,187 @@ void MinimumBayesRisk::NormalizeEps(std::vector<int32> *vec) {
   (*vec)[0] = 0;
 }
 
-double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
-                                      Vector<double> &alpha,
-                                      Matrix<double> &alpha_dash,
-                                      Vector<double> &alpha_dash_arc) {
-  alpha(1) = 0.0; // = log(1).  Line 5.
-  alpha_dash(1, 0) = 0.0; // Line 5.
-  for (int32 q = 1; q <= Q; q++) 
-    alpha_dash(1, q) = alpha_dash(1, q-1) + l(0, r(q)); // Line 7.
+double MinimumBayesRisk::EditDistance(int32 N, int32 Q) {
+  // The matrices alpha_dash_ and beta_dash_ are stored as flat arrays with
+  // Q+1 columns.  Note: l(a, b) is 0 if a == b, else 1, so we write the
+  // comparisons out.  The posterior of each arc, exp(alpha(s_a) + p_a -
+  // alpha(n)), does not depend on q so we compute it outside the loop over q.
+  int32 stride = Q + 1;
+  double *alpha = &(alpha_[0]), *alpha_dash = &(alpha_dash_[0]),
+      *alpha_dash_arc = &(alpha_dash_arc_[0]);
+  const int32 *R = &(R_[0]);  // r(q) == R[q-1].
+  alpha[1] = 0.0; // = log(1).  Line 5.
+  alpha_dash[stride + 0] = 0.0; // Line 5.
+  for (int32 q = 1; q <= Q; q++)
+    alpha_dash[stride + q] = alpha_dash[stride + q - 1] +
+        (R[q-1] != 0 ? 1.0 : 0.0); // Line 7.
   for (int32 n = 2; n <= N; n++) {
+    const std::vector<int32> &pre = pre_[n];
     double alpha_n = kLogZeroDouble;
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
-      alpha_n = LogAdd(alpha_n, alpha(arc.start_node) + arc.loglike);
+    for (size_t i = 0; i < pre.size(); i++) {
+      const Arc &arc = arcs_[pre[i]];
+      alpha_n = LogAdd(alpha_n, alpha[arc.start_node] + arc.loglike);
     }
-    alpha(n) = alpha_n; // Line 10.
+    alpha[n] = alpha_n; // Line 10.
     // Line 11 omitted: matrix was initialized to zero.
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
+    double *alpha_dash_n = alpha_dash + n * stride;
+    for (size_t i = 0; i < pre.size(); i++) {
+      const Arc &arc = arcs_[pre[i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      for (int32 q = 0; q <= Q; q++) {
-        if (q == 0) {
-          alpha_dash_arc(q) = // line 15.
-              alpha_dash(s_a, q) + l(w_a, 0) + delta();
-        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
-          int32 r_q = r(q);
-          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-              a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
-              a3 = alpha_dash_arc(q-1) + l(0, r_q);
-          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
-        }
+      const double *alpha_dash_s = alpha_dash + s_a * stride;
+      double post = exp(alpha[s_a] + p_a - alpha_n),
+          del_cost = (w_a != 0 ? 1.0 : 0.0) + delta();  // l(w_a, 0) + delta.
+      alpha_dash_arc[0] = alpha_dash_s[0] + del_cost; // line 15.
+      alpha_dash_n[0] += post * alpha_dash_arc[0]; // line 19.
+      for (int32 q = 1; q <= Q; q++) {
+        // a1,a2,a3 are the 3 parts of min expression of line 17.
+        int32 r_q = R[q-1];
+        double a1 = alpha_dash_s[q-1] + (w_a != r_q ? 1.0 : 0.0),
+            a2 = alpha_dash_s[q] + del_cost,
+            a3 = alpha_dash_arc[q-1] + (r_q != 0 ? 1.0 : 0.0);
+        alpha_dash_arc[q] = std::min(a1, std::min(a2, a3));
         // line 19:
-        alpha_dash(n, q) += exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
+        alpha_dash_n[q] += post * alpha_dash_arc[q];
       }
     }
   }
-  return alpha_dash(N, Q); // line 23.
+  return alpha_dash[N * stride + Q]; // line 23.
 }
 
 // Figure 5 in the paper.
 void MinimumBayesRisk::AccStats() {
-  using std::map;
-  
   int32 N = static_cast<int32>(pre_.size()) - 1,
-      Q = static_cast<int32>(R_.size());
+      Q = static_cast<int32>(R_.size()), stride = Q + 1;
 
-  Vector<double> alpha(N+1); // index (1...N)
-  Matrix<double> alpha_dash(N+1, Q+1); // index (1...N, 0...Q)
-  Vector<double> alpha_dash_arc(Q+1); // index 0...Q
-  Matrix<double> beta_dash(N+1, Q+1); // index (1...N, 0...Q)
-  Vector<double> beta_dash_arc(Q+1); // index 0...Q
-  vector<char> b_arc(Q+1); // integer in {1,2,3}; index 1...Q
-  vector<map<int32, double> > gamma(Q+1); // temp. form of gamma.
-  // index 1...Q [word] -> occ.
+  // Set up the buffers; they keep their memory between iterations and between
+  // lattices, so normally this does not allocate anything.
+  alpha_.resize(N+1); // index (1...N)
+  alpha_dash_.assign(static_cast<size_t>(N+1) * stride, 0.0);
+  // alpha_dash_ is indexed (1...N, 0...Q), and beta_dash_ likewise.
+  beta_dash_.assign(static_cast<size_t>(N+1) * stride, 0.0);
+  alpha_dash_arc_.resize(stride); // index 0...Q
+  beta_dash_arc_.resize(stride); // index 0...Q
+  b_arc_.resize(stride); // integer in {1,2,3}; index 1...Q
+  // gamma_tmp_ is the temporary form of gamma, index 1...Q: a list of
+  // (word, occupancy) pairs.
+  if (gamma_tmp_.size() < static_cast<size_t>(stride))
+    gamma_tmp_.resize(stride);
+  for (int32 q = 1; q <= Q; q++)
+    gamma_tmp_[q].clear();
 
   // The tau arrays below are the sums over words of the tau_b
   // and tau_e timing quantities mentioned in Appendix C of
   // the paper... we are using these to get averaged times for
   // the sausage bins, not specifically for the 1-best output.
-  Vector<double> tau_b(Q+1), tau_e(Q+1);
+  tau_b_.assign(stride, 0.0);
+  tau_e_.assign(stride, 0.0);
 
-  double Ltmp = EditDistance(N, Q, alpha, alpha_dash, alpha_dash_arc); 
+  double Ltmp = EditDistance(N, Q);
   if (L_ != 0 && Ltmp > L_) { // L_ != 0 is to rule out 1st iter.
     KALDI_WARN << "Edit distance increased: " << Ltmp << " > "
                << L_;
   }
   L_ = Ltmp;
   KALDI_VLOG(2) << "L = " << L_;
+
+  const double *alpha = &(alpha_[0]), *alpha_dash = &(alpha_dash_[0]);
+  double *beta_dash = &(beta_dash_[0]),
+      *alpha_dash_arc = &(alpha_dash_arc_[0]),
+      *beta_dash_arc = &(beta_dash_arc_[0]),
+      *tau_b = &(tau_b_[0]), *tau_e = &(tau_e_[0]);
+  char *b_arc = &(b_arc_[0]);
+  const int32 *R = &(R_[0]);  // r(q) == R[q-1].
+
   // omit line 10: zero when initialized.
-  beta_dash(N, Q) = 1.0; // Line 11.
+  beta_dash[N * stride + Q] = 1.0; // Line 11.
   for (int32 n = N; n >= 2; n--) {
-    for (size_t i = 0; i < pre_[n].size(); i++) {
-      const Arc &arc = arcs_[pre_[n][i]];
+    const std::vector<int32> &pre = pre_[n];
+    const double *beta_dash_n = beta_dash + n * stride;
+    for (size_t i = 0; i < pre.size(); i++) {
+      const Arc &arc = arcs_[pre[i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0) + delta(); // line 14.
+      const double *alpha_dash_s = alpha_dash + s_a * stride;
+      double *beta_dash_s = beta_dash + s_a * stride;
+      double post = exp(alpha[s_a] + p_a - alpha[n]),
+          del_cost = (w_a != 0 ? 1.0 : 0.0) + delta();  // l(w_a, 0) + delta.
+      alpha_dash_arc[0] = alpha_dash_s[0] + del_cost; // line 14.
       for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
-        int32 r_q = r(q);
-        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-            a2 = alpha_dash(s_a, q) + l(w_a, 0) + delta(),
-            a3 = alpha_dash_arc(q-1) + l(0, r_q);
+        int32 r_q = R[q-1];
+        double a1 = alpha_dash_s[q-1] + (w_a != r_q ? 1.0 : 0.0),
+            a2 = alpha_dash_s[q] + del_cost,
+            a3 = alpha_dash_arc[q-1] + (r_q != 0 ? 1.0 : 0.0);
         if (a1 <= a2) {
-          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc[q] = a1; }
+          else { b_arc[q] = 3; alpha_dash_arc[q] = a3; }
         } else {
-          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc[q] = a2; }
+          else { b_arc[q] = 3; alpha_dash_arc[q] = a3; }
         }
       }
-      beta_dash_arc.SetZero(); // line 19.
+      std::fill(beta_dash_arc, beta_dash_arc + stride, 0.0); // line 19.
       for (int32 q = Q; q >= 1; q--) {
         // line 21:
-        beta_dash_arc(q) += exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
+        beta_dash_arc[q] += post * beta_dash_n[q];
         switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
           case 1:
-            beta_dash(s_a, q-1) += beta_dash_arc(q);
+            beta_dash_s[q-1] += beta_dash_arc[q];
             // next: gamma(q, w(a)) += beta_dash_arc(q)
-            AddToMap(w_a, beta_dash_arc(q), &(gamma[q]));
+            AddToGamma(w_a, beta_dash_arc[q], &(gamma_tmp_[q]));
             // next: accumulating times, see decl for tau_b,tau_e
-            tau_b(q) += state_times_[s_a] * beta_dash_arc(q);
-            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            tau_b[q] += state_times_[s_a] * beta_dash_arc[q];
+            tau_e[q] += state_times_[n] * beta_dash_arc[q];
             break;
           case 2:
-            beta_dash(s_a, q) += beta_dash_arc(q);
+            beta_dash_s[q] += beta_dash_arc[q];
             break;
           case 3:
-            beta_dash_arc(q-1) += beta_dash_arc(q);
+            beta_dash_arc[q-1] += beta_dash_arc[q];
             // next: gamma(q, epsilon) += beta_dash_arc(q)
-            AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+            AddToGamma(0, beta_dash_arc[q], &(gamma_tmp_[q]));
             // next: accumulating times, see decl for tau_b,tau_e
             // WARNING: there was an error in Appendix C.  If we followed
             // the instructions there the next line would say state_times_[sa], but
             // it would be wrong.  I will try to publish an erratum.
-            tau_b(q) += state_times_[n] * beta_dash_arc(q);
-            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            tau_b[q] += state_times_[n] * beta_dash_arc[q];
+            tau_e[q] += state_times_[n] * beta_dash_arc[q];
             break;
           default:
             KALDI_ERR << "Invalid b_arc value"; // error in code.
         }
       }
-      beta_dash_arc(0) += exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
-      beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
+      beta_dash_arc[0] += post * beta_dash_n[0];
+      beta_dash_s[0] += beta_dash_arc[0]; // line 26.
     }
   }
-  beta_dash_arc.SetZero(); // line 29.
+  std::fill(beta_dash_arc, beta_dash_arc + stride, 0.0); // line 29.
   for (int32 q = Q; q >= 1; q--) {
-    beta_dash_arc(q) += beta_dash(1, q);
-    beta_dash_arc(q-1) += beta_dash_arc(q);
-    AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+    beta_dash_arc[q] += beta_dash[stride + q];
+    beta_dash_arc[q-1] += beta_dash_arc[q];
+    AddToGamma(0, beta_dash_arc[q], &(gamma_tmp_[q]));
     // the statements below are actually redundant because
     // state_times_[1] is zero.
-    tau_b(q) += state_times_[1] * beta_dash_arc(q);
-    tau_e(q) += state_times_[1] * beta_dash_arc(q);
+    tau_b[q] += state_times_[1] * beta_dash_arc[q];
+    tau_e[q] += state_times_[1] * beta_dash_arc[q];
   }
   for (int32 q = 1; q <= Q; q++) { // a check (line 35)
     double sum = 0.0;
-    for (map<int32, double>::iterator iter = gamma[q].begin();
-         iter != gamma[q].end(); ++iter) sum += iter->second;
+    for (size_t j = 0; j < gamma_tmp_[q].size(); j++)
+      sum += gamma_tmp_[q][j].second;
     if (fabs(sum - 1.0) > 0.1)
       KALDI_WARN << "sum of gamma[" << q << ",s] is " << sum;
   }
   // The next part is where we take gamma, and convert
   // to the class member gamma_, which is using a different
   // data structure and indexed from zero, not one.
-  gamma_.clear();
   gamma_.resize(Q);
   for (int32 q = 1; q <= Q; q++) {
-    for (map<int32, double>::iterator iter = gamma[q].begin();
-         iter != gamma[q].end(); ++iter)
-      gamma_[q-1].push_back(std::make_pair(iter->first, static_cast<BaseFloat>(iter->second)));
+    const std::vector<std::pair<int32, double> > &this_gamma = gamma_tmp_[q];
+    gamma_[q-1].clear();
+    for (size_t j = 0; j < this_gamma.size(); j++)
+      gamma_[q-1].push_back(std::make_pair(this_gamma[j].first,
+                             static_cast<BaseFloat>(this_gamma[j].second)));
     // sort gamma_[q-1] from largest to smallest posterior.
     GammaCompare comp;
     std::sort(gamma_[q-1].begin(), gamma_[q-1].end(), comp);
@@ -246,11 +277,10 @@ void MinimumBayesRisk::AccStats() {
   // We do the same conversion for the state times tau_b and tau_e:
   // they get turned into the times_ data member, which has zero-based
   // indexing.
-  times_.clear();
   times_.resize(Q);
   for (int32 q = 1; q <= Q; q++) {
-    times_[q-1].first = tau_b(q);
-    times_[q-1].second = tau_e(q);
+    times_[q-1].first = tau_b[q];
+    times_[q-1].second = tau_e[q];
     if (times_[q-1].first > times_[q-1].second) // this is quite bad.
       KALDI_WARN << "Times out of order";
     if (q > 1 && times_[q-2].second > times_[q-1].first) {
@@ -261,11 +291,17 @@ void MinimumBayesRisk::AccStats() {
       double avg = 0.5 * (times_[q-2].second + times_[q-1].first);
       times_[q-2].second = times_[q-1].first = avg;
     }
-  }  
+  }
+}
+
+MinimumBayesRisk::MinimumBayesRisk(bool do_mbr): do_mbr_(do_mbr), L_(0.0) { }
+
+MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat, bool do_mbr):
+    do_mbr_(do_mbr), L_(0.0) {
+  Compute(clat);
 }
 
-MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
-    do_mbr_(do_mbr) {
+void MinimumBayesRisk::Compute(const CompactLattice &clat_in) {
   CompactLattice clat(clat_in); // copy.
 
   CreateSuperFinal(&clat); // Add super-final state to clat... this is
@@ -291,6 +327,9 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in, bool do_mbr):
   // which involves adding 1 to the OpenFst states.
   int32 N = clat.NumStates();
   pre_.resize(N+1);
+  for (int32 n = 1; n <= N; n++)
+    pre_[n].clear();  // In case this object was used before.
+  arcs_.clear();
 
   // Careful: "Arc" is a class-member struct, not an OpenFst type of arc as one
   // would normally assume.
@@ -64,6 +64,15 @@ class MinimumBayesRisk {
   MinimumBayesRisk(const CompactLattice &clat, bool do_mbr = true); // if do_mbr == false,
   // it will just use the MAP recognition output, but will get the MBR stats for things
   // like confidences.
+
+  /// This constructor does not do any computation; call Compute() for each
+  /// lattice.  Using the same object for many lattices is faster than
+  /// constructing a new one for each, as it keeps the memory it allocated.
+  explicit MinimumBayesRisk(bool do_mbr = true);
+
+  /// Does the whole computation for the lattice "clat", replacing any results
+  /// for a previous lattice.
+  void Compute(const CompactLattice &clat);
   
   const std::vector<int32> &GetOneBest() const { // gets one-best (with no epsilons)
     return R_;
@@ -106,11 +115,9 @@ class MinimumBayesRisk {
   inline int32 r(int32 q) { return R_[q-1]; }
   
   
-  /// Figure 4 of the paper; called from AccStats (Fig. 5)
-  double EditDistance(int32 N, int32 Q,
-                      Vector<double> &alpha,
-                      Matrix<double> &alpha_dash,
-                      Vector<double> &alpha_dash_arc);
+  /// Figure 4 of the paper; called from AccStats (Fig. 5).  Outputs to
+  /// alpha_, alpha_dash_ and alpha_dash_arc_, which must be sized already.
+  double EditDistance(int32 N, int32 Q);
 
   /// Figure 5 of the paper.  Outputs to gamma_ and L_.
   void AccStats(); 
@@ -125,13 +132,20 @@ class MinimumBayesRisk {
   static inline BaseFloat delta() { return 1.0e-05; } // A constant
   // used in the algorithm.
 
-  /// Function used to increment map.
-  static inline void AddToMap(int32 i, double d, std::map<int32, double> *gamma) {
+  /// Function used to increment the stats for one bin of gamma_tmp_.  There
+  /// are only a few words in each bin, so a linear search is fastest.
+  static inline void AddToGamma(int32 i, double d,
+                                std::vector<std::pair<int32, double> > *gamma) {
     if (d == 0) return;
-    std::pair<const int32, double> pr(i, d);
-    std::pair<std::map<int32, double>::iterator, bool> ret = gamma->insert(pr);
-    if (!ret.second) // not inserted, so add to contents.
-      ret.first->second += d;
+    std::vector<std::pair<int32, double> >::iterator iter = gamma->begin(),
+        end = gamma->end();
+    for (; iter != end; ++iter) {
+      if (iter->first == i) {
+        iter->second += d;
+        return;
+      }
+    }
+    gamma->push_back(std::make_pair(i, d));
   }
     
   struct Arc {
@@ -185,6 +199,22 @@ class MinimumBayesRisk {
   // vector of confidences for the 1-best output (which could be
   // the MAP output if do_mbr_ == false, or the MBR output otherwise).
   // Indexed by the same index as one_best_times_.
+
+  // The following are the quantities of the same names in the paper, used
+  // inside AccStats() and EditDistance().  They are class members so that we
+  // don't allocate them on each iteration and for each lattice.  The
+  // matrices alpha_dash_ and beta_dash_ are stored row by row, with Q+1
+  // columns.
+  std::vector<double> alpha_; // index (1...N)
+  std::vector<double> alpha_dash_; // index (1...N, 0...Q)
+  std::vector<double> alpha_dash_arc_; // index 0...Q
+  std::vector<double> beta_dash_; // index (1...N, 0...Q)
+  std::vector<double> beta_dash_arc_; // index 0...Q
+  std::vector<char> b_arc_; // integer in {1,2,3}; index 1...Q
+  std::vector<double> tau_b_; // index 1...Q
+  std::vector<double> tau_e_; // index 1...Q
+  // temporary form of gamma; index 1...Q, then a list of (word, occupancy).
+  std::vector<std::vector<std::pair<int32, double> > > gamma_tmp_;
   
   struct GammaCompare{
     // should be like operator <.  But we want reverse order
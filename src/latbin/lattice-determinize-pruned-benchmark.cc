@@ -0,0 +1,131 @@
+// latbin/lattice-determinize-pruned-benchmark.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "lat/lattice-functions.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Measure the speed of pruned lattice determinization: reads all the raw\n"
+        "(state-level) lattices into memory, determinizes them as\n"
+        "lattice-determinize-pruned does, possibly several times, and prints\n"
+        "the number of input and output states per second and the peak memory\n"
+        "used by the process.  The output lattices are not written.\n"
+        "\n"
+        "Usage: lattice-determinize-pruned-benchmark [options] lattice-rspecifier\n"
+        " e.g.: lattice-determinize-pruned-benchmark --acoustic-scale=0.1 "
+        "--beam=6.0 ark:1.lats\n";
+
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 1.0;
+    BaseFloat beam = 10.0;
+    int32 num_repeats = 1;
+    fst::DeterminizeLatticePrunedOptions opts;
+    opts.max_mem = 50000000;
+    opts.max_loop = 0;
+
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("beam", &beam, "Pruning beam [applied after acoustic scaling].");
+    po.Register("num-repeats", &num_repeats, "Number of times to determinize "
+                "the whole set of lattices.");
+    opts.Register(&po);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Do not use a zero acoustic scale (cannot be inverted)";
+    KALDI_ASSERT(num_repeats > 0);
+
+    std::string lats_rspecifier = po.GetArg(1);
+
+    // Read all the lattices first, and do the same preparation as
+    // lattice-determinize-pruned, so that only the determinization is timed.
+    std::vector<Lattice*> lats;
+    int64 num_input_states = 0;
+    long memory_before = PeakMemoryKb();
+    SequentialLatticeReader lat_reader(lats_rspecifier);
+    for (; !lat_reader.Done(); lat_reader.Next()) {
+      Lattice *lat = new Lattice(lat_reader.Value());
+      lat_reader.FreeCurrent();
+      Invert(lat);  // so word labels are on the input side.
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), lat);
+      if (!TopSort(lat)) {
+        KALDI_WARN << "Could not topologically sort lattice for key "
+                   << lat_reader.Key() << ", skipping it.";
+        delete lat;
+        continue;
+      }
+      fst::ArcSort(lat, fst::ILabelCompare<LatticeArc>());
+      num_input_states += lat->NumStates();
+      lats.push_back(lat);
+    }
+    long memory_loaded = PeakMemoryKb();
+    if (lats.empty())
+      KALDI_ERR << "No lattices were read.";
+
+    int64 num_output_states = 0, num_output_arcs = 0;
+    int32 num_warn = 0;
+    Timer timer;
+    for (int32 r = 0; r < num_repeats; r++) {
+      for (size_t i = 0; i < lats.size(); i++) {
+        CompactLattice det_clat;
+        if (!DeterminizeLatticePruned(*(lats[i]), beam, &det_clat, opts))
+          num_warn++;
+        num_output_states += det_clat.NumStates();
+        for (int32 s = 0; s < det_clat.NumStates(); s++)
+          num_output_arcs += det_clat.NumArcs(s);
+      }
+    }
+    double elapsed = timer.Elapsed();
+    long memory_peak = PeakMemoryKb();
+
+    for (size_t i = 0; i < lats.size(); i++)
+      delete lats[i];
+
+    KALDI_LOG << "Determinized " << lats.size() << " lattices " << num_repeats
+              << " times in " << elapsed << " seconds; determinization "
+              << "finished earlier than specified by the beam " << num_warn
+              << " times.";
+    KALDI_LOG << "Input states per second: "
+              << (num_input_states * num_repeats / elapsed)
+              << "; output states per second: "
+              << (num_output_states / elapsed) << "; output arcs per second: "
+              << (num_output_arcs / elapsed);
+    KALDI_LOG << "Peak memory (kB): before reading lattices " << memory_before
+              << ", after reading them " << memory_loaded
+              << ", after determinizing them " << memory_peak;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
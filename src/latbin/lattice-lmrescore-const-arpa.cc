@@ -23,38 +23,137 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
+#include "thread/kaldi-task-sequence.h"
 #include "util/common-utils.h"
 
+namespace kaldi {
+
+class RescoreLatticeTask {
+ public:
+  // Initializer takes ownership of "clat".  "lm_fst" is shared between the
+  // tasks and must be thread-safe.
+  RescoreLatticeTask(std::string key,
+                     BaseFloat lm_scale,
+                     BaseFloat lattice_compose_beam,
+                     fst::DeterministicOnDemandFst<fst::StdArc> *lm_fst,
+                     CompactLattice *clat,
+                     CompactLatticeWriter *clat_writer,
+                     int32 *num_done,
+                     int32 *num_fail):
+      key_(key), lm_scale_(lm_scale),
+      lattice_compose_beam_(lattice_compose_beam), lm_fst_(lm_fst), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_fail_(num_fail) { }
+
+  void operator () () {
+    // Before composing with the LM FST, we scale the lattice weights by the
+    // inverse of "lm_scale".  We'll later scale by "lm_scale".  We do it this
+    // way so we can determinize and it will give the right effect (taking the
+    // "best path" through the LM) regardless of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale_), clat_);
+    ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    if (lattice_compose_beam_ > 0.0)
+      ComposeCompactLatticeDeterministicPruned(*clat_, lattice_compose_beam_,
+                                               lm_fst_, &composed_clat);
+    else
+      ComposeCompactLatticeDeterministic(*clat_, lm_fst_, &composed_clat);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, &det_clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &det_clat_);
+  }
+
+  ~RescoreLatticeTask() {
+    if (det_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, det_clat_);
+      (*num_done_)++;
+    }
+    delete clat_;  // NULL unless operator () was never called.
+  }
+
+ private:
+  std::string key_;
+  BaseFloat lm_scale_;
+  BaseFloat lattice_compose_beam_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_fst_;
+  CompactLattice *clat_;  // The lattice we're working on.  Owned locally.
+  CompactLattice det_clat_;  // The output of our process.  Will be written to
+                             // clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
     typedef kaldi::int32 int32;
     typedef kaldi::int64 int64;
+    typedef fst::ThreadSafeCacheDeterministicOnDemandFst<fst::StdArc>
+        CacheFst;
 
     const char *usage =
         "Rescores lattice with the ConstArpaLm format language model. The LM\n"
         "will be wrapped into the DeterministicOnDemandFst interface and the\n"
         "rescoring is done by composing with the wrapped LM using a special\n"
         "type of composition algorithm. Determinization will be applied on\n"
-        "the composed lattice.\n"
+        "the composed lattice.  The LM is memory-mapped if it is a file, so\n"
+        "parallel jobs on the same machine share one copy of it in memory.\n"
+        "With --num-threads > 1, lattices are rescored in parallel, sharing one\n"
+        "copy of the LM and a cache of its arcs; the output is written in the\n"
+        "same order as the input.  Arcs that are not in the cache are looked\n"
+        "up by one thread at a time, so a larger --num-cached-arcs helps the\n"
+        "threads scale.\n"
         "\n"
         "Usage: lattice-lmrescore-const-arpa [options] lattice-rspecifier \\\n"
         "                                   const-arpa-in lattice-wspecifier\n"
         " e.g.: lattice-lmrescore-const-arpa --lm-scale=-1.0 ark:in.lats \\\n"
         "                                   const_arpa ark:out.lats\n";
-      
+
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
-    
+    BaseFloat lattice_compose_beam = 0.0;
+    int32 num_cached_arcs = 1000000;
+    int32 max_lm_states = 1000000;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
-    
+    po.Register("lattice-compose-beam", &lattice_compose_beam, "If > 0, "
+                "prune the composition with the LM with this beam, using the "
+                "scores of the input lattice (after dividing the graph scores "
+                "by --lm-scale) to estimate the cost of the rest of each path; "
+                "this is much faster for deep lattices.");
+    po.Register("num-cached-arcs", &num_cached_arcs, "Number of LM arcs in "
+                "the cache shared by all threads.");
+    po.Register("max-lm-states", &max_lm_states, "Maximum number of LM "
+                "history states to create before discarding them and starting "
+                "again (limits memory usage).  Each state takes about "
+                "40 + 4 * (n-gram order - 1) bytes, e.g. about 50MB per "
+                "million states for a 4-gram LM.");
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 3) {
       po.PrintUsage();
       exit(1);
     }
+    if (num_cached_arcs <= 0 || max_lm_states <= 0)
+      KALDI_ERR << "Invalid --num-cached-arcs or --max-lm-states option.";
 
     std::string lats_rspecifier = po.GetArg(1),
         lm_rxfilename = po.GetArg(2),
@@ -62,57 +161,62 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    const_arpa.ReadMapped(lm_rxfilename);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
-    CompactLatticeWriter compact_lattice_writer(lats_wspecifier); 
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    // Wraps the ConstArpaLm format language model into FST, with a cache that
+    // is shared by all the threads.  The FST creates a state for each LM
+    // history it sees; we re-create it when it has too many states, to prevent
+    // memory usage increasing with time.
+    ConstArpaLmDeterministicFst *const_arpa_fst = NULL;
+    CacheFst *cache_fst = NULL;
 
     int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.        
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
+    {
+      TaskSequencer<RescoreLatticeTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+
+        if (lm_scale == 0.0) {
+          // Zero scale so nothing to do.  We have to wait for the lattices
+          // before this one so that the output stays in order.
+          sequencer.Wait();
+          compact_lattice_writer.Write(key, compact_lattice_reader.Value());
           n_done++;
+          continue;
         }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
+
+        if (cache_fst != NULL && cache_fst->NumStatesSeen() > max_lm_states) {
+          // Nothing may be using the FST while we delete it.
+          sequencer.Wait();
+          KALDI_VLOG(1) << "Re-creating LM FST after it reached "
+                        << cache_fst->NumStatesSeen() << " states.";
+          delete cache_fst;
+          delete const_arpa_fst;
+          cache_fst = NULL;
+          const_arpa_fst = NULL;
+        }
+        if (cache_fst == NULL) {
+          const_arpa_fst = new ConstArpaLmDeterministicFst(const_arpa);
+          cache_fst = new CacheFst(const_arpa_fst, num_cached_arcs);
+        }
+
+        CompactLattice *clat =
+            new CompactLattice(compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+        sequencer.Run(new RescoreLatticeTask(key, lm_scale,
+                                             lattice_compose_beam,
+                                             cache_fst, clat,
+                                             &compact_lattice_writer,
+                                             &n_done, &n_fail));
       }
+      sequencer.Wait();
     }
+    delete cache_fst;
+    delete const_arpa_fst;
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
@@ -0,0 +1,119 @@
+// latbin/lattice-mbr-decode-benchmark.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/sausages.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Measure the speed of Minimum Bayes Risk decoding: reads all the\n"
+        "lattices into memory, does MBR decoding on them as lattice-mbr-decode\n"
+        "does, possibly several times, and prints the number of lattices and\n"
+        "words per second and the peak memory used by the process.  Nothing is\n"
+        "written.  With --reuse=false, a new MinimumBayesRisk object is\n"
+        "constructed for each lattice.\n"
+        "\n"
+        "Usage: lattice-mbr-decode-benchmark [options] lattice-rspecifier\n"
+        " e.g.: lattice-mbr-decode-benchmark --acoustic-scale=0.1 ark:1.lats\n";
+
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 1.0, lm_scale = 1.0;
+    bool decode_mbr = true, reuse = true;
+    int32 num_repeats = 1;
+
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("lm-scale", &lm_scale,
+                "Scaling factor for language model probabilities");
+    po.Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
+                "decoding (else, Maximum a Posteriori)");
+    po.Register("reuse", &reuse, "If true, use the same MinimumBayesRisk "
+                "object for all the lattices.");
+    po.Register("num-repeats", &num_repeats, "Number of times to decode "
+                "the whole set of lattices.");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(num_repeats > 0);
+
+    std::string lats_rspecifier = po.GetArg(1);
+
+    std::vector<CompactLattice*> clats;
+    long memory_before = PeakMemoryKb();
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    for (; !clat_reader.Done(); clat_reader.Next()) {
+      CompactLattice *clat = new CompactLattice(clat_reader.Value());
+      clat_reader.FreeCurrent();
+      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), clat);
+      clats.push_back(clat);
+    }
+    long memory_loaded = PeakMemoryKb();
+    if (clats.empty())
+      KALDI_ERR << "No lattices were read.";
+
+    int64 num_words = 0;
+    double tot_bayes_risk = 0.0;
+    MinimumBayesRisk mbr(decode_mbr);
+    Timer timer;
+    for (int32 r = 0; r < num_repeats; r++) {
+      for (size_t i = 0; i < clats.size(); i++) {
+        if (reuse) {
+          mbr.Compute(*(clats[i]));
+          num_words += mbr.GetOneBest().size();
+          tot_bayes_risk += mbr.GetBayesRisk();
+        } else {
+          MinimumBayesRisk this_mbr(*(clats[i]), decode_mbr);
+          num_words += this_mbr.GetOneBest().size();
+          tot_bayes_risk += this_mbr.GetBayesRisk();
+        }
+      }
+    }
+    double elapsed = timer.Elapsed();
+    long memory_peak = PeakMemoryKb();
+
+    for (size_t i = 0; i < clats.size(); i++)
+      delete clats[i];
+
+    KALDI_LOG << "Decoded " << clats.size() << " lattices " << num_repeats
+              << " times in " << elapsed << " seconds; average Bayes Risk "
+              << "per sentence is "
+              << (tot_bayes_risk / (clats.size() * num_repeats));
+    KALDI_LOG << "Lattices per second: "
+              << (clats.size() * num_repeats / elapsed)
+              << "; words per second: " << (num_words / elapsed);
+    KALDI_LOG << "Peak memory (kB): before reading lattices " << memory_before
+              << ", after reading them " << memory_loaded
+              << ", after decoding them " << memory_peak;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -93,6 +93,7 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_words = 0;
     BaseFloat tot_bayes_risk = 0.0;
+    MinimumBayesRisk mbr;  // We reuse this for all the lattices.
     
     for (; !clat_reader.Done(); clat_reader.Next()) {
       std::string key = clat_reader.Key();
@@ -100,7 +101,7 @@ int main(int argc, char *argv[]) {
       clat_reader.FreeCurrent();
       fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
 
-      MinimumBayesRisk mbr(clat);
+      mbr.Compute(clat);
 
       if (trans_wspecifier != "")
         trans_writer.Write(key, mbr.GetOneBest());
@@ -0,0 +1,114 @@
+// latbin/lattice-to-ctm-conf-parallel.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/ctm-pipeline.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Generate 1-best from lattices and convert into ctm with confidences,\n"
+        "as lattice-to-ctm-conf does, but using multiple threads.  If the\n"
+        "word-boundary file and model are given, first aligns the lattices\n"
+        "with word boundaries as lattice-align-words does, so this replaces\n"
+        "the pipeline 'lattice-align-words | lattice-to-ctm-conf'.\n"
+        "The ctm is in the same order as the input, and relative to the\n"
+        "utterance-id.\n"
+        "\n"
+        "Usage: lattice-to-ctm-conf-parallel [options] [<word-boundary-file> "
+        "<model>] <lattice-rspecifier> <ctm-wxfilename>\n"
+        " e.g.: lattice-to-ctm-conf-parallel --num-threads=8 "
+        "--acoustic-scale=0.1 \\\n"
+        "   data/lang/phones/word_boundary.int final.mdl ark:1.lats 1.ctm\n"
+        "See also: lattice-align-words, lattice-to-ctm-conf\n";
+
+    ParseOptions po(usage);
+    BaseFloat inv_acoustic_scale = 1.0;
+    LatticeToCtmPipelineOptions opts;
+    WordBoundaryInfoNewOpts word_boundary_opts;
+
+    po.Register("inv-acoustic-scale", &inv_acoustic_scale, "An alternative way "
+                "of setting the acoustic scale: you can set its inverse.");
+    opts.Register(&po);
+    word_boundary_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2 && po.NumArgs() != 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    KALDI_ASSERT(opts.acoustic_scale == 1.0 || inv_acoustic_scale == 1.0);
+    if (inv_acoustic_scale != 1.0)
+      opts.acoustic_scale = 1.0 / inv_acoustic_scale;
+
+    bool align = (po.NumArgs() == 4);
+    std::string lats_rspecifier = po.GetArg(po.NumArgs() - 1),
+        ctm_wxfilename = po.GetArg(po.NumArgs());
+
+    if (ClassifyWspecifier(ctm_wxfilename, NULL, NULL, NULL) != kNoWspecifier)
+      KALDI_ERR << "The output ctm file should not be a wspecifier. "
+                << "Please use things like 1.ctm istead of ark:-";
+
+    TransitionModel tmodel;
+    WordBoundaryInfo *info = NULL;
+    if (align) {
+      ReadKaldiObject(po.GetArg(2), &tmodel);
+      info = new WordBoundaryInfo(word_boundary_opts, po.GetArg(1));
+    }
+
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+
+    Output ko(ctm_wxfilename, false); // false == non-binary writing mode.
+    ko.Stream() << std::fixed;  // Set to "fixed" floating point model, where
+    // precision() specifies the #digits after the decimal point.
+    ko.Stream().precision(2);
+
+    int32 num_read = 0, num_done = 0;
+    {
+      LatticeToCtmPipeline pipeline(opts, (align ? &tmodel : NULL), info,
+                                    &(ko.Stream()));
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        CompactLattice clat(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        pipeline.AcceptLattice(clat_reader.Key(), &clat);
+        num_read++;
+      }
+      pipeline.Finish();
+
+      num_done = pipeline.NumDone();
+      KALDI_LOG << "Done " << num_done << " out of " << num_read
+                << " lattices; " << pipeline.NumErrors() << " had errors.";
+      KALDI_LOG << "Overall average Bayes Risk per sentence is "
+                << (pipeline.TotBayesRisk() / num_done) << " and per word, "
+                << (pipeline.TotBayesRisk() / pipeline.NumWords());
+    }
+    delete info;
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
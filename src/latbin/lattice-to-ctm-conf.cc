@@ -91,6 +91,7 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_words = 0;
     BaseFloat tot_bayes_risk = 0.0;
+    MinimumBayesRisk mbr(decode_mbr);  // We reuse this for all the lattices.
     
     for (; !clat_reader.Done(); clat_reader.Next()) {
       std::string key = clat_reader.Key();
@@ -98,7 +99,7 @@ int main(int argc, char *argv[]) {
       clat_reader.FreeCurrent();
       fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
 
-      MinimumBayesRisk mbr(clat, decode_mbr);
+      mbr.Compute(clat);
       
       const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
       const std::vector<int32> &words = mbr.GetOneBest();
@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
 #include <sstream>
 
 #include "lm/const-arpa-lm.h"
@@ -43,6 +44,26 @@ struct ArpaLine {
   }
 };
 
+// Fixed-size header of the ConstArpaLm format, which comes after the token
+// "<ConstArpaLm>". It is followed by the <unigram_states_> and
+// <overflow_buffer_> arrays (int64) and the <lm_states_> array (int32), all
+// written as they are in memory. The binary-mode header "\0B" and the token
+// take 16 bytes, so if the object is at the start of a file all the arrays are
+// suitably aligned to be used in place when the file is memory-mapped.
+struct ConstArpaLmHeader {
+  int32 version;
+  int32 bos_symbol;
+  int32 eos_symbol;
+  int32 unk_symbol;
+  int32 ngram_order;
+  int32 num_words;
+  int32 overflow_buffer_size;
+  int32 lm_states_size;
+};
+
+// We would notice a machine with different byte order from this.
+static const int32 kConstArpaLmVersion = 1;
+
 // Auxiliary class to build ConstArpaLm. We first use this class to figure out
 // the relative address of different LmStates, and then put everything into one
 // block in memory.
@@ -263,12 +284,13 @@ class ConstArpaLmBuilder {
   // Memory blcok for storing LmStates.
   int32* lm_states_;
 
-  // Memory block for storing pointers of unigram LmStates.
-  int32** unigram_states_;
+  // Memory block for storing offsets of unigram LmStates (see
+  // ConstArpaLm::unigram_states_ for the format).
+  int64* unigram_states_;
 
-  // Memory block for storing pointers of the LmStates that have large relative
+  // Memory block for storing offsets of the LmStates that have large relative
   // address to their parents.
-  int32** overflow_buffer_;
+  int64* overflow_buffer_;
 
   // Hash table from word sequences to LmStates.
   unordered_map<std::vector<int32>,
@@ -529,14 +551,14 @@ void ConstArpaLmBuilder::Build() {
   }
 
   // Puts data into memory block.
-  unigram_states_ = new int32*[num_words_];
-  std::vector<int32*> overflow_buffer_vec;
+  unigram_states_ = new int64[num_words_];
+  std::vector<int64> overflow_buffer_vec;
   for (int32 i = 0; i < num_words_; ++i) {
-    unigram_states_[i] = NULL;
+    unigram_states_[i] = 0;
   }
   for (int32 i = 0; i < sorted_vec.size(); ++i) {
     // Current address.
-    int32* parent_address = lm_states_ + lm_states_index;
+    int64 parent_address = lm_states_index;
 
     // Adds logprob.
     float logprob = sorted_vec[i].second->Logprob();
@@ -583,9 +605,10 @@ void ConstArpaLmBuilder::Build() {
           child_info |= 1;
         } else {
           // Relative address cannot be represented by 30 bits, we have to put
-          // the child address into <overflow_buffer_>.
-          int32* abs_address = parent_address + offset;
-          overflow_buffer_vec.push_back(abs_address);
+          // the child address into <overflow_buffer_> (plus one, see
+          // ConstArpaLm::unigram_states_).
+          int64 abs_address = parent_address + offset;
+          overflow_buffer_vec.push_back(abs_address + 1);
           int32 overflow_buffer_index = overflow_buffer_vec.size() - 1;
           child_info = overflow_buffer_index * 2;
           child_info |= 1;
@@ -603,14 +626,14 @@ void ConstArpaLmBuilder::Build() {
     // frequently.
     if (sorted_vec[i].second->IsUnigram()) {
       KALDI_ASSERT(sorted_vec[i].first->size() == 1);
-      unigram_states_[(*sorted_vec[i].first)[0]] = parent_address;
+      unigram_states_[(*sorted_vec[i].first)[0]] = parent_address + 1;
     }
   }
   KALDI_ASSERT(lm_states_size_ == lm_states_index);
 
   // Move <overflow_buffer_> from vector holder to array.
   overflow_buffer_size_ = overflow_buffer_vec.size();
-  overflow_buffer_ = new int32*[overflow_buffer_size_];
+  overflow_buffer_ = new int64[overflow_buffer_size_];
   for (int32 i = 0; i < overflow_buffer_size_; ++i) {
     overflow_buffer_[i] = overflow_buffer_vec[i];
   }
@@ -637,47 +660,28 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
   }
 
-  // Misc info.
-  WriteBasicType(os, binary, bos_symbol_);
-  WriteBasicType(os, binary, eos_symbol_);
-  WriteBasicType(os, binary, unk_symbol_);
-  WriteBasicType(os, binary, ngram_order_);
-
-  // LmStates section.
-  WriteBasicType(os, binary, lm_states_size_);
-  for (int32 i = 0; i < lm_states_size_; ++i) {
-    WriteBasicType(os, binary, lm_states_[i]);
-  }
-
-  // Unigram section. We write memory offset to disk instead of the absolute
-  // pointers.
-  WriteBasicType(os, binary, num_words_);
-  for (int32 i = 0; i < num_words_; ++i) {
-    // The relative address here is a little bit tricky:
-    // 1. If the original address is NULL, then we set the relative address to
-    //    zero.
-    // 2. If the original address is not NULL, we set it to the following:
-    //      unigram_states_[i] - lm_states_ + 1
-    //    we plus 1 to ensure that the above value is positive.
-    int64 tmp_address = (unigram_states_[i] == NULL) ? 0 :
-        unigram_states_[i] - lm_states_ + 1;
-    WriteBasicType(os, binary, tmp_address);
-  }
-
-  // Overflow section. We write memory offset to disk instead of the absolute
-  // pointers.
-  WriteBasicType(os, binary, overflow_buffer_size_);
-  for (int32 i = 0; i < overflow_buffer_size_; ++i) {
-    // The relative address here is a little bit tricky:
-    // 1. If the original address is NULL, then we set the relative address to
-    //    zero.
-    // 2. If the original address is not NULL, we set it to the following:
-    //      overflow_buffer_[i] - lm_states_ + 1
-    //    we plus 1 to ensure that the above value is positive.
-    int64 tmp_address = (overflow_buffer_[i] == NULL) ? 0 :
-        overflow_buffer_[i] - lm_states_ + 1;
-    WriteBasicType(os, binary, tmp_address);
-  }
+  WriteToken(os, binary, "<ConstArpaLm>");
+  ConstArpaLmHeader header;
+  header.version = kConstArpaLmVersion;
+  header.bos_symbol = bos_symbol_;
+  header.eos_symbol = eos_symbol_;
+  header.unk_symbol = unk_symbol_;
+  header.ngram_order = ngram_order_;
+  header.num_words = num_words_;
+  header.overflow_buffer_size = overflow_buffer_size_;
+  header.lm_states_size = lm_states_size_;
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // The unigram and overflow sections contain offsets into <lm_states_> rather
+  // than pointers, so all the arrays can be written as they are.
+  os.write(reinterpret_cast<const char*>(unigram_states_),
+           sizeof(int64) * num_words_);
+  os.write(reinterpret_cast<const char*>(overflow_buffer_),
+           sizeof(int64) * overflow_buffer_size_);
+  os.write(reinterpret_cast<const char*>(lm_states_),
+           sizeof(int32) * lm_states_size_);
+  if (os.fail())
+    KALDI_ERR << "Error writing ConstArpaLm to stream.";
 }
 
 void ConstArpaLm::Read(std::istream &is, bool binary) {
@@ -685,7 +689,52 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
   }
+  if (is.peek() != static_cast<int>('<')) {
+    // The older format starts with an integer written by WriteBasicType().
+    ReadOldFormat(is, binary);
+    return;
+  }
+
+  ExpectToken(is, binary, "<ConstArpaLm>");
+  ConstArpaLmHeader header;
+  is.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (is.fail() || header.version != kConstArpaLmVersion) {
+    KALDI_ERR << "Error reading ConstArpaLm header (or it was written on a "
+              << "machine with different byte order).";
+  }
+  if (header.num_words < 0 || header.overflow_buffer_size < 0 ||
+      header.lm_states_size < 0) {
+    KALDI_ERR << "Bad sizes in ConstArpaLm header; it is corrupted.";
+  }
+  bos_symbol_ = header.bos_symbol;
+  eos_symbol_ = header.eos_symbol;
+  unk_symbol_ = header.unk_symbol;
+  ngram_order_ = header.ngram_order;
+  num_words_ = header.num_words;
+  overflow_buffer_size_ = header.overflow_buffer_size;
+  lm_states_size_ = header.lm_states_size;
+
+  int64 *unigram_states = new int64[num_words_],
+      *overflow_buffer = new int64[overflow_buffer_size_];
+  int32 *lm_states = new int32[lm_states_size_];
+  unigram_states_ = unigram_states;
+  overflow_buffer_ = overflow_buffer;
+  lm_states_ = lm_states;
+  memory_assigned_ = true;
+  is.read(reinterpret_cast<char*>(unigram_states),
+          sizeof(int64) * num_words_);
+  is.read(reinterpret_cast<char*>(overflow_buffer),
+          sizeof(int64) * overflow_buffer_size_);
+  is.read(reinterpret_cast<char*>(lm_states),
+          sizeof(int32) * lm_states_size_);
+  if (is.fail())
+    KALDI_ERR << "Error reading ConstArpaLm (file truncated?)";
+  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+  Check();
+  initialized_ = true;
+}
 
+void ConstArpaLm::ReadOldFormat(std::istream &is, bool binary) {
   // Misc info.
   ReadBasicType(is, binary, &bos_symbol_);
   ReadBasicType(is, binary, &eos_symbol_);
@@ -694,42 +743,134 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
 
   // LmStates section.
   ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
+  int32 *lm_states = new int32[lm_states_size_];
+  lm_states_ = lm_states;
+  memory_assigned_ = true;
   for (int32 i = 0; i < lm_states_size_; ++i) {
-    ReadBasicType(is, binary, &lm_states_[i]);
+    ReadBasicType(is, binary, &lm_states[i]);
   }
 
-  // Unigram section. We write memory offset to disk instead of the absolute
-  // pointers.
+  // Unigram section. The offsets were written in the same form as we store
+  // them in <unigram_states_>.
   ReadBasicType(is, binary, &num_words_);
-  unigram_states_ = new int32*[num_words_];
+  int64 *unigram_states = new int64[num_words_];
+  unigram_states_ = unigram_states;
   for (int32 i = 0; i < num_words_; ++i) {
-    int64 tmp_address;
-    ReadBasicType(is, binary, &tmp_address);
-    // Check out how we compute the relative address in ConstArpaLm::Write().
-    unigram_states_[i] =
-        (tmp_address == 0) ? NULL : lm_states_ + tmp_address - 1;
+    ReadBasicType(is, binary, &unigram_states[i]);
   }
 
-  // Overflow section. We write memory offset to disk instead of the absolute
-  // pointers.
+  // Overflow section, also stored as offsets.
   ReadBasicType(is, binary, &overflow_buffer_size_);
-  overflow_buffer_ = new int32*[overflow_buffer_size_];
+  int64 *overflow_buffer = new int64[overflow_buffer_size_];
+  overflow_buffer_ = overflow_buffer;
   for (int32 i = 0; i < overflow_buffer_size_; ++i) {
-    int64 tmp_address;
-    ReadBasicType(is, binary, &tmp_address);
-    // Check out how we compute the relative address in ConstArpaLm::Write().
-    overflow_buffer_[i] =
-        (tmp_address == 0) ? NULL : lm_states_ + tmp_address - 1;
+    ReadBasicType(is, binary, &overflow_buffer[i]);
   }
+  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+  Check();
+  initialized_ = true;
+}
+
+void ConstArpaLm::ReadMapped(const std::string &rxfilename) {
+  KALDI_ASSERT(!initialized_);
+  if (!mapped_file_.Open(rxfilename))
+    KALDI_ERR << "Could not read ConstArpaLm from " << rxfilename;
+  const char *data = mapped_file_.Data();
+  size_t size = mapped_file_.Size();
+  // The binary-mode header and the token; see ConstArpaLmHeader.
+  const char prefix[] = "\0B<ConstArpaLm> ";
+  const size_t prefix_size = sizeof(prefix) - 1;
+  if (size < prefix_size + sizeof(ConstArpaLmHeader) ||
+      std::memcmp(data, prefix, prefix_size) != 0) {
+    // The older format, which cannot be used in place.
+    KALDI_WARN << "ConstArpaLm " << rxfilename << " is in an older format, "
+               << "so it cannot be memory-mapped; reading it into memory. "
+               << "Re-create it with arpa-to-const-arpa to avoid this.";
+    bool binary;
+    if (ClassifyRxfilename(rxfilename) == kFileInput) {
+      // Unmap it and read the file again, so that we never hold both the
+      // mapping and the LM.
+      mapped_file_.Close();
+      Input ki(rxfilename, &binary);
+      Read(ki.Stream(), binary);
+    } else {
+      // A pipe cannot be read again, so we read the LM from the data we
+      // already have, without copying it.
+      MemoryInputBuffer buffer(data, size);
+      std::istream is(&buffer);
+      if (!InitKaldiInputStream(is, &binary))
+        KALDI_ERR << "Could not read ConstArpaLm from " << rxfilename;
+      Read(is, binary);
+      mapped_file_.Close();
+    }
+    return;
+  }
+  const ConstArpaLmHeader *header =
+      reinterpret_cast<const ConstArpaLmHeader*>(data + prefix_size);
+  if (header->version != kConstArpaLmVersion) {
+    KALDI_ERR << "ConstArpaLm " << rxfilename << " has version "
+              << header->version << ", expected " << kConstArpaLmVersion
+              << " (or it was written on a machine with different byte "
+              << "order).";
+  }
+  if (header->num_words < 0 || header->overflow_buffer_size < 0 ||
+      header->lm_states_size < 0 ||
+      prefix_size + sizeof(ConstArpaLmHeader) +
+      sizeof(int64) * (static_cast<size_t>(header->num_words) +
+                       header->overflow_buffer_size) +
+      sizeof(int32) * static_cast<size_t>(header->lm_states_size) != size) {
+    KALDI_ERR << "ConstArpaLm " << rxfilename << " has size " << size
+              << ", which does not match its header; it is corrupted.";
+  }
+  bos_symbol_ = header->bos_symbol;
+  eos_symbol_ = header->eos_symbol;
+  unk_symbol_ = header->unk_symbol;
+  ngram_order_ = header->ngram_order;
+  num_words_ = header->num_words;
+  overflow_buffer_size_ = header->overflow_buffer_size;
+  lm_states_size_ = header->lm_states_size;
+  // MappedFile gives us 8-byte aligned data, and the header ends at byte 48, so
+  // the arrays are aligned.
+  unigram_states_ = reinterpret_cast<const int64*>(header + 1);
+  overflow_buffer_ = unigram_states_ + num_words_;
+  lm_states_ = reinterpret_cast<const int32*>(overflow_buffer_ +
+                                              overflow_buffer_size_);
+  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+  memory_assigned_ = false;
+  Check();
+  initialized_ = true;
+}
+
+void ConstArpaLm::Check() const {
   KALDI_ASSERT(ngram_order_ > 0);
   KALDI_ASSERT(bos_symbol_ < num_words_ && bos_symbol_ > 0);
   KALDI_ASSERT(eos_symbol_ < num_words_ && eos_symbol_ > 0);
   KALDI_ASSERT(unk_symbol_ < num_words_ &&
                (unk_symbol_ > 0 || unk_symbol_ == -1));
-  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
-  memory_assigned_ = true;
-  initialized_ = true;;
+  // Every LmState takes at least 3 entries, so a valid offset (plus one) is at
+  // most <lm_states_size_> - 2. The LmStates themselves are checked as we
+  // visit them.
+  for (int32 i = 0; i < num_words_; ++i) {
+    if (unigram_states_[i] < 0 || unigram_states_[i] > lm_states_size_ - 2)
+      KALDI_ERR << "Bad unigram offset in ConstArpaLm; it is corrupted.";
+  }
+  for (int32 i = 0; i < overflow_buffer_size_; ++i) {
+    if (overflow_buffer_[i] <= 0 || overflow_buffer_[i] > lm_states_size_ - 2)
+      KALDI_ERR << "Bad overflow offset in ConstArpaLm; it is corrupted.";
+  }
+}
+
+bool ConstArpaLm::GetChild(const int32 lm_state, const int32 word,
+                           float* logprob, int32* child_lm_state) const {
+  KALDI_ASSERT(initialized_);
+  KALDI_ASSERT(lm_state >= 0 && lm_state + 2 <= lm_states_size_ - 1);
+  const int32* parent = lm_states_ + lm_state;
+  int32 child_info;
+  if (!GetChildInfo(word, parent, &child_info)) return false;
+  const int32* child = NULL;
+  DecodeChildInfo(child_info, parent, &child, logprob);
+  *child_lm_state = (child == NULL ? -1 : static_cast<int32>(child - lm_states_));
+  return true;
 }
 
 bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
@@ -740,7 +881,7 @@ bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
   }
 
   // Tries to locate the LmState of the given word sequence.
-  int32* lm_state = GetLmState(hist);
+  const int32* lm_state = GetLmState(hist);
   if (lm_state == NULL) {
     // <lm_state> does not exist means <hist> has no child.
     return false;
@@ -778,13 +919,12 @@ float ConstArpaLm::GetNgramLogprob(const int32 word,
   int32 mapped_word = word;
   if (unk_symbol_ != -1) {
     KALDI_ASSERT(mapped_word >= 0);
-    if (mapped_word >= num_words_ || unigram_states_[mapped_word] == NULL) {
+    if (GetUnigramState(mapped_word) == NULL) {
       mapped_word = unk_symbol_;
     }
     for (int32 i = 0; i < mapped_hist.size(); ++i) {
       KALDI_ASSERT(mapped_hist[i] >= 0);
-      if (mapped_hist[i] >= num_words_ ||
-          unigram_states_[mapped_hist[i]] == NULL) {
+      if (GetUnigramState(mapped_hist[i]) == NULL) {
         mapped_hist[i] = unk_symbol_;
       }
     }
@@ -801,28 +941,29 @@ float ConstArpaLm::GetNgramLogprobRecurse(
 
   // Unigram case.
   if (hist.size() == 0) {
-    if (word >= num_words_ || unigram_states_[word] == NULL) {
+    const int32* unigram_state = GetUnigramState(word);
+    if (unigram_state == NULL) {
       // If <unk> is defined, then the word sequence should have already been
       // mapped to <unk> is necessary; this is for the case where <unk> is not
       // defined.
       return std::numeric_limits<float>::min();
     } else {
-      return *reinterpret_cast<float*>(unigram_states_[word]);
+      return *reinterpret_cast<const float*>(unigram_state);
     }
   }
 
   // High n-gram orders.
   float logprob = 0.0;
   float backoff_logprob = 0.0;
-  int32* state;
+  const int32* state;
   if ((state = GetLmState(hist)) != NULL) {
     int32 child_info;
-    int32* child_lm_state = NULL;
+    const int32* child_lm_state = NULL;
     if (GetChildInfo(word, state, &child_info)) {
       DecodeChildInfo(child_info, state, &child_lm_state, &logprob);
       return logprob;
     } else {
-      backoff_logprob = *reinterpret_cast<float*>(state + 1);
+      backoff_logprob = *reinterpret_cast<const float*>(state + 1);
     }
   }
   std::vector<int32> new_hist(hist);
@@ -830,7 +971,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
   return backoff_logprob + GetNgramLogprobRecurse(word, new_hist);
 }
 
-int32* ConstArpaLm::GetLmState(const std::vector<int32>& seq) const {
+const int32* ConstArpaLm::GetLmState(const std::vector<int32>& seq) const {
   KALDI_ASSERT(initialized_);
 
   // No LmState exists for empty word sequence.
@@ -838,11 +979,11 @@ int32* ConstArpaLm::GetLmState(const std::vector<int32>& seq) const {
 
   // If <unk> is defined, then the word sequence should have already been mapped
   // to <unk> is necessary; this is for the case where <unk> is not defined.
-  if (seq[0] >= num_words_ || unigram_states_[seq[0]] == NULL) return NULL;
-  int32* parent = unigram_states_[seq[0]];
+  const int32* parent = GetUnigramState(seq[0]);
+  if (parent == NULL) return NULL;
 
   int32 child_info;
-  int32* child_lm_state = NULL;
+  const int32* child_lm_state = NULL;
   float logprob;
   for (int32 i = 1; i < seq.size(); ++i) {
     if (!GetChildInfo(seq[i], parent, &child_info)) {
@@ -859,7 +1000,8 @@ int32* ConstArpaLm::GetLmState(const std::vector<int32>& seq) const {
 }
 
 bool ConstArpaLm::GetChildInfo(const int32 word,
-                               int32* parent, int32* child_info) const {
+                               const int32* parent,
+                               int32* child_info) const {
   KALDI_ASSERT(initialized_);
 
   KALDI_ASSERT(parent != NULL);
@@ -892,8 +1034,8 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
 }
 
 void ConstArpaLm::DecodeChildInfo(const int32 child_info,
-                                  int32* parent,
-                                  int32** child_lm_state,
+                                  const int32* parent,
+                                  const int32** child_lm_state,
                                   float* logprob) const {
   KALDI_ASSERT(initialized_);
 
@@ -907,18 +1049,18 @@ void ConstArpaLm::DecodeChildInfo(const int32 child_info,
     int32 child_offset = child_info / 2;
     if (child_offset > 0) {
       *child_lm_state = parent + child_offset;
-      *logprob = *reinterpret_cast<float*>(*child_lm_state);
+      *logprob = *reinterpret_cast<const float*>(*child_lm_state);
     } else {
       KALDI_ASSERT(-child_offset < overflow_buffer_size_);
-      *child_lm_state = overflow_buffer_[-child_offset];
-      *logprob = *reinterpret_cast<float*>(*child_lm_state);
+      *child_lm_state = lm_states_ + overflow_buffer_[-child_offset] - 1;
+      *logprob = *reinterpret_cast<const float*>(*child_lm_state);
     }
     KALDI_ASSERT(*child_lm_state >= lm_states_);
     KALDI_ASSERT(*child_lm_state <= lm_states_end_);
   }
 }
 
-void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
+void ConstArpaLm::WriteArpaRecurse(const int32* lm_state,
                                    const std::vector<int32>& seq,
                                    std::vector<ArpaLine> *output) const {
   if (lm_state == NULL) return;
@@ -929,8 +1071,8 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
   // Inserts the current LmState to <output>.
   ArpaLine arpa_line;
   arpa_line.words = seq;
-  arpa_line.logprob = *reinterpret_cast<float*>(lm_state);
-  arpa_line.backoff_logprob = *reinterpret_cast<float*>(lm_state + 1);
+  arpa_line.logprob = *reinterpret_cast<const float*>(lm_state);
+  arpa_line.backoff_logprob = *reinterpret_cast<const float*>(lm_state + 1);
   output->push_back(arpa_line);
 
   // Scans for possible children, and recursively adds child to <output>.
@@ -941,7 +1083,7 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
     new_seq.push_back(*(lm_state + 3 + 2 * i));
     int32 child_info = *(lm_state + 4 + 2 * i);
     float logprob;
-    int32* child_lm_state = NULL;
+    const int32* child_lm_state = NULL;
     DecodeChildInfo(child_info, lm_state, &child_lm_state, &logprob);
 
     if (child_lm_state == NULL) {
@@ -962,9 +1104,10 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
 
   std::vector<ArpaLine> tmp_output;
   for (int32 i = 0; i < num_words_; ++i) {
-    if (unigram_states_[i] != NULL) {
+    const int32* unigram_state = GetUnigramState(i);
+    if (unigram_state != NULL) {
       std::vector<int32> seq(1, i);
-      WriteArpaRecurse(unigram_states_[i], seq, &tmp_output);
+      WriteArpaRecurse(unigram_state, seq, &tmp_output);
     }
   }
 
@@ -1019,66 +1162,192 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
 }
 
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
-  // Creates a history state for <s>.
-  std::vector<Label> bos_state(1, lm_.BosSymbol());
-  state_to_wseq_.push_back(bos_state);
-  wseq_to_state_[bos_state] = 0;
+    const ConstArpaLm& lm) : lm_(lm), max_history_(lm.NgramOrder() - 1),
+                             num_states_(0) {
+  // Creates a history state for <s>. We do not check if it has children, since
+  // it is the start state anyway.
+  next_lm_states_.resize(max_history_ + 1, -1);
+  int32 key = -1;
+  if (max_history_ > 0)
+    key = next_lm_states_[0] = lm_.UnigramLmState(lm_.BosSymbol());
+  state_lm_states_.insert(state_lm_states_.end(), next_lm_states_.begin(),
+                          next_lm_states_.begin() + max_history_);
+  num_states_ = 1;
   start_state_ = 0;
+  lm_state_to_state_[key] = start_state_;
+}
+
+bool ConstArpaLmDeterministicFst::GetLogprob(const int32* lm_states,
+                                             Label word, float* logprob,
+                                             int32* next_lm_states) const {
+  // Maps possible out-of-vocabulary words to <unk>, as
+  // ConstArpaLm::GetNgramLogprob() does.
+  int32 unigram_lm_state = lm_.UnigramLmState(word);
+  Label mapped_word = word;
+  if (unigram_lm_state == -1 && lm_.UnkSymbol() != -1) {
+    mapped_word = lm_.UnkSymbol();
+    unigram_lm_state = lm_.UnigramLmState(mapped_word);
+  }
+  // If <word> was mapped to <unk>, the next history is empty, since <word>
+  // itself has no LmState.
+  bool get_next = (next_lm_states != NULL && mapped_word == word);
+  if (next_lm_states != NULL) {
+    for (int32 j = 0; j < max_history_; j++)
+      next_lm_states[j] = -1;
+    if (get_next && max_history_ > 0)
+      next_lm_states[0] = unigram_lm_state;
+  }
+
+  // Searches the children of the LmStates of the history, starting from the
+  // longest. The first one that has <word> gives us the log probability; we
+  // carry on after that only for the LmStates of the next history.
+  int32 found_length = -1;
+  float found_logprob = 0.0;
+  for (int32 j = max_history_; j >= 1; j--) {
+    int32 lm_state = lm_states[j - 1];
+    if (lm_state == -1) continue;
+    if (found_length != -1 && !get_next) break;
+    float child_logprob;
+    int32 child_lm_state;
+    if (lm_.GetChild(lm_state, mapped_word, &child_logprob, &child_lm_state)) {
+      if (found_length == -1) {
+        found_length = j;
+        found_logprob = child_logprob;
+      }
+      if (get_next && j < max_history_)
+        next_lm_states[j] = child_lm_state;
+    }
+  }
+  if (found_length == -1) {
+    found_length = 0;
+    // If <unk> is defined, the word should have already been mapped to <unk>
+    // if necessary; this is for the case where <unk> is not defined.
+    found_logprob = (unigram_lm_state == -1 ?
+                     std::numeric_limits<float>::min() :
+                     lm_.Logprob(unigram_lm_state));
+  }
+  // Adds the backoff log probabilities of the histories that did not have the
+  // word, in the same order as ConstArpaLm::GetNgramLogprobRecurse() does.
+  float ans = found_logprob;
+  for (int32 j = found_length + 1; j <= max_history_; j++) {
+    if (lm_states[j - 1] != -1)
+      ans = lm_.BackoffLogprob(lm_states[j - 1]) + ans;
+  }
+  *logprob = ans;
+  return (ans != std::numeric_limits<float>::min());
+}
+
+ConstArpaLmDeterministicFst::StateId ConstArpaLmDeterministicFst::FindState(
+    int32* lm_states) {
+  // Shortens the history until it is a history state, i.e. its LmState has
+  // children; the empty history always is.
+  int32 j = max_history_;
+  for (; j >= 1; j--) {
+    if (lm_states[j - 1] != -1 && lm_.NumChildren(lm_states[j - 1]) > 0)
+      break;
+    lm_states[j - 1] = -1;
+  }
+  int32 key = (j == 0 ? -1 : lm_states[j - 1]);
+
+  // Attemps to insert the state. If it already exists then it returns false.
+  typedef unordered_map<int32, StateId>::iterator IterType;
+  std::pair<IterType, bool> result = lm_state_to_state_.insert(
+      std::make_pair(key, static_cast<StateId>(num_states_)));
+  if (result.second) {
+    state_lm_states_.insert(state_lm_states_.end(), lm_states,
+                            lm_states + max_history_);
+    num_states_++;
+  }
+  return result.first->second;
 }
 
 fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  const std::vector<Label>& wseq = state_to_wseq_[s];
-  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+  float logprob;
+  GetLogprob(StateLmStates(s), lm_.EosSymbol(), &logprob, NULL);
   return Weight(-logprob);
 }
 
 bool ConstArpaLmDeterministicFst::GetArc(StateId s,
                                          Label ilabel, fst::StdArc *oarc) {
   // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  std::vector<Label> wseq = state_to_wseq_[s];
-
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
-  if (logprob == std::numeric_limits<float>::min()) {
+  float logprob;
+  if (!GetLogprob(StateLmStates(s), ilabel, &logprob,
+                  &(next_lm_states_[0]))) {
     return false;
   }
 
-  // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
-  // taken care of in ConstArpaLm.
-  wseq.push_back(ilabel);
-  while (wseq.size() >= lm_.NgramOrder()) {
-    // History state has at most lm_.NgramOrder() -1 words in the state.
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-  while (!lm_.HistoryStateExists(wseq)) {
-    KALDI_ASSERT(wseq.size() > 0);
-    wseq.erase(wseq.begin(), wseq.begin() + 1);
-  }
-
-  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
-      wseq, static_cast<Label>(state_to_wseq_.size()));
-
-  // Attemps to insert the current <wseq_state_pair>. If the pair already exists
-  // then it returns false.
-  typedef MapType::iterator IterType;
-  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
-
-  // If the pair was just inserted, then also add it to <state_to_wseq_>.
-  if (result.second == true)
-    state_to_wseq_.push_back(wseq);
-
   // Creates the arc.
   oarc->ilabel = ilabel;
   oarc->olabel = ilabel;
-  oarc->nextstate = result.first->second;
+  oarc->nextstate = FindState(&(next_lm_states_[0]));
   oarc->weight = Weight(-logprob);
-
   return true;
 }
 
+void ConstArpaLmDeterministicFst::Prefetch(StateId s, int32 stage) const {
+  // The longest history is the one that we search first.
+  const int32* lm_states = StateLmStates(s);
+  for (int32 j = max_history_; j >= 1; j--) {
+    if (lm_states[j - 1] != -1) {
+      if (stage == 0)
+        lm_.PrefetchLmState(lm_states[j - 1]);
+      else
+        lm_.PrefetchChildren(lm_states[j - 1]);
+      return;
+    }
+  }
+}
+
+void ConstArpaLmDeterministicFst::GetArcs(
+    const std::vector<std::pair<StateId, Label> > &queries,
+    std::vector<fst::StdArc> *oarcs) {
+  // We prefetch the LmState of the history of query i + kPrefetchDistance, and
+  // the middle of its children when we get to query i + kPrefetchDistance / 2,
+  // by which time we should have the number of children.
+  const size_t kPrefetchDistance = 8;
+  size_t num_queries = queries.size(), stride = max_history_ + 1;
+  oarcs->resize(num_queries);
+  next_lm_states_.resize(std::max<size_t>(num_queries, 1) * stride);
+  for (size_t i = 0; i < std::min(num_queries, kPrefetchDistance); i++)
+    Prefetch(queries[i].first, 0);
+  for (size_t i = 0; i < std::min(num_queries, kPrefetchDistance / 2); i++)
+    Prefetch(queries[i].first, 1);
+
+  // First pass: computes the log probabilities and the LmStates of the next
+  // states, and prefetches those LmStates, which FindState() will need.
+  for (size_t i = 0; i < num_queries; i++) {
+    if (i + kPrefetchDistance < num_queries)
+      Prefetch(queries[i + kPrefetchDistance].first, 0);
+    if (i + kPrefetchDistance / 2 < num_queries)
+      Prefetch(queries[i + kPrefetchDistance / 2].first, 1);
+    fst::StdArc &oarc = (*oarcs)[i];
+    int32* next_lm_states = &(next_lm_states_[i * stride]);
+    float logprob;
+    oarc.ilabel = oarc.olabel = queries[i].second;
+    if (GetLogprob(StateLmStates(queries[i].first), queries[i].second,
+                   &logprob, next_lm_states)) {
+      oarc.weight = Weight(-logprob);
+      oarc.nextstate = 0;  // set in the second pass.
+      for (int32 j = max_history_; j >= 1; j--) {
+        if (next_lm_states[j - 1] != -1) {
+          lm_.PrefetchLmState(next_lm_states[j - 1]);
+          break;
+        }
+      }
+    } else {
+      oarc.nextstate = fst::kNoStateId;
+    }
+  }
+
+  // Second pass: finds or creates the next states.
+  for (size_t i = 0; i < num_queries; i++) {
+    fst::StdArc &oarc = (*oarcs)[i];
+    if (oarc.nextstate != fst::kNoStateId)
+      oarc.nextstate = FindState(&(next_lm_states_[i * stride]));
+  }
+}
+
 bool BuildConstArpaLm(const bool natural_base, const int32 bos_symbol,
                       const int32 eos_symbol, const int32 unk_symbol,
                       const std::string& arpa_rxfilename,
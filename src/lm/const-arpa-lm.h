@@ -23,12 +23,20 @@
 #include "base/kaldi-common.h"
 #include "fstext/deterministic-fst.h"
 #include "util/common-utils.h"
+#include "util/mapped-file.h"
 
 namespace kaldi {
 
 // Forward declaration of Auxiliary struct ArpaLine.
 struct ArpaLine;
 
+// Prefetches the cache line containing <address>, if the compiler lets us.
+inline void ConstArpaLmPrefetch(const void* address) {
+#if defined(__GNUC__)
+  __builtin_prefetch(address);
+#endif
+}
+
 class ConstArpaLm {
  public:
 
@@ -43,12 +51,14 @@ class ConstArpaLm {
   }
 
   // Special constructor, will be used when you initialize ConstArpaLm from
-  // scratch through this constructor.
+  // scratch through this constructor. <unigram_states> and <overflow_buffer>
+  // contain offsets into <lm_states>, in the format described below for
+  // <unigram_states_>. The arrays are not owned by this object.
   ConstArpaLm(const int32 bos_symbol, const int32 eos_symbol,
               const int32 unk_symbol, const int32 ngram_order,
               const int32 num_words, const int32 overflow_buffer_size,
-              const int32 lm_states_size, int32** unigram_states,
-              int32** overflow_buffer, int32* lm_states) :
+              const int32 lm_states_size, const int64* unigram_states,
+              const int64* overflow_buffer, const int32* lm_states) :
       bos_symbol_(bos_symbol), eos_symbol_(eos_symbol),
       unk_symbol_(unk_symbol), ngram_order_(ngram_order),
       num_words_(num_words), overflow_buffer_size_(overflow_buffer_size),
@@ -75,12 +85,25 @@ class ConstArpaLm {
     }
   }
 
-  // Reads the ConstArpaLm format language model.
+  // Reads the ConstArpaLm format language model. Both the current format and
+  // the older format (in which every integer was written with WriteBasicType())
+  // can be read; either way the language model is copied into memory.
   void Read(std::istream &is, bool binary);
 
-  // Writes the language model in ConstArpaLm format.
+  // Writes the language model in ConstArpaLm format. The arrays are written
+  // as they are in memory, so that ReadMapped() can use them in place.
   void Write(std::ostream &os, bool binary) const;
 
+  // Loads the language model from <rxfilename>, which should have been written
+  // by Write() (e.g. by arpa-to-const-arpa). If it is an ordinary file in the
+  // current format, the file is memory-mapped and the language model is used
+  // in place: nothing is copied, only the pages that are actually visited are
+  // read from disk, and processes on the same machine that load the same file
+  // share one copy of it in the page cache. Pipes are read into memory first;
+  // files in the older format are read into memory like Read(). Throws on
+  // error.
+  void ReadMapped(const std::string &rxfilename);
+
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
   void WriteArpa(std::ostream &os) const;
@@ -98,6 +121,59 @@ class ConstArpaLm {
   int32 UnkSymbol() const { return unk_symbol_; }
   int32 NgramOrder() const { return ngram_order_; }
 
+  // The functions below give access to individual LmStates, for code that
+  // keeps track of history states itself instead of looking up the whole
+  // history for every query (see ConstArpaLmDeterministicFst). An LmState is
+  // identified by its offset in <lm_states_>; each one corresponds to a single
+  // word sequence. -1 means "no LmState".
+
+  // Returns the LmState of the unigram <word>, or -1 if there is none.
+  int32 UnigramLmState(const int32 word) const {
+    KALDI_ASSERT(initialized_ && word >= 0);
+    const int32* lm_state = GetUnigramState(word);
+    return (lm_state == NULL ? -1 : static_cast<int32>(lm_state - lm_states_));
+  }
+
+  // Looks up <word> among the children of <lm_state>, i.e. looks up the n-gram
+  // formed by the word sequence of <lm_state> followed by <word>, without
+  // backing off. If it exists, returns true, sets <logprob> to its log
+  // probability and <child_lm_state> to its LmState (-1 if it has none, which
+  // happens for n-grams of the highest order and for other n-grams that are
+  // not a history).
+  bool GetChild(const int32 lm_state, const int32 word,
+                float* logprob, int32* child_lm_state) const;
+
+  // Returns the log probability of the word sequence of <lm_state>.
+  float Logprob(const int32 lm_state) const {
+    return *reinterpret_cast<const float*>(lm_states_ + lm_state);
+  }
+
+  // Returns the backoff log probability of the word sequence of <lm_state>.
+  float BackoffLogprob(const int32 lm_state) const {
+    return *reinterpret_cast<const float*>(lm_states_ + lm_state + 1);
+  }
+
+  // Returns the number of children of <lm_state>; if it is zero, the word
+  // sequence is not a history state of the language model.
+  int32 NumChildren(const int32 lm_state) const {
+    return lm_states_[lm_state + 2];
+  }
+
+  // Hints to the CPU that <lm_state> will be accessed soon. Call this some
+  // time before NumChildren(), BackoffLogprob() or GetChild() on it, so that the
+  // memory accesses of several lookups overlap.
+  void PrefetchLmState(const int32 lm_state) const {
+    ConstArpaLmPrefetch(lm_states_ + lm_state);
+  }
+
+  // Like PrefetchLmState(), but for the middle of the children of <lm_state>,
+  // where GetChild() starts its binary search. This reads the number of
+  // children, so it should be called some time after PrefetchLmState().
+  void PrefetchChildren(const int32 lm_state) const {
+    ConstArpaLmPrefetch(lm_states_ + lm_state + 1 +
+                        2 * ((NumChildren(lm_state) + 1) / 2));
+  }
+
  private:
   // Loops up n-gram probability for given word sequence. Backoff is handled by
   // recursively calling this function. 
@@ -110,7 +186,13 @@ class ConstArpaLm {
   // If the word sequence exists in n-gram language model, but it is a leaf and
   // is not an unigram, we still return NULL, since there is no LmState struct
   // reserved for this sequence. 
-  int32* GetLmState(const std::vector<int32>& seq) const;
+  const int32* GetLmState(const std::vector<int32>& seq) const;
+
+  // Returns the LmState of the unigram <word>, or NULL if there is none.
+  const int32* GetUnigramState(const int32 word) const {
+    if (word >= num_words_ || unigram_states_[word] == 0) return NULL;
+    return lm_states_ + unigram_states_[word] - 1;
+  }
 
   // Given a pointer to the parent, find the child_info that corresponds to
   // given word. The parent has the following structure:
@@ -121,17 +203,25 @@ class ConstArpaLm {
   //   std::pair<int32, int32> [] children;
   // }
   // It returns false if the child is not found.
-  bool GetChildInfo(const int32 word, int32* parent, int32* child_info) const;
+  bool GetChildInfo(const int32 word, const int32* parent,
+                    int32* child_info) const;
 
   // Decodes <child_info> to get log probability and child LmState. In the leaf
   // case, only <logprob> will be returned, and <child_address> will be NULL.
-  void DecodeChildInfo(const int32 child_info, int32* parent,
-                       int32** child_lm_state, float* logprob) const;
+  void DecodeChildInfo(const int32 child_info, const int32* parent,
+                       const int32** child_lm_state, float* logprob) const;
 
-  void WriteArpaRecurse(int32* lm_state,
+  void WriteArpaRecurse(const int32* lm_state,
                         const std::vector<int32>& seq,
                         std::vector<ArpaLine> *output) const;
 
+  // Reads the older format, written before the arrays were written as they are
+  // in memory; called from Read().
+  void ReadOldFormat(std::istream &is, bool binary);
+
+  // Checks the sizes and the offsets after loading.
+  void Check() const;
+
   // We assign memory in Read(). If it is called, we have to release memory in
   // the destructor.
   bool memory_assigned_;
@@ -165,18 +255,21 @@ class ConstArpaLm {
 
   // Points to the end of <lm_states_>. We use this information to check if
   // there is any illegal visit to the un-reserved memory.
-  int32* lm_states_end_;
+  const int32* lm_states_end_;
 
-  // Loopup table for pointers of unigrams. The pointer could be NULL, for
-  // example for those words that are in words.txt, but not in the language
-  // model.
-  int32** unigram_states_;
+  // Loopup table for the unigram LmStates. We store offsets rather than
+  // pointers so that the table can be used in place when the file is
+  // memory-mapped: an entry is zero if there is no LmState (for example for
+  // those words that are in words.txt, but not in the language model), and
+  // otherwise the offset of the LmState in <lm_states_> plus one.
+  const int64* unigram_states_;
 
   // Technically a 32-bit number cannot represent a possibly 64-bit pointer. We
   // therefore use "relative" address instead of "absolute" address, which will
   // be a small number most of the time. This buffer is for the case where the
-  // relative address has more than 30-bits.
-  int32** overflow_buffer_;
+  // relative address has more than 30-bits; its entries are offsets in the
+  // same format as <unigram_states_>.
+  const int64* overflow_buffer_;
 
   // Memory chunk that contains the actual LmStates. One LmState has the
   // following structure:
@@ -192,12 +285,25 @@ class ConstArpaLm {
   // bytes, therefore one LmState will occupy the following number of bytes:
   //
   // x = 1 + 1 + 1 + 2 * children.size() = 3 + 2 * children.size() 
-  int32* lm_states_;
+  const int32* lm_states_;
+
+  // The memory-mapped file, if the language model was loaded by ReadMapped();
+  // in that case the arrays above point into it.
+  MappedFile mapped_file_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ConstArpaLm);
 };
 
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
  in DeterministicOnDemandFst.
+
+ Each state corresponds to a history state of the language model, and we keep
+ the LmStates of all the suffixes of its history, so that a lookup only has to
+ search for the word among the children of those LmStates (backing off from the
+ longest to the shortest) instead of first finding the history from scratch.
+ The LmStates of the next state are found during the same search. States are
+ looked up by the LmState of their history, which is a single integer.
  */
 class ConstArpaLmDeterministicFst :
     public fst::DeterministicOnDemandFst<fst::StdArc> {
@@ -218,13 +324,59 @@ class ConstArpaLmDeterministicFst :
 
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
+  // Does the lookups of many arcs at once. We prefetch the LmStates that the
+  // lookups a few queries ahead will need, and we find all the next LmStates
+  // (prefetching them too) before we create or look up any of the next states,
+  // so the cache misses of different lookups overlap.
+  virtual void GetArcs(const std::vector<std::pair<StateId, Label> > &queries,
+                       std::vector<fst::StdArc> *oarcs);
+
  private:
-  typedef unordered_map<std::vector<Label>,
-                        StateId, VectorHasher<Label> > MapType;
-  StateId start_state_;
-  MapType wseq_to_state_;
-  std::vector<std::vector<Label> > state_to_wseq_;
+  // Returns the LmStates of the history of state <s>; see <state_lm_states_>.
+  const int32* StateLmStates(StateId s) const {
+    KALDI_ASSERT(static_cast<size_t>(s) < num_states_);
+    return (max_history_ == 0 ? NULL : &(state_lm_states_[s * max_history_]));
+  }
+
+  // Computes the log probability of <word> given the history whose LmStates
+  // are <lm_states> (in the format of <state_lm_states_>), following backoff
+  // as necessary. Returns false if the word is not in the language model and
+  // there is no <unk>. If <next_lm_states> is not NULL, also sets it to the
+  // LmStates of the history followed by <word>, before the history is
+  // shortened to a history state.
+  bool GetLogprob(const int32* lm_states, Label word, float* logprob,
+                  int32* next_lm_states) const;
+
+  // Returns the state whose history has the LmStates <lm_states>, after
+  // removing the LmStates for the histories that are longer than the longest
+  // history state. Creates the state if it does not exist yet.
+  StateId FindState(int32* lm_states);
+
+  // Starts prefetching what GetArc() will need for state <s> (stage 0) or,
+  // some time after that, for the children of its longest history (stage 1).
+  void Prefetch(StateId s, int32 stage) const;
+
   const ConstArpaLm& lm_;
+
+  // The maximum history length, lm_.NgramOrder() - 1.
+  int32 max_history_;
+
+  // For state s, elements [s * max_history_, (s + 1) * max_history_) are the
+  // LmStates of the suffixes of its history: element (j - 1) corresponds to
+  // the suffix of length j, and is -1 if the history is shorter than j or that
+  // suffix has no LmState.
+  std::vector<int32> state_lm_states_;
+  size_t num_states_;
+
+  // Maps the LmState of the history of each state (-1 for the empty history)
+  // to the state.
+  unordered_map<int32, StateId> lm_state_to_state_;
+
+  StateId start_state_;
+
+  // Temporary storage for the LmStates of the next state(s), with stride
+  // max_history_ + 1 in GetArcs().
+  std::vector<int32> next_lm_states_;
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
@@ -26,9 +26,13 @@
  */
 
 #include <iostream>
+#include <limits>
+#include <map>
+#include <set>
 #include <string>
 #include <sstream>
 #include "lm/kaldi-lm.h"
+#include "lm/const-arpa-lm.h"
 
 namespace kaldi {
 
@@ -298,6 +302,225 @@ bool TestLmTableEvalScore(const string &inpfile,
   return success;
 }
 
+// Builds a ConstArpaLm from a small Arpa language model with integer words,
+// and checks that reading it into memory, reading it through a memory-mapped
+// file and reading it in the older format all give the same language model.
+bool TestConstArpaLmRead() {
+  {
+    Output ko("tmp.arpa", false, false);
+    ko.Stream() << "\n\\data\\\nngram 1=6\nngram 2=5\nngram 3=2\n\n"
+                << "\\1-grams:\n-1.0\t1\t-0.5\n-99\t2\t-0.3\n-0.8\t3\n"
+                << "-1.2\t4\t-0.2\n-1.1\t5\t-0.25\n-1.5\t6\t-0.1\n\n"
+                << "\\2-grams:\n-0.4\t2 4\t-0.1\n-0.6\t2 5\n-0.7\t4 5\t-0.2\n"
+                << "-0.3\t5 3\n-0.9\t6 3\n\n"
+                << "\\3-grams:\n-0.2\t2 4 5\n-0.1\t4 5 3\n\n\\end\\\n";
+  }
+  // bos = 2, eos = 3, unk = 1.
+  BuildConstArpaLm(false, 2, 3, 1, "tmp.arpa", "tmp.carpa");
+
+  // Re-writes "tmp.carpa" in the older format, in which each integer was
+  // written with WriteBasicType() and the sections came in a different order.
+  {
+    bool binary;
+    Input ki("tmp.carpa", &binary);
+    std::istream &is = ki.Stream();
+    ExpectToken(is, binary, "<ConstArpaLm>");
+    int32 header[8];  // see ConstArpaLmHeader in const-arpa-lm.cc.
+    is.read(reinterpret_cast<char*>(header), sizeof(header));
+    std::vector<int64> unigram_states(header[5]),
+        overflow_buffer(header[6]);
+    std::vector<int32> lm_states(header[7]);
+    is.read(reinterpret_cast<char*>(&(unigram_states[0])),
+            sizeof(int64) * unigram_states.size());
+    if (!overflow_buffer.empty())
+      is.read(reinterpret_cast<char*>(&(overflow_buffer[0])),
+              sizeof(int64) * overflow_buffer.size());
+    is.read(reinterpret_cast<char*>(&(lm_states[0])),
+            sizeof(int32) * lm_states.size());
+    KALDI_ASSERT(is.good());
+    Output ko("tmp.old.carpa", true);
+    std::ostream &os = ko.Stream();
+    for (int32 i = 1; i <= 4; i++)
+      WriteBasicType(os, true, header[i]);
+    WriteBasicType(os, true, header[7]);
+    for (size_t i = 0; i < lm_states.size(); i++)
+      WriteBasicType(os, true, lm_states[i]);
+    WriteBasicType(os, true, header[5]);
+    for (size_t i = 0; i < unigram_states.size(); i++)
+      WriteBasicType(os, true, unigram_states[i]);
+    WriteBasicType(os, true, header[6]);
+    for (size_t i = 0; i < overflow_buffer.size(); i++)
+      WriteBasicType(os, true, overflow_buffer[i]);
+  }
+
+  ConstArpaLm lm_read, lm_mapped, lm_mapped_pipe, lm_old, lm_old_mapped,
+      lm_old_mapped_pipe;
+  ReadKaldiObject("tmp.carpa", &lm_read);
+  lm_mapped.ReadMapped("tmp.carpa");
+  lm_mapped_pipe.ReadMapped("cat tmp.carpa |");
+  ReadKaldiObject("tmp.old.carpa", &lm_old);
+  lm_old_mapped.ReadMapped("tmp.old.carpa");
+  lm_old_mapped_pipe.ReadMapped("cat tmp.old.carpa |");
+  const ConstArpaLm *lms[] = { &lm_read, &lm_mapped, &lm_mapped_pipe,
+                               &lm_old, &lm_old_mapped, &lm_old_mapped_pipe };
+
+  bool success = true;
+  std::ostringstream ref_arpa;
+  lm_read.WriteArpa(ref_arpa);
+  for (int32 i = 0; i < 6; i++) {
+    std::ostringstream arpa;
+    lms[i]->WriteArpa(arpa);
+    if (arpa.str() != ref_arpa.str()) {
+      std::cerr << "ConstArpaLm " << i << " differs after reading.\n";
+      success = false;
+    }
+    // (4 5 3) is a trigram, (2 4 3) backs off twice; 7 is out of vocabulary.
+    std::vector<int32> hist;
+    hist.push_back(4);
+    hist.push_back(5);
+    if (!ApproxEqual(lms[i]->GetNgramLogprob(3, hist), -0.1) ||
+        !lms[i]->HistoryStateExists(hist)) success = false;
+    hist[0] = 2;
+    hist[1] = 4;
+    if (!ApproxEqual(lms[i]->GetNgramLogprob(3, hist),
+                     (-0.1 - 0.2 - 0.8))) success = false;
+    if (!ApproxEqual(lms[i]->GetNgramLogprob(7, hist),
+                     (-0.1 - 0.2 - 1.0))) success = false;
+  }
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  unlink("tmp.old.carpa");
+  return success;
+}
+
+// Writes a random Arpa language model with integer words to <filename>; the
+// words are 1 ... num_words, and the n-grams of order k are formed by extending
+// random n-grams of order k - 1, so not all their suffixes exist.
+static void WriteRandomIntegerArpa(const std::string &filename,
+                                   int32 num_words, int32 order) {
+  std::vector<std::set<std::vector<int32> > > ngrams(order + 1);
+  for (int32 w = 1; w <= num_words; w++)
+    ngrams[1].insert(std::vector<int32>(1, w));
+  for (int32 k = 2; k <= order; k++) {
+    std::vector<std::vector<int32> > hists(ngrams[k - 1].begin(),
+                                           ngrams[k - 1].end());
+    int32 num_ngrams = 2 * hists.size();
+    for (int32 i = 0; i < num_ngrams; i++) {
+      std::vector<int32> ngram(hists[Rand() % hists.size()]);
+      ngram.push_back(1 + Rand() % num_words);
+      ngrams[k].insert(ngram);
+    }
+  }
+  Output ko(filename, false, false);
+  std::ostream &os = ko.Stream();
+  os << "\n\\data\\\n";
+  for (int32 k = 1; k <= order; k++)
+    os << "ngram " << k << "=" << ngrams[k].size() << "\n";
+  for (int32 k = 1; k <= order; k++) {
+    os << "\n\\" << k << "-grams:\n";
+    std::set<std::vector<int32> >::const_iterator iter = ngrams[k].begin();
+    for (; iter != ngrams[k].end(); ++iter) {
+      os << -0.01 * (1 + Rand() % 300) << '\t';
+      for (size_t i = 0; i < iter->size(); i++)
+        os << (i == 0 ? "" : " ") << (*iter)[i];
+      if (k < order && Rand() % 4 != 0)
+        os << '\t' << -0.01 * (Rand() % 100);
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+}
+
+// Checks ConstArpaLmDeterministicFst against lookups of whole word sequences
+// with ConstArpaLm::GetNgramLogprob(), and GetArcs() against GetArc().
+bool TestConstArpaLmDeterministicFst() {
+  bool success = true;
+  for (int32 n = 0; n < 4; n++) {
+    int32 num_words = 10 + Rand() % 30, order = 1 + n % 4,
+        unk_symbol = (n % 2 == 0 ? 3 : -1);
+    WriteRandomIntegerArpa("tmp.arpa", num_words, order);
+    BuildConstArpaLm(false, 1, 2, unk_symbol, "tmp.arpa", "tmp.carpa");
+    ConstArpaLm lm;
+    lm.ReadMapped("tmp.carpa");
+    ConstArpaLmDeterministicFst fst(lm), batch_fst(lm);
+    typedef fst::StdArc::StateId StateId;
+
+    // Random walks; each state of <fst> must always correspond to the same
+    // history, found the way ConstArpaLmDeterministicFst used to do it.
+    std::map<StateId, std::vector<int32> > state_to_hist;
+    for (int32 walk = 0; walk < 50; walk++) {
+      StateId s = fst.Start();
+      std::vector<int32> hist(1, lm.BosSymbol());
+      if (order == 1) hist.clear();  // all states are the same then.
+      state_to_hist[s] = hist;
+      for (int32 t = 0; t < 10; t++) {
+        if (!ApproxEqual(fst.Final(s).Value(),
+                         -lm.GetNgramLogprob(lm.EosSymbol(), hist)))
+          success = false;
+        // Includes words that are not in the language model.
+        int32 word = 1 + Rand() % (num_words + 3);
+        float logprob = lm.GetNgramLogprob(word, hist);
+        fst::StdArc arc;
+        bool matched = fst.GetArc(s, word, &arc);
+        if (matched != (logprob != std::numeric_limits<float>::min())) {
+          success = false;
+          break;
+        }
+        if (!matched) continue;
+        if (!ApproxEqual(arc.weight.Value(), -logprob) ||
+            arc.ilabel != word || arc.olabel != word)
+          success = false;
+        hist.push_back(word);
+        while (hist.size() >= lm.NgramOrder())
+          hist.erase(hist.begin());
+        while (!lm.HistoryStateExists(hist))
+          hist.erase(hist.begin());
+        s = arc.nextstate;
+        if (state_to_hist.count(s) != 0 && state_to_hist[s] != hist)
+          success = false;
+        state_to_hist[s] = hist;
+      }
+    }
+    if (!success) {
+      std::cerr << "ConstArpaLmDeterministicFst gave wrong arcs.\n";
+      break;
+    }
+
+    // Batches of random queries for the states created so far; <batch_fst>
+    // should create exactly the same states as <single_fst>.
+    ConstArpaLmDeterministicFst single_fst(lm);
+    StateId num_states = 1;
+    for (int32 b = 0; b < 20; b++) {
+      std::vector<std::pair<StateId, int32> > queries;
+      int32 num_queries = Rand() % 40;
+      for (int32 i = 0; i < num_queries; i++)
+        queries.push_back(std::make_pair(Rand() % num_states,
+                                         1 + Rand() % (num_words + 3)));
+      std::vector<fst::StdArc> arcs;
+      batch_fst.GetArcs(queries, &arcs);
+      if (arcs.size() != queries.size()) success = false;
+      for (int32 i = 0; i < num_queries && success; i++) {
+        fst::StdArc arc;
+        if (!single_fst.GetArc(queries[i].first, queries[i].second, &arc))
+          arc.nextstate = fst::kNoStateId;
+        if (arc.nextstate != arcs[i].nextstate ||
+            (arc.nextstate != fst::kNoStateId &&
+             (arc.weight.Value() != arcs[i].weight.Value() ||
+              arc.ilabel != arcs[i].ilabel))) success = false;
+        num_states = std::max(num_states, arc.nextstate + 1);
+      }
+    }
+    if (!success) {
+      std::cerr << "ConstArpaLmDeterministicFst::GetArcs() differs from "
+                << "GetArc().\n";
+      break;
+    }
+  }
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  return success;
+}
+
 }  // end namespace kaldi
 
 int main(int argc, char *argv[]) {
@@ -337,6 +560,12 @@ int main(int argc, char *argv[]) {
                                            refscore.str());
   }
 
+  std::cout << "Testing reading of ConstArpaLm" << '\n';
+  success &= kaldi::TestConstArpaLmRead();
+
+  std::cout << "Testing ConstArpaLmDeterministicFst" << '\n';
+  success &= kaldi::TestConstArpaLmDeterministicFst();
+
   unlink("output.fst");
 
   exit(success ? 0 : 1);
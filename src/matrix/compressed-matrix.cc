@@ -21,8 +21,108 @@
 #include "matrix/compressed-matrix.h"
 #include <algorithm>
 
+// SSE2 is part of the baseline for x86-64 (and we compile with -msse2 on
+// 32-bit x86), so we don't need to check for it at run time.
+#if defined(__SSE2__) || defined(_M_X64)
+#define KALDI_COMPRESSED_MATRIX_SSE2 1
+#include <emmintrin.h>
+#endif
+
 namespace kaldi {
 
+namespace {
+
+// The parameters needed to decode the bytes of one column of a compressed
+// matrix in format 1; s0, s1 and s2 are the slopes of the three linear
+// ranges.  See CompressedMatrix::CharToFloat(), which computes the same thing.
+struct ColumnDecodeParams {
+  float p0, p25, p75, s0, s1, s2;
+  ColumnDecodeParams() { }
+  ColumnDecodeParams(float p0_in, float p25_in, float p75_in, float p100_in):
+      p0(p0_in), p25(p25_in), p75(p75_in),
+      s0((p25_in - p0_in) * (1.0f / 64.0f)),
+      s1((p75_in - p25_in) * (1.0f / 128.0f)),
+      s2((p100_in - p75_in) * (1.0f / 63.0f)) { }
+};
+
+inline float DecodeByte(const ColumnDecodeParams &p, unsigned char value) {
+  if (value <= 64)
+    return p.p0 + p.s0 * value;
+  else if (value <= 192)
+    return p.p25 + p.s1 * (value - 64);
+  else
+    return p.p75 + p.s2 * (value - 192);
+}
+
+// Decodes "num_rows" bytes from each of the "num_cols" columns cols[0] ..
+// cols[num_cols - 1] (num_cols <= 4) into a block of a row-major matrix
+// starting at "dest" with row stride "stride".
+template<typename Real>
+void DecodeColumns(const ColumnDecodeParams *params,
+                   const unsigned char *const *cols, int32 num_cols,
+                   int32 num_rows, Real *dest, MatrixIndexT stride) {
+  for (int32 r = 0; r < num_rows; r++, dest += stride)
+    for (int32 c = 0; c < num_cols; c++)
+      dest[c] = DecodeByte(params[c], cols[c][r]);
+}
+
+#ifdef KALDI_COMPRESSED_MATRIX_SSE2
+// Decodes 16 bytes from one column into 4 vectors of 4 floats each, using the
+// same arithmetic as DecodeByte().
+inline void DecodeBytesSse2(const ColumnDecodeParams &p,
+                            const unsigned char *bytes, __m128 *out) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)),
+      lo = _mm_unpacklo_epi8(b, zero), hi = _mm_unpackhi_epi8(b, zero);
+  __m128i w[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                   _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+  const __m128 p0 = _mm_set1_ps(p.p0), p25 = _mm_set1_ps(p.p25),
+      p75 = _mm_set1_ps(p.p75), s0 = _mm_set1_ps(p.s0),
+      s1 = _mm_set1_ps(p.s1), s2 = _mm_set1_ps(p.s2),
+      c64 = _mm_set1_ps(64.0f), c192 = _mm_set1_ps(192.0f);
+  for (int32 k = 0; k < 4; k++) {
+    __m128 v = _mm_cvtepi32_ps(w[k]),
+        f0 = _mm_add_ps(p0, _mm_mul_ps(s0, v)),
+        f1 = _mm_add_ps(p25, _mm_mul_ps(s1, _mm_sub_ps(v, c64))),
+        f2 = _mm_add_ps(p75, _mm_mul_ps(s2, _mm_sub_ps(v, c192))),
+        m1 = _mm_cmpgt_ps(v, c64), m2 = _mm_cmpgt_ps(v, c192),
+        f = _mm_or_ps(_mm_and_ps(m1, f1), _mm_andnot_ps(m1, f0));
+    out[k] = _mm_or_ps(_mm_and_ps(m2, f2), _mm_andnot_ps(m2, f));
+  }
+}
+
+// Specialization for float: for blocks of 4 columns we decode 16 rows of
+// each column at a time and transpose them in registers.
+template<>
+void DecodeColumns(const ColumnDecodeParams *params,
+                   const unsigned char *const *cols, int32 num_cols,
+                   int32 num_rows, float *dest, MatrixIndexT stride) {
+  int32 r = 0;
+  if (num_cols == 4) {
+    for (; r + 16 <= num_rows; r += 16) {
+      __m128 decoded[4][4];  // indexed by [column][group of 4 rows].
+      for (int32 c = 0; c < 4; c++)
+        DecodeBytesSse2(params[c], cols[c] + r, decoded[c]);
+      for (int32 k = 0; k < 4; k++) {
+        __m128 row0 = decoded[0][k], row1 = decoded[1][k],
+            row2 = decoded[2][k], row3 = decoded[3][k];
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+        float *d = dest + (r + 4 * k) * stride;
+        _mm_storeu_ps(d, row0);
+        _mm_storeu_ps(d + stride, row1);
+        _mm_storeu_ps(d + 2 * stride, row2);
+        _mm_storeu_ps(d + 3 * stride, row3);
+      }
+    }
+  }
+  for (; r < num_rows; r++)
+    for (int32 c = 0; c < num_cols; c++)
+      dest[r * stride + c] = DecodeByte(params[c], cols[c][r]);
+}
+#endif  // KALDI_COMPRESSED_MATRIX_SSE2
+
+}  // namespace
+
 //static 
 MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   // Returns size in bytes of the data.
@@ -363,12 +463,14 @@ inline unsigned char CompressedMatrix::FloatToChar(
 inline float CompressedMatrix::CharToFloat(
     float p0, float p25, float p75, float p100,
     unsigned char value) {
+  // Note: this is computed in the same way as in the (vectorized) code in
+  // CopyToMat(), so all the ways of decompressing give the same result.
   if (value <= 64) {
-    return p0 + (p25 - p0) * value * (1/64.0);
+    return p0 + (p25 - p0) * (1.0f / 64.0f) * value;
   } else if (value <= 192) {
-    return p25 + (p75 - p25) * (value - 64) * (1/128.0);
+    return p25 + (p75 - p25) * (1.0f / 128.0f) * (value - 64);
   } else {
-    return p75 + (p100 - p75) * (value - 192) * (1/63.0);
+    return p75 + (p100 - p75) * (1.0f / 63.0f) * (value - 192);
   }
 }
 
@@ -488,35 +590,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat) const {
     KALDI_ASSERT(mat->NumCols() == 0);
     return;
   }
-  GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
-  int32 num_cols = h->num_cols, num_rows = h->num_rows;
-  KALDI_ASSERT(mat->NumRows() == num_rows);
-  KALDI_ASSERT(mat->NumCols() == num_cols);
-  
-  if (h->format == 1) {
-    PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
-    unsigned char *byte_data = reinterpret_cast<unsigned char*>(per_col_header +
-                                                                h->num_cols);
-    for (int32 i = 0; i < num_cols; i++, per_col_header++) {
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < num_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*mat)(j, i) = f;
-      }
-    }
-  } else {
-    KALDI_ASSERT(h->format == 2);
-    const uint16 *data = reinterpret_cast<const uint16*>(h + 1);
-    for (int32 i = 0; i < num_rows; i++) {
-      Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = Uint16ToFloat(*h, data[j]);
-      data += num_cols;
-    }
-  }
+  KALDI_ASSERT(mat->NumRows() == this->NumRows());
+  KALDI_ASSERT(mat->NumCols() == this->NumCols());
+  CopyToMat(0, 0, mat);
 }
 
 // Instantiate the template for float and double.
@@ -604,42 +680,44 @@ template<typename Real>
 void CompressedMatrix::CopyToMat(int32 row_offset,
                                  int32 col_offset,
                                  MatrixBase<Real> *dest) const {
-  KALDI_PARANOID_ASSERT(row_offset < this->NumRows());
-  KALDI_PARANOID_ASSERT(col_offset < this->NumCols());
-  KALDI_PARANOID_ASSERT(row_offset >= 0);
-  KALDI_PARANOID_ASSERT(col_offset >= 0);
-  KALDI_ASSERT(row_offset+dest->NumRows() < this->NumRows());
-  KALDI_ASSERT(col_offset+dest->NumCols() < this->NumCols());
+  KALDI_ASSERT(row_offset >= 0 && col_offset >= 0);
+  KALDI_ASSERT(row_offset + dest->NumRows() <= this->NumRows());
+  KALDI_ASSERT(col_offset + dest->NumCols() <= this->NumCols());
+  int32 tgt_cols = dest->NumCols(), tgt_rows = dest->NumRows();
+  if (tgt_rows == 0 || tgt_cols == 0)
+    return;
   // everything is OK
   GlobalHeader *h = reinterpret_cast<GlobalHeader*>(data_);
-  int32 num_rows = h->num_rows, num_cols = h->num_cols,
-      tgt_cols = dest->NumCols(), tgt_rows = dest->NumRows();
+  int32 num_rows = h->num_rows, num_cols = h->num_cols;
   
   if (h->format == 1) {
     // format where we have a per-column header and use one byte per
-    // element.
-    PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
-    unsigned char *byte_data = reinterpret_cast<unsigned char*>(per_col_header +
-                                                                h->num_cols);
-
-    unsigned char *start_of_subcol = byte_data+row_offset;  // skip appropriate
-    // number of columns
-    start_of_subcol += col_offset*num_rows;  // skip appropriate number of rows
-
+    // element.  We decode blocks of 4 columns at a time, which lets us
+    // write whole rows of the block.
+    const PerColHeader *per_col_header =
+        reinterpret_cast<PerColHeader*>(h+1);
+    const unsigned char *byte_data =
+        reinterpret_cast<const unsigned char*>(per_col_header + num_cols);
     per_col_header += col_offset;  // skip the appropriate number of headers
-
-    for (int32 i = 0;
-         i < tgt_cols;
-         i++, per_col_header++, start_of_subcol+=num_rows) {
-      byte_data = start_of_subcol;
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < tgt_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*dest)(j, i) = f;
+    byte_data += col_offset * num_rows + row_offset;  // start of first subcol.
+
+    Real *dest_data = dest->Data();
+    MatrixIndexT dest_stride = dest->Stride();
+    for (int32 c = 0; c < tgt_cols; c += 4) {
+      int32 block_cols = std::min<int32>(4, tgt_cols - c);
+      ColumnDecodeParams params[4];
+      const unsigned char *cols[4];
+      for (int32 i = 0; i < block_cols; i++) {
+        const PerColHeader &header = per_col_header[c + i];
+        params[i] = ColumnDecodeParams(
+            Uint16ToFloat(*h, header.percentile_0),
+            Uint16ToFloat(*h, header.percentile_25),
+            Uint16ToFloat(*h, header.percentile_75),
+            Uint16ToFloat(*h, header.percentile_100));
+        cols[i] = byte_data + (c + i) * num_rows;
       }
+      DecodeColumns(params, cols, block_cols, tgt_rows, dest_data + c,
+                    dest_stride);
     }
   } else {
     KALDI_ASSERT(h->format == 2);
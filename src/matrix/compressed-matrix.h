@@ -103,7 +103,9 @@ class CompressedMatrix {
 
   /// Copies submatrix of compressed matrix into matrix dest.
   /// Submatrix starts at row row_offset and column column_offset and its size
-  /// is defined by size of provided matrix dest
+  /// is defined by size of provided matrix dest.  Only the requested part of
+  /// the matrix is decompressed, so this is the efficient way to get a range
+  /// of rows.
   template<typename Real>
   void CopyToMat(int32 row_offset,
                  int32 column_offset,
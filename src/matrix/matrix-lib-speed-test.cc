@@ -268,6 +268,26 @@ static void UnitTestAddVecToColsSpeed() {
   KALDI_LOG << __func__ << " finished in " << t.Elapsed() << " seconds.";   
 }
 
+template<typename Real>
+static void UnitTestCompressedMatrixSpeed() {
+  Timer t;
+  // Sizes typical of features (frames x dim).
+  MatrixIndexT num_rows = 1000, num_cols = 40;
+  Matrix<Real> M(num_rows, num_cols), M2(num_rows, num_cols);
+  M.SetRandn();
+  CompressedMatrix cmat(M);
+
+  int32 iter = 0;
+  BaseFloat time_in_secs = 0.05;
+  Timer t1;
+  for (; t1.Elapsed() < time_in_secs; iter++)
+    cmat.CopyToMat(&M2);
+  BaseFloat melems = (num_rows * num_cols * iter) / (t1.Elapsed() * 1.0e+06);
+  KALDI_LOG << "For CompressedMatrix::CopyToMat" << NameOf<Real>()
+            << ", speed: " << melems << " million elements per second.";
+  KALDI_LOG << __func__ << " finished in " << t.Elapsed() << " seconds.";
+}
+
 template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestRealFftSpeed<Real>();
   UnitTestSplitRadixRealFftSpeed<Real>();
@@ -277,6 +297,7 @@ template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestAddColSumMatSpeed<Real>();
   UnitTestAddVecToRowsSpeed<Real>();
   UnitTestAddVecToColsSpeed<Real>();
+  UnitTestCompressedMatrixSpeed<Real>();
 }
 
 } // namespace kaldi
@@ -4207,6 +4207,36 @@ static void UnitTestExtractCompressedMatrix() {
 }
 
 
+// Tests CopyToMat() with row and column offsets on matrices large enough to
+// exercise the vectorized code, against CopyRowToVec().
+template<typename Real>
+static void UnitTestCompressedMatrixRowRange() {
+  for (int32 i = 0; i < 20; i++) {
+    MatrixIndexT num_rows = 9 + Rand() % 100, num_cols = 1 + Rand() % 50;
+    Matrix<Real> mat(num_rows, num_cols);
+    mat.SetRandn();
+    CompressedMatrix cmat(mat);
+
+    MatrixIndexT row_offset = Rand() % num_rows, col_offset = Rand() % num_cols;
+    MatrixIndexT sub_num_rows = Rand() % (num_rows - row_offset) + 1,
+        sub_num_cols = Rand() % (num_cols - col_offset) + 1;
+    Matrix<Real> sub_mat(sub_num_rows, sub_num_cols);
+    cmat.CopyToMat(row_offset, col_offset, &sub_mat);
+    Vector<Real> row(num_cols);
+    for (MatrixIndexT r = 0; r < sub_num_rows; r++) {
+      cmat.CopyRowToVec(r + row_offset, &row);
+      for (MatrixIndexT c = 0; c < sub_num_cols; c++)
+        KALDI_ASSERT(sub_mat(r, c) == row(c + col_offset));
+    }
+    // The whole matrix, via both versions of CopyToMat().
+    Matrix<Real> mat2(num_rows, num_cols), mat3(num_rows, num_cols);
+    cmat.CopyToMat(&mat2);
+    cmat.CopyToMat(0, 0, &mat3);
+    KALDI_ASSERT(mat2.ApproxEqual(mat3, 0.0));
+    KALDI_ASSERT(mat2.ApproxEqual(mat, 0.02));
+  }
+}
+
 template<typename Real>
 static void UnitTestTridiag() {
   SpMatrix<Real> A(3);
@@ -4327,6 +4357,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   // UnitTestSvdBad<Real>(); // test bug in Jama SVD code.
   UnitTestCompressedMatrix<Real>();
   UnitTestExtractCompressedMatrix<Real>();
+  UnitTestCompressedMatrixRowRange<Real>();
   UnitTestResize<Real>();
   UnitTestMatrixExponentialBackprop();
   UnitTestMatrixExponential<Real>();
@@ -106,11 +106,12 @@ int main(int argc, char *argv[]) {
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
     int num_done = 0, num_err = 0;
-    VectorFst<StdArc> *decode_fst = NULL;
+    fst::Fst<StdArc> *decode_fst = NULL;
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
-      decode_fst = fst::ReadFstKaldi(fst_in_str);
+      // This may be a normal or a memory-mapped FST (see fstmakemapped).
+      decode_fst = fst::ReadMappedOrVectorFst(fst_in_str);
 
       {
     
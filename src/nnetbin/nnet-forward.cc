@@ -24,6 +24,7 @@
 #include "nnet/nnet-pdf-prior.h"
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/matrix-view-reader.h"
 #include "base/timer.h"
 
 
@@ -110,11 +111,11 @@ int main(int argc, char *argv[]) {
 
     kaldi::int64 tot_t = 0;
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    SequentialBaseFloatMatrixViewReader feature_reader(feature_rspecifier);
     BaseFloatMatrixWriter feature_writer(feature_wspecifier);
 
     CuMatrix<BaseFloat> feats, feats_transf, nnet_out;
-    Matrix<BaseFloat> nnet_out_host;
+    Matrix<BaseFloat> nnet_out_host, shifted_mat;
 
 
     Timer time;
@@ -123,7 +124,9 @@ int main(int argc, char *argv[]) {
     // iterate over all feature files
     for (; !feature_reader.Done(); feature_reader.Next()) {
       // read
-      Matrix<BaseFloat> mat = feature_reader.Value();
+      // (a view into the archive where possible; we only copy it if we need to
+      // append frames to it.)
+      const SubMatrix<BaseFloat> mat(feature_reader.Value());
       std::string utt = feature_reader.Key();
       KALDI_VLOG(2) << "Processing utterance " << num_done+1 
                     << ", " << utt
@@ -137,14 +140,18 @@ int main(int argc, char *argv[]) {
       // time-shift, copy the last frame of LSTM input N-times,
       if (time_shift > 0) {
         int32 last_row = mat.NumRows() - 1; // last row,
-        mat.Resize(mat.NumRows() + time_shift, mat.NumCols(), kCopyData);
-        for (int32 r = last_row+1; r<mat.NumRows(); r++) {
-          mat.CopyRowFromVec(mat.Row(last_row), r); // copy last row,
+        shifted_mat.Resize(mat.NumRows() + time_shift, mat.NumCols(),
+                           kUndefined);
+        shifted_mat.RowRange(0, mat.NumRows()).CopyFromMat(mat);
+        for (int32 r = last_row+1; r<shifted_mat.NumRows(); r++) {
+          shifted_mat.CopyRowFromVec(mat.Row(last_row), r); // copy last row,
         }
+        // push it to gpu,
+        feats = shifted_mat;
+      } else {
+        // push it to gpu,
+        feats = mat;
       }
-      
-      // push it to gpu,
-      feats = mat;
 
       // fwd-pass, feature transform,
       nnet_transf.Feedforward(feats, &feats_transf);
@@ -203,7 +210,7 @@ int main(int argc, char *argv[]) {
                       << " frames per second.";
       }
       num_done++;
-      tot_t += mat.NumRows();
+      tot_t += feats.NumRows();
     }
     
     // final message
@@ -98,6 +98,20 @@ OnlineFeaturePipelineConfig::OnlineFeaturePipelineConfig(
               << "and --splice-feats options";
 
   lda_rxfilename = config.lda_rxfilename;
+
+  max_frames_kept = config.max_frames_kept;
+  if (config.max_frames_kept > 0) {
+    // The online CMVN looks back over cmn_window frames of the base features,
+    // plus up to "modulus" frames to the nearest cached stats.
+    if (config.max_frames_kept <= cmvn_opts.cmn_window + cmvn_opts.modulus)
+      KALDI_ERR << "--max-frames-kept=" << config.max_frames_kept
+                << " must be larger than --cmn-window=" << cmvn_opts.cmn_window
+                << " plus " << cmvn_opts.modulus;
+    cmvn_opts.max_frames_kept = config.max_frames_kept;
+    if (add_pitch)
+      KALDI_WARN << "--max-frames-kept does not limit the memory used by "
+                 << "the pitch features.";
+  }
 }
 
 
@@ -158,11 +172,14 @@ void OnlineFeaturePipeline::GetCmvnState(OnlineCmvnState *cmvn_state) {
 // initialized.
 void OnlineFeaturePipeline::Init() {
   if (config_.feature_type == "mfcc") {
-    base_feature_ = new OnlineMfcc(config_.mfcc_opts);
+    base_feature_ = new OnlineMfcc(config_.mfcc_opts,
+                                   config_.max_frames_kept);
   } else if (config_.feature_type == "plp") {
-    base_feature_ = new OnlinePlp(config_.plp_opts);
+    base_feature_ = new OnlinePlp(config_.plp_opts,
+                                  config_.max_frames_kept);
   } else if (config_.feature_type == "fbank") {
-    base_feature_ = new OnlineFbank(config_.fbank_opts);
+    base_feature_ = new OnlineFbank(config_.fbank_opts,
+                                    config_.max_frames_kept);
   } else {
     KALDI_ERR << "Code error: invalid feature type " << config_.feature_type;
   }
@@ -253,6 +270,11 @@ void OnlineFeaturePipeline::GetFrame(int32 frame,
   AdaptedFeature()->GetFrame(frame, feat);
 }
 
+void OnlineFeaturePipeline::GetFrames(int32 first_frame,
+                                      MatrixBase<BaseFloat> *feats) {
+  AdaptedFeature()->GetFrames(first_frame, feats);
+}
+
 OnlineFeaturePipeline::~OnlineFeaturePipeline() {
   // Note: the delete command only deletes pointers that are non-NULL.  Not all
   // of the pointers below will be non-NULL.
@@ -297,10 +319,7 @@ BaseFloat OnlineFeaturePipelineConfig::FrameShiftInSeconds() const {
 void OnlineFeaturePipeline::GetAsMatrix(Matrix<BaseFloat> *feats) {
   if (pitch_) {
     feats->Resize(NumFramesReady(), pitch_feature_->Dim());
-    for (int32 i = 0; i < NumFramesReady(); i++) {
-      SubVector<BaseFloat> row(*feats, i);
-      pitch_feature_->GetFrame(i, &row);
-    }
+    pitch_feature_->GetFrames(0, feats);
   }
 }
 
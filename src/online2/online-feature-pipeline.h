@@ -61,10 +61,14 @@ struct OnlineFeaturePipelineCommandLineConfig {
   bool splice_feats;
   std::string splice_config;
   std::string lda_rxfilename;
+  // If > 0, only (about) this many of the most recent frames of the base
+  // features and CMVN stats are kept, so that the pipeline can process an
+  // unbounded stream in constant memory.  Does not limit the pitch features.
+  int32 max_frames_kept;
 
   OnlineFeaturePipelineCommandLineConfig() :
     feature_type("mfcc"), add_pitch(false), add_deltas(false),
-    splice_feats(false) { }
+    splice_feats(false), max_frames_kept(-1) { }
 
   void Register(OptionsItf *po) {
     po->Register("feature-type", &feature_type,
@@ -98,6 +102,10 @@ struct OnlineFeaturePipelineCommandLineConfig {
                  "for frame splicing, if done (e.g. prior to LDA)");
     po->Register("lda-matrix", &lda_rxfilename, "Filename of LDA matrix (if "
                  "using LDA), e.g. exp/foo/final.mat");
+    po->Register("max-frames-kept", &max_frames_kept, "If >0, only this many "
+                 "of the most recent feature frames are kept in memory, which "
+                 "allows decoding of unbounded streams; must be more than the "
+                 "CMN window (--add-pitch=true is not limited by this).");
   }
 };
 
@@ -112,7 +120,7 @@ struct OnlineFeaturePipelineCommandLineConfig {
 struct OnlineFeaturePipelineConfig {
   OnlineFeaturePipelineConfig():
       feature_type("mfcc"), add_pitch(false), add_deltas(true),
-      splice_feats(false) { }
+      splice_feats(false), max_frames_kept(-1) { }
 
   OnlineFeaturePipelineConfig(
       const OnlineFeaturePipelineCommandLineConfig &cmdline_config);
@@ -144,6 +152,10 @@ struct OnlineFeaturePipelineConfig {
                                // if used.
   std::string global_cmvn_stats_rxfilename;  // Filename used for reading global
                                              // CMVN stats
+
+  int32 max_frames_kept;  // If > 0, only (about) this many recent frames of
+                          // the base features and CMVN stats are kept; see
+                          // OnlineFeaturePipelineCommandLineConfig.
 };
 
 
@@ -163,6 +175,7 @@ class OnlineFeaturePipeline: public OnlineFeatureInterface {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const;
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats);
 
   // This is supplied for debug purposes.
   void GetAsMatrix(Matrix<BaseFloat> *feats);
@@ -42,6 +42,7 @@ void OnlineIvectorExtractionInfo::Init(
     use_most_recent_ivector = true;
   }
   max_remembered_frames = config.max_remembered_frames;
+  max_frames_kept = -1;
   
   std::string note = "(note: this may be needed "
       "in the file supplied to --ivector-extractor-config)";
@@ -89,7 +90,7 @@ void OnlineIvectorExtractionInfo::Check() const {
 OnlineIvectorExtractionInfo::OnlineIvectorExtractionInfo():
     ivector_period(0), num_gselect(0), min_post(0.0), posterior_scale(0.0),
     use_most_recent_ivector(true), greedy_ivector_extractor(false),
-    max_remembered_frames(0) { }
+    max_remembered_frames(0), max_frames_kept(-1) { }
 
 OnlineIvectorExtractorAdaptationState::OnlineIvectorExtractorAdaptationState(
     const OnlineIvectorExtractorAdaptationState &other):
@@ -203,11 +204,8 @@ void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
     if ((!info_.use_most_recent_ivector && t % ivector_period == 0) ||
         (info_.use_most_recent_ivector && t == frame)) {
       ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
-      if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
-        int32 ivec_index = t / ivector_period;
-        KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
-        ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
-      }
+      if (!info_.use_most_recent_ivector)  // need to cache iVectors.
+        AddIvectorToHistory(t);
     }
   }
 }
@@ -217,7 +215,9 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
                delta_weights_provided_ &&
                ! updated_with_no_delta_weights_ &&
                frame <= most_recent_frame_with_weight_);
-  bool debug_weights = true;
+  // The debugging vector has one element per frame, so we don't keep it if
+  // we've been asked to run in bounded memory.
+  bool debug_weights = (info_.max_frames_kept <= 0);
 
   int32 ivector_period = info_.ivector_period;
   int32 num_cg_iters = info_.num_cg_iters;
@@ -232,6 +232,13 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
       delta_weights_.pop();
       int32 frame = p.first;
       BaseFloat weight = p.second;
+      if (frame < FirstFrameReweightable()) {
+        // Only possible if info_.max_frames_kept > 0: the decoder traceback
+        // changed so far back that we no longer have the features.
+        KALDI_VLOG(3) << "Ignoring weight change for frame " << frame
+                      << " as its features have been discarded.";
+        continue;
+      }
       UpdateStatsForFrame(frame, weight);
       if (debug_weights) {
         if (current_frame_weight_debug_.size() <= frame)
@@ -244,16 +251,42 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
     if ((!info_.use_most_recent_ivector && t % ivector_period == 0) ||
         (info_.use_most_recent_ivector && t == frame)) {
       ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
-      if (!info_.use_most_recent_ivector) {  // need to cache iVectors.
-        int32 ivec_index = t / ivector_period;
-        KALDI_ASSERT(ivec_index == static_cast<int32>(ivectors_history_.size()));
-        ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
-      }
+      if (!info_.use_most_recent_ivector)  // need to cache iVectors.
+        AddIvectorToHistory(t);
     }
   }
 }
 
 
+int32 OnlineIvectorFeature::FirstFrameReweightable() const {
+  if (info_.max_frames_kept <= 0)
+    return 0;
+  // We have read the base features up to at most base_->NumFramesReady(), and
+  // they are kept from max_frames_kept frames before the slowest reader.
+  // Recomputing frame t needs the base features from t - left_context for the
+  // splicing, and from about t - cmn_window - modulus for the CMVN stats.
+  return base_->NumFramesReady() - info_.max_frames_kept +
+      info_.cmvn_opts.cmn_window + info_.cmvn_opts.modulus +
+      info_.splice_opts.left_context;
+}
+
+void OnlineIvectorFeature::AddIvectorToHistory(int32 t) {
+  int32 ivector_period = info_.ivector_period,
+      ivec_index = t / ivector_period;
+  KALDI_ASSERT(ivec_index == num_ivectors_discarded_ +
+               static_cast<int32>(ivectors_history_.size()));
+  ivectors_history_.push_back(new Vector<BaseFloat>(current_ivector_));
+  if (info_.max_frames_kept > 0) {
+    // Keep the iVectors for all frames from t - max_frames_kept onward.
+    int32 first_index_kept = (t - info_.max_frames_kept) / ivector_period;
+    while (num_ivectors_discarded_ < first_index_kept) {
+      delete ivectors_history_.front();
+      ivectors_history_.pop_front();
+      num_ivectors_discarded_++;
+    }
+  }
+}
+
 void OnlineIvectorFeature::GetFrame(int32 frame,
                                     VectorBase<BaseFloat> *feat) {
   int32 frame_to_update_until = (info_.greedy_ivector_extractor ?
@@ -277,6 +310,11 @@ void OnlineIvectorFeature::GetFrame(int32 frame,
     (*feat)(0) -= info_.extractor.PriorOffset();
   } else {
     int32 i = frame / info_.ivector_period;  // rounds down.
+    if (i < num_ivectors_discarded_)
+      KALDI_ERR << "Requesting iVector for frame " << frame << ", which has "
+                << "been discarded (max-frames-kept = "
+                << info_.max_frames_kept << ")";
+    i -= num_ivectors_discarded_;
     // if the following fails, UpdateStatsUntilFrame would have a bug.
     KALDI_ASSERT(static_cast<size_t>(i) <  ivectors_history_.size());
     feat->CopyFromVec(*(ivectors_history_[i]));
@@ -339,7 +377,8 @@ OnlineIvectorFeature::OnlineIvectorFeature(
                    info_.max_count),
     num_frames_stats_(0), delta_weights_provided_(false),
     updated_with_no_delta_weights_(false),
-    most_recent_frame_with_weight_(-1), tot_ubm_loglike_(0.0) {
+    most_recent_frame_with_weight_(-1), tot_ubm_loglike_(0.0),
+    num_ivectors_discarded_(0) {
   info.Check();
   KALDI_ASSERT(base_feature != NULL);
   splice_ = new OnlineSpliceFrames(info_.splice_opts, base_);
@@ -349,7 +388,9 @@ OnlineIvectorFeature::OnlineIvectorFeature(
   // about the speaker.  If you want to inform this class about more specific
   // adaptation state, call this->SetAdaptationState(), most likely derived
   // from a call to GetAdaptationState() from a previous object of this type.
-  cmvn_ = new OnlineCmvn(info.cmvn_opts, naive_cmvn_state, base_);
+  OnlineCmvnOptions cmvn_opts(info.cmvn_opts);
+  cmvn_opts.max_frames_kept = info.max_frames_kept;
+  cmvn_ = new OnlineCmvn(cmvn_opts, naive_cmvn_state, base_);
   splice_normalized_ = new OnlineSpliceFrames(info_.splice_opts, cmvn_);
   lda_normalized_ = new OnlineTransform(info.lda_mat, splice_normalized_);
 
@@ -413,8 +454,11 @@ void OnlineSilenceWeighting::ComputeCurrentTraceback(
   while (frame >= 0) {
     LatticeArc arc;
     arc.ilabel = 0;
-    while (arc.ilabel == 0)  // the while loop skips over input-epsilons
+    while (arc.ilabel == 0 && !iter.Done())  // skips over input-epsilons
       iter = decoder.TraceBackBestPath(iter, &arc);
+    if (arc.ilabel == 0)
+      break;  // The traceback stops at the last cut made by
+              // LatticeFasterOnlineDecoder::DeterminizePrefix().
     // note, the iter.frame values are slightly unintuitively defined,
     // they are one less than you might expect.
     KALDI_ASSERT(iter.frame == frame - 1); 
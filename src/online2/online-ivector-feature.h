@@ -180,6 +180,12 @@ struct OnlineIvectorExtractionInfo {
   bool greedy_ivector_extractor;
   BaseFloat max_remembered_frames;
 
+  // The following is not set from OnlineIvectorExtractionConfig; it is set by
+  // the feature pipeline.  If > 0, OnlineIvectorFeature only remembers the
+  // iVectors (and the CMVN stats) for about this many of the most recent
+  // frames, so that it can run on an unbounded stream in constant memory.
+  int32 max_frames_kept;
+
   OnlineIvectorExtractionInfo(const OnlineIvectorExtractionConfig &config);
 
   void Init(const OnlineIvectorExtractionConfig &config);
@@ -321,6 +327,17 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   // This is the new UpdateStatsUntilFrame that is called when there is
   // data-weighting (i.e. when the user has been calling UpdateFrameWeights()).
   void UpdateStatsUntilFrameWeighted(int32 frame);
+
+  // Called from the two functions above when current_ivector_ has been
+  // estimated on frame t (a multiple of ivector_period), if
+  // !info_.use_most_recent_ivector; appends it to ivectors_history_ and
+  // discards old iVectors if info_.max_frames_kept > 0.
+  void AddIvectorToHistory(int32 t);
+
+  // Returns the first frame whose weight can still be changed by
+  // UpdateFrameWeights(); earlier frames may need base features that have been
+  // discarded.  Returns 0 unless info_.max_frames_kept > 0.
+  int32 FirstFrameReweightable() const;
   
   void PrintDiagnostics() const;
   
@@ -382,8 +399,10 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   /// the iVector we estimated each info_.ivector_period frames so that
   /// GetFrame() can return the iVector that was active on that frame.
   /// ivectors_history_[i] contains the iVector we estimated on
-  /// frame t = i * info_.ivector_period.
-  std::vector<Vector<BaseFloat>* > ivectors_history_;
+  /// frame t = (i + num_ivectors_discarded_) * info_.ivector_period.
+  /// If info_.max_frames_kept > 0, old iVectors are removed from the front.
+  std::deque<Vector<BaseFloat>* > ivectors_history_;
+  int32 num_ivectors_discarded_;
  
 };
 
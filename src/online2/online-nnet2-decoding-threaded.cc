@@ -555,12 +555,8 @@ bool SingleUtteranceNnet2DecoderThreaded::RunNnetEvaluationInternal() {
     Matrix<BaseFloat> feats;
     if (num_frames_evaluate > 0) {
       // we have something to do...
-      feats.Resize(num_frames_evaluate, feature_pipeline_.Dim());
-      for (int32 i = 0; i < num_frames_evaluate; i++) {
-        int32 t = num_frames_consumed + i;
-        SubVector<BaseFloat> feat(feats, i);
-        feature_pipeline_.GetFrame(t, &feat);
-      }
+      feats.Resize(num_frames_evaluate, feature_pipeline_.Dim(), kUndefined);
+      feature_pipeline_.GetFrames(num_frames_consumed, &feats);
     }
     /****** End locking of feature pipeline mutex. ******/
     feature_pipeline_mutex_.Unlock();  
@@ -33,12 +33,23 @@ SingleUtteranceNnet2Decoder::SingleUtteranceNnet2Decoder(
     feature_pipeline_(feature_pipeline),
     tmodel_(tmodel),
     decodable_(model, tmodel, config.decodable_opts, feature_pipeline),
-    decoder_(fst, config.decoder_opts) {
+    decoder_(fst, config.decoder_opts),
+    determinizer_(config.incremental_opts, tmodel,
+                  config.decoder_opts.lattice_beam,
+                  config.decoder_opts.det_opts) {
+  if (config.determinize_incrementally &&
+      !config.decoder_opts.determinize_lattice)
+    KALDI_ERR << "--determinize-incrementally=true requires "
+              << "--determinize-lattice=true";
   decoder_.InitDecoding();
 }
 
 void SingleUtteranceNnet2Decoder::AdvanceDecoding() {
   decoder_.AdvanceDecoding(&decodable_);
+  if (config_.determinize_incrementally) {
+    // We may have decoded many frames, so cut the lattice as often as we can.
+    while (decoder_.DeterminizePrefix(&determinizer_));
+  }
 }
 
 void SingleUtteranceNnet2Decoder::FinalizeDecoding() {
@@ -53,6 +64,10 @@ void SingleUtteranceNnet2Decoder::GetLattice(bool end_of_utterance,
                                              CompactLattice *clat) const {
   if (NumFramesDecoded() == 0)
     KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  if (config_.determinize_incrementally) {
+    decoder_.GetLatticeIncremental(end_of_utterance, determinizer_, clat);
+    return;
+  }
   Lattice raw_lat;
   decoder_.GetRawLattice(&raw_lat, end_of_utterance);
 
@@ -66,6 +81,15 @@ void SingleUtteranceNnet2Decoder::GetLattice(bool end_of_utterance,
 
 void SingleUtteranceNnet2Decoder::GetBestPath(bool end_of_utterance,
                                               Lattice *best_path) const {
+  if (decoder_.NumFramesDeterminized() > 0) {
+    // The decoder has freed the tokens before the last cut, so we get the best
+    // path from the lattice.
+    CompactLattice clat, best_clat;
+    GetLattice(end_of_utterance, &clat);
+    CompactLatticeShortestPath(clat, &best_clat);
+    ConvertLattice(best_clat, best_path);
+    return;
+  }
   decoder_.GetBestPath(best_path, end_of_utterance);
 }
 
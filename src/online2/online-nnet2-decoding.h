@@ -51,12 +51,23 @@ struct OnlineNnet2DecodingConfig {
   
   LatticeFasterDecoderConfig decoder_opts;
   nnet2::DecodableNnet2OnlineOptions decodable_opts;
+  bool determinize_incrementally;
+  LatticeIncrementalDeterminizerConfig incremental_opts;
   
-  OnlineNnet2DecodingConfig() {  decodable_opts.acoustic_scale = 0.1; }
+  OnlineNnet2DecodingConfig(): determinize_incrementally(false) {
+    decodable_opts.acoustic_scale = 0.1;
+  }
   
   void Register(OptionsItf *po) {
     decoder_opts.Register(po);
     decodable_opts.Register(po);
+    po->Register("determinize-incrementally", &determinize_incrementally,
+                 "If true, determinize the lattice in pieces while decoding, "
+                 "which bounds the memory used on long recordings and the "
+                 "time taken to get the lattice at the end.  The lattice is "
+                 "not quite deterministic where the pieces meet, unless "
+                 "--determinize-final=true.");
+    incremental_opts.Register(po);
   }
 };
 
@@ -95,7 +106,8 @@ class SingleUtteranceNnet2Decoder {
   /// Outputs an FST corresponding to the single best path through the current
   /// lattice. If "use_final_probs" is true AND we reached the final-state of
   /// the graph then it will include those as final-probs, else it will treat
-  /// all final-probs as one.
+  /// all final-probs as one.  With --determinize-incrementally this has to get
+  /// the lattice, so it is slower.
   void GetBestPath(bool end_of_utterance,
                    Lattice *best_path) const;
 
@@ -118,6 +130,9 @@ class SingleUtteranceNnet2Decoder {
   nnet2::DecodableNnet2Online decodable_;
   
   LatticeFasterOnlineDecoder decoder_;
+
+  // Only used if config_.determinize_incrementally is true.
+  LatticeIncrementalDeterminizer determinizer_;
   
 };
 
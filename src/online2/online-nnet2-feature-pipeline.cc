@@ -74,17 +74,58 @@ OnlineNnet2FeaturePipelineInfo::OnlineNnet2FeaturePipelineInfo(
   } else {
     use_ivectors = false;
   }
+
+  max_frames_kept = config.max_frames_kept;
+  if (config.max_frames_kept > 0) {
+    if (use_ivectors) {
+      // The online CMVN of the iVector extractor looks back over cmn_window
+      // frames of the base features (plus up to "modulus" frames, to the
+      // nearest cached stats), and the splicing needs some context.
+      const OnlineIvectorExtractionInfo &info = ivector_extractor_info;
+      int32 min_frames_kept = info.cmvn_opts.cmn_window +
+          info.cmvn_opts.modulus + info.splice_opts.left_context +
+          info.splice_opts.right_context;
+      if (config.max_frames_kept <= min_frames_kept)
+        KALDI_ERR << "--max-frames-kept=" << config.max_frames_kept
+                  << " must be larger than " << min_frames_kept
+                  << " (the --cmn-window of the iVector extractor plus the "
+                  << "context it needs)";
+      ivector_extractor_info.max_frames_kept = config.max_frames_kept;
+    }
+    if (add_pitch)
+      KALDI_WARN << "--max-frames-kept does not limit the memory used by "
+                 << "the pitch features.";
+  }
 }
 
 OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
     const OnlineNnet2FeaturePipelineInfo &info):
     info_(info) {
+  // The neural net input and the iVector extractor read the base features
+  // through separate readers, so that with --max-frames-kept neither has
+  // frames discarded because the other one has gone further ahead.  (A reader
+  // that is never used would keep all the frames, so we only create the
+  // iVector extractor's reader if it is needed.)
+  OnlineFeatureInterface *nnet_input = NULL, *ivector_input = NULL;
   if (info_.feature_type == "mfcc") {
-    base_feature_ = new OnlineMfcc(info_.mfcc_opts);
+    OnlineMfcc *mfcc = new OnlineMfcc(info_.mfcc_opts, info_.max_frames_kept);
+    nnet_input = mfcc->NewReader();
+    if (info_.use_ivectors)
+      ivector_input = mfcc->NewReader();
+    base_feature_ = mfcc;
   } else if (info_.feature_type == "plp") {
-    base_feature_ = new OnlinePlp(info_.plp_opts);
+    OnlinePlp *plp = new OnlinePlp(info_.plp_opts, info_.max_frames_kept);
+    nnet_input = plp->NewReader();
+    if (info_.use_ivectors)
+      ivector_input = plp->NewReader();
+    base_feature_ = plp;
   } else if (info_.feature_type == "fbank") {
-    base_feature_ = new OnlineFbank(info_.fbank_opts);
+    OnlineFbank *fbank = new OnlineFbank(info_.fbank_opts,
+                                         info_.max_frames_kept);
+    nnet_input = fbank->NewReader();
+    if (info_.use_ivectors)
+      ivector_input = fbank->NewReader();
+    base_feature_ = fbank;
   } else {
     KALDI_ERR << "Code error: invalid feature type " << info_.feature_type;
   }
@@ -93,17 +134,17 @@ OnlineNnet2FeaturePipeline::OnlineNnet2FeaturePipeline(
     pitch_ = new OnlinePitchFeature(info_.pitch_opts);
     pitch_feature_ = new OnlineProcessPitch(info_.pitch_process_opts,
                                             pitch_);
-    feature_plus_optional_pitch_ = new OnlineAppendFeature(base_feature_,
+    feature_plus_optional_pitch_ = new OnlineAppendFeature(nnet_input,
                                                            pitch_feature_);
   } else {
     pitch_ = NULL;
     pitch_feature_ = NULL;
-    feature_plus_optional_pitch_ = base_feature_;
+    feature_plus_optional_pitch_ = nnet_input;
   }
 
   if (info_.use_ivectors) {
     ivector_feature_ = new OnlineIvectorFeature(info_.ivector_extractor_info,
-                                                base_feature_);
+                                                ivector_input);
     final_feature_ = new OnlineAppendFeature(feature_plus_optional_pitch_,
                                              ivector_feature_);
   } else {
@@ -128,6 +169,11 @@ void OnlineNnet2FeaturePipeline::GetFrame(int32 frame,
   return final_feature_->GetFrame(frame, feat);
 }
 
+void OnlineNnet2FeaturePipeline::GetFrames(int32 first_frame,
+                                           MatrixBase<BaseFloat> *feats) {
+  final_feature_->GetFrames(first_frame, feats);
+}
+
 void OnlineNnet2FeaturePipeline::SetAdaptationState(
     const OnlineIvectorExtractorAdaptationState &adaptation_state) {
   if (info_.use_ivectors) {
@@ -153,7 +199,7 @@ OnlineNnet2FeaturePipeline::~OnlineNnet2FeaturePipeline() {
   if (final_feature_ != feature_plus_optional_pitch_)
     delete final_feature_;
   delete ivector_feature_;
-  if (feature_plus_optional_pitch_ != base_feature_)
+  if (pitch_feature_ != NULL)  // else it is a reader owned by base_feature_.
     delete feature_plus_optional_pitch_;
   delete pitch_feature_;
   delete pitch_;
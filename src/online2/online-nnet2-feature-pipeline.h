@@ -85,8 +85,15 @@ struct OnlineNnet2FeaturePipelineConfig {
   // play with it in test time.
   OnlineSilenceWeightingConfig silence_weighting_config;
 
+  // If > 0, the feature pipeline only keeps (about) this many frames of the
+  // base features, iVectors and CMVN stats before the oldest frame that the
+  // neural net input and the iVector extractor are still reading, so that it
+  // can process an unbounded stream in constant memory; older frames may not
+  // be requested.  Note: the pitch features are not limited by this.
+  int32 max_frames_kept;
+
   OnlineNnet2FeaturePipelineConfig():
-      feature_type("mfcc"), add_pitch(false) { }
+      feature_type("mfcc"), add_pitch(false), max_frames_kept(-1) { }
       
 
   void Register(OptionsItf *po) {
@@ -107,6 +114,13 @@ struct OnlineNnet2FeaturePipelineConfig {
                  "Configuration file for online iVector extraction, "
                  "see class OnlineIvectorExtractionConfig in the code");
     silence_weighting_config.RegisterWithPrefix("ivector-silence-weighting", po);
+    po->Register("max-frames-kept", &max_frames_kept, "If >0, only about this "
+                 "many feature frames before the oldest frame still being "
+                 "read are kept in memory, which allows decoding of unbounded "
+                 "streams; must be more than the CMN window of the iVector "
+                 "extractor plus its context.  Silence-weighting changes to "
+                 "frames older than that are ignored (--add-pitch=true is "
+                 "not limited by this).");
   }
 };
 
@@ -121,7 +135,7 @@ struct OnlineNnet2FeaturePipelineConfig {
 /// command line, as well as for easiter multithreaded operation.
 struct OnlineNnet2FeaturePipelineInfo {
   OnlineNnet2FeaturePipelineInfo():
-      feature_type("mfcc"), add_pitch(false) { }
+      feature_type("mfcc"), add_pitch(false), max_frames_kept(-1) { }
 
   OnlineNnet2FeaturePipelineInfo(
       const OnlineNnet2FeaturePipelineConfig &config);
@@ -153,6 +167,10 @@ struct OnlineNnet2FeaturePipelineInfo {
   // it's the kind of thing you might want to play with directly
   // on the command line instead of inside sub-config-files.
   OnlineSilenceWeightingConfig silence_weighting_config;
+
+  // If > 0, only (about) this many recent frames of the base features,
+  // iVectors and CMVN stats are kept; see OnlineNnet2FeaturePipelineConfig.
+  int32 max_frames_kept;
   
   int32 IvectorDim() { return ivector_extractor_info.extractor.IvectorDim(); }
  private:
@@ -192,6 +210,7 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   virtual bool IsLastFrame(int32 frame) const;
   virtual int32 NumFramesReady() const;
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
+  virtual void GetFrames(int32 first_frame, MatrixBase<BaseFloat> *feats);
 
   /// Set the adaptation state to a particular value, e.g. reflecting previous
   /// utterances of the same speaker; this will generally be called after
@@ -242,9 +261,9 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   OnlineProcessPitch *pitch_feature_;  // Processed pitch, if pitch used.
 
 
-  // feature_plus_pitch_ is the base_feature_ appended (OnlineAppendFeature)
-  /// with pitch_feature_, if used; otherwise, points to the same address as
-  /// base_feature_.
+  // feature_plus_pitch_ is a reader of base_feature_ (see
+  /// OnlineGenericBaseFeature::NewReader()) appended (OnlineAppendFeature)
+  /// with pitch_feature_, if used; otherwise, it is just the reader.
   OnlineFeatureInterface *feature_plus_optional_pitch_;  
   
   OnlineIvectorFeature *ivector_feature_;  // iVector feature, if used.
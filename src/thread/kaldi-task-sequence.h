@@ -21,8 +21,11 @@
 #define KALDI_THREAD_KALDI_TASK_SEQUENCE_H_ 1
 
 #include <pthread.h>
+#include <deque>
 #include "thread/kaldi-thread.h"
+#include "thread/kaldi-thread-pool.h"
 #include "itf/options-itf.h"
+#include "thread/kaldi-mutex.h"
 #include "thread/kaldi-semaphore.h"
 
 
@@ -46,8 +49,8 @@ namespace kaldi {
    does some kind of output).  We have a templated class TaskSequencer<C> which
    is responsible for running the jobs in parallel.  It has a function Run()
    that will accept a new object of class C; this will block until a thread is
-   free, at which time it will spawn a thread that starts running the operator
-   () of the class.  When classes are finished running, the objects will be
+   free, at which time it will give the object to a thread of the global
+   ThreadPool, which runs the operator () of the class.  When classes are finished running, the objects will be
    deleted.  Class TaskSequencer guarantees that the destructors will be called
    sequentially (not in parallel) and in the same order the objects were given
    to the Run() function, so that it is safe for the destructor to have side
@@ -65,131 +68,129 @@ struct TaskSequencerConfig {
     po->Register("num-threads", &num_threads, "Number of actively processing "
                  "threads to run in parallel");
     po->Register("num-threads-total", &num_threads_total, "Total number of "
-                 "threads, including those that are waiting on other threads "
-                 "to produce their output.  Controls memory use.  If <= 0, "
-                 "defaults to --num-threads plus 20.  Otherwise, must "
-                 "be >= num-threads.");
+                 "tasks in progress, including those that are waiting on "
+                 "other tasks to produce their output.  Controls memory use.  "
+                 "If <= 0, defaults to --num-threads plus 20.  Otherwise, "
+                 "must be >= num-threads.");
   }
 };
 
 // C should have an operator () taking no arguments, that does some kind
 // of computation, and a destructor that produces some kind of output (the
 // destructors will be run sequentially in the same order Run as called.
+// The tasks are run on the threads of the global ThreadPool (see
+// kaldi-thread-pool.h); we don't create any threads per task.
 template<class C>
 class TaskSequencer {
  public:
   TaskSequencer(const TaskSequencerConfig &config):
+      num_threads_total_(config.num_threads_total > 0 ?
+                         config.num_threads_total : config.num_threads + 20),
       threads_avail_(config.num_threads),
-      tot_threads_avail_(config.num_threads_total > 0 ? config.num_threads_total :
-                         config.num_threads + 20),
-      thread_list_(NULL) {
+      tot_threads_avail_(num_threads_total_),
+      draining_(false) {
     KALDI_ASSERT((config.num_threads_total <= 0 ||
                   config.num_threads_total >= config.num_threads) &&
                  "num-threads-total, if specified, must be >= num-threads");
+    // The extra thread is for whichever thread is doing the output (i.e.
+    // deleting finished objects), which happens after it signals
+    // threads_avail_.
+    ThreadPool::Global().EnsureNumThreads(config.num_threads + 1);
   }
 
   /// This function takes ownership of the pointer "c", and will delete it
   /// in the same sequence as Run was called on the jobs.
   void Run(C *c) {
     threads_avail_.Wait(); // wait till we have a thread for computation free.
-    tot_threads_avail_.Wait(); // this ensures we don't have too many threads
-    // waiting on I/O, and consume too much memory.
-    
-    // put the new RunTaskArgsList object at head of the singly
-    // linked list thread_list_.
-    thread_list_ = new RunTaskArgsList(this, c, thread_list_);
-    int32 ret;
-    if ((ret=pthread_create(&(thread_list_->thread),
-                            NULL, // default attributes
-                            TaskSequencer<C>::RunTask,
-                            static_cast<void*>(thread_list_)))) {
-      const char *c = strerror(ret);
-      KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
-    }
+    tot_threads_avail_.Wait(); // this ensures we don't have too many tasks
+    // waiting to do their output, and consume too much memory.
+
+    TaskInfo *info = new TaskInfo(c);
+    mutex_.Lock();
+    pending_.push_back(info);
+    mutex_.Unlock();
+    ThreadPool::Global().Submit(new SequencerTask(this, info));
   }
 
   void Wait() { // You call this at the end if it's more convenient
     // than waiting for the destructor.  It waits for all tasks to finish.
-    if (thread_list_ != NULL) {
-      int ret = pthread_join(thread_list_->thread, NULL);
-      if (ret != 0) {
-        const char *c = strerror(ret);
-        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
-      }
-      KALDI_ASSERT(thread_list_->tail == NULL); // thread would not
-      // have exited without setting tail to NULL.
-      delete thread_list_;
-      thread_list_ = NULL;
-    }
+    // Each task signals tot_threads_avail_ after its object is deleted, so
+    // once we can take all of it, all the tasks are done.
+    for (int32 i = 0; i < num_threads_total_; i++)
+      tot_threads_avail_.Wait();
+    for (int32 i = 0; i < num_threads_total_; i++)
+      tot_threads_avail_.Signal();
   }
-  
-  /// The destructor waits for the last thread to exit.
+
+  /// The destructor waits for the remaining tasks to finish.
   ~TaskSequencer() {
-    Wait();      
+    Wait();
   }
  private:
-  struct RunTaskArgsList {
-    TaskSequencer *me; // Think of this as a "this" pointer.
-    C *c; // Clist element of the task we're expected
-    pthread_t thread;
-    RunTaskArgsList *tail;
-    RunTaskArgsList(TaskSequencer *me, C *c, RunTaskArgsList *tail):
-        me(me), c(c), tail(tail) {}
+  struct TaskInfo {
+    C *c;
+    bool done;  // true once c's operator () has returned.
+    explicit TaskInfo(C *c): c(c), done(false) { }
   };
-  // This static function gets run in the threads that we create.
-  static void* RunTask(void *input) {
-    RunTaskArgsList *args = static_cast<RunTaskArgsList*>(input);
-    
-    // (1) run the job.
-    (*(args->c))(); // call operator () on args->c, which does the computation.
-    args->me->threads_avail_.Signal(); // Signal that the compute-intensive
-    // part of the thread is done (we want to run no more than
-    // config_.num_threads of these.)
-    
-    // (2) we want to destroy the object "c" now, by deleting it.  But for
-    //     correct sequencing (this is the whole point of this class, it
-    //     is intended to ensure the output of the program is in correct order),
-    //     we first wait till the previous thread, whose details will be in "tail",
-    //     is finished.
-    if (args->tail != NULL) {
-      int ret = pthread_join(args->tail->thread, NULL);
-      if (ret != 0) {
-        const char *c = strerror(ret);
-        KALDI_ERR << "Error joining thread, errno was: " << (c ? c : "[NULL]");
-      }
+
+  class SequencerTask: public ThreadPoolTask {
+   public:
+    SequencerTask(TaskSequencer *me, TaskInfo *info): me_(me), info_(info) { }
+    virtual void Run() {
+      (*(info_->c))(); // call operator () on c, which does the computation.
+      me_->threads_avail_.Signal(); // Signal that the compute-intensive
+      // part of the task is done (we want to run no more than
+      // config_.num_threads of these.)
+      me_->TaskDone(info_);
     }
+   private:
+    TaskSequencer *me_;
+    TaskInfo *info_;
+  };
 
-    delete args->c; // delete the object "c".  This may cause some output,
-    // e.g. to a stream.  We don't need to worry about concurrent access to
-    // the output stream, because each thread waits for the previous thread
-    // to be done, before doing this.  So there is no risk of concurrent
-    // access.
-    args->c = NULL;
-    
-    if (args->tail != NULL) {
-      KALDI_ASSERT(args->tail->tail == NULL); // Because we already
-      // did pthread_join on args->tail->thread, which means that
-      // thread was done, and before it exited, it would have
-      // deleted and set to NULL its tail (which is the next line of code).
-      delete args->tail;
-      args->tail = NULL;
+  // Marks the task as done, and deletes the objects at the front of pending_
+  // whose tasks are done, in order.  Only one thread at a time does the
+  // deleting (draining_ is true while it does), so the destructors of the
+  // objects, which may produce output, are never called concurrently; a
+  // thread that finds another one deleting leaves its object for that thread.
+  void TaskDone(TaskInfo *info) {
+    mutex_.Lock();
+    info->done = true;
+    if (draining_) {
+      mutex_.Unlock();
+      return;
+    }
+    draining_ = true;
+    int32 num_deleted = 0;
+    while (!pending_.empty() && pending_.front()->done) {
+      TaskInfo *front = pending_.front();
+      pending_.pop_front();
+      mutex_.Unlock();
+      delete front->c; // delete the object "c".  This may cause some output,
+      // e.g. to a stream.
+      delete front;
+      num_deleted++;
+      mutex_.Lock();
     }
-    // At this point we are exiting from the thread.  Signal the
-    // "tot_threads_avail_" semaphore which is used to limit the total number of threads that are alive, including
-    // not onlhy those that are in active computation in c->operator (), but those
-    // that are waiting on I/O or other threads.
-    args->me->tot_threads_avail_.Signal();
-    // .. and exit the thread, by returning. 
-    return NULL;
+    draining_ = false;
+    mutex_.Unlock();
+    // This must come last: once Wait() can return, *this may be destroyed.
+    for (int32 i = 0; i < num_deleted; i++)
+      tot_threads_avail_.Signal();
   }
 
+  int32 num_threads_total_;
+
   Semaphore threads_avail_; // Initialized to the number of threads we are
   // supposed to run with; the function Run() waits on this.
 
   Semaphore tot_threads_avail_; // We use this semaphore to ensure we don't
   // consume too much memory...
-  RunTaskArgsList *thread_list_; 
-  
+
+  Mutex mutex_;  // protects pending_, draining_ and the "done" flags.
+  std::deque<TaskInfo*> pending_;  // tasks whose objects are not yet deleted,
+                                   // in the order Run() was called.
+  bool draining_;
 };
 
 } // namespace kaldi
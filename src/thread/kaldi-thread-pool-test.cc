@@ -0,0 +1,154 @@
+// thread/kaldi-thread-pool-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "thread/kaldi-thread-pool.h"
+#include "thread/kaldi-thread.h"
+
+namespace kaldi {
+
+// Adds "value" to *sum, and possibly submits more tasks from inside the pool;
+// signals "done" once per unit of value added.
+class AddTask: public ThreadPoolTask {
+ public:
+  AddTask(int32 depth, Mutex *mutex, int64 *sum, Semaphore *done):
+      depth_(depth), mutex_(mutex), sum_(sum), done_(done) { }
+  virtual void Run() {
+    if (depth_ > 0) {  // test submitting tasks from a worker thread.
+      for (int32 i = 0; i < 2; i++)
+        ThreadPool::Global().Submit(new AddTask(depth_ - 1, mutex_, sum_,
+                                                done_));
+    }
+    mutex_->Lock();
+    (*sum_)++;
+    mutex_->Unlock();
+    done_->Signal();
+  }
+ private:
+  int32 depth_;
+  Mutex *mutex_;
+  int64 *sum_;
+  Semaphore *done_;
+};
+
+void TestThreadPoolSubmit() {
+  int32 num_tasks = 1 + Rand() % 20, depth = Rand() % 5;
+  Mutex mutex;
+  int64 sum = 0;
+  Semaphore done;
+  for (int32 i = 0; i < num_tasks; i++)
+    ThreadPool::Global().Submit(new AddTask(depth, &mutex, &sum, &done));
+  // Each top-level task creates 2^(depth+1) - 1 tasks in total.
+  int64 expected = num_tasks * ((1 << (depth + 1)) - 1);
+  for (int64 i = 0; i < expected; i++)
+    done.Wait();
+  KALDI_ASSERT(sum == expected);
+}
+
+class SquareClass {
+ public:
+  explicit SquareClass(std::vector<int64> *output): output_(output) { }
+  void operator () (int32 i) const {
+    int32 spin = Rand() % 10000;
+    for (volatile int32 j = 0; j < spin; j++);  // make the times uneven.
+    (*output_)[i] = static_cast<int64>(i) * i;
+  }
+ private:
+  std::vector<int64> *output_;
+};
+
+void TestParallelFor() {
+  int32 begin = Rand() % 10, end = begin + Rand() % 1000,
+      num_threads = 1 + Rand() % 10;
+  std::vector<int64> output(end, -1);
+  SquareClass c(&output);
+  ParallelFor(begin, end, num_threads, c);
+  for (int32 i = 0; i < end; i++)
+    KALDI_ASSERT(output[i] == (i < begin ? -1 : static_cast<int64>(i) * i));
+}
+
+// Calls ParallelFor() from inside the pool, which must not deadlock even if
+// all the pool's threads are busy.
+class NestedClass {
+ public:
+  void operator () (int32 i) const { TestParallelFor(); }
+};
+
+void TestNestedParallelFor() {
+  NestedClass c;
+  ParallelFor(0, 1 + Rand() % 10, 1 + Rand() % 4, c);
+}
+
+// The copies of this class wait for each other on a barrier, which only works
+// if they all run at the same time.
+class BarrierClass: public MultiThreadable {
+ public:
+  BarrierClass(Barrier *barrier, int32 *count):
+      barrier_(barrier), count_(count), my_count_(0) { }
+  void operator () () {
+    for (int32 i = 0; i < 3; i++) {
+      my_count_++;
+      barrier_->Wait();
+    }
+  }
+  ~BarrierClass() { *count_ += my_count_; }
+ private:
+  Barrier *barrier_;
+  int32 *count_;
+  int32 my_count_;
+};
+
+void TestMultiThreaderBarrier() {
+  int32 num_threads = 1 + Rand() % 10, count = 0;
+  Barrier barrier(num_threads);
+  {
+    BarrierClass c(&barrier, &count);
+    MultiThreader<BarrierClass> m(num_threads, c);
+  }
+  KALDI_ASSERT(count == 3 * num_threads);
+}
+
+// Runs several MultiThreaders at once from different threads; if they could
+// count on the same idle workers, some of the barriers would never be reached.
+class ConcurrentBarrierClass {
+ public:
+  void operator () (int32 i) const { TestMultiThreaderBarrier(); }
+};
+
+void TestConcurrentMultiThreaders() {
+  ConcurrentBarrierClass c;
+  int32 num_threads = 2 + Rand() % 4;
+  ParallelFor(0, num_threads, num_threads, c);
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++) {
+    TestThreadPoolSubmit();
+    TestParallelFor();
+    TestNestedParallelFor();
+    TestMultiThreaderBarrier();
+    TestConcurrentMultiThreaders();
+  }
+  KALDI_LOG << "Thread pool has " << ThreadPool::Global().NumThreads()
+            << " threads.";
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,167 @@
+// thread/kaldi-thread-pool.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include "thread/kaldi-thread-pool.h"
+
+namespace kaldi {
+
+ThreadPool *ThreadPool::global_pool_ = NULL;
+pthread_once_t ThreadPool::global_pool_once_ = PTHREAD_ONCE_INIT;
+
+void ThreadPool::CreateGlobal() {
+  global_pool_ = new ThreadPool();
+}
+
+ThreadPool &ThreadPool::Global() {
+  pthread_once(&global_pool_once_, ThreadPool::CreateGlobal);
+  return *global_pool_;
+}
+
+ThreadPool::ThreadPool(): next_worker_(0), num_pending_(0), num_queued_(0) {
+  int ret;
+  if ((ret = pthread_key_create(&worker_key_, NULL)) != 0) {
+    const char *c = strerror(ret);
+    KALDI_ERR << "Error creating thread-specific key, errno was: "
+              << (c ? c : "[NULL]");
+  }
+  if (pthread_mutex_init(&mutex_, NULL) != 0)
+    KALDI_ERR << "Cannot initialize pthread mutex";
+  if (pthread_cond_init(&task_queued_, NULL) != 0)
+    KALDI_ERR << "Cannot initialize pthread conditional variable";
+}
+
+void ThreadPool::StartWorker() {
+  Worker *worker = new Worker();
+  worker->pool = this;
+  worker->index = workers_.size();
+  pthread_attr_t pthread_attr;
+  pthread_attr_init(&pthread_attr);
+  // The threads are never joined; they live as long as the process.
+  pthread_attr_setdetachstate(&pthread_attr, PTHREAD_CREATE_DETACHED);
+  int ret;
+  if ((ret = pthread_create(&(worker->thread), &pthread_attr,
+                            ThreadPool::WorkerMain,
+                            static_cast<void*>(worker)))) {
+    const char *c = strerror(ret);
+    pthread_attr_destroy(&pthread_attr);
+    delete worker;
+    pthread_mutex_unlock(&mutex_);
+    KALDI_ERR << "Error creating thread, errno was: " << (c ? c : "[NULL]");
+  }
+  pthread_attr_destroy(&pthread_attr);
+  workers_.push_back(worker);
+}
+
+void ThreadPool::EnsureNumThreads(int32 num_threads) {
+  pthread_mutex_lock(&mutex_);
+  while (static_cast<int32>(workers_.size()) < num_threads)
+    StartWorker();
+  pthread_mutex_unlock(&mutex_);
+}
+
+int32 ThreadPool::NumThreads() {
+  pthread_mutex_lock(&mutex_);
+  int32 ans = workers_.size();
+  pthread_mutex_unlock(&mutex_);
+  return ans;
+}
+
+ThreadPool::Worker *ThreadPool::CurrentWorker() {
+  Worker *worker = static_cast<Worker*>(pthread_getspecific(worker_key_));
+  KALDI_ASSERT(worker == NULL || worker->pool == this);
+  return worker;
+}
+
+void ThreadPool::QueueTask(Worker *worker, ThreadPoolTask *task) {
+  if (worker == NULL) {
+    if (workers_.empty())
+      StartWorker();
+    worker = workers_[next_worker_ % workers_.size()];
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+  }
+  worker->tasks.push_back(task);
+  num_pending_++;
+  num_queued_++;
+}
+
+void ThreadPool::Submit(ThreadPoolTask *task) {
+  Worker *worker = CurrentWorker();
+  pthread_mutex_lock(&mutex_);
+  QueueTask(worker, task);
+  pthread_cond_signal(&task_queued_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void ThreadPool::SubmitGroup(const std::vector<ThreadPoolTask*> &tasks) {
+  Worker *worker = CurrentWorker();
+  int32 num_tasks = tasks.size();
+  pthread_mutex_lock(&mutex_);
+  // Counting the idle workers and queueing the tasks is done under one lock,
+  // so that the workers we count cannot be given to another group first.
+  while (static_cast<int32>(workers_.size()) - num_pending_ < num_tasks)
+    StartWorker();
+  for (int32 i = 0; i < num_tasks; i++)
+    QueueTask(worker, tasks[i]);
+  pthread_cond_broadcast(&task_queued_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+ThreadPoolTask *ThreadPool::TakeTask(Worker *self) {
+  pthread_mutex_lock(&mutex_);
+  while (num_queued_ == 0)
+    pthread_cond_wait(&task_queued_, &mutex_);
+  ThreadPoolTask *task = NULL;
+  if (!self->tasks.empty()) {
+    task = self->tasks.back();
+    self->tasks.pop_back();
+  } else {
+    // Our own deque is empty, so steal the oldest task of another worker.
+    // Since we hold mutex_ and num_queued_ > 0, one of them has a task.
+    int32 num_workers = workers_.size();
+    for (int32 k = 1; k < num_workers && task == NULL; k++) {
+      Worker *other = workers_[(self->index + k) % num_workers];
+      if (!other->tasks.empty()) {
+        task = other->tasks.front();
+        other->tasks.pop_front();
+      }
+    }
+  }
+  KALDI_ASSERT(task != NULL);
+  num_queued_--;
+  pthread_mutex_unlock(&mutex_);
+  return task;
+}
+
+void *ThreadPool::WorkerMain(void *worker_in) {
+  Worker *worker = static_cast<Worker*>(worker_in);
+  ThreadPool *pool = worker->pool;
+  pthread_setspecific(pool->worker_key_, worker);
+  while (true) {
+    ThreadPoolTask *task = pool->TakeTask(worker);
+    task->Run();
+    delete task;
+    pthread_mutex_lock(&pool->mutex_);
+    pool->num_pending_--;
+    pthread_mutex_unlock(&pool->mutex_);
+  }
+  return NULL;
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,250 @@
+// thread/kaldi-thread-pool.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_THREAD_KALDI_THREAD_POOL_H_
+#define KALDI_THREAD_KALDI_THREAD_POOL_H_ 1
+
+#include <pthread.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "thread/kaldi-mutex.h"
+#include "thread/kaldi-semaphore.h"
+
+namespace kaldi {
+
+/**
+   This header provides ThreadPool, a process-wide pool of persistent worker
+   threads, on which MultiThreader / RunMultiThreaded (kaldi-thread.h) and
+   TaskSequencer (kaldi-task-sequence.h) are implemented.  Creating a thread
+   costs far more than handing a task to an existing one, which matters when
+   the tasks are small, e.g. when decoding many short utterances.
+
+   Each worker thread has its own deque of tasks.  A task submitted from a
+   worker thread (e.g. from inside another task) goes on the back of that
+   worker's deque, and the worker takes its own tasks from the back; tasks
+   submitted from other threads are spread round-robin over the workers.  A
+   worker whose deque is empty steals from the front of the other workers'
+   deques, so the load is balanced even if tasks take very different times.
+
+   All the deques are protected by one mutex, and idle workers sleep on a
+   condition variable until a task is queued; the tasks are expected to be
+   large enough (utterances, chunks of a matrix) that the lock is not
+   contended.
+
+   Tasks that block waiting for other tasks (e.g. the copies of the object in
+   RunMultiThreaded(), which may wait on each other through a Barrier or a
+   producer-consumer queue) must all be running at the same time, or we could
+   deadlock.  Submit such tasks together with SubmitGroup(), which starts more
+   worker threads if there are not enough idle ones and queues the tasks in
+   the same critical section, so two groups submitted at the same time from
+   different threads cannot both count on the same idle workers.  The pool
+   only ever grows, to the largest number of threads that was needed at one
+   time.
+*/
+
+/// Base class for the tasks that ThreadPool runs.
+class ThreadPoolTask {
+ public:
+  /// Does the work of the task.  It is called once, from one of the pool's
+  /// threads, and after it returns the pool deletes the task.
+  virtual void Run() = 0;
+  virtual ~ThreadPoolTask() { }
+};
+
+
+class ThreadPool {
+ public:
+  /// Returns the process-wide thread pool, creating it (with no threads) the
+  /// first time it is called.  The pool is never destroyed.
+  static ThreadPool &Global();
+
+  /// Starts worker threads, if necessary, so that there are at least
+  /// "num_threads" of them.
+  void EnsureNumThreads(int32 num_threads);
+
+  /// Queues "task" to be run by one of the worker threads.  The pool takes
+  /// ownership of "task", and deletes it after calling its Run() function.
+  void Submit(ThreadPoolTask *task);
+
+  /// Queues "tasks", which may block waiting for each other, so that they
+  /// will all be running at the same time: it first starts worker threads,
+  /// if necessary, so that there is an idle worker for each of them in
+  /// addition to the tasks already submitted.  Takes ownership of the tasks.
+  void SubmitGroup(const std::vector<ThreadPoolTask*> &tasks);
+
+  /// Returns the number of worker threads.
+  int32 NumThreads();
+
+ private:
+  struct Worker {
+    ThreadPool *pool;
+    int32 index;  // index into workers_.
+    pthread_t thread;
+    std::deque<ThreadPoolTask*> tasks;  // protected by the pool's mutex_.
+  };
+
+  ThreadPool();
+
+  // Starts a new worker thread; the caller must hold mutex_.
+  void StartWorker();
+
+  // Adds "task" to the deque of "worker", or of the next worker in
+  // round-robin order if it is NULL; the caller must hold mutex_.
+  void QueueTask(Worker *worker, ThreadPoolTask *task);
+
+  // Waits until a task is queued, then removes it from the deque of worker
+  // "self" or, if that is empty, steals one from another worker.
+  ThreadPoolTask *TakeTask(Worker *self);
+
+  // Returns the Worker object of the calling thread, or NULL if it is not a
+  // worker thread of this pool.
+  Worker *CurrentWorker();
+
+  static void *WorkerMain(void *worker_in);
+
+  static void CreateGlobal();
+
+  // mutex_ protects workers_, the workers' deques, next_worker_,
+  // num_pending_ and num_queued_.  It is a raw pthread mutex because we wait
+  // on task_queued_ with it.
+  pthread_mutex_t mutex_;
+  pthread_cond_t task_queued_;  // signaled when a task is added to a deque.
+  std::vector<Worker*> workers_;
+  int32 next_worker_;  // Next worker to give a task submitted from outside.
+  int32 num_pending_;  // Number of tasks that were submitted but not finished.
+  int32 num_queued_;  // Number of tasks waiting in the deques.
+  pthread_key_t worker_key_;  // Thread-specific pointer to the Worker.
+
+  static ThreadPool *global_pool_;
+  static pthread_once_t global_pool_once_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+
+/// This is the internal state of ParallelFor(), which is shared between the
+/// calling thread and the tasks it submits; it is deleted by the last one to
+/// finish with it.
+template<class C>
+class ParallelForState {
+ public:
+  ParallelForState(int32 begin, int32 end, const C &c, int32 ref_count):
+      next_(begin), end_(end), c_(c), num_running_(0), ref_count_(ref_count),
+      closed_(false) { }
+
+  // Calls c_(i) for indices i that no other thread has taken yet, until there
+  // are none left.
+  void Work() {
+    while (true) {
+      mutex_.Lock();
+      int32 i = next_++;
+      mutex_.Unlock();
+      if (i >= end_) return;
+      c_(i);
+    }
+  }
+
+  // Called from the tasks in the pool.  Tasks that start after the calling
+  // thread has given up waiting for them (because all indices were done) do
+  // nothing.
+  void RunTask() {
+    mutex_.Lock();
+    bool closed = closed_;
+    if (!closed) num_running_++;
+    mutex_.Unlock();
+    if (!closed) {
+      Work();
+      mutex_.Lock();
+      num_running_--;
+      bool signal = (closed_ && num_running_ == 0);
+      mutex_.Unlock();
+      if (signal) done_.Signal();
+    }
+    Release();
+  }
+
+  // Called from the calling thread: does work, then waits for the tasks that
+  // started.
+  void RunCaller() {
+    Work();
+    mutex_.Lock();
+    closed_ = true;
+    bool wait = (num_running_ > 0);
+    mutex_.Unlock();
+    if (wait) done_.Wait();
+    Release();
+  }
+
+ private:
+  void Release() {
+    mutex_.Lock();
+    bool last = (--ref_count_ == 0);
+    mutex_.Unlock();
+    if (last) delete this;
+  }
+
+  Mutex mutex_;  // protects all the variables below except c_ and end_.
+  int32 next_;
+  int32 end_;
+  const C &c_;
+  int32 num_running_;
+  int32 ref_count_;
+  bool closed_;
+  Semaphore done_;
+};
+
+template<class C>
+class ParallelForTask: public ThreadPoolTask {
+ public:
+  explicit ParallelForTask(ParallelForState<C> *state): state_(state) { }
+  virtual void Run() { state_->RunTask(); }
+ private:
+  ParallelForState<C> *state_;
+};
+
+/// Calls c(i) for i = begin ... end - 1 using up to "num_threads" threads: the
+/// calling thread, plus up to num_threads - 1 tasks in the global ThreadPool.
+/// The indices are handed out one by one as threads become free, so this
+/// uses the CPUs well even if the calls take very different amounts of time;
+/// it is intended for cases where each call does a substantial amount of
+/// work.  C must have an operator () (int32 i) const, which must be safe to
+/// call from different threads at once (for different i).  Returns when all
+/// the calls are done.
+template<class C>
+void ParallelFor(int32 begin, int32 end, int32 num_threads, const C &c) {
+  int32 num_tasks = std::min(num_threads, end - begin) - 1;
+  if (num_tasks <= 0) {  // Just do it in this thread.
+    for (int32 i = begin; i < end; i++)
+      c(i);
+    return;
+  }
+  ThreadPool &pool = ThreadPool::Global();
+  pool.EnsureNumThreads(num_tasks);
+  ParallelForState<C> *state = new ParallelForState<C>(begin, end, c,
+                                                       num_tasks + 1);
+  for (int32 t = 0; t < num_tasks; t++)
+    pool.Submit(new ParallelForTask<C>(state));
+  state->RunCaller();
+}
+
+} // namespace kaldi
+
+#endif  // KALDI_THREAD_KALDI_THREAD_POOL_H_
@@ -28,7 +28,10 @@
 #endif
 
 #include <pthread.h>
+#include <algorithm>
+#include <vector>
 #include "thread/kaldi-barrier.h"
+#include "thread/kaldi-thread-pool.h"
 // This header provides a convenient mechanism for parallelization.  The idea is
 // that you have some range of integers, e.g. A ... B-1 (with B > A), and some
 // function call that takes a range of integers, and you partition these up into
@@ -41,21 +44,10 @@
 // multi-threading.
 
 
-// Description of MultiThreadPool and its usage:
-//
-// Usage of the RunMultiThreadedPersistent is the same as the usage of
-// RunMultiThreaded, except that the object provided ust inherit MultiThreadable
-// and it's run method isn't called, but operator() is called directly instead.
-// Member variables num_threads_ and thread_id_ must NOT be redefined in the
-// classes used, as they are called when using MultiThreadable*
-//
-// MultiThreadPool is a singleton class, it's instance is obtained using
-// MultiThreadPool::Instantiate(). First instantiation initializes the thread
-// pool using g_num_threads threads, each of those threads runs infinite loop in
-// ThreadWorker::run(). When RunMultiThreadedPersistent(c) is called, each
-// ThreadWorker is given a pointer to a copy of c and calls c() in it's thread.
-// After doing this, it Waits on barrier to sync with all the threads and the
-// main one, then Waits again until it receives another job.
+// The jobs are run on the persistent threads of the global ThreadPool (see
+// kaldi-thread-pool.h), so calling RunMultiThreaded() many times is cheap.
+// Also see ParallelFor() in kaldi-thread-pool.h, which is better when the work
+// consists of many independent pieces of different sizes.
 
 namespace kaldi {
 
@@ -121,47 +113,55 @@ class ExampleClass: public MultiThreadable {
 };
 
 
+// MultiThreader runs num_threads copies of c_in (with thread_id_ set to 0,
+// 1, ...) in parallel, using threads from the global ThreadPool (see
+// kaldi-thread-pool.h) so that no threads are created after the first time.
+// The copies are all guaranteed to run at the same time, so they may wait on
+// each other.  The destructor waits for them to finish, and then destroys
+// them.
 template<class C>
 class MultiThreader {
  public:
   MultiThreader(int32 num_threads,
                 const C &c_in):
-    threads_(new pthread_t[std::max<int32>(1, num_threads)]),
-    cvec_(std::max<int32>(1, num_threads), c_in) {
+    cvec_(std::max<int32>(1, num_threads), c_in),
+    num_tasks_(num_threads) {
     if (num_threads == 0) {
       // This is a special case with num_threads == 0, which behaves like with
-      // num_threads == 1 but without creating extra threads.  This can be
+      // num_threads == 1 but without using extra threads.  This can be
       // useful in GPU computations where threads cannot be used.
-      KALDI_PTHREAD_PTR(threads_[0]) = 0;
       cvec_[0].thread_id_ = 0;
       cvec_[0].num_threads_ = 1;
       (cvec_[0])();
     } else {
-      pthread_attr_t pthread_attr;
-      pthread_attr_init(&pthread_attr);
+      std::vector<ThreadPoolTask*> tasks(num_threads);
       for (int32 thread = 0; thread < num_threads; thread++) {
         cvec_[thread].thread_id_ = thread;
         cvec_[thread].num_threads_ = num_threads;
-        int32 ret;
-        if ((ret=pthread_create(&(threads_[thread]),
-                                &pthread_attr, C::run, &(cvec_[thread])))) {
-          const char *c = strerror(ret);
-          if (c == NULL) { c = "[NULL]"; }
-          KALDI_ERR << "Error creating thread, errno was: " << c;
-        }
+        tasks[thread] = new MultiThreaderTask(&(cvec_[thread]), &done_);
       }
+      ThreadPool::Global().SubmitGroup(tasks);
     }
   }
   ~MultiThreader() {
-    for (size_t thread = 0; thread < cvec_.size(); thread++)
-      if (KALDI_PTHREAD_PTR(threads_[thread]) != 0)
-        if (pthread_join(threads_[thread], NULL))
-          KALDI_ERR << "Error rejoining thread.";
-    delete [] threads_;
+    for (int32 thread = 0; thread < num_tasks_; thread++)
+      done_.Wait();
   }
  private:
-  pthread_t *threads_;
+  class MultiThreaderTask: public ThreadPoolTask {
+   public:
+    MultiThreaderTask(C *c, Semaphore *done): c_(c), done_(done) { }
+    virtual void Run() {
+      (*c_)();  // call operator () on it.
+      done_->Signal();
+    }
+   private:
+    C *c_;
+    Semaphore *done_;
+  };
   std::vector<C> cvec_;
+  int32 num_tasks_;
+  Semaphore done_;  // signaled when each task finishes.
 };
 
 /// Here, class C should inherit from MultiThreadable.  Note: if you want to
@@ -22,7 +22,10 @@
 #ifndef KALDI_UTIL_KALDI_TABLE_INL_H_
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
+#include <pthread.h>
 #include <algorithm>
+#include <cstring>
+#include <deque>
 #include "util/kaldi-io.h"
 #include "util/text-utils.h"
 #include "util/stl-utils.h" // for StringHasher.
@@ -45,6 +48,15 @@ template<class Holder> class SequentialTableReaderImplBase {
   virtual void FreeCurrent() = 0;
   virtual void Next() = 0;
   virtual bool Close() = 0;
+  // SwapHolder() is used by SequentialTableReaderBackgroundImpl to take the
+  // current object without copying it.  It is only valid to call it after
+  // Value() has returned successfully.  It gives the caller the holder that
+  // has the current object and takes ownership of "holder" (which should not
+  // have an object) instead.  Afterward the state is as after FreeCurrent().
+  virtual Holder *SwapHolder(Holder *holder) {
+    KALDI_ERR << "SwapHolder() not supported for this type of TableReader.";
+    return NULL;
+  }
   SequentialTableReaderImplBase() { }
   virtual ~SequentialTableReaderImplBase() { }
  private:
@@ -59,7 +71,8 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
  public:
   typedef typename Holder::T T;
 
-  SequentialTableReaderScriptImpl(): state_(kUninitialized) { }
+  SequentialTableReaderScriptImpl(): holder_(new Holder),
+                                     state_(kUninitialized) { }
 
   virtual bool Open(const std::string &rspecifier) {
     if (state_ != kUninitialized)
@@ -152,16 +165,24 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
       // This would be a coding error.
       KALDI_ERR << "TableReader: Value() called at the wrong time.";
     }
-    return holder_.Value();
+    return holder_->Value();
   }
   void FreeCurrent() {
     if (state_ == kLoadSucceeded) {
-      holder_.Clear();
+      holder_->Clear();
       state_ = kLoadFailed;
     } else {
       KALDI_WARN << "TableReader: FreeCurrent called at the wrong time.";
     }
   }
+  virtual Holder *SwapHolder(Holder *holder) {
+    if (state_ != kLoadSucceeded)
+      KALDI_ERR << "TableReader: SwapHolder() called at the wrong time.";
+    Holder *ans = holder_;
+    holder_ = holder;
+    state_ = kLoadFailed;  // as for FreeCurrent().
+    return ans;
+  }
   void Next() {
     while (1) {
       NextScpLine();
@@ -187,7 +208,7 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
     if (data_input_.IsOpen())
       data_input_.Close();
     if (state_ == kLoadSucceeded)
-      holder_.Clear();
+      holder_->Clear();
     if (!this->IsOpen())
       KALDI_ERR << "Close() called on input that was not open.";
     StateType old_state = state_;
@@ -208,7 +229,8 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
     // If you don't want this exception to be thrown you can
     // call Close() and check the status.
     if (state_ == kLoadSucceeded)
-      holder_.Clear();
+      holder_->Clear();
+    delete holder_;
   }
  private:  
   bool LoadCurrent() {
@@ -226,7 +248,7 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
       state_ = kLoadFailed;
       return false;
     } else {
-      if (holder_.Read(data_input_.Stream())) {
+      if (holder_->Read(data_input_.Stream())) {
         state_ = kLoadSucceeded;
         return true;
       } else {  // holder_ will not contain data.
@@ -241,7 +263,7 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
   // Reads the next line in the script file.
   void NextScpLine() {
     switch (state_) {
-      case kLoadSucceeded: holder_.Clear(); break;
+      case kLoadSucceeded: holder_->Clear(); break;
       case kHaveScpLine: case kLoadFailed: case kFileStart: break;
       default:
         // No other states are valid to call Next() from.
@@ -271,7 +293,7 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
   Input script_input_;  // Input object for the .scp file
   Input data_input_;   // Input object for the entries in
   // the script file.
-  Holder holder_;  // Holds the object.
+  Holder *holder_;  // Holds the object.
   bool binary_;  // Binary-mode archive.
   std::string key_;
   std::string rspecifier_;
@@ -312,7 +334,8 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
  public:
   typedef typename Holder::T T;
 
-  SequentialTableReaderArchiveImpl(): state_(kUninitialized) { }
+  SequentialTableReaderArchiveImpl(): holder_(new Holder),
+                                      state_(kUninitialized) { }
 
   virtual bool Open(const std::string &rspecifier) {
     if (state_ != kUninitialized) {
@@ -358,7 +381,7 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
   virtual void Next() {
     switch (state_) {
       case kHaveObject:
-        holder_.Clear(); break;
+        holder_->Clear(); break;
       case kFileStart: case kFreedObject:
         break;
       default:
@@ -391,7 +414,7 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
       return;
     }
     if (c != '\n') is.get();  // Consume the space or tab.
-    if (holder_.Read(is)) {
+    if (holder_->Read(is)) {
       state_ = kHaveObject;
       return;
     } else {
@@ -443,15 +466,23 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
         // coding error.
         KALDI_ERR << "Value() called on TableReader object at the wrong time.";
     }
-    return holder_.Value();
+    return holder_->Value();
   }
   virtual void FreeCurrent() {
     if (state_ == kHaveObject) {
-      holder_.Clear();
+      holder_->Clear();
       state_ = kFreedObject;
     } else
       KALDI_WARN << "TableReader: FreeCurernt called at the wrong time.";
   }
+  virtual Holder *SwapHolder(Holder *holder) {
+    if (state_ != kHaveObject)
+      KALDI_ERR << "TableReader: SwapHolder() called at the wrong time.";
+    Holder *ans = holder_;
+    holder_ = holder;
+    state_ = kFreedObject;
+    return ans;
+  }
 
   virtual bool Close() {
     if (! this->IsOpen())
@@ -459,7 +490,7 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
     if (input_.IsOpen())
       input_.Close();
     if (state_ == kHaveObject)
-      holder_.Clear();
+      holder_->Clear();
     bool ans;
     if (opts_.permissive) {
       ans = true;  // always return success.
@@ -486,11 +517,12 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
     // If you don't want this exception to be thrown you can
     // call Close() and check the status.
     if (state_ == kHaveObject)
-      holder_.Clear();
+      holder_->Clear();
+    delete holder_;
   }
  private:
   Input input_;  // Input object for the archive
-  Holder holder_;     // Holds the object.
+  Holder *holder_;     // Holds the object.
   std::string key_;
   std::string rspecifier_;
   std::string archive_rxfilename_;
@@ -507,6 +539,261 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
 };
 
 
+// This is the implementation for SequentialTableReader when the rspecifier
+// has the "bg" option.  It wraps an archive or script implementation, which a
+// background thread uses to read up to queue_size_ objects ahead of the
+// program (see the "bg=N" option), so that reading overlaps with whatever the program does with the
+// objects.  The objects are passed from the background thread to the program
+// with SwapHolder(), so they are not copied, and the holders are reused.
+template<class Holder>  class SequentialTableReaderBackgroundImpl:
+      public SequentialTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  // Takes ownership of "base_reader", which should not be open.
+  explicit SequentialTableReaderBackgroundImpl(
+      SequentialTableReaderImplBase<Holder> *base_reader):
+      base_reader_(base_reader), holder_(NULL), queue_size_(0), stop_(false),
+      thread_done_(false), thread_error_(false), state_(kUninitialized) {
+    if (pthread_mutex_init(&mutex_, NULL) != 0 ||
+        pthread_cond_init(&cond_, NULL) != 0)
+      KALDI_ERR << "Error initializing pthread mutex or condition variable.";
+  }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized)
+      if (!Close())  // call Close() yourself to suppress this exception.
+        KALDI_ERR << "TableReader::Open, error closing previous input: "
+                  << "rspecifier was " << rspecifier_;
+    rspecifier_ = rspecifier;
+    ClassifyRspecifier(rspecifier, NULL, &opts_);
+    queue_size_ = opts_.background_queue_size;
+    // Open the base reader in this thread, so that errors opening it are
+    // reported from Open().  It will have read the first object (or at least
+    // the first scp line).
+    if (!base_reader_->Open(rspecifier))
+      return false;
+    stop_ = false;
+    thread_done_ = false;
+    thread_error_ = false;
+    int ret = pthread_create(&thread_, NULL, RunThread, this);
+    if (ret != 0) {
+      KALDI_WARN << "Error creating thread to read " << rspecifier
+                 << ", errno was: " << (strerror(ret));
+      base_reader_->Close();
+      return false;
+    }
+    state_ = kFileStart;
+    Next();
+    return true;
+  }
+
+  virtual bool IsOpen() const {
+    return (state_ != kUninitialized);
+  }
+
+  virtual bool Done() const {
+    switch (state_) {
+      case kHaveObject: case kFreedObject: return false;
+      case kEof: return true;
+      default:
+        KALDI_ERR << "Done() called on TableReader object at the wrong time.";
+        return false;
+    }
+  }
+
+  virtual std::string Key() {
+    if (state_ != kHaveObject && state_ != kFreedObject)
+      KALDI_ERR << "Key() called on TableReader object at the wrong time.";
+    return key_;
+  }
+
+  virtual const T &Value() {
+    if (state_ != kHaveObject)
+      KALDI_ERR << "Value() called on TableReader object at the wrong time"
+                << " (or after FreeCurrent()).";
+    if (holder_ == NULL)  // The background thread failed to read it.
+      KALDI_ERR << "TableReader: failed to load object for key " << key_
+                << " from " << rspecifier_ << " (to suppress this error, add "
+                << "the permissive (p, ) option to the rspecifier.";
+    return holder_->Value();
+  }
+
+  virtual void FreeCurrent() {
+    if (state_ == kHaveObject) {
+      ReleaseHolder(holder_);
+      holder_ = NULL;
+      state_ = kFreedObject;
+    } else {
+      KALDI_WARN << "TableReader: FreeCurrent called at the wrong time.";
+    }
+  }
+
+  virtual void Next() {
+    switch (state_) {
+      case kHaveObject: case kFreedObject: case kFileStart: break;
+      default:
+        KALDI_ERR << "TableReader: Next() called wrongly.";
+    }
+    if (holder_ != NULL) {
+      ReleaseHolder(holder_);
+      holder_ = NULL;
+    }
+    pthread_mutex_lock(&mutex_);
+    while (queue_.empty() && !thread_done_)
+      pthread_cond_wait(&cond_, &mutex_);
+    if (queue_.empty()) {
+      state_ = kEof;
+    } else {
+      key_ = queue_.front().first;
+      holder_ = queue_.front().second;
+      queue_.pop_front();
+      state_ = kHaveObject;
+      pthread_cond_broadcast(&cond_);  // There is space in the queue now.
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  virtual bool Close() {
+    if (!IsOpen())
+      KALDI_ERR << "Close() called on TableReader twice or otherwise wrongly.";
+    StopThread();
+    bool ans = base_reader_->Close();
+    if (thread_error_) {
+      if (opts_.permissive) {
+        KALDI_WARN << "Error detected reading " << rspecifier_ << " in "
+                   << "background thread, ignoring it because permissive "
+                   << "mode specified.";
+      } else {
+        ans = false;
+      }
+    }
+    state_ = kUninitialized;
+    return ans;
+  }
+
+  virtual ~SequentialTableReaderBackgroundImpl() {
+    if (state_ != kUninitialized) {
+      StopThread();
+      if (thread_error_ && !opts_.permissive)
+        KALDI_WARN << "TableReader: error detected reading " << rspecifier_
+                   << " in background thread.";
+    }
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+    delete base_reader_;  // its destructor may throw if there was an error.
+  }
+
+ private:
+  static void *RunThread(void *this_ptr) {
+    static_cast<SequentialTableReaderBackgroundImpl<Holder>*>(this_ptr)->Run();
+    return NULL;
+  }
+
+  // This is what the background thread runs.
+  void Run() {
+    try {
+      while (!base_reader_->Done()) {
+        Holder *holder = NULL;
+        pthread_mutex_lock(&mutex_);
+        while (queue_.size() >= queue_size_ && !stop_)
+          pthread_cond_wait(&cond_, &mutex_);
+        bool stop = stop_;
+        if (!free_holders_.empty()) {
+          holder = free_holders_.back();
+          free_holders_.pop_back();
+        }
+        pthread_mutex_unlock(&mutex_);
+        if (stop) {
+          delete holder;
+          break;
+        }
+        if (holder == NULL) holder = new Holder;
+        std::string key = base_reader_->Key();
+        Holder *value_holder = NULL;
+        try {
+          base_reader_->Value();  // Loads the object, for scp files.
+          value_holder = base_reader_->SwapHolder(holder);
+        } catch (...) {
+          // Value() failed (for script files that are not permissive); the
+          // program gets the error if it calls Value() on this key.
+          delete holder;
+        }
+        pthread_mutex_lock(&mutex_);
+        queue_.push_back(std::make_pair(key, value_holder));
+        pthread_cond_broadcast(&cond_);
+        pthread_mutex_unlock(&mutex_);
+        base_reader_->Next();
+      }
+    } catch (...) {
+      KALDI_WARN << "Exception caught reading " << rspecifier_
+                 << " in background thread.";
+      thread_error_ = true;
+    }
+    pthread_mutex_lock(&mutex_);
+    thread_done_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  // Stops and joins the background thread and frees the holders.
+  void StopThread() {
+    pthread_mutex_lock(&mutex_);
+    stop_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+    if (pthread_join(thread_, NULL) != 0)
+      KALDI_ERR << "Error joining TableReader background thread.";
+    delete holder_;
+    holder_ = NULL;
+    for (size_t i = 0; i < queue_.size(); i++)
+      delete queue_[i].second;
+    queue_.clear();
+    for (size_t i = 0; i < free_holders_.size(); i++)
+      delete free_holders_[i];
+    free_holders_.clear();
+  }
+
+  // Clears a holder and gives it back to the background thread to reuse.
+  void ReleaseHolder(Holder *holder) {
+    holder->Clear();
+    pthread_mutex_lock(&mutex_);
+    free_holders_.push_back(holder);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  SequentialTableReaderImplBase<Holder> *base_reader_;  // Only used by the
+                                                        // background thread
+                                                        // while it runs.
+  std::string key_;
+  Holder *holder_;  // Holds the current object; NULL if it could not be read.
+  std::string rspecifier_;
+  RspecifierOptions opts_;
+  // The number of objects the background thread reads ahead of the program.
+  size_t queue_size_;
+
+  pthread_t thread_;
+  // mutex_ protects the variables below, and cond_ is signaled whenever
+  // they change.
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  std::deque<std::pair<std::string, Holder*> > queue_;  // Objects read ahead.
+  std::vector<Holder*> free_holders_;  // Cleared holders, for reuse.
+  bool stop_;  // Tells the background thread to stop.
+  bool thread_done_;  // Set when the background thread has finished.
+  bool thread_error_;  // Set if the background thread caught an exception.
+
+  enum {
+    kUninitialized,  // Uninitialized or closed.
+    kFileStart,      // [state we use internally: just opened.]
+    kEof,            // We got to the end of the table (or an error).
+    kHaveObject,     // We have an object (or holder_ == NULL if the
+                     // background thread failed to read it).
+    kFreedObject     // The user called FreeCurrent().
+  } state_;
+};
+
+
 template<class Holder>
 SequentialTableReader<Holder>::SequentialTableReader(const std::string &rspecifier): impl_(NULL) {
   if (rspecifier != "" && !Open(rspecifier))
@@ -520,7 +807,8 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
       KALDI_ERR << "Could not close previously open object.";
   // now impl_ will be NULL.
 
-  RspecifierType wt = ClassifyRspecifier(rspecifier, NULL, NULL);
+  RspecifierOptions opts;
+  RspecifierType wt = ClassifyRspecifier(rspecifier, NULL, &opts);
   switch (wt) {
     case kArchiveRspecifier:
       impl_ = new SequentialTableReaderArchiveImpl<Holder>();
@@ -532,6 +820,8 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
       KALDI_WARN << "Invalid rspecifier " << rspecifier;
       return false;
   }
+  if (opts.background)  // read in a background thread ("bg" option).
+    impl_ = new SequentialTableReaderBackgroundImpl<Holder>(impl_);
   if (!impl_->Open(rspecifier)) {
     delete impl_;
     impl_ = NULL;
@@ -656,6 +946,14 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
                                            NULL,
                                            &opts_);
     KALDI_ASSERT(ws == kArchiveWspecifier);  // or wrongly called.
+    if (opts_.write_index &&
+        ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "TableWriter: the idx option requires the archive to be "
+                 << "an actual file: wspecifier is " << wspecifier;
+      state_ = kUninitialized;
+      return false;
+    }
+    index_writer_.Clear();
 
     if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false means no binary header.
       state_ = kOpen;
@@ -695,12 +993,16 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key)) // e.g. empty string or has spaces...
       KALDI_ERR << "TableWriter: using invalid key " << key;
     output_.Stream() << key << ' ';
+    int64 offset = (opts_.write_index ? output_.Stream().tellp() :
+                    std::streampos(0));
     if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
       KALDI_WARN << "TableWriter: write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
       return false;
     }
+    if (opts_.write_index)
+      index_writer_.Add(key, offset, output_.Stream().tellp() - offset);
     if (state_ == kWriteError) return false;  // Even if this Write seems to have
     // succeeded, we fail because a previous Write failed and the archive may be
     // corrupted and unreadable.
@@ -725,6 +1027,8 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
   virtual bool Close() {
     if (!this->IsOpen() || !output_.IsOpen())
       KALDI_ERR << "TableWriter: Close called on a stream that was not open." << this->IsOpen() << ", " << output_.IsOpen();
+    int64 archive_size = (opts_.write_index && state_ == kOpen ?
+                          output_.Stream().tellp() : std::streampos(0));
     bool close_success = output_.Close();
     if (!close_success) {
       KALDI_WARN << "TableWriter: error closing stream: wspecifier is "
@@ -739,6 +1043,12 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
       return false;
     }
     state_ = kUninitialized;
+    if (opts_.write_index) {
+      bool ans = index_writer_.Write(ArchiveIndexFilename(archive_wxfilename_),
+                                     archive_size);
+      index_writer_.Clear();
+      return ans;  // Write() will have printed any warning.
+    }
     return true;
   }
 
@@ -757,6 +1067,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
+  ArchiveIndexWriter index_writer_;  // used if opts_.write_index.
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -949,6 +1260,14 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       KALDI_WARN << "When writing to both archive and script, the script file "
           "will generally not be interpreted correctly unless the archive is "
           "an actual file: wspecifier = " << wspecifier;
+    if (opts_.write_index &&
+        ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "TableWriter: the idx option requires the archive to be "
+                 << "an actual file: wspecifier is " << wspecifier;
+      state_ = kUninitialized;
+      return false;
+    }
+    index_writer_.Clear();
 
     if (!archive_output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false means no binary header.
       state_ = kUninitialized;
@@ -1036,6 +1355,9 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       state_ = kWriteError;
       return false;
     }
+    if (opts_.write_index)
+      index_writer_.Add(key, archive_os_pos,
+                        archive_os.tellp() - archive_os_pos);
 
     if (state_ == kWriteError) return false;  // Even if this Write seems to have
     // succeeded, we fail because a previous Write failed and the archive may be
@@ -1063,12 +1385,19 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     if (!this->IsOpen())
       KALDI_ERR << "TableWriter: Close called on a stream that was not open.";
     bool close_success = true;
+    int64 archive_size = (opts_.write_index && state_ == kOpen ?
+                          archive_output_.Stream().tellp() :
+                          std::streampos(0));
     if (archive_output_.IsOpen())
       if (!archive_output_.Close()) close_success = false;
     if (script_output_.IsOpen())
       if (!script_output_.Close()) close_success = false;
     bool ans = close_success && (state_ != kWriteError);
     state_ = kUninitialized;
+    if (ans && opts_.write_index)
+      ans = index_writer_.Write(ArchiveIndexFilename(archive_wxfilename_),
+                                archive_size);
+    index_writer_.Clear();
     return ans;
   }
 
@@ -1090,6 +1419,7 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
   std::string archive_wxfilename_;
   std::string script_wxfilename_;
   std::string wspecifier_;
+  ArchiveIndexWriter index_writer_;  // used if opts_.write_index.
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -1193,6 +1523,9 @@ TableWriter<Holder>::~TableWriter() {
 // [i.e. write it as ark, scp].  The main reason to read archives directly
 // is if they are part of a pipe, and in this case it's not seekable, so
 // we implement only this case.
+// [The exception is archives written with an index (the "idx" option); for
+// these the index stores the file offsets for us, and we seek in the archive;
+// see RandomAccessTableReaderIndexedArchiveImpl.]
 //
 // Note that we will rarely in practice have to keep in memory everything in
 // the archive, as long as things are only read once from the archive (the
@@ -2077,6 +2410,133 @@ template<class Holder>  class RandomAccessTableReaderUnsortedArchiveImpl:
 };
 
 
+// RandomAccessTableReaderIndexedArchiveImpl is used when the rspecifier has the
+// "idx" option.  It looks keys up in the archive's index (see table-index.h),
+// which it memory-maps, and reads each object by seeking in the archive, which
+// stays open; so unlike the other archive implementations it never reads the
+// archive sequentially or stores objects other than the last one asked for.
+// Note: the code for this class is similar to RandomAccessTableReaderScriptImpl.
+template<class Holder>  class RandomAccessTableReaderIndexedArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderIndexedArchiveImpl(): state_(kUninitialized) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized)
+      KALDI_ERR << "Opening already open RandomAccessTableReader: "
+                << "call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier,
+                                           &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.use_index);  // or wrongly
+                                                                // called.
+    if (!index_.Open(archive_rxfilename_)) {
+      KALDI_WARN << "Could not open the index of the archive: rspecifier is "
+                 << rspecifier;  // more specific warning printed already.
+      return false;
+    }
+    state_ = kNotHaveObject;
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "HasKey called on RandomAccessTableReader object that is "
+                << "not open.";
+    if (state_ == kHaveObject && key == current_key_)
+      return true;
+    // In permissive mode, we have to check that we can read the object
+    // before we assert that the key is there.
+    if (opts_.permissive)
+      return ReadObject(key);
+    else
+      return (index_.Lookup(key) != NULL);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "Value() called on non-open object.";
+    if (!(state_ == kHaveObject && key == current_key_)) {
+      if (index_.Lookup(key) == NULL)
+        KALDI_ERR << "Could not get item for key " << key
+                  << ", rspecifier is " << rspecifier_ << " [to ignore this, "
+                  << "add the p, (permissive) option to the rspecifier.";
+      if (!ReadObject(key))
+        KALDI_ERR << "Error reading object for key " << key
+                  << " from archive: rspecifier is " << rspecifier_;
+    }
+    return holder_.Value();
+  }
+
+  virtual bool Close() {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "Close() called on RandomAccessTableReader that was not "
+                << "open.";
+    holder_.Clear();
+    index_.Close();
+    if (input_.IsOpen())
+      input_.Close();
+    current_key_ = "";
+    state_ = kUninitialized;
+    // Errors in the archive would only affect the objects we read, and we
+    // reported those when they were read.
+    return true;
+  }
+
+  virtual ~RandomAccessTableReaderIndexedArchiveImpl() {
+    if (state_ == kHaveObject)
+      holder_.Clear();
+  }
+
+ private:
+  // Reads the object for "key" into holder_, if "key" is in the index.
+  // Returns true on success; prints a warning if the object could not be
+  // read.
+  bool ReadObject(const std::string &key) {
+    const ArchiveIndexEntry *entry = index_.Lookup(key);
+    if (entry == NULL) return false;
+    if (state_ == kHaveObject) {
+      holder_.Clear();
+      state_ = kNotHaveObject;
+    }
+    std::ostringstream offset_rxfilename;  // e.g. foo.ark:12345
+    offset_rxfilename << archive_rxfilename_ << ':' << entry->offset;
+    // If input_ is already open on this archive, this just seeks.
+    if (!input_.Open(offset_rxfilename.str())) {
+      KALDI_WARN << "Error opening stream "
+                 << PrintableRxfilename(offset_rxfilename.str());
+      return false;
+    }
+    if (!holder_.Read(input_.Stream())) {
+      KALDI_WARN << "Error reading object from stream "
+                 << PrintableRxfilename(offset_rxfilename.str());
+      return false;
+    }
+    current_key_ = key;
+    state_ = kHaveObject;
+    return true;
+  }
+
+  Input input_;  // Keeps the archive open between reads.
+  ArchiveIndex index_;
+  RspecifierOptions opts_;
+  std::string rspecifier_;  // rspecifier used to open it; for messages.
+  std::string archive_rxfilename_;
+
+  std::string current_key_;  // Key of object in holder_
+  Holder holder_;
+
+  enum {  //             [Is index_ open?]  [Does holder_ contain object?]
+    kUninitialized,  //       no                   no
+    kNotHaveObject,  //       yes                  no
+    kHaveObject      //       yes                  yes
+  } state_;
+};
+
+
 
 
 
@@ -2099,7 +2559,9 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
-      if (opts.sorted) {
+      if (opts.use_index) {
+        impl_ = new RandomAccessTableReaderIndexedArchiveImpl<Holder>();
+      } else if (opts.sorted) {
         if (opts.called_sorted) // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
         else
@@ -167,6 +167,19 @@ void UnitTestClassifyWspecifier() {
     KALDI_ASSERT(ans == kBothWspecifier && ark == "" && scp == "" && opts.binary == true && opts.flush == false);
   }
 
+  {
+    std::string a = "ark,idx:foo";
+    std::string ark = "x", scp = "y"; WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && ark == "foo" && scp == "" && opts.write_index);
+  }
+
+  {
+    std::string a = "scp,idx:foo";  // indexes are only for archives.
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, NULL);
+    KALDI_ASSERT(ans == kNoWspecifier);
+  }
+
 
 }
 
@@ -317,6 +330,38 @@ void UnitTestClassifyRspecifier() {
     KALDI_ASSERT(ans == kArchiveRspecifier && b == "a");
   }
 
+  {
+    std::string a = "p,idx,ark:a", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && b == "a" && opts.use_index &&
+                 opts.permissive);
+  }
+  {
+    std::string a = "idx,scp:a";  // indexes are only for archives.
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+  {
+    std::string a = "bg,scp:a", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && b == "a" && opts.background &&
+                 opts.background_queue_size == 2);
+  }
+  {
+    std::string a = "bg=5,ark:a", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && b == "a" && opts.background &&
+                 opts.background_queue_size == 5);
+  }
+  {
+    std::string a = "bg=0,ark:a";  // the queue size must be positive.
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
 
 }
 
@@ -882,6 +927,129 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
 }
 
 
+// Reads with the "bg" option (reading in a background thread).
+void UnitTestTableSequentialBackground(bool binary, bool read_scp) {
+  int32 sz = Rand() % 20;
+  std::vector<std::string> k;
+  std::vector<std::vector<int32> > v;
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    k.push_back(os.str());
+    v.push_back(std::vector<int32>(Rand() % 5, i));
+  }
+  Int32VectorWriter bw(binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                       "t,ark,scp:tmpf,tmpf.scp");
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[i], v[i]);
+  KALDI_ASSERT(bw.Close());
+
+  {
+    const char *bg_options[] = { "bg", "bg=1", "bg=8" };
+    std::string bg = bg_options[Rand() % 3];
+    SequentialInt32VectorReader sbr(read_scp ? bg + ",scp:tmpf.scp" :
+                                    (Rand() % 2 == 0 ? bg + ",ark:tmpf" :
+                                     bg + ",ark:cat tmpf|"));
+    int32 i = 0;
+    for (; !sbr.Done(); sbr.Next(), i++) {
+      KALDI_ASSERT(i < sz && sbr.Key() == k[i]);
+      if (Rand() % 4 == 0) sbr.FreeCurrent();
+      else KALDI_ASSERT(sbr.Value() == v[i]);
+    }
+    KALDI_ASSERT(i == sz);
+    KALDI_ASSERT(sbr.Close());
+  }
+  {  // Closing before the end should stop the background thread cleanly.
+    SequentialInt32VectorReader sbr("bg,ark:tmpf");
+    if (!sbr.Done()) sbr.Next();
+    KALDI_ASSERT(sbr.Close());
+  }
+  if (read_scp && sz > 0) {
+    // An scp file with a missing file: with "p", it should be skipped; without
+    // it, only Value() on that key should fail.
+    std::vector<std::pair<std::string, std::string> > script;
+    KALDI_ASSERT(ReadScriptFile("tmpf.scp", true, &script));
+    int32 bad = Rand() % sz;
+    script[bad].second = "nonexistent-file";
+    KALDI_ASSERT(WriteScriptFile("tmpf.scp", script));
+    SequentialInt32VectorReader sbr("p,bg,scp:tmpf.scp");
+    int32 i = 0;
+    for (; !sbr.Done(); sbr.Next(), i++) {
+      if (i == bad) i++;
+      KALDI_ASSERT(sbr.Key() == k[i] && sbr.Value() == v[i]);
+    }
+    KALDI_ASSERT(i == sz || (bad == sz - 1 && i == sz - 1));
+    KALDI_ASSERT(sbr.Close());
+    SequentialInt32VectorReader sbr2("bg,scp:tmpf.scp");
+    for (i = 0; !sbr2.Done(); sbr2.Next(), i++) {
+      KALDI_ASSERT(sbr2.Key() == k[i]);
+      if (i != bad) {
+        KALDI_ASSERT(sbr2.Value() == v[i]);
+      } else {
+        bool threw = false;
+        try {
+          sbr2.Value();
+        } catch (...) {
+          threw = true;
+        }
+        KALDI_ASSERT(threw);
+      }
+    }
+    KALDI_ASSERT(i == sz && sbr2.Close());
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
+// Writes an archive with an index, and reads it with the "idx" option.
+void UnitTestTableRandomIndexed(bool binary, bool write_scp) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<std::vector<int32> > v;
+
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back( CharToString( 'a' + static_cast<char>(i)));
+    if (i%2 == 0) k.back() = k.back() +  CharToString( 'a' + i);  // make them different lengths.
+    v.push_back( std::vector<int32>() );
+    int32 sz2 = Rand() % 5;
+    for (int32 j = 0; j  < sz2; j++)
+      v.back().push_back( Rand() % 100);
+  }
+  RandomizeVector(&k);  // the index does not need the keys to be sorted.
+
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      (write_scp ? "ark,scp,idx:tmpf,tmpf.scp" : "ark,idx:tmpf");
+  Int32VectorWriter bw(wspecifier);
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[i], v[i]);
+  KALDI_ASSERT(bw.Close());
+
+  {
+    RandomAccessInt32VectorReader sbr(Rand() % 2 == 0 ? "idx,ark:tmpf" :
+                                      "p,idx,ark:tmpf");
+    KALDI_ASSERT(!sbr.HasKey("z"));  // no such key.
+    for (int32 n = 0; n < 2 * sz; n++) {
+      int32 i = Rand() % sz;
+      if (Rand() % 2 == 0)
+        KALDI_ASSERT(sbr.HasKey(k[i]));
+      KALDI_ASSERT(sbr.Value(k[i]) == v[i]);
+    }
+    KALDI_ASSERT(sbr.Close());
+  }
+
+  // If the archive is rewritten without the index, the old index is stale and
+  // we should refuse to use it.
+  if (sz > 0) {
+    Int32VectorWriter bw2(binary ? "b,ark:tmpf" : "t,ark:tmpf");
+    bw2.Write(k[0], std::vector<int32>(1000, 1));
+    KALDI_ASSERT(bw2.Close());
+    RandomAccessInt32VectorReader sbr;
+    KALDI_ASSERT(!sbr.Open("idx,ark:tmpf"));
+  }
+  unlink("tmpf");
+  unlink("tmpf.idx");
+  unlink("tmpf.scp");
+}
 
 }  // end namespace kaldi.
 
@@ -904,6 +1072,8 @@ int main() {
       UnitTestTableSequentialInt32PairVectorBoth(b, c);
       UnitTestTableSequentialInt32VectorVectorBoth(b, c);
       UnitTestTableSequentialBaseFloatVectorBoth(b, c);
+      UnitTestTableRandomIndexed(b, c);
+      UnitTestTableSequentialBackground(b, c);
       for (int k = 0; k < 2; k++) {
         bool d = (k == 0);
         for (int l = 0; l < 2; l++) {
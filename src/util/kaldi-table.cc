@@ -155,6 +155,7 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   // between commas.
 
   WspecifierType ws = kNoWspecifier;
+  bool index = false;  // true if we saw "idx".
 
   if (opts != NULL)
     *opts = WspecifierOptions(); // Make sure all the defaults are as in the
@@ -173,6 +174,9 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->write_index = true;
+      index = true;
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else return kNoWspecifier;  // We do not allow "scp, ark", only "ark, scp".
@@ -184,6 +188,8 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       return kNoWspecifier;  // Could not interpret this option.
     }
   }
+  if (index && ws == kScriptWspecifier)
+    return kNoWspecifier;  // Indexes are only for archives.
 
   switch (ws) {
     case kArchiveWspecifier:
@@ -253,6 +259,7 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // between commas.
 
   RspecifierType rs = kNoRspecifier;
+  bool index = false;  // true if we saw "idx".
 
   for (size_t i = 0; i < split_first_part.size(); i++) {
     const std::string &str = split_first_part[i];  // e.g. "b", "t", "f", "ark", "scp".
@@ -276,6 +283,21 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = true;
     } else if (!strcmp(c, "ncs")) {
       if (opts) opts->called_sorted = false;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->use_index = true;
+      index = true;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg=", 3)) {
+      int32 queue_size;
+      if (!ConvertStringToInteger(c + 3, &queue_size) || queue_size <= 0)
+        return kNoRspecifier;
+      if (opts) {
+        opts->background = true;
+        opts->background_queue_size = queue_size;
+      }
+    } else if (!strcmp(c, "nbg")) {
+      if (opts) opts->background = false;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else return kNoRspecifier;  // Repeated or combined ark and scp options invalid.
@@ -286,6 +308,8 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       return kNoRspecifier;  // Could not interpret this option.
     }
   }
+  if (index && rs == kScriptRspecifier)
+    return kNoRspecifier;  // Indexes are only for archives.
   if ((rs == kArchiveRspecifier || rs == kScriptRspecifier)
      && wxfilename != NULL)
     *wxfilename = after_colon;
@@ -27,6 +27,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/kaldi-holder.h"
+#include "util/table-index.h"
 
 namespace kaldi {
 
@@ -70,12 +71,18 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  idx means also write an index of the archive, in the file whose name is
+//     the archive filename with ".idx" appended, when the archive is closed
+//     (only for ark and ark,scp, and the archive must be an actual file).  The
+//     index lets RandomAccessTableReader look keys up directly; see the idx
+//     option of rspecifiers, and table-index.h.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
+//  ark,idx:foo.ark
 //
 //  The meanings of rxfilename and wxfilename are as described in
 //  kaldi-stream.h (they are filenames but include pipes, stdin/stdout
@@ -113,7 +120,9 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive; // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool write_index;  // write an index of the archive (ark,idx:foo.ark).
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       write_index(false) { }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -178,6 +187,22 @@ bool WriteScriptFile(std::ostream &os,
 //       corresponding option).
 //      [any of the above options can be prefixed by n to negate them, e.g. no, ns,
 //       ncs, np; but these aren't currently useful as you could just omit the option].
+//   idx means (for RandomAccessTableReader reading an archive that is an actual
+//       file) that we look up keys in the archive's index, which must have been
+//       written with it (see the idx option of wspecifiers).  Each lookup is
+//       then a binary search in the memory-mapped index and a seek in the
+//       archive, which stays open, so we neither read the archive sequentially
+//       nor keep objects in memory, and the o, s and cs options are not
+//       needed.  SequentialTableReader ignores this option.
+//   bg  means (for SequentialTableReader) that the objects are read in a
+//       background thread, which keeps a few objects ahead of the program, so
+//       that reading (and e.g. decompressing, or waiting for a network
+//       filesystem or a pipe) overlaps with the computation.  The objects are
+//       given to the program in the usual order.  RandomAccessTableReader
+//       ignores this option.
+//   bg=N is like bg but the background thread keeps up to N objects ahead of
+//       the program (the default is 2); more helps if the time taken to read
+//       the objects varies a lot, at the cost of memory.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -186,6 +211,9 @@ bool WriteScriptFile(std::ostream &os,
 //  So for instance the following would be a valid rspecifier:
 //
 //   "o, s, p, ark:gunzip -c foo.gz|"
+//
+//  and so would "p, idx, ark:foo.ark", "bg, scp:feats.scp" and
+//  "bg=8, ark:foo.ark".
 
 struct  RspecifierOptions {
   // These options only make a difference for the RandomAccessTableReader class.
@@ -198,9 +226,16 @@ struct  RspecifierOptions {
   // For archive files it will suppress errors getting thrown if the archive
   
   // is corrupted and can't be read to the end.
+  bool use_index;  // look up keys in the archive's index (idx, ark:foo.ark).
+  bool background;  // SequentialTableReader reads ahead in a background
+                    // thread (bg, ark:foo.ark).
+  int32 background_queue_size;  // How many objects it reads ahead
+                                // (bg=4, ark:foo.ark).
 
   RspecifierOptions(): once(false), sorted(false),
-                       called_sorted(false), permissive(false) { }
+                       called_sorted(false), permissive(false),
+                       use_index(false), background(false),
+                       background_queue_size(2) { }
 };
 
 enum RspecifierType  {
@@ -0,0 +1,59 @@
+// util/mapped-file-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/mapped-file.h"
+#include "util/kaldi-io.h"
+#ifndef _MSC_VER
+#include <unistd.h>  // for unlink.
+#endif
+
+namespace kaldi {
+
+void UnitTestMappedFile() {
+  int32 size = (Rand() % 2 == 0 ? 0 : Rand() % 100000);
+  std::string contents;
+  for (int32 i = 0; i < size; i++)
+    contents.push_back(static_cast<char>(Rand() % 256));
+  {
+    Output ko("tmpf", true, false);
+    ko.Stream().write(contents.data(), contents.size());
+  }
+  // Read it as a file (memory-mapped) and through a pipe (read into memory).
+  for (int32 i = 0; i < 2; i++) {
+    MappedFile file;
+    KALDI_ASSERT(!file.IsOpen());
+    KALDI_ASSERT(file.Open(i == 0 ? "tmpf" : "cat tmpf |"));
+    KALDI_ASSERT(file.IsOpen() && file.Size() == contents.size());
+    KALDI_ASSERT(std::string(file.Data(), file.Size()) == contents);
+    KALDI_ASSERT(reinterpret_cast<size_t>(file.Data()) % 8 == 0);
+    file.Close();
+    KALDI_ASSERT(!file.IsOpen());
+  }
+  MappedFile file;
+  KALDI_ASSERT(!file.Open("nonexistent-file"));
+  unlink("tmpf");
+}
+
+}  // end namespace kaldi
+
+int main() {
+  for (int i = 0; i < 10; i++)
+    kaldi::UnitTestMappedFile();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,109 @@
+// util/mapped-file.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "util/mapped-file.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+bool MappedFile::Open(const std::string &rxfilename) {
+  Close();
+#ifndef _MSC_VER
+  if (ClassifyRxfilename(rxfilename) == kFileInput) {
+    int fd = open(rxfilename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      KALDI_WARN << "Could not open file " << rxfilename << ": "
+                 << strerror(errno);
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      KALDI_WARN << "Could not stat file " << rxfilename << ": "
+                 << strerror(errno);
+      close(fd);
+      return false;
+    }
+    if (st.st_size > 0) {  // mmap() fails for empty files.
+      void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);  // the mapping stays valid after closing the file.
+      if (addr == MAP_FAILED) {
+        KALDI_WARN << "Could not memory-map file " << rxfilename << ": "
+                   << strerror(errno);
+        return false;
+      }
+      data_ = static_cast<char*>(addr);
+      size_ = st.st_size;
+      is_mapped_ = true;
+      return true;
+    }
+    close(fd);
+  }
+#endif
+  // Not an ordinary file (or no mmap on this platform): read it into memory.
+  Input ki;
+  if (!ki.Open(rxfilename)) {
+    KALDI_WARN << "Could not open " << PrintableRxfilename(rxfilename);
+    return false;
+  }
+  std::istream &is = ki.Stream();
+  std::vector<char> contents;
+  char buf[65536];
+  while (is.read(buf, sizeof(buf)) || is.gcount() > 0)
+    contents.insert(contents.end(), buf, buf + is.gcount());
+  if (is.bad()) {
+    KALDI_WARN << "Error reading from " << PrintableRxfilename(rxfilename);
+    return false;
+  }
+  // Allocate as int64 to get suitable alignment; allocate at least one element
+  // so that Data() is non-NULL for empty files.
+  size_ = contents.size();
+  int64 *buffer = new int64[(size_ + sizeof(int64)) / sizeof(int64)];
+  data_ = reinterpret_cast<char*>(buffer);
+  if (size_ > 0)
+    std::memcpy(data_, &(contents[0]), size_);
+  is_mapped_ = false;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ == NULL) return;
+#ifndef _MSC_VER
+  if (is_mapped_) {
+    munmap(data_, size_);
+  } else
+#endif
+  {
+    delete [] reinterpret_cast<int64*>(data_);
+  }
+  data_ = NULL;
+  size_ = 0;
+  is_mapped_ = false;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,83 @@
+// util/mapped-file.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_MAPPED_FILE_H_
+#define KALDI_UTIL_MAPPED_FILE_H_
+
+#include <streambuf>
+#include <string>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// MappedFile gives read-only access to the whole contents of a file as one
+/// block of memory.  Ordinary files are memory-mapped (read-only and shared,
+/// so that processes reading the same file share one copy of it in the page
+/// cache, and only the pages that are actually touched get read from disk).
+/// Anything else that Input can read (pipes, standard input), and any file on
+/// platforms without mmap, is read into memory instead.  Either way the data
+/// is aligned to at least 8 bytes.
+class MappedFile {
+ public:
+  MappedFile(): data_(NULL), size_(0), is_mapped_(false) { }
+
+  /// Opens "rxfilename" (closing any previously open file first).  Returns
+  /// true on success; on failure prints a warning and returns false.
+  bool Open(const std::string &rxfilename);
+
+  bool IsOpen() const { return (data_ != NULL); }
+
+  /// Returns the contents of the file; only valid while the file is open.
+  /// Do not write to it.
+  const char *Data() const { return data_; }
+
+  /// Returns the size of the file in bytes.
+  size_t Size() const { return size_; }
+
+  /// Returns true if the file was memory-mapped rather than read into memory.
+  bool IsMapped() const { return is_mapped_; }
+
+  /// Unmaps or frees the data.  Pointers into it become invalid.
+  void Close();
+
+  ~MappedFile() { Close(); }
+
+ private:
+  char *data_;
+  size_t size_;
+  bool is_mapped_;  // true if mmap'ed, false if allocated with new [].
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+/// A read-only stream buffer on a block of memory (e.g. the Data() of a
+/// MappedFile), so the normal Read() functions can be used on it without
+/// copying it.
+class MemoryInputBuffer: public std::streambuf {
+ public:
+  MemoryInputBuffer(const char *data, size_t size) {
+    char *begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+  // Returns the number of bytes consumed so far.
+  size_t Position() const { return gptr() - eback(); }
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_MAPPED_FILE_H_
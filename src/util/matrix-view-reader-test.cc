@@ -0,0 +1,143 @@
+// util/matrix-view-reader-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/matrix-view-reader.h"
+#include "util/table-types.h"
+#include "matrix/compressed-matrix.h"
+#ifndef _MSC_VER
+#include <unistd.h>  // for unlink.
+#endif
+
+namespace kaldi {
+
+// Writes random matrices to tmpf (and tmpf.scp and tmpf.idx).  If
+// "aligned_keys" is true, all keys have length 4, so with binary float
+// matrices every matrix starts at a multiple of 4 bytes into the archive.
+static void WriteTestArchive(bool binary, bool compress, bool aligned_keys,
+                             std::vector<std::string> *keys,
+                             std::vector<Matrix<BaseFloat> > *mats) {
+  int32 sz = Rand() % 10;
+  keys->clear();
+  mats->clear();
+  for (int32 i = 0; i < sz; i++) {
+    std::string key = "utt" + std::string(1, 'a' + static_cast<char>(i));
+    if (!aligned_keys && i % 2 == 0) key += "x";
+    keys->push_back(key);
+    // (no empty compressed matrices: CompressedMatrix::Write() writes 4 more
+    // bytes for those than it reads back.)
+    int32 rows = (compress ? 1 : 0) + Rand() % 20,
+        cols = (rows == 0 ? 0 : 1 + Rand() % 15);
+    mats->push_back(Matrix<BaseFloat>(rows, cols));
+    mats->back().SetRandn();
+  }
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      "ark,scp,idx:tmpf,tmpf.scp";
+  if (compress) {
+    CompressedMatrixWriter writer(wspecifier);
+    for (int32 i = 0; i < sz; i++) {
+      CompressedMatrix cmat((*mats)[i]);
+      writer.Write((*keys)[i], cmat);
+      cmat.CopyToMat(&((*mats)[i]));  // what we expect to read back.
+    }
+  } else {
+    BaseFloatMatrixWriter writer(wspecifier);
+    for (int32 i = 0; i < sz; i++)
+      writer.Write((*keys)[i], (*mats)[i]);
+  }
+}
+
+void UnitTestSequentialMatrixViewReader(bool binary, bool compress,
+                                        bool aligned_keys) {
+  std::vector<std::string> keys;
+  std::vector<Matrix<BaseFloat> > mats;
+  WriteTestArchive(binary, compress, aligned_keys, &keys, &mats);
+
+  const char *rspecifiers[] = { "ark:tmpf", "scp:tmpf.scp", "ark:cat tmpf |" };
+  for (int32 r = 0; r < 3; r++) {
+    SequentialBaseFloatMatrixViewReader reader(rspecifiers[r]);
+    size_t i = 0;
+    for (; !reader.Done(); reader.Next(), i++) {
+      KALDI_ASSERT(i < keys.size() && reader.Key() == keys[i]);
+      const SubMatrix<BaseFloat> value(reader.Value());
+      AssertEqual(value, mats[i], (compress ? 1.0e-03 : 1.0e-05));
+      // We can only avoid copying if the matrix was written in binary without
+      // compression and it is not being read from a pipe; with keys of length
+      // 4 the data is always suitably aligned, otherwise only sometimes.
+      bool can_view = (binary && !compress && r != 2 && value.NumRows() != 0);
+      if (aligned_keys || !can_view) {
+        KALDI_ASSERT(reader.ValueIsView() == can_view);
+      }
+    }
+    KALDI_ASSERT(i == keys.size());
+    KALDI_ASSERT(reader.Close());
+  }
+
+  // Reading as double always requires a copy.
+  SequentialDoubleMatrixViewReader double_reader("ark:tmpf");
+  size_t i = 0;
+  for (; !double_reader.Done(); double_reader.Next(), i++) {
+    KALDI_ASSERT(double_reader.Key() == keys[i]);
+    Matrix<BaseFloat> value(double_reader.Value());
+    AssertEqual(value, mats[i], (compress ? 1.0e-03 : 1.0e-05));
+    KALDI_ASSERT(!double_reader.ValueIsView());
+  }
+  KALDI_ASSERT(i == keys.size());
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  unlink("tmpf.idx");
+}
+
+void UnitTestRandomAccessMatrixViewReader(bool binary, bool compress) {
+  std::vector<std::string> keys;
+  std::vector<Matrix<BaseFloat> > mats;
+  WriteTestArchive(binary, compress, Rand() % 2 == 0, &keys, &mats);
+
+  const char *rspecifiers[] = { "idx,ark:tmpf", "p,idx,ark:tmpf",
+                                "scp:tmpf.scp" };
+  for (int32 r = 0; r < 3; r++) {
+    RandomAccessBaseFloatMatrixViewReader reader(rspecifiers[r]);
+    KALDI_ASSERT(!reader.HasKey("foo"));
+    for (size_t n = 0; n < 2 * keys.size(); n++) {
+      size_t i = Rand() % keys.size();
+      KALDI_ASSERT(reader.HasKey(keys[i]));
+      AssertEqual(reader.Value(keys[i]), mats[i],
+                  (compress ? 1.0e-03 : 1.0e-05));
+    }
+    KALDI_ASSERT(reader.Close());
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  unlink("tmpf.idx");
+}
+
+}  // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++) {
+    for (int32 j = 0; j < 8; j++) {
+      bool binary = (j % 2 == 0), compress = ((j / 2) % 2 == 0),
+          aligned_keys = (j / 4 == 0);
+      UnitTestSequentialMatrixViewReader(binary, compress, aligned_keys);
+    }
+    for (int32 j = 0; j < 4; j++)
+      UnitTestRandomAccessMatrixViewReader(j % 2 == 0, j / 2 == 0);
+  }
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,501 @@
+// util/matrix-view-reader.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cctype>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+
+#include "util/matrix-view-reader.h"
+#include "util/kaldi-io.h"
+#include "util/text-utils.h"
+
+namespace kaldi {
+
+namespace {
+
+// Size of the header of a binary matrix: "\0B", then the token "FM " or
+// "DM ", then the number of rows and columns, each as a size byte (4) and an
+// int32.
+const size_t kBinaryMatrixHeaderSize = 15;
+
+// If the object at data[0 .. size-1] is a matrix written in binary mode as
+// Matrix<Real> and not truncated, outputs its dimensions and returns true.
+template<typename Real>
+bool ParseBinaryMatrixHeader(const char *data, size_t size,
+                             MatrixIndexT *num_rows, MatrixIndexT *num_cols) {
+  const char *token = (sizeof(Real) == 4 ? "FM " : "DM ");
+  if (size < kBinaryMatrixHeaderSize || data[0] != '\0' || data[1] != 'B' ||
+      std::memcmp(data + 2, token, 3) != 0 || data[5] != 4 || data[10] != 4)
+    return false;
+  int32 rows, cols;
+  std::memcpy(&rows, data + 6, sizeof(rows));
+  std::memcpy(&cols, data + 11, sizeof(cols));
+  if (rows < 0 || cols < 0 ||
+      static_cast<double>(rows) * cols * sizeof(Real) >
+      static_cast<double>(size - kBinaryMatrixHeaderSize))
+    return false;
+  *num_rows = rows;
+  *num_cols = cols;
+  return true;
+}
+
+// Reads the matrix that starts at data[0] (and ends before data + size).  If
+// possible, the output is a view into "data"; otherwise the matrix is read or
+// copied into *buffer and the output points there.  Outputs the number of
+// bytes the matrix took up and returns true on success; prints a warning and
+// returns false on failure.
+template<typename Real>
+bool ReadMatrixAt(const char *data, size_t size, Matrix<Real> *buffer,
+                  const Real **view_data, MatrixIndexT *num_rows,
+                  MatrixIndexT *num_cols, MatrixIndexT *stride,
+                  size_t *bytes_read) {
+  MatrixIndexT rows, cols;
+  if (ParseBinaryMatrixHeader<Real>(data, size, &rows, &cols)) {
+    const char *matrix_data = data + kBinaryMatrixHeaderSize;
+    *bytes_read = kBinaryMatrixHeaderSize +
+        sizeof(Real) * static_cast<size_t>(rows) * static_cast<size_t>(cols);
+    if (rows == 0 || cols == 0) {
+      *view_data = NULL;
+      *num_rows = *num_cols = *stride = 0;
+    } else if (reinterpret_cast<size_t>(matrix_data) % sizeof(Real) == 0) {
+      *view_data = reinterpret_cast<const Real*>(matrix_data);
+      *num_rows = rows;
+      *num_cols = cols;
+      *stride = cols;
+    } else {
+      // The data is not suitably aligned to be used in place (the compiler
+      // may assume it is), so copy it.
+      if (buffer->NumRows() != rows || buffer->NumCols() != cols)
+        buffer->Resize(rows, cols, kUndefined);
+      for (MatrixIndexT r = 0; r < rows; r++)
+        std::memcpy(buffer->RowData(r), matrix_data + r * cols * sizeof(Real),
+                    cols * sizeof(Real));
+      *view_data = buffer->Data();
+      *num_rows = rows;
+      *num_cols = cols;
+      *stride = buffer->Stride();
+    }
+    return true;
+  }
+  // Anything else (text mode, compressed, the other floating-point type):
+  // use the normal Read() function.
+  MemoryInputBuffer membuf(data, size);
+  std::istream is(&membuf);
+  bool binary;
+  if (!InitKaldiInputStream(is, &binary)) {
+    KALDI_WARN << "Reading matrix, failed reading binary header";
+    return false;
+  }
+  try {
+    buffer->Read(is, binary);
+  } catch (std::exception &e) {
+    KALDI_WARN << "Exception caught reading matrix";
+    if (!IsKaldiError(e.what())) { std::cerr << e.what(); }
+    return false;
+  }
+  *view_data = (buffer->NumRows() == 0 ? NULL : buffer->Data());
+  *num_rows = buffer->NumRows();
+  *num_cols = buffer->NumCols();
+  *stride = buffer->Stride();
+  *bytes_read = membuf.Position();
+  return true;
+}
+
+// Splits an rxfilename of type kFileInput or kOffsetFileInput (e.g.
+// foo.ark:1234) into filename and offset.  Returns false if it is of some
+// other type or the offset cannot be parsed.
+bool SplitFileRxfilename(const std::string &rxfilename,
+                         std::string *filename, size_t *offset) {
+  InputType type = ClassifyRxfilename(rxfilename);
+  if (type == kFileInput) {
+    *filename = rxfilename;
+    *offset = 0;
+    return true;
+  } else if (type == kOffsetFileInput) {
+    size_t pos = rxfilename.find_last_of(':');
+    *filename = std::string(rxfilename, 0, pos);
+    return ConvertStringToInteger(std::string(rxfilename, pos + 1), offset);
+  } else {
+    return false;
+  }
+}
+
+}  // namespace
+
+
+template<typename Real>
+SequentialMatrixViewReader<Real>::SequentialMatrixViewReader():
+    mode_(kNotOpen), state_(kEof), view_data_(NULL), view_rows_(0),
+    view_cols_(0), view_stride_(0), pos_(0), script_index_(0) { }
+
+template<typename Real>
+SequentialMatrixViewReader<Real>::SequentialMatrixViewReader(
+    const std::string &rspecifier):
+    mode_(kNotOpen), state_(kEof), view_data_(NULL), view_rows_(0),
+    view_cols_(0), view_stride_(0), pos_(0), script_index_(0) {
+  if (rspecifier != "" && !Open(rspecifier))
+    KALDI_ERR << "Error constructing TableReader: rspecifier is "
+              << rspecifier;
+}
+
+template<typename Real>
+bool SequentialMatrixViewReader<Real>::Open(const std::string &rspecifier) {
+  if (IsOpen() && !Close())
+    KALDI_ERR << "TableReader::Open, error closing previous input: "
+              << "rspecifier was " << rspecifier_;
+  rspecifier_ = rspecifier;
+  std::string rxfilename;
+  RspecifierType rs = ClassifyRspecifier(rspecifier, &rxfilename, &opts_);
+  if (rs == kArchiveRspecifier && ClassifyRxfilename(rxfilename) ==
+      kFileInput) {
+    if (!file_.Open(rxfilename)) {
+      KALDI_WARN << "TableReader: failed to open stream "
+                 << PrintableRxfilename(rxfilename);
+      return false;
+    }
+    mapped_filename_ = rxfilename;
+    pos_ = 0;
+    mode_ = kArchive;
+    NextArchiveEntry();
+    if (state_ == kError) {
+      KALDI_WARN << "Error beginning to read archive file (wrong filename?): "
+                 << PrintableRxfilename(rxfilename);
+      file_.Close();
+      mode_ = kNotOpen;
+      return false;
+    }
+    return true;
+  } else if (rs == kScriptRspecifier) {
+    script_.clear();
+    if (!ReadScriptFile(rxfilename, true, &script_))
+      return false;  // ReadScriptFile() will have printed a warning.
+    mode_ = kScript;
+    script_index_ = 0;
+    NextScriptEntry();
+    return true;
+  } else {
+    // Not something we can memory-map (e.g. a pipe), or an invalid
+    // rspecifier: use the normal reader, which will print any warnings.
+    if (!fallback_reader_.Open(rspecifier))
+      return false;
+    mode_ = kFallback;
+    return true;
+  }
+}
+
+template<typename Real>
+void SequentialMatrixViewReader<Real>::NextArchiveEntry() {
+  const char *data = file_.Data();
+  size_t size = file_.Size();
+  // Skip whitespace, then read the key.
+  while (pos_ < size && isspace(data[pos_])) pos_++;
+  if (pos_ == size) {
+    state_ = kEof;
+    return;
+  }
+  size_t key_begin = pos_;
+  while (pos_ < size && !isspace(data[pos_])) pos_++;
+  key_.assign(data + key_begin, pos_ - key_begin);
+  // As in SequentialTableReader, we expect a space after the key; we also
+  // allow tab (which is consumed) and newline (which is not).
+  char c = (pos_ < size ? data[pos_] : '\0');
+  if (c != ' ' && c != '\t' && c != '\n') {
+    KALDI_WARN << "Invalid archive file format: expected space after key "
+               << key_ << ", reading " << mapped_filename_;
+    state_ = kError;
+    return;
+  }
+  if (c != '\n') pos_++;
+  size_t bytes_read;
+  if (!ReadMatrixAt(data + pos_, size - pos_, &buffer_, &view_data_,
+                    &view_rows_, &view_cols_, &view_stride_, &bytes_read)) {
+    KALDI_WARN << "Object read failed, reading archive " << mapped_filename_;
+    state_ = kError;
+    return;
+  }
+  pos_ += bytes_read;
+  state_ = kHaveObject;
+}
+
+template<typename Real>
+void SequentialMatrixViewReader<Real>::NextScriptEntry() {
+  for (; script_index_ < script_.size(); script_index_++) {
+    key_ = script_[script_index_].first;
+    const std::string &rxfilename = script_[script_index_].second;
+    std::string filename;
+    size_t offset;
+    bool ok;
+    if (SplitFileRxfilename(rxfilename, &filename, &offset)) {
+      ok = true;
+      if (filename != mapped_filename_ || !file_.IsOpen()) {
+        mapped_filename_ = "";
+        ok = file_.Open(filename);
+        if (ok) mapped_filename_ = filename;
+      }
+      size_t bytes_read;
+      ok = ok && offset <= file_.Size() &&
+          ReadMatrixAt(file_.Data() + offset, file_.Size() - offset, &buffer_,
+                       &view_data_, &view_rows_, &view_cols_, &view_stride_,
+                       &bytes_read);
+    } else {  // e.g. a pipe: read it in the normal way.
+      Input ki;
+      bool binary;
+      ok = ki.Open(rxfilename, &binary);  // this reads the binary header.
+      if (ok) {
+        try {
+          buffer_.Read(ki.Stream(), binary);
+        } catch (std::exception &e) {
+          if (!IsKaldiError(e.what())) { std::cerr << e.what(); }
+          ok = false;
+        }
+      }
+      view_data_ = (buffer_.NumRows() == 0 ? NULL : buffer_.Data());
+      view_rows_ = buffer_.NumRows();
+      view_cols_ = buffer_.NumCols();
+      view_stride_ = buffer_.Stride();
+    }
+    if (ok) {
+      state_ = kHaveObject;
+      return;
+    }
+    if (opts_.permissive) {
+      KALDI_WARN << "TableReader: failed to load object from "
+                 << PrintableRxfilename(rxfilename) << " (skipping it, as "
+                 << "permissive mode specified)";
+    } else {
+      KALDI_ERR << "TableReader: failed to load object from "
+                << PrintableRxfilename(rxfilename);
+    }
+  }
+  state_ = kEof;
+}
+
+template<typename Real>
+bool SequentialMatrixViewReader<Real>::Done() {
+  switch (mode_) {
+    case kArchive: case kScript:
+      return (state_ != kHaveObject);
+    case kFallback:
+      return fallback_reader_.Done();
+    default:
+      KALDI_ERR << "Done() called on TableReader that is not open.";
+      return true;
+  }
+}
+
+template<typename Real>
+std::string SequentialMatrixViewReader<Real>::Key() {
+  if (mode_ == kFallback)
+    return fallback_reader_.Key();
+  if (mode_ == kNotOpen || state_ != kHaveObject)
+    KALDI_ERR << "Key() called on TableReader object at the wrong time.";
+  return key_;
+}
+
+template<typename Real>
+SubMatrix<Real> SequentialMatrixViewReader<Real>::Value() {
+  if (mode_ == kFallback) {
+    const Matrix<Real> &m = fallback_reader_.Value();
+    return SubMatrix<Real>(const_cast<Real*>(m.Data()), m.NumRows(),
+                           m.NumCols(), m.Stride());
+  }
+  if (mode_ == kNotOpen || state_ != kHaveObject)
+    KALDI_ERR << "Value() called on TableReader object at the wrong time.";
+  // SubMatrix has no const version; the user must not write to it.
+  return SubMatrix<Real>(const_cast<Real*>(view_data_), view_rows_,
+                         view_cols_, view_stride_);
+}
+
+template<typename Real>
+bool SequentialMatrixViewReader<Real>::ValueIsView() {
+  if (mode_ == kFallback || view_data_ == NULL) return false;
+  const char *data = reinterpret_cast<const char*>(view_data_);
+  return (file_.IsOpen() && data >= file_.Data() &&
+          data < file_.Data() + file_.Size());
+}
+
+template<typename Real>
+void SequentialMatrixViewReader<Real>::Next() {
+  switch (mode_) {
+    case kArchive:
+      if (state_ != kHaveObject)
+        KALDI_ERR << "TableReader: Next() called wrongly.";
+      NextArchiveEntry();
+      break;
+    case kScript:
+      if (state_ != kHaveObject)
+        KALDI_ERR << "TableReader: Next() called wrongly.";
+      script_index_++;
+      NextScriptEntry();
+      break;
+    case kFallback:
+      fallback_reader_.Next();
+      break;
+    default:
+      KALDI_ERR << "TableReader: Next() called wrongly.";
+  }
+}
+
+template<typename Real>
+bool SequentialMatrixViewReader<Real>::Close() {
+  if (mode_ == kNotOpen)
+    KALDI_ERR << "Close() called on TableReader twice or otherwise wrongly.";
+  bool ans = true;
+  if (mode_ == kFallback) {
+    ans = fallback_reader_.Close();
+  } else if (state_ == kError) {
+    if (opts_.permissive)
+      KALDI_WARN << "Error detected closing TableReader for archive "
+                 << mapped_filename_ << " but ignoring "
+                 << "it as permissive mode specified.";
+    else
+      ans = false;
+  }
+  file_.Close();
+  mapped_filename_ = "";
+  script_.clear();
+  view_data_ = NULL;
+  state_ = kEof;
+  mode_ = kNotOpen;
+  return ans;
+}
+
+template<typename Real>
+SequentialMatrixViewReader<Real>::~SequentialMatrixViewReader() {
+  if (IsOpen() && !Close())
+    KALDI_ERR << "TableReader: error detected closing table: rspecifier is "
+              << rspecifier_;
+}
+
+
+template<typename Real>
+RandomAccessMatrixViewReader<Real>::RandomAccessMatrixViewReader():
+    mode_(kNotOpen) { }
+
+template<typename Real>
+RandomAccessMatrixViewReader<Real>::RandomAccessMatrixViewReader(
+    const std::string &rspecifier): mode_(kNotOpen) {
+  if (rspecifier != "" && !Open(rspecifier))
+    KALDI_ERR << "Error opening RandomAccessTableReader object "
+              << " (rspecifier is: " << rspecifier << ")";
+}
+
+template<typename Real>
+bool RandomAccessMatrixViewReader<Real>::Open(const std::string &rspecifier) {
+  if (IsOpen())
+    KALDI_ERR << "Already open.";
+  rspecifier_ = rspecifier;
+  std::string rxfilename;
+  RspecifierType rs = ClassifyRspecifier(rspecifier, &rxfilename, &opts_);
+  if (rs == kArchiveRspecifier && opts_.use_index) {
+    if (!index_.Open(rxfilename) || !file_.Open(rxfilename)) {
+      KALDI_WARN << "Error opening archive with index: rspecifier is "
+                 << rspecifier;  // more specific warning printed already.
+      index_.Close();
+      return false;
+    }
+    mode_ = kIndexed;
+    return true;
+  } else {
+    if (!fallback_reader_.Open(rspecifier))
+      return false;
+    mode_ = kFallback;
+    return true;
+  }
+}
+
+template<typename Real>
+bool RandomAccessMatrixViewReader<Real>::HasKey(const std::string &key) {
+  switch (mode_) {
+    case kIndexed:
+      if (opts_.permissive) {  // we have to check that we can read it.
+        const ArchiveIndexEntry *entry = index_.Lookup(key);
+        if (entry == NULL) return false;
+        const Real *view_data;
+        MatrixIndexT rows, cols, stride;
+        size_t bytes_read;
+        return (static_cast<size_t>(entry->offset) <= file_.Size() &&
+                ReadMatrixAt(file_.Data() + entry->offset,
+                             file_.Size() - entry->offset, &buffer_,
+                             &view_data, &rows, &cols, &stride, &bytes_read));
+      }
+      return (index_.Lookup(key) != NULL);
+    case kFallback:
+      return fallback_reader_.HasKey(key);
+    default:
+      KALDI_ERR << "HasKey called on RandomAccessTableReader object that is "
+                << "not open.";
+      return false;
+  }
+}
+
+template<typename Real>
+SubMatrix<Real> RandomAccessMatrixViewReader<Real>::Value(
+    const std::string &key) {
+  if (mode_ == kFallback) {
+    const Matrix<Real> &m = fallback_reader_.Value(key);
+    return SubMatrix<Real>(const_cast<Real*>(m.Data()), m.NumRows(),
+                           m.NumCols(), m.Stride());
+  }
+  if (mode_ != kIndexed)
+    KALDI_ERR << "Value() called on non-open object.";
+  const ArchiveIndexEntry *entry = index_.Lookup(key);
+  if (entry == NULL)
+    KALDI_ERR << "Could not get item for key " << key
+              << ", rspecifier is " << rspecifier_ << " [to ignore this, "
+              << "add the p, (permissive) option to the rspecifier.";
+  const Real *view_data;
+  MatrixIndexT rows, cols, stride;
+  size_t bytes_read;
+  if (static_cast<size_t>(entry->offset) > file_.Size() ||
+      !ReadMatrixAt(file_.Data() + entry->offset,
+                    file_.Size() - entry->offset, &buffer_,
+                    &view_data, &rows, &cols, &stride, &bytes_read))
+    KALDI_ERR << "Error reading object for key " << key
+              << " from archive: rspecifier is " << rspecifier_;
+  return SubMatrix<Real>(const_cast<Real*>(view_data), rows, cols, stride);
+}
+
+template<typename Real>
+bool RandomAccessMatrixViewReader<Real>::Close() {
+  if (mode_ == kNotOpen)
+    KALDI_ERR << "Close() called on RandomAccessTableReader that was not "
+              << "open.";
+  bool ans = true;
+  if (mode_ == kFallback)
+    ans = fallback_reader_.Close();
+  index_.Close();
+  file_.Close();
+  mode_ = kNotOpen;
+  return ans;
+}
+
+template<typename Real>
+RandomAccessMatrixViewReader<Real>::~RandomAccessMatrixViewReader() {
+  if (IsOpen() && !Close())
+    KALDI_ERR << "failure detected in destructor.";
+}
+
+template class SequentialMatrixViewReader<float>;
+template class SequentialMatrixViewReader<double>;
+template class RandomAccessMatrixViewReader<float>;
+template class RandomAccessMatrixViewReader<double>;
+
+}  // namespace kaldi
@@ -0,0 +1,200 @@
+// util/matrix-view-reader.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_MATRIX_VIEW_READER_H_
+#define KALDI_UTIL_MATRIX_VIEW_READER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/kaldi-matrix.h"
+#include "util/kaldi-table.h"
+#include "util/mapped-file.h"
+#include "util/table-index.h"
+
+/* This header defines SequentialMatrixViewReader and
+   RandomAccessMatrixViewReader, which read tables of matrices like
+   SequentialTableReader and RandomAccessTableReader with
+   KaldiObjectHolder<Matrix<Real> >, but which give out the matrices as
+   SubMatrix objects instead of as references to Matrix.
+
+   When the matrices come from a file (an archive that is an actual file, or an
+   scp file whose entries are files or offsets into files, e.g.
+   foo.ark:1234), the file is memory-mapped, and a matrix that was written in
+   binary with the same floating-point type as Real is given out as a view
+   straight into the mapped file, with no memory allocation or copying: the
+   rows are contiguous in the file, so the view's stride equals its number of
+   columns.  This saves a lot of memory bandwidth for programs that go through
+   features that are already in the page cache.  Matrices that cannot be
+   given out in this way (text-mode or compressed matrices, matrices of the
+   other floating-point type, and matrices whose data does not start at a
+   multiple of sizeof(Real) bytes into the file, which depends on the lengths
+   of the keys before it) are read into a buffer that is reused from one
+   matrix to the next.  Rspecifiers that cannot be memory-mapped (pipes,
+   standard input) are read with the usual table readers.
+
+   The view is valid only until the next call to Next() or Value() (or
+   Close()); it must not be written to.  Typical usage:
+   \code
+     SequentialBaseFloatMatrixViewReader feature_reader(feature_rspecifier);
+     for (; !feature_reader.Done(); feature_reader.Next()) {
+       const SubMatrix<BaseFloat> feats(feature_reader.Value());
+       ...
+     }
+   \endcode
+*/
+
+namespace kaldi {
+
+/// \addtogroup table_group
+/// @{
+
+template<typename Real>
+class SequentialMatrixViewReader {
+ public:
+  SequentialMatrixViewReader();
+
+  /// This constructor is equivalent to the default constructor + Open(), but
+  /// throws on error.
+  explicit SequentialMatrixViewReader(const std::string &rspecifier);
+
+  /// Opens the table; the rspecifier is as for SequentialTableReader.
+  bool Open(const std::string &rspecifier);
+
+  bool IsOpen() const { return (mode_ != kNotOpen); }
+
+  /// Returns true if we're done (or there was an error; check with Close()).
+  bool Done();
+
+  /// Only valid to call if Done() returned false.
+  std::string Key();
+
+  /// Returns the current matrix.  The returned object is a view, which is
+  /// valid until the next call to Next() or Close().
+  SubMatrix<Real> Value();
+
+  /// Returns true if the current matrix was given out without being copied
+  /// (mainly for testing).
+  bool ValueIsView();
+
+  void Next();
+
+  /// Close() returns false if Done() became true because of an error rather
+  /// than because we reached the end of the table.  If you don't call it,
+  /// the destructor will throw in that case.
+  bool Close();
+
+  ~SequentialMatrixViewReader();
+
+ private:
+  // Sets up the value for the matrix of the next scp entry (in scp mode) or
+  // the next archive entry (in archive mode).
+  void NextScriptEntry();
+  void NextArchiveEntry();
+
+  enum {
+    kNotOpen,
+    kArchive,    // reading a memory-mapped archive.
+    kScript,     // reading an scp file, memory-mapping the files in it.
+    kFallback    // reading with fallback_reader_.
+  } mode_;
+  enum {
+    kHaveObject,
+    kEof,
+    kError
+  } state_;
+
+  std::string rspecifier_;
+  RspecifierOptions opts_;
+
+  std::string key_;
+  const Real *view_data_;  // data of the current matrix (pointing into file_
+                           // or buffer_).
+  MatrixIndexT view_rows_, view_cols_, view_stride_;
+  Matrix<Real> buffer_;  // holds matrices that we could not give out as views.
+
+  MappedFile file_;  // the archive, or the file of the current scp entry.
+  std::string mapped_filename_;  // filename of file_.
+  size_t pos_;  // current position in file_ (archive mode).
+
+  std::vector<std::pair<std::string, std::string> > script_;  // scp mode.
+  size_t script_index_;  // index of the current scp entry.
+
+  SequentialTableReader<KaldiObjectHolder<Matrix<Real> > > fallback_reader_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialMatrixViewReader);
+};
+
+
+/// RandomAccessMatrixViewReader gives out views of matrices in an archive that
+/// was written with an index, if the rspecifier has the "idx" option (see
+/// table-index.h); otherwise it uses RandomAccessTableReader and copies.
+template<typename Real>
+class RandomAccessMatrixViewReader {
+ public:
+  RandomAccessMatrixViewReader();
+
+  /// This constructor is equivalent to the default constructor + Open(), but
+  /// throws on error.
+  explicit RandomAccessMatrixViewReader(const std::string &rspecifier);
+
+  bool Open(const std::string &rspecifier);
+
+  bool IsOpen() const { return (mode_ != kNotOpen); }
+
+  bool HasKey(const std::string &key);
+
+  /// Returns the matrix for "key" (it is an error if it is not present).  The
+  /// returned object is a view, which is valid until the next call to Value()
+  /// or Close().
+  SubMatrix<Real> Value(const std::string &key);
+
+  bool Close();
+
+  ~RandomAccessMatrixViewReader();
+
+ private:
+  enum {
+    kNotOpen,
+    kIndexed,  // reading a memory-mapped archive with an index.
+    kFallback  // reading with fallback_reader_.
+  } mode_;
+
+  std::string rspecifier_;
+  RspecifierOptions opts_;
+  MappedFile file_;
+  ArchiveIndex index_;
+  Matrix<Real> buffer_;
+
+  RandomAccessTableReader<KaldiObjectHolder<Matrix<Real> > > fallback_reader_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RandomAccessMatrixViewReader);
+};
+
+typedef SequentialMatrixViewReader<BaseFloat> SequentialBaseFloatMatrixViewReader;
+typedef RandomAccessMatrixViewReader<BaseFloat> RandomAccessBaseFloatMatrixViewReader;
+typedef SequentialMatrixViewReader<double> SequentialDoubleMatrixViewReader;
+typedef RandomAccessMatrixViewReader<double> RandomAccessDoubleMatrixViewReader;
+
+/// @} end "addtogroup table_group"
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_MATRIX_VIEW_READER_H_
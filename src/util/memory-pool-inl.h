@@ -0,0 +1,85 @@
+// util/memory-pool-inl.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MEMORY_POOL_INL_H_
+#define KALDI_UTIL_MEMORY_POOL_INL_H_
+
+// Do not include this file directly.  It is included by memory-pool.h
+
+
+namespace kaldi {
+
+template<class T> MemoryPool<T>::MemoryPool(size_t block_size):
+    freed_head_(NULL), block_size_(block_size), num_in_use_(0),
+    high_water_mark_(0) {
+  KALDI_ASSERT(block_size > 0);
+}
+
+template<class T>
+inline void *MemoryPool<T>::Allocate() {
+  if (freed_head_ == NULL) {
+    Slot *block = new Slot[block_size_];
+    // link all the new slots into the free list, in order.
+    for (size_t i = 0; i + 1 < block_size_; i++)
+      block[i].next = block + i + 1;
+    block[block_size_ - 1].next = NULL;
+    freed_head_ = block;
+    allocated_.push_back(block);
+  }
+  Slot *ans = freed_head_;
+  freed_head_ = ans->next;
+  if (++num_in_use_ > high_water_mark_)
+    high_water_mark_ = num_in_use_;
+  return static_cast<void*>(ans);
+}
+
+template<class T>
+inline void MemoryPool<T>::Delete(T *t) {
+  t->~T();
+  Slot *slot = reinterpret_cast<Slot*>(t);
+  slot->next = freed_head_;
+  freed_head_ = slot;
+  KALDI_PARANOID_ASSERT(num_in_use_ > 0);
+  num_in_use_--;
+}
+
+template<class T>
+void MemoryPool<T>::FreeAll() {
+  KALDI_ASSERT(num_in_use_ == 0 &&
+               "MemoryPool::FreeAll() called while objects still in use");
+  for (size_t i = 0; i < allocated_.size(); i++)
+    delete [] allocated_[i];
+  allocated_.clear();
+  freed_head_ = NULL;
+}
+
+template<class T>
+MemoryPool<T>::~MemoryPool() {
+  if (num_in_use_ != 0)
+    KALDI_WARN << "MemoryPool destroyed with " << num_in_use_
+               << " objects still in use.";
+  for (size_t i = 0; i < allocated_.size(); i++)
+    delete [] allocated_[i];
+}
+
+
+} // end namespace kaldi
+
+#endif  // KALDI_UTIL_MEMORY_POOL_INL_H_
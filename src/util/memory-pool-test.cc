@@ -0,0 +1,104 @@
+// util/memory-pool-test.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/memory-pool.h"
+#include <algorithm>
+#include <iostream>
+
+namespace kaldi {
+
+// An object with a nontrivial destructor, so we can check that Delete() calls
+// it.  (TestMemoryPoolSmall<char>() checks objects smaller than a pointer.)
+struct PoolTestObject {
+  int32 value;
+  int32 *num_destroyed;
+  PoolTestObject(int32 value, int32 *num_destroyed):
+      value(value), num_destroyed(num_destroyed) { }
+  ~PoolTestObject() { (*num_destroyed)++; }
+};
+
+template<class T> void TestMemoryPoolSmall() {
+  MemoryPool<T> pool(3);
+  std::vector<T*> ptrs;
+  for (int32 i = 0; i < 10; i++)
+    ptrs.push_back(new (pool.Allocate()) T(i));
+  KALDI_ASSERT(pool.NumInUse() == 10 && pool.HighWaterMark() == 10);
+  for (int32 i = 0; i < 10; i++)
+    KALDI_ASSERT(*(ptrs[i]) == static_cast<T>(i));
+  for (int32 i = 0; i < 10; i++)
+    pool.Delete(ptrs[i]);
+  KALDI_ASSERT(pool.NumInUse() == 0 && pool.HighWaterMark() == 10);
+  pool.FreeAll();
+  KALDI_ASSERT(pool.NumBytesAllocated() == 0);
+}
+
+void TestMemoryPool() {
+  int32 block_size = 1 + Rand() % 20;
+  MemoryPool<PoolTestObject> pool(block_size);
+  int32 num_destroyed = 0, num_created = 0;
+  std::vector<PoolTestObject*> live;
+  size_t max_live = 0;
+  for (int32 iter = 0; iter < 1000; iter++) {
+    if (live.empty() || Rand() % 3 != 0) {
+      PoolTestObject *obj = new (pool.Allocate())
+          PoolTestObject(num_created++, &num_destroyed);
+      live.push_back(obj);
+    } else {
+      // delete a random element.
+      size_t i = Rand() % live.size();
+      pool.Delete(live[i]);
+      live[i] = live.back();
+      live.pop_back();
+    }
+    max_live = std::max(max_live, live.size());
+    KALDI_ASSERT(pool.NumInUse() == live.size());
+    KALDI_ASSERT(pool.HighWaterMark() == max_live);
+    KALDI_ASSERT(num_created - num_destroyed == static_cast<int32>(live.size()));
+  }
+  // Check that no two live objects share memory.
+  std::sort(live.begin(), live.end());
+  for (size_t i = 0; i + 1 < live.size(); i++)
+    KALDI_ASSERT(live[i] + 1 <= live[i+1]);
+  // Memory should be bounded by the high-water mark.
+  size_t max_blocks = (max_live + block_size - 1) / block_size;
+  KALDI_ASSERT(pool.NumBytesAllocated() <=
+               max_blocks * block_size * std::max(sizeof(PoolTestObject),
+                                                  sizeof(void*)) * 2);
+  for (size_t i = 0; i < live.size(); i++)
+    pool.Delete(live[i]);
+  KALDI_ASSERT(num_created == num_destroyed);
+  pool.ResetHighWaterMark();
+  KALDI_ASSERT(pool.HighWaterMark() == 0);
+}
+
+
+} // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    TestMemoryPoolSmall<char>();
+    TestMemoryPoolSmall<int32>();
+    TestMemoryPoolSmall<double>();
+    TestMemoryPool();
+  }
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,116 @@
+// util/memory-pool.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MEMORY_POOL_H_
+#define KALDI_UTIL_MEMORY_POOL_H_
+
+#include <new>
+#include <vector>
+#include "base/kaldi-common.h"
+
+/* This header provides a simple pool allocator for fixed-size objects, which
+   is used in the decoders to allocate Tokens and ForwardLinks.  These are
+   small objects which are allocated and freed in very large numbers (millions
+   per second), and going through the general-purpose allocator for each of
+   them is a significant part of the decoding time.  The pool allocates
+   objects in large blocks, and freed objects are put on a singly-linked free
+   list (stored in the freed objects themselves) to be handed out again; the
+   memory is only returned to the system when the pool is destroyed.  Since
+   after pruning a frame we free many objects at once and then allocate many
+   more on the next frame, in steady state there are no calls to the system
+   allocator at all.
+
+   This class is not thread-safe; each decoder has its own pools.
+
+   Typical usage:
+   \code
+     MemoryPool<Token> pool;
+     Token *tok = new (pool.Allocate()) Token(args...);
+     ...
+     pool.Delete(tok);
+   \endcode
+   See memory-pool-test.cc for an example.
+*/
+
+
+namespace kaldi {
+
+template<class T> class MemoryPool {
+ public:
+  /// The block size is the number of objects we allocate at a time.  It must
+  /// be largish so storing the list of blocks doesn't become a problem.
+  explicit MemoryPool(size_t block_size = 1024);
+
+  /// Returns uninitialized memory for one object of type T; you must use
+  /// placement new to construct the object.
+  inline void *Allocate();
+
+  /// Calls the destructor of *t, and returns its memory to the pool.
+  /// The object must have been allocated by this pool.
+  inline void Delete(T *t);
+
+  /// Returns the number of objects currently allocated from the pool and not
+  /// yet deleted.
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the largest value that NumInUse() has taken since this object was
+  /// constructed or ResetHighWaterMark() was last called.
+  size_t HighWaterMark() const { return high_water_mark_; }
+
+  /// Resets the high-water mark to the current number of objects in use.
+  void ResetHighWaterMark() { high_water_mark_ = num_in_use_; }
+
+  /// Returns the total amount of memory, in bytes, that the pool has obtained
+  /// from the system.
+  size_t NumBytesAllocated() const {
+    return allocated_.size() * block_size_ * sizeof(Slot);
+  }
+
+  /// Frees all the memory held by the pool.  It is an error to call this
+  /// while any objects are still in use.
+  void FreeAll();
+
+  ~MemoryPool();
+ private:
+  // A Slot holds either an object of type T, or (while it is on the free
+  // list) a pointer to the next free slot.  The other union members are there
+  // to ensure suitable alignment.
+  union Slot {
+    char data[sizeof(T)];
+    Slot *next;
+    double d;
+    int64 i;
+  };
+
+  Slot *freed_head_;  // head of list of currently freed slots.
+  std::vector<Slot*> allocated_;  // list of allocated blocks.
+  size_t block_size_;  // number of Slots per block.
+  size_t num_in_use_;
+  size_t high_water_mark_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryPool);
+};
+
+
+} // end namespace kaldi
+
+#include "util/memory-pool-inl.h"
+
+#endif  // KALDI_UTIL_MEMORY_POOL_H_
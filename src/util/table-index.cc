@@ -0,0 +1,182 @@
+// util/table-index.cc
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "util/table-index.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+static const char kArchiveIndexMagic[8] = { 'K', 'A', 'L', 'D', 'I', 'I', 'D',
+                                            'X' };
+static const int32 kArchiveIndexVersion = 1;
+
+std::string ArchiveIndexFilename(const std::string &archive_filename) {
+  return archive_filename + ".idx";
+}
+
+void ArchiveIndexWriter::Add(const std::string &key, int64 offset,
+                             int64 length) {
+  KALDI_ASSERT(offset >= 0 && length >= 0);
+  entries_.push_back(std::make_pair(key, std::make_pair(offset, length)));
+}
+
+bool ArchiveIndexWriter::Write(const std::string &wxfilename,
+                               int64 archive_size) {
+  std::sort(entries_.begin(), entries_.end());
+  ArchiveIndexHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kArchiveIndexMagic, sizeof(kArchiveIndexMagic));
+  header.version = kArchiveIndexVersion;
+  header.num_entries = entries_.size();
+  header.keys_size = 0;
+  header.archive_size = archive_size;
+
+  std::vector<ArchiveIndexEntry> entries(entries_.size());
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (i > 0 && entries_[i].first == entries_[i-1].first) {
+      KALDI_WARN << "Not writing archive index " << wxfilename
+                 << " because the archive contains duplicate key "
+                 << entries_[i].first;
+      return false;
+    }
+    entries[i].offset = entries_[i].second.first;
+    entries[i].length = entries_[i].second.second;
+    entries[i].key_offset = header.keys_size;
+    entries[i].key_length = entries_[i].first.size();
+    header.keys_size += entries_[i].first.size();
+  }
+
+  Output ko;
+  if (!ko.Open(wxfilename, true, false)) {  // binary, no header.
+    KALDI_WARN << "Could not open archive index " << wxfilename
+               << " for writing.";
+    return false;
+  }
+  std::ostream &os = ko.Stream();
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!entries.empty())
+    os.write(reinterpret_cast<const char*>(&(entries[0])),
+             entries.size() * sizeof(ArchiveIndexEntry));
+  for (size_t i = 0; i < entries_.size(); i++)
+    os.write(entries_[i].first.data(), entries_[i].first.size());
+  if (!ko.Close()) {
+    KALDI_WARN << "Error writing archive index " << wxfilename;
+    return false;
+  }
+  return true;
+}
+
+
+bool ArchiveIndex::Open(const std::string &archive_filename) {
+  Close();
+  std::string index_filename = ArchiveIndexFilename(archive_filename);
+  if (ClassifyRxfilename(archive_filename) != kFileInput) {
+    KALDI_WARN << "Archive indexes can only be used with archives that are "
+               << "ordinary files, not with " << archive_filename;
+    return false;
+  }
+  if (!file_.Open(index_filename))
+    return false;  // will have printed a warning.
+
+  const char *data = file_.Data();
+  size_t size = file_.Size();
+  const ArchiveIndexHeader *header =
+      reinterpret_cast<const ArchiveIndexHeader*>(data);
+  if (size < sizeof(ArchiveIndexHeader) ||
+      std::memcmp(header->magic, kArchiveIndexMagic,
+                  sizeof(kArchiveIndexMagic)) != 0) {
+    KALDI_WARN << "File " << index_filename << " is not an archive index.";
+    file_.Close();
+    return false;
+  }
+  if (header->version != kArchiveIndexVersion) {
+    KALDI_WARN << "Archive index " << index_filename << " has version "
+               << header->version << ", expected " << kArchiveIndexVersion
+               << " (or it was written on a machine with different byte "
+               << "order).";
+    file_.Close();
+    return false;
+  }
+  if (header->num_entries < 0 || header->keys_size < 0 ||
+      header->num_entries > static_cast<int64>(size) ||
+      header->keys_size > static_cast<int64>(size) ||
+      sizeof(ArchiveIndexHeader) + header->num_entries *
+      sizeof(ArchiveIndexEntry) + header->keys_size != size) {
+    KALDI_WARN << "Archive index " << index_filename << " is corrupted.";
+    file_.Close();
+    return false;
+  }
+  std::ifstream archive(archive_filename.c_str(),
+                        std::ios_base::in | std::ios_base::binary);
+  archive.seekg(0, std::ios_base::end);
+  int64 archive_size = archive.tellg();
+  if (!archive.good() || archive_size != header->archive_size) {
+    KALDI_WARN << "Archive index " << index_filename << " does not match "
+               << "the archive " << archive_filename << " (archive has size "
+               << archive_size << ", index expects " << header->archive_size
+               << "); the index is stale, or the archive could not be read.";
+    file_.Close();
+    return false;
+  }
+  header_ = header;
+  entries_ = reinterpret_cast<const ArchiveIndexEntry*>(
+      data + sizeof(ArchiveIndexHeader));
+  keys_ = reinterpret_cast<const char*>(entries_ + header->num_entries);
+  return true;
+}
+
+void ArchiveIndex::Close() {
+  file_.Close();
+  header_ = NULL;
+  entries_ = NULL;
+  keys_ = NULL;
+}
+
+int ArchiveIndex::CompareKey(int64 i, const std::string &key) const {
+  const ArchiveIndexEntry &entry = entries_[i];
+  size_t len = std::min(static_cast<size_t>(entry.key_length), key.size());
+  int ans = std::char_traits<char>::compare(keys_ + entry.key_offset,
+                                            key.data(), len);
+  if (ans != 0) return ans;
+  if (static_cast<size_t>(entry.key_length) < key.size()) return -1;
+  else if (static_cast<size_t>(entry.key_length) > key.size()) return 1;
+  else return 0;
+}
+
+const ArchiveIndexEntry *ArchiveIndex::Lookup(const std::string &key) const {
+  KALDI_ASSERT(IsOpen());
+  // Binary search for the first entry whose key is >= "key".
+  int64 begin = 0, end = header_->num_entries;
+  while (begin < end) {
+    int64 middle = begin + (end - begin) / 2;
+    if (CompareKey(middle, key) < 0) begin = middle + 1;
+    else end = middle;
+  }
+  if (begin < header_->num_entries && CompareKey(begin, key) == 0)
+    return entries_ + begin;
+  else
+    return NULL;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,150 @@
+// util/table-index.h
+
+// Copyright 2015  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_TABLE_INDEX_H_
+#define KALDI_UTIL_TABLE_INDEX_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/mapped-file.h"
+
+/* This header defines the archive index: a "sidecar" file that is written
+   next to an archive, with ".idx" appended to the archive's filename, and
+   that gives for each key the byte offset and length of its object in the
+   archive.  The entries are sorted on the key, so a key can be looked up by
+   binary search, and the file is memory-mapped when read, so opening an index
+   costs nothing however large the archive is, and only the pages touched by
+   the lookups are read from disk.
+
+   The index is written by TableWriter if the wspecifier has the "idx" option,
+   e.g. "ark,idx:foo.ark" writes foo.ark and foo.ark.idx, and it is used by
+   RandomAccessTableReader if the rspecifier has the "idx" option, e.g.
+   "ark,idx:foo.ark".  See kaldi-table.h.
+
+   The file format is native-endian and consists of:
+     - a header (ArchiveIndexHeader),
+     - an array of ArchiveIndexEntry, sorted on the key (in the order of
+       std::string::compare(), like the "s" option of rspecifiers expects),
+     - the keys, concatenated with no separators.
+*/
+
+namespace kaldi {
+
+struct ArchiveIndexHeader {
+  char magic[8];  // "KALDIIDX"
+  int32 version;  // currently 1.
+  int32 reserved;  // zero.
+  int64 num_entries;
+  int64 keys_size;  // total size of the keys, in bytes.
+  int64 archive_size;  // size of the archive the index was written for; this
+                       // is used to detect stale indexes.
+};
+
+struct ArchiveIndexEntry {
+  int64 offset;  // byte offset of the object in the archive (just after
+                 // "key ", i.e. the same offset an scp file would have).
+  int64 length;  // size of the object in the archive, in bytes.
+  int64 key_offset;  // byte offset of the key within the keys section.
+  int64 key_length;
+};
+
+/// Returns the filename of the index of the archive "archive_filename", which
+/// is the archive filename with ".idx" appended.
+std::string ArchiveIndexFilename(const std::string &archive_filename);
+
+
+/// Collects the entries of an archive index while the archive is written, and
+/// writes the index at the end.
+class ArchiveIndexWriter {
+ public:
+  ArchiveIndexWriter() { }
+
+  /// Records that the object for "key" was written at byte offset "offset" of
+  /// the archive and is "length" bytes long.
+  void Add(const std::string &key, int64 offset, int64 length);
+
+  size_t NumEntries() const { return entries_.size(); }
+
+  /// Sorts the entries and writes the index to "wxfilename"; "archive_size" is
+  /// the size of the finished archive in bytes.  Returns true on success; on
+  /// failure (including if a key was added more than once) it prints a
+  /// warning and returns false.
+  bool Write(const std::string &wxfilename, int64 archive_size);
+
+  void Clear() { entries_.clear(); }
+
+ private:
+  // (key, (offset, length)).
+  std::vector<std::pair<std::string, std::pair<int64, int64> > > entries_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ArchiveIndexWriter);
+};
+
+
+/// Gives read access to an archive index, which it memory-maps.  Lookups take
+/// time logarithmic in the number of keys and do not allocate memory.
+class ArchiveIndex {
+ public:
+  ArchiveIndex(): header_(NULL), entries_(NULL), keys_(NULL) { }
+
+  /// Opens the index of the archive "archive_filename", which must be an
+  /// ordinary file, and checks that it matches the archive (that the archive
+  /// has the size recorded in the index).  Returns true on success; on failure
+  /// it prints a warning and returns false.
+  bool Open(const std::string &archive_filename);
+
+  bool IsOpen() const { return (header_ != NULL); }
+
+  void Close();
+
+  int64 NumEntries() const { return header_->num_entries; }
+
+  /// Returns the i'th key, in sorted order.
+  std::string Key(int64 i) const {
+    KALDI_ASSERT(static_cast<uint64>(i) <
+                 static_cast<uint64>(header_->num_entries));
+    return std::string(keys_ + entries_[i].key_offset, entries_[i].key_length);
+  }
+
+  /// Returns the entry for the i'th key.
+  const ArchiveIndexEntry &Entry(int64 i) const {
+    KALDI_ASSERT(static_cast<uint64>(i) <
+                 static_cast<uint64>(header_->num_entries));
+    return entries_[i];
+  }
+
+  /// Looks up "key"; if it is present, returns a pointer to its entry, else
+  /// returns NULL.
+  const ArchiveIndexEntry *Lookup(const std::string &key) const;
+
+ private:
+  // Compares the key of entry "i" with "key", like std::string::compare().
+  int CompareKey(int64 i, const std::string &key) const;
+
+  MappedFile file_;
+  const ArchiveIndexHeader *header_;
+  const ArchiveIndexEntry *entries_;
+  const char *keys_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ArchiveIndex);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_INDEX_H_